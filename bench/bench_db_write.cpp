@@ -0,0 +1,56 @@
+/**
+ * Measures how DbWriteLog group commit amortizes fsyncs as the number of
+ * threads appending batches of writes grows, and the time each append takes
+ * to be acknowledged.
+ *
+ * Usage: bench_db_write.exx [batches per thread] [log path]
+ */
+#include <dbwritelog.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    unsigned int batches = argc > 1 ? atoi(argv[1]) : 200;
+    std::string path = argc > 2 ? argv[2] : "/tmp/lightningcpp-bench-db.log";
+    std::string statement = "UPDATE channels SET msatoshi_local=1000000, next_index_local=42 WHERE id=7;";
+
+    printf("%-8s %12s %10s %12s %10s %10s %10s\n", "threads", "batches/s", "syncs", "batch/sync",
+           "ack p50", "ack p99", "ack p999");
+    for (unsigned int threads = 1; threads <= 16; threads *= 2) {
+        unlink(path.c_str());
+        DbWriteLog log(path);
+        LatencyHistogram ack;
+        std::vector<std::thread> writers;
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < threads; i++) {
+            writers.push_back(std::thread([&]() {
+                DbWrite batch;
+                batch.hasDataVersion = false;
+                for (unsigned int j = 0; j < 3; j++)
+                    batch.writes.push_back({statement.data(), statement.size()});
+                for (unsigned int j = 0; j < batches; j++) {
+                    auto before = std::chrono::steady_clock::now();
+                    log.append(batch);
+                    ack.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - before).count());
+                }
+            }));
+        }
+        for (auto &writer : writers)
+            writer.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        printf("%-8u %12.0f %10lu %12.2f %8luus %8luus %8luus\n", threads, threads * batches / elapsed.count(),
+               (unsigned long)log.getSyncs(), (double)log.getBatches() / log.getSyncs(),
+               (unsigned long)ack.getPercentile(50), (unsigned long)ack.getPercentile(99),
+               (unsigned long)ack.getPercentile(99.9));
+    }
+    unlink(path.c_str());
+    return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * Measures how long NetworkGraph takes to load a network of the size of the
+ * public Lightning Network from a fake lightningd, to refresh it when nothing,
+ * a few channel updates, or a few channels changed, and to walk the outgoing
+ * channels of every node. Fetching listchannels and listnodes as Json::Value,
+ * as a graph built from the plain commands would, is measured for comparison.
+ *
+ * Usage: bench_network_graph.exx [channels] [nodes]
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+#include <networkgraph.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+static double millisecondsSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count() / 1000.0;
+}
+
+static void printRefresh(const char *what, NetworkGraph &graph, unsigned long &rebuilds)
+{
+    NetworkGraphStats stats = graph.getStats();
+    printf("%-28s %10.1fms %8lu %8lu %8lu %8s\n", what, stats.lastRefreshMicros / 1000.0, stats.channelsAdded,
+           stats.channelsRemoved, stats.channelsUpdated, stats.rebuilds > rebuilds ? "rebuilt" : "patched");
+    rebuilds = stats.rebuilds;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int channels = argc > 1 ? atoi(argv[1]) : 50000;
+    unsigned int nodes = argc > 2 ? atoi(argv[2]) : 12000;
+    std::string socketPath = "/tmp/lightningcpp-bench-graph";
+    FakeLightningd lightningd(socketPath);
+    CLightningRpc rpc(socketPath, 1);
+
+    Json::Value network = FakeLightningd::makeNetworkChannels(nodes, channels);
+    lightningd.setResult("listchannels", network);
+    lightningd.setResult("listnodes", FakeLightningd::makeListNodes(nodes));
+    printf("%u nodes, %u channels\n\n", nodes, channels);
+
+    auto start = std::chrono::steady_clock::now();
+    Json::Value jsonChannels = rpc.listChannels();
+    Json::Value jsonNodes = rpc.listNodes();
+    printf("%-28s %10.1fms\n\n", "Json::Value listchannels+listnodes", millisecondsSince(start));
+
+    printf("%-28s %12s %8s %8s %8s\n", "refresh", "time", "added", "removed", "updated");
+    NetworkGraph graph(rpc);
+    unsigned long rebuilds = 0;
+    graph.refresh();
+    printRefresh("initial load", graph, rebuilds);
+    graph.refresh();
+    printRefresh("nothing changed", graph, rebuilds);
+
+    // A hundredth of the channels got a new update
+    for (unsigned int i = 0; i < network["channels"].size(); i += 100) {
+        network["channels"][i]["last_update"] = network["channels"][i]["last_update"].asUInt() + 1;
+        network["channels"][i]["fee_per_millionth"] = network["channels"][i]["fee_per_millionth"].asUInt() + 1;
+    }
+    lightningd.setResult("listchannels", network);
+    graph.refresh();
+    printRefresh("1% of the channels updated", graph, rebuilds);
+
+    // And as many were closed
+    Json::Value closed(Json::arrayValue);
+    for (unsigned int i = 0; i < network["channels"].size(); i++)
+        if (i / 2 % 100 != 1)
+            closed.append(network["channels"][i]);
+    network["channels"] = closed;
+    lightningd.setResult("listchannels", network);
+    graph.refresh();
+    printRefresh("1% of the channels closed", graph, rebuilds);
+
+    std::shared_ptr<const GraphSnapshot> snapshot = graph.getSnapshot();
+    uint64_t fees = 0;
+    const unsigned int walks = 100;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int walk = 0; walk < walks; walk++)
+        for (uint32_t node = 0; node < snapshot->getNodeCount(); node++)
+            for (const Channel &channel : snapshot->outgoing(node))
+                fees += channel.baseFeeMsat + channel.feePerMillionth;
+    double elapsed = millisecondsSince(start);
+    printf("\nwalking all the outgoing channels : %.2fms (%.1fns per channel, checksum %lu)\n", elapsed / walks,
+           elapsed * 1e6 / walks / snapshot->getChannelCount(), (unsigned long)fees);
+
+    return 0;
+}
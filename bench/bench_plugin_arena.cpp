@@ -0,0 +1,129 @@
+/**
+ * Compares the heap allocations and hook calls/sec of a plugin handling "htlc_accepted"
+ * with a Json::Value handler, a pre-serialized result handler and an arena handler.
+ * The calls are replayed from a file on the plugin's stdin and the responses are
+ * written to /dev/null, so that only the parsing, handling and serialization remain.
+ *
+ * Allocations are counted by interposing malloc, which only works with glibc.
+ *
+ * Usage: bench_plugin_arena.exx [calls]
+ */
+#include <clightningplugin.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <unistd.h>
+
+extern "C" {
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *ptr, size_t size);
+}
+
+static std::atomic<unsigned long> allocations(0);
+
+extern "C" void *malloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(ptr, size);
+}
+
+static const char *HTLC = "{\"onion\":{\"payload\":\"0000\",\"type\":\"tlv\",\"next_onion\":\"abcdef0123456789\","
+    "\"shared_secret\":\"0101010101010101010101010101010101010101010101010101010101010101\"},"
+    "\"htlc\":{\"short_channel_id\":\"103x1x0\",\"id\":2,\"amount_msat\":\"1000msat\",\"cltv_expiry\":117,"
+    "\"cltv_expiry_relative\":17,\"payment_hash\":\"0202020202020202020202020202020202020202020202020202020202020202\"}}";
+
+/**
+ * Replays `calls` hook calls to a plugin set up by `subscribe`, returns the allocations per call
+ */
+static double allocationsPerCall(const std::function<void(Plugin&)> &subscribe, const unsigned int &calls,
+            double &callsPerSecond)
+{
+    char path[] = "/tmp/bench_plugin_arena.XXXXXX";
+    int fd = mkstemp(path);
+    std::string messages;
+    for (unsigned int i = 0; i < calls; i++)
+        messages += "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(i + 1)
+                    + ",\"method\":\"htlc_accepted\",\"params\":" + HTLC + "}\n\n";
+    if (write(fd, messages.data(), messages.size()) != (ssize_t)messages.size())
+        perror("write");
+    lseek(fd, 0, SEEK_SET);
+    unlink(path);
+    int stdinCopy = dup(STDIN_FILENO), stdoutCopy = dup(STDOUT_FILENO), devNull = open("/dev/null", O_WRONLY);
+    dup2(fd, STDIN_FILENO);
+    dup2(devNull, STDOUT_FILENO);
+
+    Plugin plugin;
+    subscribe(plugin);
+    unsigned long before = allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    plugin.start();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    unsigned long after = allocations.load();
+
+    dup2(stdinCopy, STDIN_FILENO);
+    dup2(stdoutCopy, STDOUT_FILENO);
+    close(stdinCopy);
+    close(stdoutCopy);
+    close(devNull);
+    close(fd);
+    callsPerSecond = calls / elapsed.count();
+    return (double)(after - before) / calls;
+}
+
+static bool accept(const std::string &paymentHash, const uint64_t &cltvExpiry)
+{
+    return paymentHash.size() == 64 && cltvExpiry > 100;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int calls = argc > 1 ? atoi(argv[1]) : 100000;
+    double rate;
+
+    printf("%-12s %16s %16s\n", "handler", "allocs/call", "calls/sec");
+    double allocs = allocationsPerCall([](Plugin &plugin) {
+        plugin.hookSubscribe("htlc_accepted", [](Json::Value &params) {
+            Json::Value result(Json::objectValue);
+            result["result"] = accept(params["htlc"]["payment_hash"].asString(),
+                                      params["htlc"]["cltv_expiry"].asUInt64()) ? "continue" : "fail";
+            return result;
+        });
+    }, calls, rate);
+    printf("%-12s %16.2f %16.0f\n", "json", allocs, rate);
+
+    allocs = allocationsPerCall([](Plugin &plugin) {
+        plugin.hookSubscribeRaw("htlc_accepted", [](Json::Value &params) -> std::string {
+            return accept(params["htlc"]["payment_hash"].asString(), params["htlc"]["cltv_expiry"].asUInt64()) ?
+                        "{\"result\":\"continue\"}" : "{\"result\":\"fail\"}";
+        });
+    }, calls, rate);
+    printf("%-12s %16.2f %16.0f\n", "raw", allocs, rate);
+
+    allocs = allocationsPerCall([](Plugin &plugin) {
+        plugin.hookSubscribeArena("htlc_accepted", [](const JsonView &params, Arena &arena, ArenaString &result) {
+            StringView hash = params["htlc"]["payment_hash"].asString(arena);
+            bool accepted = hash.size == 64 && params["htlc"]["cltv_expiry"].asUInt() > 100;
+            result += accepted ? "{\"result\":\"continue\"}" : "{\"result\":\"fail\"}";
+        });
+    }, calls, rate);
+    printf("%-12s %16.2f %16.0f\n", "arena", allocs, rate);
+    return 0;
+}
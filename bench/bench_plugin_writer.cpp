@@ -0,0 +1,81 @@
+/**
+ * Compares the plugin responses/sec of the former output path (Json::FastWriter
+ * on a Json envelope then a flushed std::ostream) with ResponseWriter, for a
+ * small and a large result, and for a pre-serialized result. Responses are
+ * written to /dev/null so that only the serialization and write costs remain.
+ *
+ * Usage: bench_plugin_writer.exx [responses]
+ */
+#include <jsonwriter.h>
+#include <responsewriter.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <unistd.h>
+
+static double responsesPerSecond(const std::function<void(const std::string&)> &respond, const unsigned int &responses)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < responses; i++)
+        respond(std::to_string(i));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return responses / elapsed.count();
+}
+
+static Json::Value makeResult(const unsigned int &channels)
+{
+    Json::Value result(Json::objectValue);
+    result["channels"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < channels; i++) {
+        Json::Value channel(Json::objectValue);
+        channel["source"] = "02" + std::string(64, 'a');
+        channel["destination"] = "03" + std::string(64, 'b');
+        channel["short_channel_id"] = std::to_string(600000 + i) + "x1x0";
+        channel["public"] = true;
+        channel["satoshis"] = (Json::UInt64)1000000 + i;
+        channel["fee_per_millionth"] = 10;
+        channel["description"] = "chan\t\"" + std::to_string(i) + "\"";
+        result["channels"].append(channel);
+    }
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int responses = argc > 1 ? atoi(argv[1]) : 100000;
+    std::ofstream devNull("/dev/null");
+    int fd = open("/dev/null", O_WRONLY);
+    ResponseWriter writer(fd);
+    Json::FastWriter fastWriter;
+
+    printf("%-10s %16s %16s %16s\n", "result", "fastwriter", "responsewriter", "raw");
+    const unsigned int sizes[] = {0, 1, 100};
+    for (const unsigned int &size : sizes) {
+        Json::Value result = size ? makeResult(size) : Json::Value(true);
+        std::string raw;
+        JsonWriter::append(result, raw);
+        unsigned int count = size < 100 ? responses : responses / 50;
+        double before = responsesPerSecond([&](const std::string &id) {
+            Json::Value response;
+            response["jsonrpc"] = "2.0";
+            response["id"] = id;
+            response["result"] = result;
+            devNull << fastWriter.write(response) << "\n" << std::flush;
+        }, count);
+        double after = responsesPerSecond([&](const std::string &id) {
+            writer.writeResult(id, result);
+        }, count);
+        double preSerialized = responsesPerSecond([&](const std::string &id) {
+            writer.writeRawResult(id, raw);
+        }, count);
+        printf("%-10s %16.0f %16.0f %16.0f\n", (std::to_string(size) + " chans").c_str(),
+               before, after, preSerialized);
+    }
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * Measures how much of the load of read-mostly commands the response cache
+ * takes off lightningd : threads sharing a pooled CLightningRpc call getinfo,
+ * listconfigs and listinvoices, with an occasional invoice invalidating the
+ * latter, against a fake lightningd answering after a fixed latency.
+ *
+ * Usage: bench_response_cache.exx [calls per thread] [latency us]
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void work(CLightningRpc &rpc, const unsigned int &calls, const unsigned int &thread)
+{
+    Json::Value none(Json::objectValue);
+    for (unsigned int i = 0; i < calls; i++) {
+        switch (i % 4) {
+        case 0:
+            rpc.sendCommand("getinfo", none);
+            break;
+        case 1:
+            rpc.sendCommand("listconfigs", none);
+            break;
+        default:
+            // 1 in 100 calls creates an invoice
+            if (i % 100 == 99)
+                rpc.invoice(1000, "bench-" + std::to_string(thread) + "-" + std::to_string(i), "bench");
+            else
+                rpc.sendCommand("listinvoices", none);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int calls = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned int latency = argc > 2 ? atoi(argv[2]) : 200;
+    std::string socketPath = "/tmp/lightningcpp-bench-cache";
+    FakeLightningd lightningd(socketPath, latency);
+    lightningd.setCannedResults(100);
+    lightningd.setResult("listconfigs", Json::Value(Json::objectValue));
+
+    printf("%u calls per thread, lightningd answering in %uus\n\n", calls, latency);
+    printf("%-8s %-8s %12s %12s %10s %10s %10s %10s\n", "threads", "cache", "calls/s", "lightningd", "hits",
+           "misses", "coalesced", "invalid.");
+    const unsigned int threadCounts[] = {1, 8};
+    for (const unsigned int &threads : threadCounts) {
+        for (int cached = 0; cached < 2; cached++) {
+            CLightningRpc rpc(socketPath, threads);
+            if (cached) {
+                rpc.getCache().setTtl("getinfo", std::chrono::seconds(1));
+                rpc.getCache().setTtl("listconfigs", std::chrono::seconds(10));
+                rpc.getCache().setTtl("listinvoices", std::chrono::seconds(1));
+            }
+            unsigned long before = lightningd.getRequests();
+            auto start = std::chrono::steady_clock::now();
+            std::vector<std::thread> workers;
+            for (unsigned int t = 0; t < threads; t++)
+                workers.emplace_back(work, std::ref(rpc), calls, t);
+            for (auto &worker : workers)
+                worker.join();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            ResponseCacheStats stats = rpc.getCache().getStats();
+            printf("%-8u %-8s %12.0f %12lu %10lu %10lu %10lu %10lu\n", threads, cached ? "ttl" : "none",
+                   threads * calls / seconds, lightningd.getRequests() - before, stats.hits, stats.misses,
+                   stats.coalesced, stats.invalidations);
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * Compares asking lightningd for routes (getroute) against finding them
+ * locally with RouteFinder, over a network the size of the public Lightning
+ * Network served by a fake lightningd. The fake answers getroute with a canned
+ * route without searching anything, so the RPC figures are a lower bound of
+ * what a real lightningd costs.
+ *
+ * Usage: bench_route_finder.exx [queries] [channels] [nodes]
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+#include <latencyhistogram.h>
+#include <routefinder.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+static std::string nodeId(const unsigned int &index)
+{
+    char hex[67];
+    snprintf(hex, sizeof(hex), "02%064x", index);
+    return hex;
+}
+
+static void printLatency(const char *what, LatencyHistogram &latency, const double &seconds)
+{
+    printf("%-26s %10.1f %8.1fus %8luus %8luus\n", what, latency.getCount() / seconds, latency.getMean(),
+           (unsigned long)latency.getPercentile(50), (unsigned long)latency.getPercentile(99));
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int queries = argc > 1 ? atoi(argv[1]) : 2000;
+    unsigned int channels = argc > 2 ? atoi(argv[2]) : 50000;
+    unsigned int nodes = argc > 3 ? atoi(argv[3]) : 12000;
+    std::string socketPath = "/tmp/lightningcpp-bench-route";
+    FakeLightningd lightningd(socketPath);
+    CLightningRpc rpc(socketPath, 1);
+
+    lightningd.setResult("listchannels", FakeLightningd::makeNetworkChannels(nodes, channels));
+    lightningd.setResult("listnodes", FakeLightningd::makeListNodes(nodes));
+    NetworkGraph graph(rpc, false);
+    graph.refresh();
+    RouteFinder finder(graph, nodeId(0));
+
+    std::vector<RouteQuery> batch;
+    for (unsigned int i = 0; i < queries; i++)
+        batch.push_back(RouteQuery(nodeId(1 + (i * 7919) % (nodes - 1)), 10000000 + i, 10));
+    std::vector<RouteHop> route;
+    finder.findRoute(batch[0], route);
+    lightningd.setResult("getroute", finder.toJson(route));
+    printf("%u nodes, %u channels, %u queries\n\n", nodes, channels, queries);
+    printf("%-26s %10s %10s %10s %10s\n", "", "routes/s", "mean", "p50", "p99");
+
+    LatencyHistogram rpcLatency;
+    auto start = std::chrono::steady_clock::now();
+    for (const RouteQuery &query : batch) {
+        auto begin = std::chrono::steady_clock::now();
+        rpc.getRoute(query.id, query.amountMsat, query.riskfactor);
+        rpcLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+    }
+    printLatency("getroute (rpc)", rpcLatency, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    LatencyHistogram localLatency;
+    unsigned int found = 0, hops = 0;
+    start = std::chrono::steady_clock::now();
+    for (const RouteQuery &query : batch) {
+        auto begin = std::chrono::steady_clock::now();
+        if (finder.findRoute(query, route)) {
+            found++;
+            hops += route.size();
+        }
+        localLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+    }
+    printLatency("RouteFinder", localLatency, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    LatencyHistogram yenLatency;
+    std::vector<std::vector<RouteHop>> routes;
+    start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < queries / 20; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        finder.findRoutes(batch[i], 5, routes);
+        yenLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - begin).count());
+    }
+    printLatency("RouteFinder, 5 routes", yenLatency, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+    const unsigned int threads[] = {1, 4, 16};
+    for (const unsigned int &count : threads) {
+        RouteFinder parallelFinder(graph, nodeId(0), count);
+        start = std::chrono::steady_clock::now();
+        parallelFinder.findRoutes(batch, routes);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("batch, %2u threads %17.1f\n", count, queries / seconds);
+    }
+    printf("\n%u/%u routes found, %.1f hops on average\n", found, queries, found ? (double)hops / found : 0.0);
+
+    return 0;
+}
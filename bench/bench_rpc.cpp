@@ -0,0 +1,102 @@
+/**
+ * The CLightningRpc benchmark suite, run against an in-process fake lightningd.
+ *
+ * For each of getinfo, listpeers, listinvoices and listchannels, with results of
+ * growing size, it measures the throughput and latency percentiles of calls made
+ * by a growing number of threads sharing one CLightningRpc, over each transport.
+ * The fake lightningd can be made to take `latency` microseconds to answer.
+ *
+ * Usage: bench_rpc.exx [calls per thread] [latency in us]
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+#include <latencyhistogram.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum Transport { DEFAULT, POOL, MULTIPLEXED };
+static const char *transportNames[] = {"default", "pool", "multiplexed"};
+
+struct Measure {
+    bool failed;
+    double callsPerSecond;
+    LatencyHistogram latency;
+};
+
+static void run(CLightningRpc &rpc, const std::string &command, const unsigned int &threads,
+                const unsigned int &calls, Measure &measure)
+{
+    std::vector<std::thread> workers;
+    std::atomic<bool> failed(false);
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < threads; i++) {
+        workers.push_back(std::thread([&]() {
+            Json::Value params(Json::objectValue);
+            try {
+                for (unsigned int j = 0; j < calls && !failed; j++) {
+                    auto before = std::chrono::steady_clock::now();
+                    rpc.sendCommand(command, params);
+                    measure.latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                                std::chrono::steady_clock::now() - before).count());
+                }
+            } catch (CLightningRpcException &e) {
+                failed = true;
+            }
+        }));
+    }
+    for (auto &worker : workers)
+        worker.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    measure.failed = failed;
+    measure.callsPerSecond = threads * calls / elapsed.count();
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int calls = argc > 1 ? atoi(argv[1]) : 500;
+    unsigned int latency = argc > 2 ? atoi(argv[2]) : 0;
+    std::string socketPath = "/tmp/lightningcpp-bench-rpc";
+    FakeLightningd lightningd(socketPath, latency);
+
+    const char *commands[] = {"getinfo", "listpeers", "listinvoices", "listchannels"};
+    const unsigned int sizes[] = {1, 100, 1000};
+    const unsigned int threadCounts[] = {1, 4, 16};
+
+    printf("%u calls per thread (fewer for large results), %uus of lightningd latency\n\n", calls, latency);
+    printf("%-13s %6s %8s %-12s %11s %9s %9s %9s\n", "command", "size", "threads", "transport",
+           "calls/s", "p50", "p99", "p999");
+    for (const char *command : commands) {
+        for (const unsigned int &size : sizes) {
+            // getinfo doesn't return a list
+            if (std::string(command) == "getinfo" && size != sizes[0])
+                continue;
+            lightningd.setCannedResults(size);
+            unsigned int count = size >= 1000 ? calls / 20 + 1 : size >= 100 ? calls / 4 + 1 : calls;
+            for (const unsigned int &threads : threadCounts) {
+                for (unsigned int transport = DEFAULT; transport <= MULTIPLEXED; transport++) {
+                    CLightningRpc rpc(socketPath, transport == POOL ? threads : 0, transport == MULTIPLEXED);
+                    Measure measure;
+                    run(rpc, command, threads, count, measure);
+                    printf("%-13s %6u %8u %-12s", command, size, threads, transportNames[transport]);
+                    if (measure.failed)
+                        printf(" %11s\n", "error");
+                    else
+                        printf(" %11.0f %7luus %7luus %7luus\n", measure.callsPerSecond,
+                               (unsigned long)measure.latency.getPercentile(50),
+                               (unsigned long)measure.latency.getPercentile(99),
+                               (unsigned long)measure.latency.getPercentile(99.9));
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    return 0;
+}
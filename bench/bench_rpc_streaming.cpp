@@ -0,0 +1,104 @@
+/**
+ * Compares listChannels(), which builds the whole result, with streamChannels(),
+ * which hands the channels to a callback one at a time, on growing networks:
+ * how long it takes to go through every channel and the peak memory it needs.
+ *
+ * The fake lightningd runs in a child process so that its own buffers don't
+ * count in our peak RSS.
+ *
+ * Usage: bench_rpc_streaming.exx
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/** Resets the peak RSS of this process to its current RSS. */
+static void resetPeakRss()
+{
+    std::ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5";
+}
+
+/** The peak RSS of this process in kB, since the last reset. */
+static long peakRss()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return atol(line.c_str() + 6);
+    return -1;
+}
+
+static pid_t startLightningd(const std::string &socketPath, const unsigned int &channels)
+{
+    int ready[2];
+    char ok;
+    if (pipe(ready) < 0)
+        return -1;
+    pid_t pid = fork();
+    if (pid == 0) {
+        FakeLightningd lightningd(socketPath);
+        lightningd.setResult("listchannels", FakeLightningd::makeListChannels(channels));
+        if (write(ready[1], "1", 1) == 1)
+            pause();
+        _exit(0);
+    }
+    if (read(ready[0], &ok, 1) != 1)
+        return -1;
+    close(ready[0]);
+    close(ready[1]);
+    return pid;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string socketPath = "/tmp/lightningcpp-bench-streaming";
+    const unsigned int sizes[] = {1000, 10000, 100000};
+
+    printf("%-10s %-10s %12s %16s\n", "channels", "call", "time", "peak RSS");
+    for (const unsigned int &size : sizes) {
+        pid_t lightningd = startLightningd(socketPath, size);
+        if (lightningd < 0) {
+            fprintf(stderr, "Could not start the fake lightningd\n");
+            return 1;
+        }
+        CLightningRpc rpc(socketPath, 1);
+        for (unsigned int streaming = 0; streaming < 2; streaming++) {
+            unsigned long capacity = 0, seen = 0;
+            resetPeakRss();
+            long before = peakRss();
+            auto start = std::chrono::steady_clock::now();
+            if (streaming) {
+                rpc.streamChannels([&](Json::Value &channel) {
+                    capacity += channel["satoshis"].asUInt64();
+                    seen++;
+                });
+            } else {
+                Json::Value channels = rpc.listChannels();
+                for (const Json::Value &channel : channels["channels"]) {
+                    capacity += channel["satoshis"].asUInt64();
+                    seen++;
+                }
+            }
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (seen != size)
+                fprintf(stderr, "Only got %lu channels\n", seen);
+            printf("%-10u %-10s %10.1fms %+13ld kB\n", size, streaming ? "stream" : "list", elapsed.count(),
+                   peakRss() - before);
+        }
+        kill(lightningd, SIGTERM);
+        waitpid(lightningd, nullptr, 0);
+    }
+
+    return 0;
+}
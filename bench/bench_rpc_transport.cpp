@@ -0,0 +1,61 @@
+/**
+ * Compares the per-call latency of a single CLightningRpc caller over the
+ * libjson-rpc-cpp client (the default transport) and over the native one (a
+ * single persistent connection), against a fake lightningd answering at once.
+ * Results of growing size are used so that framing and parsing costs show.
+ *
+ * Usage: bench_rpc_transport.exx [calls]
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+#include <latencyhistogram.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+/** Returns false if a call failed. */
+static bool measure(CLightningRpc &rpc, const unsigned int &calls, LatencyHistogram &latency)
+{
+    try {
+        for (unsigned int i = 0; i < calls; i++) {
+            auto start = std::chrono::steady_clock::now();
+            rpc.sendCommand("listchannels", Json::Value(Json::objectValue));
+            latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        }
+    } catch (CLightningRpcException &e) {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int calls = argc > 1 ? atoi(argv[1]) : 2000;
+    std::string socketPath = "/tmp/lightningcpp-bench-transport";
+    FakeLightningd lightningd(socketPath);
+
+    printf("%u listchannels calls per size\n\n", calls);
+    printf("%-10s %-16s %10s %10s %10s %10s\n", "channels", "transport", "mean", "p50", "p99", "p999");
+    const unsigned int sizes[] = {0, 10, 1000};
+    for (const unsigned int &size : sizes) {
+        lightningd.setResult("listchannels", FakeLightningd::makeListChannels(size));
+        unsigned int count = size < 1000 ? calls : calls / 20;
+        for (unsigned int transport = 0; transport < 2; transport++) {
+            CLightningRpc rpc(socketPath, transport);
+            LatencyHistogram latency;
+            printf("%-10u %-16s", size, transport ? "native" : "libjson-rpc-cpp");
+            if (measure(rpc, count, latency))
+                printf(" %8.1fus %8luus %8luus %8luus\n", latency.getMean(),
+                       (unsigned long)latency.getPercentile(50), (unsigned long)latency.getPercentile(99),
+                       (unsigned long)latency.getPercentile(99.9));
+            else
+                printf(" %10s\n", "error");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/**
+ * Compares reading listchannels into a Json::Value tree and walking it against
+ * decoding it into the typed ListChannelsResult, over the native transport and
+ * against a fake lightningd answering at once. Both sum the channels capacity
+ * so that the fields are actually read. Heap allocations are counted by
+ * replacing the global operator new.
+ *
+ * Usage: bench_rpc_typed.exx [calls]
+ */
+#include "fakelightningd.h"
+
+#include <clightningrpc.h>
+#include <latencyhistogram.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+static std::atomic<unsigned long> allocations(0);
+
+void *operator new(size_t size)
+{
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+/** Returns false if a call failed. */
+static bool measure(CLightningRpc &rpc, const bool &typed, const unsigned int &calls,
+                    LatencyHistogram &latency, uint64_t &capacity)
+{
+    ListChannelsResult result;
+    try {
+        for (unsigned int i = 0; i < calls; i++) {
+            auto start = std::chrono::steady_clock::now();
+            if (typed) {
+                rpc.listChannels(result);
+                for (const Channel &channel : result.channels)
+                    capacity += channel.amountMsat / 1000;
+            } else {
+                Json::Value channels = rpc.listChannels();
+                for (const Json::Value &channel : channels["channels"])
+                    capacity += channel["satoshis"].asUInt64();
+            }
+            latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                        std::chrono::steady_clock::now() - start).count());
+        }
+    } catch (CLightningRpcException &e) {
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int calls = argc > 1 ? atoi(argv[1]) : 1000;
+    std::string socketPath = "/tmp/lightningcpp-bench-typed";
+    FakeLightningd lightningd(socketPath);
+    CLightningRpc rpc(socketPath, 1);
+
+    printf("%u listchannels calls per size\n\n", calls);
+    printf("%-10s %-10s %10s %10s %10s %14s\n", "channels", "result", "mean", "p50", "p99", "allocs/call");
+    const unsigned int sizes[] = {10, 100, 1000};
+    for (const unsigned int &size : sizes) {
+        lightningd.setResult("listchannels", FakeLightningd::makeListChannels(size));
+        unsigned int count = size < 1000 ? calls : calls / 10;
+        for (unsigned int typed = 0; typed < 2; typed++) {
+            LatencyHistogram latency;
+            uint64_t capacity = 0;
+            // Warm the connection, the thread-local buffers and the node ids up
+            measure(rpc, typed, 1, latency, capacity);
+            latency.reset();
+            unsigned long before = allocations;
+            printf("%-10u %-10s", size, typed ? "typed" : "Json::Value");
+            if (measure(rpc, typed, count, latency, capacity))
+                printf(" %8.1fus %8luus %8luus %14.1f\n", latency.getMean(),
+                       (unsigned long)latency.getPercentile(50), (unsigned long)latency.getPercentile(99),
+                       (double)(allocations - before) / count);
+            else
+                printf(" %10s\n", "error");
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,507 @@
+#include "fakelightningd.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// The epoll data of our own fds, clients use their id
+static const uint64_t LISTEN_EVENT = 0;
+static const uint64_t STOP_EVENT = 1;
+static const uint64_t TIMER_EVENT = 2;
+
+static uint64_t nowMicros()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+/**
+ * Returns the offset right after the first complete JSON object in `buffer` starting
+ * from `start`, or std::string::npos if it is not entirely there yet.
+ */
+static size_t jsonObjectEnd(const std::string &buffer, const size_t &start)
+{
+    int depth = 0;
+    bool inString = false, escaped = false;
+    for (size_t i = start; i < buffer.size(); i++) {
+        char c = buffer[i];
+        if (inString) {
+            if (escaped)
+                escaped = false;
+            else if (c == '\\')
+                escaped = true;
+            else if (c == '"')
+                inString = false;
+            continue;
+        }
+        if (c == '"')
+            inString = true;
+        else if (c == '{' || c == '[')
+            depth++;
+        else if ((c == '}' || c == ']') && --depth == 0)
+            return i + 1;
+    }
+    return std::string::npos;
+}
+
+FakeLightningd::FakeLightningd(const std::string &socketPath, const unsigned int &latency):
+    socketPath(socketPath),
+    latency(latency),
+    nextClientId(TIMER_EVENT + 1),
+    requests(0)
+{
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(socketPath.c_str());
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listenFd, 128) < 0)
+        throw std::runtime_error("Could not listen on " + socketPath + " : " + strerror(errno));
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_EVENT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.u64 = STOP_EVENT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event);
+    event.data.u64 = TIMER_EVENT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &event);
+    thread = std::thread(&FakeLightningd::run, this);
+}
+
+FakeLightningd::~FakeLightningd()
+{
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) == sizeof(one))
+        thread.join();
+    else
+        thread.detach();
+    for (auto &it : clients)
+        close(it.second.fd);
+    close(listenFd);
+    close(epollFd);
+    close(eventFd);
+    close(timerFd);
+    unlink(socketPath.c_str());
+}
+
+void FakeLightningd::setResult(const std::string &method, const Json::Value &result)
+{
+    Json::FastWriter writer;
+    writer.omitEndingLineFeed();
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    results[method] = writer.write(result);
+}
+
+void FakeLightningd::setHandler(const std::string &method, const std::function<Json::Value(const Json::Value&)> &handler)
+{
+    std::lock_guard<std::mutex> lock(resultsMutex);
+    handlers[method] = handler;
+}
+
+void FakeLightningd::setCannedResults(const unsigned int &entries)
+{
+    setResult("getinfo", makeGetInfo());
+    setResult("listpeers", makeListPeers(entries));
+    setResult("listfunds", makeListFunds(entries));
+    setResult("listinvoices", makeListInvoices(entries));
+    setResult("listchannels", makeListChannels(entries));
+}
+
+/** A fake 33 bytes compressed public key, unique per index. */
+static std::string nodeId(const unsigned int &index)
+{
+    char hex[67];
+    snprintf(hex, sizeof(hex), "02%064x", index);
+    return hex;
+}
+
+static std::string shortChannelId(const unsigned int &index)
+{
+    return std::to_string(500000 + index / 100) + "x" + std::to_string(index % 100) + "x0";
+}
+
+Json::Value FakeLightningd::makeGetInfo()
+{
+    Json::Value info(Json::objectValue);
+    info["id"] = nodeId(0);
+    info["alias"] = "fakelightningd";
+    info["color"] = "02bf81";
+    info["num_peers"] = 12;
+    info["num_pending_channels"] = 0;
+    info["num_active_channels"] = 10;
+    info["num_inactive_channels"] = 2;
+    info["address"] = Json::Value(Json::arrayValue);
+    info["binding"] = Json::Value(Json::arrayValue);
+    info["version"] = "v0.7.1";
+    info["blockheight"] = 600000;
+    info["network"] = "bitcoin";
+    info["msatoshi_fees_collected"] = 0;
+    info["fees_collected_msat"] = "0msat";
+    return info;
+}
+
+Json::Value FakeLightningd::makeListPeers(const unsigned int &count)
+{
+    Json::Value result(Json::objectValue);
+    result["peers"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < count; i++) {
+        Json::Value peer(Json::objectValue), channel(Json::objectValue);
+        peer["id"] = nodeId(i + 1);
+        peer["connected"] = true;
+        peer["netaddr"].append("127.0.0.1:" + std::to_string(9735 + i % 1000));
+        channel["state"] = "CHANNELD_NORMAL";
+        channel["short_channel_id"] = shortChannelId(i);
+        channel["direction"] = i % 2;
+        channel["channel_id"] = std::string(64, 'c');
+        channel["funding_txid"] = std::string(64, 'f');
+        channel["msatoshi_to_us"] = (Json::UInt64)500000000;
+        channel["msatoshi_total"] = (Json::UInt64)1000000000;
+        channel["to_us_msat"] = "500000000msat";
+        channel["total_msat"] = "1000000000msat";
+        channel["dust_limit_satoshis"] = 546;
+        channel["their_to_self_delay"] = 144;
+        channel["our_to_self_delay"] = 144;
+        channel["in_payments_offered"] = i;
+        channel["out_payments_offered"] = i;
+        peer["channels"].append(channel);
+        result["peers"].append(peer);
+    }
+    return result;
+}
+
+Json::Value FakeLightningd::makeListFunds(const unsigned int &count)
+{
+    Json::Value result(Json::objectValue);
+    result["outputs"] = Json::Value(Json::arrayValue);
+    result["channels"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < count; i++) {
+        Json::Value output(Json::objectValue), channel(Json::objectValue);
+        output["txid"] = std::string(64, 'e');
+        output["output"] = i;
+        output["value"] = 100000 + i;
+        output["amount_msat"] = std::to_string(100000000ULL + i * 1000ULL) + "msat";
+        output["address"] = "bc1q" + std::string(38, 'w');
+        output["status"] = "confirmed";
+        result["outputs"].append(output);
+        channel["peer_id"] = nodeId(i + 1);
+        channel["connected"] = true;
+        channel["state"] = "CHANNELD_NORMAL";
+        channel["short_channel_id"] = shortChannelId(i);
+        channel["channel_sat"] = 500000;
+        channel["our_amount_msat"] = "500000000msat";
+        channel["channel_total_sat"] = 1000000;
+        channel["amount_msat"] = "1000000000msat";
+        channel["funding_txid"] = std::string(64, 'f');
+        channel["funding_output"] = 0;
+        result["channels"].append(channel);
+    }
+    return result;
+}
+
+Json::Value FakeLightningd::makeListInvoices(const unsigned int &count)
+{
+    Json::Value result(Json::objectValue);
+    result["invoices"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < count; i++) {
+        Json::Value invoice(Json::objectValue);
+        invoice["label"] = "invoice-" + std::to_string(i);
+        invoice["bolt11"] = "lnbc10u1pw" + std::string(250, 'q');
+        invoice["payment_hash"] = std::string(64, 'a');
+        invoice["msatoshi"] = 1000000;
+        invoice["amount_msat"] = "1000000msat";
+        invoice["status"] = i % 3 ? "paid" : "unpaid";
+        invoice["description"] = "coffee #" + std::to_string(i);
+        invoice["expires_at"] = 1560000000 + i;
+        if (i % 3) {
+            invoice["pay_index"] = i;
+            invoice["paid_at"] = 1559990000 + i;
+        }
+        result["invoices"].append(invoice);
+    }
+    return result;
+}
+
+Json::Value FakeLightningd::makeListChannels(const unsigned int &count)
+{
+    Json::Value result(Json::objectValue);
+    result["channels"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < count; i++) {
+        Json::Value channel(Json::objectValue);
+        channel["source"] = nodeId(i);
+        channel["destination"] = nodeId(i + 1);
+        channel["short_channel_id"] = shortChannelId(i);
+        channel["public"] = true;
+        channel["satoshis"] = 1000000 + i;
+        channel["amount_msat"] = std::to_string(1000000000ULL + i * 1000ULL) + "msat";
+        channel["message_flags"] = 0;
+        channel["channel_flags"] = i % 2;
+        channel["active"] = true;
+        channel["last_update"] = 1559000000 + i;
+        channel["base_fee_millisatoshi"] = 1000;
+        channel["fee_per_millionth"] = 10;
+        channel["delay"] = 14;
+        result["channels"].append(channel);
+    }
+    return result;
+}
+
+Json::Value FakeLightningd::makeListNodes(const unsigned int &count)
+{
+    Json::Value result(Json::objectValue);
+    result["nodes"] = Json::Value(Json::arrayValue);
+    for (unsigned int i = 0; i < count; i++) {
+        Json::Value node(Json::objectValue);
+        node["nodeid"] = nodeId(i);
+        node["alias"] = "node-" + std::to_string(i);
+        node["color"] = "02bf81";
+        node["last_timestamp"] = 1559000000 + i;
+        node["addresses"] = Json::Value(Json::arrayValue);
+        result["nodes"].append(node);
+    }
+    return result;
+}
+
+Json::Value FakeLightningd::makeNetworkChannels(const unsigned int &nodes, const unsigned int &channels)
+{
+    Json::Value result(Json::objectValue);
+    result["channels"] = Json::Value(Json::arrayValue);
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    auto random = [&state](const unsigned int &range) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return (unsigned int)((state >> 33) % range);
+    };
+    for (unsigned int i = 0; i < channels; i++) {
+        // The first channels link each node to a lesser one so that the network is connected
+        unsigned int a = i + 1 < nodes ? i + 1 : random(nodes);
+        unsigned int b = i + 1 < nodes ? random(i + 1) : random(nodes);
+        if (a == b)
+            b = (a + 1) % nodes;
+        uint64_t satoshis = 100000 + random(10000000);
+        for (unsigned int direction = 0; direction < 2; direction++) {
+            Json::Value channel(Json::objectValue);
+            unsigned int source = (a < b) == (direction == 0) ? a : b;
+            channel["source"] = nodeId(source);
+            channel["destination"] = nodeId(source == a ? b : a);
+            channel["short_channel_id"] = shortChannelId(i);
+            channel["public"] = true;
+            channel["satoshis"] = (Json::UInt64)satoshis;
+            channel["amount_msat"] = std::to_string(satoshis * 1000) + "msat";
+            channel["message_flags"] = 1;
+            channel["channel_flags"] = direction;
+            channel["active"] = true;
+            channel["last_update"] = 1559000000 + random(1000000);
+            channel["base_fee_millisatoshi"] = random(2000);
+            channel["fee_per_millionth"] = 1 + random(1000);
+            channel["delay"] = 6 + random(138);
+            channel["htlc_minimum_msat"] = "1000msat";
+            channel["htlc_maximum_msat"] = std::to_string(satoshis * 1000) + "msat";
+            result["channels"].append(channel);
+        }
+    }
+    return result;
+}
+
+unsigned long FakeLightningd::getRequests()
+{
+    return requests;
+}
+
+void FakeLightningd::accept()
+{
+    int fd;
+    while ((fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        uint64_t id = nextClientId++;
+        clients[id].fd = fd;
+        clients[id].written = 0;
+        clients[id].waitingWritable = false;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u64 = id;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+void FakeLightningd::closeClient(const uint64_t &clientId)
+{
+    auto it = clients.find(clientId);
+    if (it == clients.end())
+        return;
+    close(it->second.fd);
+    clients.erase(it);
+}
+
+void FakeLightningd::readRequests(const uint64_t &clientId)
+{
+    Client &client = clients[clientId];
+    char chunk[65536];
+    while (true) {
+        ssize_t n = read(client.fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n <= 0)
+            return closeClient(clientId);
+        client.readBuffer.append(chunk, n);
+    }
+
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    Json::FastWriter writer;
+    writer.omitEndingLineFeed();
+    size_t consumed = 0, end;
+    while ((end = jsonObjectEnd(client.readBuffer, consumed)) != std::string::npos) {
+        Json::Value request;
+        const char *begin = client.readBuffer.data() + consumed;
+        if (!reader->parse(begin, client.readBuffer.data() + end, &request, nullptr))
+            return closeClient(clientId);
+        consumed = end;
+
+        std::string method = request["method"].asString();
+        std::string response = "{\"jsonrpc\":\"2.0\",\"id\":" + writer.write(request["id"]);
+        std::function<Json::Value(const Json::Value&)> handler;
+        bool canned = false;
+        {
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            auto handled = handlers.find(method);
+            auto it = results.find(method);
+            if (handled != handlers.end()) {
+                handler = handled->second;
+            } else if (it != results.end()) {
+                response += ",\"result\":";
+                response += it->second;
+                canned = true;
+            }
+        }
+        if (handler) {
+            Json::Value members = handler(request["params"]);
+            for (const std::string &name : members.getMemberNames())
+                response += ",\"" + name + "\":" + writer.write(members[name]);
+        } else if (!canned) {
+            Json::Value echo(Json::objectValue);
+            echo["method"] = request["method"];
+            echo["params"] = request["params"];
+            response += ",\"result\":" + writer.write(echo);
+        }
+        response += "}\n\n";
+        requests++;
+        if (latency) {
+            DelayedResponse delayedResponse = {nowMicros() + latency, clientId, response};
+            delayed.push_back(delayedResponse);
+        } else {
+            respond(clientId, response);
+        }
+    }
+    client.readBuffer.erase(0, consumed);
+    flush(clientId);
+}
+
+void FakeLightningd::respond(const uint64_t &clientId, std::string &response)
+{
+    auto it = clients.find(clientId);
+    if (it == clients.end())
+        return;
+    if (it->second.writeBuffer.empty())
+        it->second.writeBuffer.swap(response);
+    else
+        it->second.writeBuffer += response;
+}
+
+void FakeLightningd::flush(const uint64_t &clientId)
+{
+    auto it = clients.find(clientId);
+    if (it == clients.end())
+        return;
+    Client &client = it->second;
+    while (client.written < client.writeBuffer.size()) {
+        ssize_t n = send(client.fd, client.writeBuffer.data() + client.written,
+                            client.writeBuffer.size() - client.written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0)
+            return closeClient(clientId);
+        client.written += n;
+    }
+    // Erasing what was sent after each partial write would move large responses over and over
+    if (client.written == client.writeBuffer.size()) {
+        client.writeBuffer.clear();
+        client.written = 0;
+    }
+    if (client.writeBuffer.empty() != client.waitingWritable)
+        return;
+    struct epoll_event event;
+    client.waitingWritable = !client.writeBuffer.empty();
+    event.events = client.waitingWritable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.u64 = clientId;
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, client.fd, &event);
+}
+
+void FakeLightningd::armTimer()
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (!delayed.empty()) {
+        // A zero value would disarm the timer
+        uint64_t due = delayed.front().due ? delayed.front().due : 1;
+        spec.it_value.tv_sec = due / 1000000;
+        spec.it_value.tv_nsec = (due % 1000000) * 1000;
+    }
+    timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void FakeLightningd::run()
+{
+    struct epoll_event events[64];
+
+    while (true) {
+        int n = epoll_wait(epollFd, events, 64, -1);
+        if (n < 0 && errno != EINTR)
+            return;
+        for (int i = 0; i < n; i++) {
+            uint64_t id = events[i].data.u64;
+            if (id == STOP_EVENT)
+                return;
+            if (id == LISTEN_EVENT) {
+                accept();
+            } else if (id == TIMER_EVENT) {
+                uint64_t expirations;
+                if (read(timerFd, &expirations, sizeof(expirations)) < 0) {
+                    // Already handled
+                }
+            } else {
+                if (events[i].events & EPOLLOUT)
+                    flush(id);
+                if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && clients.count(id))
+                    readRequests(id);
+            }
+        }
+
+        // Send the responses whose latency elapsed, batching the writes per client
+        std::map<uint64_t, bool> touched;
+        uint64_t now = nowMicros();
+        while (!delayed.empty() && delayed.front().due <= now) {
+            respond(delayed.front().clientId, delayed.front().response);
+            touched[delayed.front().clientId] = true;
+            delayed.pop_front();
+        }
+        for (auto &it : touched)
+            flush(it.first);
+        armTimer();
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef LIGHTNINGCPP_FAKELIGHTNINGD_H
+#define LIGHTNINGCPP_FAKELIGHTNINGD_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <jsonrpccpp/client.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * A minimal stand-in for lightningd's JSON-RPC socket, used by the benchmarks.
+ *
+ * Like lightningd, it serves any number of connections from a single thread and
+ * answers requests in any order. Each request is answered after `latency`
+ * microseconds with the canned result of its method, or an echo of its
+ * parameters if none was set.
+ */
+class FakeLightningd {
+
+public:
+    FakeLightningd(const std::string &socketPath, const unsigned int &latency=0);
+    ~FakeLightningd();
+
+    /** Sets the result returned to any `method` request. */
+    void setResult(const std::string &method, const Json::Value &result);
+
+    /**
+     * Answers `method` requests with whatever `handler` returns given their params : an
+     * object holding either a "result" or an "error" member. It is called from the fake's
+     * thread and takes precedence over setResult().
+     */
+    void setHandler(const std::string &method, const std::function<Json::Value(const Json::Value&)> &handler);
+
+    /**
+     * Sets canned results for getinfo, listpeers, listfunds, listinvoices and listchannels,
+     * the lists holding `entries` elements each.
+     */
+    void setCannedResults(const unsigned int &entries);
+
+    /** Results shaped like lightningd's, with `count` elements in their list. */
+    static Json::Value makeGetInfo();
+    static Json::Value makeListPeers(const unsigned int &count);
+    static Json::Value makeListFunds(const unsigned int &count);
+    static Json::Value makeListInvoices(const unsigned int &count);
+    static Json::Value makeListChannels(const unsigned int &count);
+    static Json::Value makeListNodes(const unsigned int &count);
+
+    /**
+     * A listchannels result for a connected network of `nodes` nodes and `channels`
+     * channels (so twice as many entries, one per direction) between random nodes
+     * with random fees, the same for the same arguments.
+     */
+    static Json::Value makeNetworkChannels(const unsigned int &nodes, const unsigned int &channels);
+
+    /** The number of requests answered so far. */
+    unsigned long getRequests();
+
+private:
+    struct Client {
+        int fd;
+        std::string readBuffer;
+        std::string writeBuffer;
+        // How much of writeBuffer was sent, it is only shrunk once empty
+        size_t written;
+        bool waitingWritable;
+    };
+    struct DelayedResponse {
+        uint64_t due;
+        uint64_t clientId;
+        std::string response;
+    };
+
+    std::string socketPath;
+    unsigned int latency;
+    int listenFd;
+    int epollFd;
+    int eventFd;
+    // Fires when the oldest delayed response is due
+    int timerFd;
+    std::thread thread;
+    std::map<uint64_t, Client> clients;
+    uint64_t nextClientId;
+    // Responses waiting for their latency to elapse, in due order since the latency is constant
+    std::deque<DelayedResponse> delayed;
+    // Serialized canned results
+    std::mutex resultsMutex;
+    std::map<std::string, std::string> results;
+    std::map<std::string, std::function<Json::Value(const Json::Value&)>> handlers;
+    std::atomic<unsigned long> requests;
+
+    void run();
+    void accept();
+    void readRequests(const uint64_t &clientId);
+    /** Queues a response, which may be emptied. */
+    void respond(const uint64_t &clientId, std::string &response);
+    void flush(const uint64_t &clientId);
+    void closeClient(const uint64_t &clientId);
+    void armTimer();
+};
+
+#endif // LIGHTNINGCPP_FAKELIGHTNINGD_H
@@ -0,0 +1,421 @@
+/**
+ * A load generator for plugins, standing in for lightningd.
+ *
+ * It spawns a plugin binary, sends it "getmanifest" and "init" (pointing it to
+ * an in-process fake lightningd), then a mix of RPC calls, hook invocations and
+ * notifications at a target rate. It reports the throughput, the latency of the
+ * responses (overall and per kind of message) and the peak RSS of the plugin.
+ *
+ * Usage: plugin_loadgen.exx <plugin> [--count=N] [--rate=N] [--inflight=N] [--mix=KIND:NAME:WEIGHT,..]
+ *
+ *   --count     The number of messages to send after init (defaults to 100000)
+ *   --rate      The target number of messages per second, 0 for as fast as possible (the default)
+ *   --inflight  The maximum number of requests waiting for a response (defaults to 64)
+ *   --mix       The messages to send and their relative weight, KIND being one of rpc, hook
+ *               or notify (e.g. "hook:db_write:10,hook:htlc_accepted:5,rpc:hello:1"). Defaults
+ *               to everything the plugin registers in its manifest, with the same weight.
+ */
+#include "fakelightningd.h"
+
+#include <jsonframer.h>
+#include <jsonscanner.h>
+#include <latencyhistogram.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+/** A kind of message to send, and the latency of its responses. */
+struct MixEntry {
+    std::string kind;
+    std::string name;
+    unsigned int weight;
+    unsigned long sent;
+    unsigned long errors;
+    std::shared_ptr<LatencyHistogram> latency;
+
+    MixEntry(const std::string &kind, const std::string &name, const unsigned int &weight):
+        kind(kind), name(name), weight(weight), sent(0), errors(0), latency(new LatencyHistogram())
+    {}
+};
+
+/** The plugin process and its pipes. */
+struct Plugin {
+    pid_t pid;
+    int in;
+    int out;
+};
+
+struct InFlight {
+    Clock::time_point sent;
+    // The index of its MixEntry, or -1 for getmanifest/init
+    int entry;
+};
+
+/** The state shared by the sending and receiving threads. */
+struct Session {
+    std::mutex mutex;
+    std::condition_variable answered;
+    std::unordered_map<uint64_t, InFlight> inFlight;
+    unsigned long responses;
+    unsigned long errors;
+    LatencyHistogram latency;
+    // The results of the setup requests, by id
+    std::unordered_map<uint64_t, Json::Value> setupResults;
+};
+
+static Plugin spawn(const char *path)
+{
+    int toPlugin[2], fromPlugin[2];
+    Plugin plugin;
+    if (pipe(toPlugin) < 0 || pipe(fromPlugin) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    plugin.pid = fork();
+    if (plugin.pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+    if (plugin.pid == 0) {
+        dup2(toPlugin[0], STDIN_FILENO);
+        dup2(fromPlugin[1], STDOUT_FILENO);
+        close(toPlugin[0]);
+        close(toPlugin[1]);
+        close(fromPlugin[0]);
+        close(fromPlugin[1]);
+        execl(path, path, (char *)nullptr);
+        perror("exec");
+        _exit(127);
+    }
+    close(toPlugin[0]);
+    close(fromPlugin[1]);
+    plugin.in = toPlugin[1];
+    plugin.out = fromPlugin[0];
+    return plugin;
+}
+
+static bool writeAll(const int &fd, const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = write(fd, data.data() + written, data.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        written += n;
+    }
+    return true;
+}
+
+/** Canned parameters for the hooks and notifications we know about, an empty object otherwise. */
+static Json::Value makeParams(const MixEntry &entry, const unsigned long &sequence)
+{
+    Json::Value params(Json::objectValue);
+    if (entry.kind == "rpc") {
+        return Json::Value(Json::arrayValue);
+    } else if (entry.name == "db_write") {
+        params["data_version"] = (Json::UInt64)sequence;
+        params["writes"].append("UPDATE vars SET intval=" + std::to_string(sequence) + " WHERE name='data_version';");
+        params["writes"].append("INSERT INTO channel_htlcs (channel_id, id, direction, msatoshi, cltv_expiry, "
+                                "payment_hash, hstate) VALUES (7, " + std::to_string(sequence) + ", 0, 1000000, "
+                                "600144, X'" + std::string(64, 'a') + "', 3);");
+    } else if (entry.name == "htlc_accepted") {
+        params["onion"]["payload"] = "";
+        params["onion"]["type"] = "legacy";
+        params["onion"]["short_channel_id"] = "600000x1x0";
+        params["onion"]["forward_amount"] = "1000000msat";
+        params["onion"]["outgoing_cltv_value"] = 600100;
+        params["onion"]["shared_secret"] = std::string(64, 's');
+        params["onion"]["next_onion"] = std::string(2600, '0');
+        params["htlc"]["amount"] = "1001000msat";
+        params["htlc"]["cltv_expiry"] = 600144;
+        params["htlc"]["cltv_expiry_relative"] = 144;
+        params["htlc"]["payment_hash"] = std::string(64, 'a');
+    } else if (entry.name == "warning") {
+        params["warning"]["level"] = "warn";
+        params["warning"]["time"] = "1559000000.000000000";
+        params["warning"]["source"] = "plugin_loadgen";
+        params["warning"]["log"] = "warning #" + std::to_string(sequence);
+    } else if (entry.name == "connect" || entry.name == "disconnect") {
+        params["id"] = "02" + std::string(64, 'a');
+        params["address"]["type"] = "ipv4";
+        params["address"]["address"] = "127.0.0.1";
+        params["address"]["port"] = 9735;
+    } else if (entry.name == "invoice_payment") {
+        params["payment"]["label"] = "invoice-" + std::to_string(sequence);
+        params["payment"]["preimage"] = std::string(64, 'p');
+        params["payment"]["msat"] = "1000000msat";
+    }
+    return params;
+}
+
+static void appendMessage(const uint64_t &id, const bool &hasId, const std::string &method,
+                          const Json::Value &params, std::string &out)
+{
+    Json::Value message(Json::objectValue);
+    Json::FastWriter writer;
+    message["jsonrpc"] = "2.0";
+    if (hasId)
+        message["id"] = (Json::UInt64)id;
+    message["method"] = method;
+    message["params"] = params;
+    out += writer.write(message);
+    out += "\n";
+}
+
+/** Reads the plugin's responses until it closes its stdout. */
+static void receive(const Plugin &plugin, Session &session, std::vector<MixEntry> &mix)
+{
+    JsonFramer framer;
+    const char *begin, *end, *keyBegin, *keyEnd;
+    while (true) {
+        ssize_t n = read(plugin.out, framer.prepare(65536), 65536);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        framer.commit(n);
+        while (framer.next(begin, end)) {
+            auto now = Clock::now();
+            const char *resultBegin = nullptr, *resultEnd = nullptr;
+            JsonScanner scanner(begin, end);
+            uint64_t id = 0;
+            bool hasId = false, isError = false;
+            if (!scanner.beginObject())
+                continue;
+            while (scanner.nextMember(keyBegin, keyEnd)) {
+                std::string key(keyBegin, keyEnd);
+                if (key == "id" && scanner.peek() == '"') {
+                    std::string raw;
+                    hasId = scanner.readString(raw);
+                    id = strtoull(raw.c_str(), nullptr, 10);
+                } else if (key == "id") {
+                    hasId = scanner.readUnsigned(id);
+                } else if (key == "result") {
+                    scanner.skipValue(resultBegin, resultEnd);
+                } else {
+                    isError |= key == "error";
+                    scanner.skipValue();
+                }
+            }
+            // Notifications from the plugin (e.g. "log") don't have an id
+            if (!hasId)
+                continue;
+            std::lock_guard<std::mutex> lock(session.mutex);
+            auto it = session.inFlight.find(id);
+            if (it == session.inFlight.end())
+                continue;
+            uint64_t micros = std::chrono::duration_cast<std::chrono::microseconds>(now - it->second.sent).count();
+            if (it->second.entry < 0) {
+                Json::Value result;
+                Json::Reader().parse(resultBegin ? std::string(resultBegin, resultEnd) : "null", result);
+                session.setupResults[id] = result;
+            } else {
+                session.latency.record(micros);
+                mix[it->second.entry].latency->record(micros);
+                mix[it->second.entry].errors += isError;
+            }
+            session.responses++;
+            session.errors += isError;
+            session.inFlight.erase(it);
+            session.answered.notify_all();
+        }
+    }
+    std::lock_guard<std::mutex> lock(session.mutex);
+    session.inFlight.clear();
+    session.answered.notify_all();
+}
+
+/** Sends a setup request and waits for its result. */
+static Json::Value setup(const Plugin &plugin, Session &session, const uint64_t &id, const std::string &method,
+                         const Json::Value &params)
+{
+    std::string raw;
+    appendMessage(id, true, method, params, raw);
+    std::unique_lock<std::mutex> lock(session.mutex);
+    session.inFlight[id] = {Clock::now(), -1};
+    if (!writeAll(plugin.in, raw)) {
+        fprintf(stderr, "The plugin exited before answering %s\n", method.c_str());
+        exit(1);
+    }
+    if (!session.answered.wait_for(lock, std::chrono::seconds(10), [&]{ return session.setupResults.count(id) > 0; })) {
+        fprintf(stderr, "The plugin didn't answer %s\n", method.c_str());
+        exit(1);
+    }
+    return session.setupResults[id];
+}
+
+static bool parseMix(const std::string &spec, std::vector<MixEntry> &mix)
+{
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t comma = spec.find(',', start);
+        std::string item = spec.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        size_t first = item.find(':'), last = item.rfind(':');
+        if (first == std::string::npos || first == last)
+            return false;
+        MixEntry entry(item.substr(0, first), item.substr(first + 1, last - first - 1),
+                       atoi(item.substr(last + 1).c_str()));
+        if ((entry.kind != "rpc" && entry.kind != "hook" && entry.kind != "notify") || !entry.weight)
+            return false;
+        mix.push_back(entry);
+        if (comma == std::string::npos)
+            break;
+        start = comma + 1;
+    }
+    return !mix.empty();
+}
+
+/** Everything the plugin registered in its manifest, with the same weight. */
+static void mixFromManifest(const Json::Value &manifest, std::vector<MixEntry> &mix)
+{
+    const char *kinds[][2] = {{"rpc", "rpcmethods"}, {"hook", "hooks"}, {"notify", "subscriptions"}};
+    for (auto &kind : kinds) {
+        for (const Json::Value &item : manifest[kind[1]]) {
+            mix.push_back(MixEntry(kind[0], item.isObject() ? item["name"].asString() : item.asString(), 1));
+        }
+    }
+}
+
+static void printLatency(const char *name, const unsigned long &count, const LatencyHistogram &latency)
+{
+    printf("%-28s %10lu %9luus %9luus %9luus %9luus\n", name, count, (unsigned long)latency.getPercentile(50),
+           (unsigned long)latency.getPercentile(99), (unsigned long)latency.getPercentile(99.9),
+           (unsigned long)latency.getMax());
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long count = 100000;
+    double rate = 0;
+    unsigned int maxInFlight = 64;
+    std::vector<MixEntry> mix;
+
+    if (argc < 2) {
+        fprintf(stderr, "Usage: %s <plugin> [--count=N] [--rate=N] [--inflight=N] [--mix=KIND:NAME:WEIGHT,..]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--count=") == 0) {
+            count = strtoul(arg.c_str() + 8, nullptr, 10);
+        } else if (arg.compare(0, 7, "--rate=") == 0) {
+            rate = atof(arg.c_str() + 7);
+        } else if (arg.compare(0, 11, "--inflight=") == 0) {
+            maxInFlight = atoi(arg.c_str() + 11);
+        } else if (arg.compare(0, 6, "--mix=") != 0 || !parseMix(arg.substr(6), mix)) {
+            fprintf(stderr, "Invalid argument : %s\n", arg.c_str());
+            return 1;
+        }
+    }
+    if (!maxInFlight)
+        maxInFlight = 1;
+
+    // The plugin connects to "lightningd" on init, give it something to talk to
+    std::string lightningDir = "/tmp/lightningcpp-loadgen";
+    mkdir(lightningDir.c_str(), 0700);
+    FakeLightningd lightningd(lightningDir + "/lightning-rpc");
+    lightningd.setCannedResults(10);
+
+    signal(SIGPIPE, SIG_IGN);
+    Plugin plugin = spawn(argv[1]);
+    Session session;
+    session.responses = 0;
+    session.errors = 0;
+    std::thread receiver(receive, std::cref(plugin), std::ref(session), std::ref(mix));
+
+    Json::Value manifest = setup(plugin, session, 0, "getmanifest", Json::Value(Json::objectValue));
+    Json::Value initParams(Json::objectValue);
+    initParams["options"] = Json::Value(Json::objectValue);
+    for (const Json::Value &option : manifest["options"])
+        initParams["options"][option["name"].asString()] = option["default"];
+    initParams["configuration"]["lightning-dir"] = lightningDir;
+    initParams["configuration"]["rpc-file"] = "lightning-rpc";
+    setup(plugin, session, 1, "init", initParams);
+    session.responses = 0;
+    if (mix.empty())
+        mixFromManifest(manifest, mix);
+    if (mix.empty()) {
+        fprintf(stderr, "The plugin doesn't register anything to send\n");
+        return 1;
+    }
+
+    // A weighted round robin over the mix, so that runs are reproducible
+    std::vector<int> schedule;
+    for (size_t i = 0; i < mix.size(); i++)
+        for (unsigned int j = 0; j < mix[i].weight; j++)
+            schedule.push_back(i);
+
+    std::string raw;
+    unsigned long notifications = 0;
+    bool pluginExited = false;
+    auto start = Clock::now();
+    for (unsigned long i = 0; i < count && !pluginExited; i++) {
+        MixEntry &entry = mix[schedule[i % schedule.size()]];
+        uint64_t id = i + 2;
+        bool isRequest = entry.kind != "notify";
+        if (rate > 0)
+            std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t)(i * 1000000 / rate)));
+        raw.clear();
+        appendMessage(id, isRequest, entry.name, makeParams(entry, i), raw);
+        {
+            std::unique_lock<std::mutex> lock(session.mutex);
+            if (isRequest) {
+                session.answered.wait(lock, [&]{ return session.inFlight.size() < maxInFlight; });
+                session.inFlight[id] = {Clock::now(), (int)(&entry - &mix[0])};
+            } else {
+                notifications++;
+            }
+            entry.sent++;
+        }
+        pluginExited = !writeAll(plugin.in, raw);
+    }
+    {
+        std::unique_lock<std::mutex> lock(session.mutex);
+        session.answered.wait(lock, [&]{ return session.inFlight.empty(); });
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    // The plugin exits once its stdin is closed
+    close(plugin.in);
+    receiver.join();
+    int status;
+    struct rusage usage;
+    wait4(plugin.pid, &status, 0, &usage);
+
+    unsigned long messages = session.responses + notifications;
+    printf("%s : %lu messages (%lu notifications) in %.2fs, %s\n\n", argv[1], messages, notifications,
+           elapsed.count(), pluginExited ? "the plugin exited early" : "all requests answered");
+    printf("%-28s %10s %11s %11s %11s %11s\n", "", "sent", "p50", "p99", "p999", "max");
+    for (const MixEntry &entry : mix) {
+        // Notifications are not answered
+        if (entry.kind == "notify")
+            printf("%-28s %10lu\n", (entry.kind + ":" + entry.name).c_str(), entry.sent);
+        else
+            printLatency((entry.kind + ":" + entry.name).c_str(), entry.sent, *entry.latency);
+    }
+    printLatency("all requests", session.responses, session.latency);
+    printf("\nthroughput : %.0f messages/s (target %s)\n", messages / elapsed.count(),
+           rate > 0 ? std::to_string((unsigned long)rate).c_str() : "unbounded");
+    printf("errors : %lu\n", session.errors);
+    printf("peak RSS : %ld KB\n", usage.ru_maxrss);
+
+    return pluginExited || session.errors;
+}
@@ -0,0 +1,72 @@
+#include "arena.h"
+
+#include <cstdlib>
+
+Arena::Arena(const size_t &chunkSize):
+    chunkSize(chunkSize),
+    current(0),
+    offset(0),
+    usedBefore(0),
+    chunkAllocations(0)
+{}
+
+Arena::~Arena()
+{
+    for (Chunk &chunk : chunks)
+        free(chunk.data);
+}
+
+void *Arena::allocate(const size_t &size, const size_t &alignment)
+{
+    while (current < chunks.size()) {
+        Chunk &chunk = chunks[current];
+        size_t aligned = (offset + alignment - 1) & ~(alignment - 1);
+        if (aligned + size <= chunk.size) {
+            offset = aligned + size;
+            return chunk.data + aligned;
+        }
+        // Move on to the next chunk kept from a previous request, if any
+        usedBefore += offset;
+        current++;
+        offset = 0;
+    }
+
+    // Oversized allocations get a chunk of their own, kept for the next requests as well
+    Chunk chunk;
+    chunk.size = size + alignment > chunkSize ? size + alignment : chunkSize;
+    chunk.data = static_cast<char*>(malloc(chunk.size));
+    if (!chunk.data)
+        throw std::bad_alloc();
+    chunks.push_back(chunk);
+    chunkAllocations++;
+    current = chunks.size() - 1;
+    size_t aligned = (reinterpret_cast<uintptr_t>(chunk.data) % alignment) ?
+                        alignment - reinterpret_cast<uintptr_t>(chunk.data) % alignment : 0;
+    offset = aligned + size;
+    return chunk.data + aligned;
+}
+
+void Arena::reset()
+{
+    current = 0;
+    offset = 0;
+    usedBefore = 0;
+}
+
+size_t Arena::getUsed() const
+{
+    return usedBefore + offset;
+}
+
+size_t Arena::getCapacity() const
+{
+    size_t capacity = 0;
+    for (const Chunk &chunk : chunks)
+        capacity += chunk.size;
+    return capacity;
+}
+
+uint64_t Arena::getChunkAllocations() const
+{
+    return chunkAllocations;
+}
@@ -0,0 +1,94 @@
+#ifndef LIGHTNINGCPP_ARENA_H
+#define LIGHTNINGCPP_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * A bump allocator for the data of a single request, released all at once.
+ *
+ * Memory is handed out of large chunks which are kept across reset(), so that
+ * once warmed up an arena doesn't allocate anymore. Objects created in it are
+ * never destroyed, they must not own anything outside of it.
+ */
+class Arena {
+
+public:
+    Arena(const size_t &chunkSize=65536);
+    ~Arena();
+
+    void *allocate(const size_t &size, const size_t &alignment=alignof(std::max_align_t));
+
+    template<typename T, typename... Args>
+    T *create(Args&&... args)
+    {
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * Makes all the memory available again, invalidating everything allocated so far.
+     */
+    void reset();
+
+    /** The bytes allocated since the last reset. */
+    size_t getUsed() const;
+
+    /** The bytes held by the arena. */
+    size_t getCapacity() const;
+
+    /** The number of chunks allocated on the heap since the arena was created. */
+    uint64_t getChunkAllocations() const;
+
+private:
+    struct Chunk {
+        char *data;
+        size_t size;
+    };
+
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    // The chunk we are allocating from, and the offset of its free space
+    size_t current;
+    size_t offset;
+    // The bytes used in the chunks before the current one
+    size_t usedBefore;
+    uint64_t chunkAllocations;
+
+    Arena(const Arena&);
+    Arena &operator=(const Arena&);
+};
+
+/**
+ * A standard allocator handing memory out of an Arena, for scratch containers.
+ * Deallocation is a no-op, the memory is reclaimed by Arena::reset().
+ */
+template<typename T>
+class ArenaAllocator {
+
+public:
+    typedef T value_type;
+
+    ArenaAllocator(Arena &arena): arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other): arena(other.arena) {}
+
+    T *allocate(const size_t &n) { return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T*, const size_t&) {}
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+
+private:
+    template<typename U> friend class ArenaAllocator;
+    Arena *arena;
+};
+
+typedef std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>> ArenaString;
+
+#endif // LIGHTNINGCPP_ARENA_H
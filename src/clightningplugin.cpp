@@ -1,15 +1,27 @@
 #include "clightningplugin.h"
+#include "jsonwriter.h"
 #include "pluginexception.h"
+#include "threadpool.h"
 
-#include <iostream>
+#include <cstring>
+#include <memory>
+#include <unistd.h>
 
-Plugin::Plugin():
+Plugin::Plugin(const unsigned int &workers):
     rpc(nullptr),
-    options(Json::Value(Json::arrayValue))
+    workers(workers),
+    output(STDOUT_FILENO),
+    options(Json::Value(Json::arrayValue)),
+    notificationWorkers(0),
+    notificationCapacity(1024),
+    notificationPolicy(NotificationQueue::DROP),
+    notificationQueue(nullptr)
 {}
 
 Plugin::~Plugin()
 {
+    if (notificationQueue)
+        delete notificationQueue;
     if (rpc)
         delete rpc;
 }
@@ -37,12 +49,12 @@ void Plugin::addOption(const std::string &name, const std::string &defaultValue,
 
 void Plugin::printResponseSuccess(const Json::Value &result, const std::string &reqId)
 {
-    Json::FastWriter writer;
-    Json::Value response;
-    response["jsonrpc"] = "2.0";
-    response["result"] = result;
-    response["id"] = reqId;
-    std::cout << writer.write(response);
+    output.writeResult(reqId, result);
+}
+
+void Plugin::printRawResponseSuccess(const std::string &rawResult, const std::string &reqId)
+{
+    output.writeRawResult(reqId, rawResult);
 }
 
 RpcMethod Plugin::generateManifest()
@@ -67,8 +79,20 @@ RpcMethod Plugin::generateManifest()
         manifest["subscriptions"] = Json::Value(Json::arrayValue);
         for (const auto &it : subscriptions)
             manifest["subscriptions"].append(it.first);
+        for (const auto &it : batchSubscriptions)
+            if (!subscriptions.count(it.first))
+                manifest["subscriptions"].append(it.first);
         for (const auto &it : hookSubscriptions)
             manifest["hooks"].append(it.first);
+        for (const auto &it : rawHookSubscriptions)
+            manifest["hooks"].append(it.first);
+        for (const auto &it : asyncHookSubscriptions)
+            manifest["hooks"].append(it.first);
+        for (const auto &it : arenaHookSubscriptions)
+            manifest["hooks"].append(it.first);
+        if (dbWriteHandler && !hookSubscriptions.count("db_write") && !rawHookSubscriptions.count("db_write")
+                && !asyncHookSubscriptions.count("db_write") && !arenaHookSubscriptions.count("db_write"))
+            manifest["hooks"].append("db_write");
         
         return manifest;
     });
@@ -106,45 +130,416 @@ void Plugin::hookSubscribe(const std::string name, std::function<Json::Value(Jso
     hookSubscriptions[name] = handler;
 }
 
+void Plugin::dbWriteSubscribe(std::function<bool(const DbWrite&)> handler)
+{
+    dbWriteHandler = handler;
+}
+
+const LatencyHistogram &Plugin::getDbWriteLatency() const
+{
+    return dbWriteLatency;
+}
+
+void Plugin::hookSubscribeRaw(const std::string name, std::function<std::string(Json::Value&)> handler)
+{
+    rawHookSubscriptions[name] = handler;
+}
+
+void Plugin::hookSubscribeArena(const std::string name,
+                    std::function<void(const JsonView &params, Arena &arena, ArenaString &result)> handler)
+{
+    arenaHookSubscriptions[name] = handler;
+}
+
+const Arena &Plugin::getArena() const
+{
+    return arena;
+}
+
+void Plugin::hookSubscribeAsync(const std::string name, std::function<void(Json::Value&, RpcResponder)> handler)
+{
+    asyncHookSubscriptions[name] = handler;
+}
+
+void Plugin::hookSubscribeDeferred(const std::string name, const std::chrono::milliseconds &timeout,
+                    const Json::Value &onTimeout, std::function<void(Json::Value&, RpcResponder)> handler)
+{
+    std::string serialized;
+    JsonWriter::append(onTimeout, serialized);
+    std::shared_ptr<const std::string> timeoutResult = std::make_shared<const std::string>(serialized);
+    asyncHookSubscriptions[name] = [this, timeout, timeoutResult, handler](Json::Value &params, RpcResponder responder) {
+        pending.setTimeout(responder.getId(), timeout, timeoutResult);
+        handler(params, responder);
+    };
+}
+
+int Plugin::addTimer(const std::chrono::milliseconds &interval, const std::function<void()> &callback,
+                    const bool &repeat)
+{
+    return loop.addTimer(interval, callback, repeat);
+}
+
+void Plugin::removeTimer(const int &timer)
+{
+    loop.removeTimer(timer);
+}
+
+void Plugin::addFd(const int &fd, const std::function<void(uint32_t)> &callback, const uint32_t &events)
+{
+    if (!loop.addFd(fd, callback, events))
+        throw CLightningPluginException(1, "File descriptor " + std::to_string(fd) + " can't be watched by epoll");
+}
+
+void Plugin::removeFd(const int &fd)
+{
+    loop.removeFd(fd);
+}
+
+PendingRequests &Plugin::getPendingRequests()
+{
+    return pending;
+}
+
+CLightningRpc *Plugin::getRpc()
+{
+    return rpc;
+}
+
+Instrumentation &Plugin::getInstrumentation()
+{
+    return instrumentation;
+}
+
+void Plugin::logInstrumentation(const std::chrono::milliseconds &interval)
+{
+    instrumentation.setEnabled(true);
+    instrumentation.startDumping(interval, [this](const std::string &table) {
+        std::string message;
+        size_t begin = 0, end;
+        // lightningd logs each notification as a single line
+        while ((end = table.find('\n', begin)) != std::string::npos) {
+            message = "{\"jsonrpc\":\"2.0\",\"method\":\"log\",\"params\":{\"level\":\"info\",\"message\":";
+            JsonWriter::appendString(table.data() + begin, table.data() + end, message);
+            message += "}}\n\n";
+            output.writeMessage(message);
+            begin = end + 1;
+        }
+    });
+}
+
+/**
+ * The name a handler is instrumented under
+ */
+static const std::string &operationName(const DispatchEntry &entry, const bool &isRequest)
+{
+    return isRequest ? entry.requestOperation : entry.notificationOperation;
+}
+
+/**
+ * The error answering a request whose handler threw, to be called from a catch block
+ */
+static void handlerError(const std::string &name, int &code, std::string &message)
+{
+    try {
+        throw;
+    } catch (CLightningPluginException &e) {
+        code = e.getCode();
+        message = e.what();
+    } catch (std::exception &e) {
+        code = -32603;
+        message = e.what();
+    } catch (...) {
+        code = -32603;
+        message = "The handler of '" + name + "' failed";
+    }
+}
+
+void Plugin::dispatch(const DispatchEntry &entry, Json::Value &params, const bool &isRequest,
+                    const std::string &reqId)
+{
+    bool timed = instrumentation.isEnabled();
+    if (isRequest && (entry.asyncHook || (!entry.rawHook && !entry.hook && entry.method && entry.method->asyncMainFunc))) {
+        // Answered whenever the handler completes, which records the time it took
+        RpcResponder responder(output, reqId, timed ? &instrumentation : nullptr, operationName(entry, isRequest));
+        pending.add(responder);
+        try {
+            if (entry.asyncHook)
+                (*entry.asyncHook)(params, responder);
+            else
+                entry.method->asyncMainFunc(params, responder);
+        } catch (...) {
+            int code;
+            std::string message;
+            handlerError(*entry.name, code, message);
+            // A no-op if the handler answered before throwing
+            responder.reject(code, message);
+        }
+        return;
+    }
+
+    std::chrono::steady_clock::time_point start, handled;
+    if (timed)
+        start = std::chrono::steady_clock::now();
+
+    Json::Value result;
+    std::string rawResult;
+    bool raw = false;
+    try {
+        if (!isRequest) {
+            if (entry.notification)
+                (*entry.notification)(params);
+        } else if (entry.rawHook) {
+            rawResult = (*entry.rawHook)(params);
+            raw = true;
+        } else if (entry.hook) {
+            result = (*entry.hook)(params);
+        } else if (entry.method && entry.method->rawMainFunc) {
+            rawResult = entry.method->rawMainFunc(params);
+            raw = true;
+        } else if (entry.method) {
+            result = entry.method->mainFunc(params);
+        }
+    } catch (...) {
+        // Whether executed here or by a worker, the error is the answer to the request. Notifications
+        // can't be answered, their failure is only recorded by the instrumentation.
+        int code;
+        std::string message;
+        handlerError(*entry.name, code, message);
+        size_t written = isRequest ? output.writeError(reqId, code, message) : 0;
+        if (timed)
+            instrumentation.record(operationName(entry, isRequest), Instrumentation::microsSince(start), true,
+                                   0, written);
+        return;
+    }
+    if (timed)
+        handled = std::chrono::steady_clock::now();
+
+    size_t written = 0;
+    if (isRequest)
+        written = raw ? output.writeRawResult(reqId, rawResult) : output.writeResult(reqId, result);
+    if (timed) {
+        instrumentation.record(operationName(entry, isRequest),
+                               std::chrono::duration_cast<std::chrono::microseconds>(handled - start).count(),
+                               false, 0, written);
+        if (isRequest)
+            instrumentation.record("write", Instrumentation::microsSince(handled), false, 0, written);
+    }
+}
+
+void Plugin::dispatchDbWrite(const PluginMessage &message, const std::chrono::steady_clock::time_point &received)
+{
+    bool timed = instrumentation.isEnabled();
+    if (!dbWrite.parse(message.params, message.params + message.paramsLength)) {
+        // lightningd waits for the answer to every write, don't leave it hanging
+        size_t written = output.writeError(message.getId(), -32602, "Could not parse the db_write parameters");
+        if (timed)
+            instrumentation.record("parse", Instrumentation::microsSince(received), true, message.paramsLength, written);
+        return;
+    }
+    std::chrono::steady_clock::time_point parsed, handled;
+    if (timed)
+        parsed = std::chrono::steady_clock::now();
+    bool persisted = false, threw = false;
+    int code;
+    std::string error;
+    try {
+        persisted = dbWriteHandler(dbWrite);
+    } catch (...) {
+        // lightningd stops on an error as on "false", but with the reason in its log
+        handlerError("db_write", code, error);
+        threw = true;
+    }
+    if (timed)
+        handled = std::chrono::steady_clock::now();
+    size_t written = threw ? output.writeError(message.getId(), code, error)
+                           : output.writeRawResult(message.getId(), persisted ? "true" : "false");
+    dbWriteLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - received).count());
+    if (timed) {
+        instrumentation.record("parse", std::chrono::duration_cast<std::chrono::microseconds>(parsed - received).count(),
+                               false, message.paramsLength);
+        instrumentation.record("hook:db_write",
+                               std::chrono::duration_cast<std::chrono::microseconds>(handled - parsed).count(),
+                               !persisted, 0, written);
+        instrumentation.record("write", Instrumentation::microsSince(handled), false, 0, written);
+    }
+}
+
+void Plugin::dispatchArena(const DispatchEntry &entry, const PluginMessage &message)
+{
+    bool timed = instrumentation.isEnabled();
+    std::chrono::steady_clock::time_point start, parsed, handled;
+    if (timed)
+        start = std::chrono::steady_clock::now();
+    const JsonView *params = JsonView::parse(message.params, message.params + message.paramsLength, arena);
+    if (!params) {
+        arena.reset();
+        // lightningd waits for the answer to its hooks
+        size_t written = output.writeError(message.getId(), -32602, "Could not parse the parameters of '"
+                                           + *entry.name + "'");
+        if (timed)
+            instrumentation.record("parse", Instrumentation::microsSince(start), true, message.paramsLength, written);
+        return;
+    }
+    if (timed)
+        parsed = std::chrono::steady_clock::now();
+
+    ArenaString result((ArenaAllocator<char>(arena)));
+    try {
+        (*entry.arenaHook)(*params, arena, result);
+    } catch (...) {
+        arena.reset();
+        // lightningd waits for the answer to its hooks
+        int code;
+        std::string error;
+        handlerError(*entry.name, code, error);
+        size_t written = output.writeError(message.getId(), code, error);
+        if (timed)
+            instrumentation.record(operationName(entry, true), Instrumentation::microsSince(parsed), true, 0, written);
+        return;
+    }
+    if (timed)
+        handled = std::chrono::steady_clock::now();
+    size_t written = output.writeRawResult(message.getId(), result.data(), result.size());
+    arena.reset();
+    if (timed) {
+        instrumentation.record("parse", std::chrono::duration_cast<std::chrono::microseconds>(parsed - start).count(),
+                               false, message.paramsLength);
+        instrumentation.record(operationName(entry, true),
+                               std::chrono::duration_cast<std::chrono::microseconds>(handled - parsed).count(),
+                               false, 0, written);
+        instrumentation.record("write", Instrumentation::microsSince(handled), false, 0, written);
+    }
+}
+
+/**
+ * A message handed to the worker pool
+ */
+struct PendingMessage {
+    const DispatchEntry *entry;
+    Json::Value params;
+    bool isRequest;
+    std::string id;
+};
+
 void Plugin::start()
 {
-    Json::Value msg;
-    Json::Reader reader;
-    std::string line;
+    MessageReader reader(STDIN_FILENO);
+    PluginMessage msg;
+    ThreadPool *pool = nullptr;
 
     rpcMethods.push_back(generateManifest());
     rpcMethods.push_back(generateInit());
+    // Methods, hooks and subscriptions can't change from now on
+    for (auto &method : rpcMethods)
+        dispatchTable.addMethod(method.getName(), &method);
+    for (auto &it : hookSubscriptions)
+        dispatchTable.addHook(it.first, &it.second);
+    for (auto &it : rawHookSubscriptions)
+        dispatchTable.addRawHook(it.first, &it.second);
+    for (auto &it : asyncHookSubscriptions)
+        dispatchTable.addAsyncHook(it.first, &it.second);
+    for (auto &it : arenaHookSubscriptions)
+        dispatchTable.addArenaHook(it.first, &it.second);
+    if (notificationWorkers) {
+        notificationQueue = new NotificationQueue(notificationWorkers, notificationPolicy, &instrumentation);
+        for (auto &it : batchSubscriptions)
+            dispatchTable.addQueuedNotification(it.first, notificationQueue->addTopic(it.first, it.second.first,
+                            notificationCapacity, it.second.second, notificationPriorities[it.first]));
+        for (auto &it : subscriptions) {
+            if (batchSubscriptions.count(it.first))
+                continue;
+            std::function<void(Json::Value&)> *handler = &it.second;
+            dispatchTable.addQueuedNotification(it.first, notificationQueue->addTopic(it.first,
+                            [handler](std::vector<Json::Value> &batch) {
+                                for (Json::Value &params : batch)
+                                    (*handler)(params);
+                            }, notificationCapacity, 64, notificationPriorities[it.first]));
+        }
+    } else {
+        for (auto &it : batchSubscriptions) {
+            std::function<void(std::vector<Json::Value>&)> handler = it.second.first;
+            subscriptions[it.first] = [handler](Json::Value &params) {
+                std::vector<Json::Value> batch(1);
+                batch[0].swap(params);
+                handler(batch);
+            };
+        }
+        for (auto &it : subscriptions)
+            dispatchTable.addNotification(it.first, &it.second);
+    }
+    dispatchTable.freeze();
+    const RpcMethod *manifest = &rpcMethods[rpcMethods.size() - 2], *init = &rpcMethods.back();
+    if (workers)
+        pool = new ThreadPool(workers);
 
-    while (getline(std::cin, line)) {
-        if (!reader.parse(line, msg, false))
-            continue;
-        if (!msg["method"] || !msg["params"] || !msg["jsonrpc"])
-            // Discard noise
-            continue;
-        Json::Value method = msg["method"];
-        if (!method)
-            continue;
-        Json::Value params = msg["params"];
-        // If this is a notification
-        if (!msg["id"]) {
-            auto it = subscriptions.find(method.asString());
-            if (it != subscriptions.end())
-                it->second(params);
-            continue;
+    auto handle = [&](const PluginMessage &msg) {
+        if (dbWriteHandler && msg.hasId && msg.methodLength == 8 && !memcmp(msg.method, "db_write", 8)) {
+            dispatchDbWrite(msg, std::chrono::steady_clock::now());
+            return;
         }
-        auto it = hookSubscriptions.find(method.asString());
-        if (it != hookSubscriptions.end()) {
-            printResponseSuccess(it->second(params), msg["id"].asString());
-            continue;
+        const DispatchEntry *entry = dispatchTable.find(msg.method, msg.methodLength);
+        if (entry && msg.hasId && entry->arenaHook) {
+            dispatchArena(*entry, msg);
+            return;
         }
-        for (unsigned int i = 0; i < rpcMethods.size(); i++) {
-            if (rpcMethods[i].getName() == method.asString()) {
-                Json::Value parameters = params;
-                printResponseSuccess(rpcMethods[i].mainFunc(parameters), msg["id"].asString());
-                break;
-            }
+        // Don't even parse the parameters if we have nothing to do with them
+        if (!entry || (msg.hasId && !entry->hook && !entry->rawHook && !entry->asyncHook && !entry->method)
+                || (!msg.hasId && !entry->notification && !entry->queuedTopic))
+            return;
+        Json::Value params;
+        bool timed = instrumentation.isEnabled();
+        std::chrono::steady_clock::time_point parseStart;
+        if (timed)
+            parseStart = std::chrono::steady_clock::now();
+        bool parsed = reader.parseParams(msg, params);
+        if (timed)
+            instrumentation.record("parse", Instrumentation::microsSince(parseStart), !parsed, msg.paramsLength);
+        if (!parsed) {
+            // lightningd may be waiting for the answer, e.g. to a hook
+            if (msg.hasId)
+                output.writeError(msg.getId(), -32602, "Could not parse the parameters of '" + *entry->name + "'");
+            return;
+        }
+        if (!msg.hasId && entry->queuedTopic) {
+            notificationQueue->push(entry->queuedTopic - 1, params);
+        } else if (!pool || entry->method == manifest || entry->method == init) {
+            dispatch(*entry, params, msg.hasId, msg.hasId ? msg.getId() : "");
+        } else {
+            std::shared_ptr<PendingMessage> pending = std::make_shared<PendingMessage>();
+            pending->entry = entry;
+            pending->params.swap(params);
+            pending->isRequest = msg.hasId;
+            if (msg.hasId)
+                pending->id = msg.getId();
+            pool->submit([this, pending]() {
+                dispatch(*pending->entry, pending->params, pending->isRequest, pending->id);
+            });
+        }
+    };
+
+    bool watched = loop.addFd(STDIN_FILENO, [&](uint32_t) {
+        if (!reader.fill()) {
+            loop.removeFd(STDIN_FILENO);
+            loop.stop();
+            return;
+        }
+        while (reader.nextBuffered(msg))
+            handle(msg);
+    });
+    if (watched) {
+        loop.run();
+    } else {
+        // epoll can't watch a regular file (e.g. a replayed session) nor /dev/null, which are always
+        // readable anyway : our timers and file descriptors are served in between their messages instead
+        while (reader.next(msg)) {
+            handle(msg);
+            loop.poll();
         }
     }
+    // Wait for the pending requests to complete
+    if (pool)
+        delete pool;
 }
 
 void Plugin::subscribe(const std::string name, std::function<void(Json::Value&)> handler)
@@ -152,3 +547,29 @@ void Plugin::subscribe(const std::string name, std::function<void(Json::Value&)>
     // overrides if entry is already present
     subscriptions[name] = handler;
 }
+
+void Plugin::subscribeBatch(const std::string name, std::function<void(std::vector<Json::Value>&)> handler,
+                    const size_t &maxBatch)
+{
+    batchSubscriptions[name] = std::make_pair(handler, maxBatch);
+}
+
+void Plugin::queueNotifications(const unsigned int &workers, const size_t &capacity,
+                    const NotificationQueue::OverflowPolicy &policy)
+{
+    notificationWorkers = workers;
+    notificationCapacity = capacity;
+    notificationPolicy = policy;
+}
+
+void Plugin::setNotificationPriority(const std::string &name, const int &priority)
+{
+    notificationPriorities[name] = priority;
+}
+
+std::vector<NotificationTopicStats> Plugin::getNotificationStats()
+{
+    if (!notificationQueue)
+        return std::vector<NotificationTopicStats>();
+    return notificationQueue->getStats();
+}
@@ -1,24 +1,50 @@
 #ifndef LIGHTNINGCPP_PLUGIN_H
 #define LIGHTNINGCPP_PLUGIN_H
 
+#include "arena.h"
 #include "clightningrpc.h"
+#include "dbwrite.h"
+#include "dispatchtable.h"
+#include "instrumentation.h"
+#include "jsonview.h"
+#include "latencyhistogram.h"
+#include "messagereader.h"
+#include "notificationqueue.h"
+#include "pendingrequests.h"
+#include "pluginloop.h"
+#include "responsewriter.h"
 #include "rpcmethod.h"
+#include "rpcresponder.h"
 
+#include <chrono>
 #include <functional>
 #include <jsonrpccpp/client.h>
 #include <map>
+#include <mutex>
 #include <vector>
 
 class Plugin {
 
 public:
-    Plugin();
+    /**
+     * @param workers If not 0, requests are executed concurrently by this many worker
+     *                threads instead of one after the other by start() (defaults to 0)
+     */
+    Plugin(const unsigned int &workers=0);
     ~Plugin();
     
     /**
      * The Plugin main loop.
      *
-     * It listens for incoming JSONRPC requests on stdout.
+     * It listens for incoming JSONRPC requests on stdin. Only the envelope of the
+     * messages is scanned, and their parameters are parsed once and handed to the
+     * handlers by reference. The timers and file descriptors added to the plugin
+     * are served by the same epoll loop, until stdin is closed.
+     *
+     * With workers, requests are read and parsed here then handed to the worker
+     * pool, and their responses are written as soon as they complete (in any order,
+     * lightningd matches them by id). "getmanifest" and "init" are still handled
+     * in place as they configure the plugin. Handlers must then be thread-safe.
      */
     void start();
 
@@ -47,6 +73,38 @@ public:
      */
     void subscribe(const std::string name, std::function<void(Json::Value&)> handler);
 
+    /**
+     * Subscribe to a lightningd notification with a handler receiving the queued notifications
+     * by batches, see queueNotifications(). Without a queue, each batch is a single notification.
+     *
+     * @param name The name/type of the notification ("forward_event", ..)
+     * @param handler The function to be executed upon notifications reception
+     * @param maxBatch The maximum number of notifications handed at once
+     */
+    void subscribeBatch(const std::string name, std::function<void(std::vector<Json::Value>&)> handler,
+                    const size_t &maxBatch=64);
+
+    /**
+     * Hands the notifications to `workers` dedicated threads instead of executing their handlers
+     * in start(), so that a burst of them doesn't delay the hook calls and requests.
+     *
+     * Each notification name gets a bounded queue of `capacity` notifications. When it's full,
+     * notifications are either dropped or waited for room depending on `policy`. Handlers must
+     * then be thread-safe.
+     */
+    void queueNotifications(const unsigned int &workers, const size_t &capacity=1024,
+                    const NotificationQueue::OverflowPolicy &policy=NotificationQueue::DROP);
+
+    /**
+     * Queued notifications with a higher priority are handled first (defaults to 0).
+     */
+    void setNotificationPriority(const std::string &name, const int &priority);
+
+    /**
+     * The counters of the notification queues, empty if notifications are not queued.
+     */
+    std::vector<NotificationTopicStats> getNotificationStats();
+
     /**
      * Subscribe to a lightningd hook.
      *
@@ -55,17 +113,173 @@ public:
      */
     void hookSubscribe(const std::string name, std::function<Json::Value(Json::Value&)> handler);
 
+    /**
+     * Subscribe to a lightningd hook with a handler returning its result already serialized
+     * as JSON, which is written as is in the response.
+     *
+     * @param name The name/type of the hook ("db_write", "htlc", ..)
+     * @param handler The function to be executed upon hook triggering
+     */
+    void hookSubscribeRaw(const std::string name, std::function<std::string(Json::Value&)> handler);
+
+    /**
+     * Subscribe to a lightningd hook with a handler which may answer after returning.
+     *
+     * The handler can keep the responder in the callback of an asynchronous `rpc` command
+     * or of a timer (see addTimer()), and the plugin keeps serving other messages meanwhile.
+     * The callbacks of `rpc` commands are executed by the RPC event loop thread, concurrently
+     * with the handlers executed by start(). If the handler throws before answering, the
+     * request is answered with an error.
+     *
+     * @param name The name/type of the hook ("htlc_accepted", ..)
+     * @param handler The function to be executed upon hook triggering
+     */
+    void hookSubscribeAsync(const std::string name, std::function<void(Json::Value&, RpcResponder)> handler);
+
+    /**
+     * Subscribe to a lightningd hook whose calls are held until an external decision, e.g.
+     * "htlc_accepted" for HTLC interception.
+     *
+     * Like hookSubscribeAsync(), but the handler doesn't need to keep the responder : the call
+     * can be answered by id from any thread through getPendingRequests(), and is answered with
+     * `onTimeout` if it's still pending after `timeout`.
+     *
+     * @param name The name/type of the hook
+     * @param timeout How long a call can be held
+     * @param onTimeout The result of the calls held for too long, e.g. {"result": "continue"}
+     * @param handler The function to be executed upon hook triggering
+     */
+    void hookSubscribeDeferred(const std::string name, const std::chrono::milliseconds &timeout,
+                    const Json::Value &onTimeout, std::function<void(Json::Value&, RpcResponder)> handler);
+
+    /**
+     * The requests to the asynchronous handlers which were not answered yet.
+     */
+    PendingRequests &getPendingRequests();
+
+    /**
+     * Executes `callback` from start(), every `interval` or once after it (e.g. to answer a
+     * request later), in between lightningd's messages. It can be used from any thread, a
+     * handler included, and must not block. When stdin can't be watched by epoll (a regular
+     * file such as a replayed session, or /dev/null), timers are only served in between its
+     * messages, until its end. A timer throwing is reported on stderr.
+     *
+     * @return An identifier to remove the timer with
+     */
+    int addTimer(const std::chrono::milliseconds &interval, const std::function<void()> &callback,
+                    const bool &repeat=true);
+    void removeTimer(const int &timer);
+
+    /**
+     * Executes `callback` from start() with the ready events whenever `fd` is ready, e.g. to serve
+     * a socket of our own. It must be removed before being closed. As for timers, when stdin can't
+     * be watched by epoll it is only served in between its messages.
+     *
+     * @param events The events to wait for (defaults to EPOLLIN)
+     * @throw CLightningPluginException if epoll can't watch it, e.g. a regular file
+     */
+    void addFd(const int &fd, const std::function<void(uint32_t)> &callback, const uint32_t &events=EPOLLIN);
+    void removeFd(const int &fd);
+
+    /**
+     * Our RPC wrapper, or nullptr until lightningd initialized the plugin.
+     */
+    CLightningRpc *getRpc();
+
+    /**
+     * Subscribe to a lightningd hook with a handler which doesn't touch the heap once warmed up.
+     *
+     * The parameters are parsed into a per-request arena as a JsonView pointing into the message
+     * read from lightningd, the handler may use the arena as scratch space, and appends the JSON
+     * text of its result to `result` which lives in the arena as well. Everything is released at
+     * once after the response is written. The handler is always executed by start(), as the
+     * parameters are only valid until the next read.
+     *
+     * @param name The name/type of the hook ("htlc_accepted", ..)
+     * @param handler The function to be executed upon hook triggering
+     */
+    void hookSubscribeArena(const std::string name,
+                    std::function<void(const JsonView &params, Arena &arena, ArenaString &result)> handler);
+
+    /**
+     * The arena of the hooks subscribed with hookSubscribeArena(), e.g. for its capacity.
+     */
+    const Arena &getArena() const;
+
+    /**
+     * Subscribe to the "db_write" hook without building a Json::Value of its parameters.
+     *
+     * The handler gets the statements as views into the message read from lightningd,
+     * and is always executed by start() as lightningd waits for our answer before
+     * doing anything else. It takes precedence over a "db_write" hookSubscribe().
+     *
+     * @param handler Returns whether the writes were persisted, if not lightningd stops
+     */
+    void dbWriteSubscribe(std::function<bool(const DbWrite&)> handler);
+
+    /**
+     * The time taken to acknowledge each "db_write", from the reception of the hook call
+     * to the write of our response, in microseconds.
+     */
+    const LatencyHistogram &getDbWriteLatency() const;
+
+    /**
+     * The time spent in each handler ("method:<name>", "hook:<name>", "notification:<name>")
+     * with the size of its responses, in parsing the parameters of the messages ("parse") and
+     * in writing the responses ("write"), once enabled with `getInstrumentation().setEnabled(true)`.
+     */
+    Instrumentation &getInstrumentation();
+
+    /**
+     * Enables the instrumentation and writes it to lightningd's log every `interval`, one
+     * line per operation, skipping those which were not called since the last time.
+     */
+    void logInstrumentation(const std::chrono::milliseconds &interval);
+
 protected:
     // Our RPC wrapper
     CLightningRpc *rpc;
+    // The number of worker threads executing requests, 0 to execute them in start()
+    unsigned int workers;
+    // Writes our responses to stdout
+    ResponseWriter output;
+    // Serves stdin, our timers and file descriptors
+    PluginLoop loop;
     // Our RPC methods added to lightningd
     std::vector<RpcMethod> rpcMethods;
     // Our options added to lightningd startup
     Json::Value options;
     // Our subscriptions to lightningd notifications
     std::map<std::string, std::function<void(Json::Value&)>> subscriptions;
+    // Our subscriptions to lightningd notifications handled by batches, and their maximum size
+    std::map<std::string, std::pair<std::function<void(std::vector<Json::Value>&)>, size_t>> batchSubscriptions;
     // Our subscriptions to lightningd notifications
     std::map<std::string, std::function<Json::Value(Json::Value&)>> hookSubscriptions;
+    // Our subscriptions to lightningd hooks which return pre-serialized JSON
+    std::map<std::string, std::function<std::string(Json::Value&)>> rawHookSubscriptions;
+    // Our subscriptions to lightningd hooks handled in an arena
+    std::map<std::string, std::function<void(const JsonView&, Arena&, ArenaString&)>> arenaHookSubscriptions;
+    // The memory of their requests, reset after each response
+    Arena arena;
+    // Our subscriptions to lightningd hooks which may answer after returning
+    std::map<std::string, std::function<void(Json::Value&, RpcResponder)>> asyncHookSubscriptions;
+    // Our "db_write" fast path subscription
+    std::function<bool(const DbWrite&)> dbWriteHandler;
+    // The parameters of the last "db_write", reused to avoid allocations
+    DbWrite dbWrite;
+    LatencyHistogram dbWriteLatency;
+    Instrumentation instrumentation;
+    // The requests our asynchronous handlers did not answer yet
+    PendingRequests pending;
+    // All of the above by name, built when the plugin starts
+    DispatchTable dispatchTable;
+    // The number of threads handling the notifications, 0 to handle them in start()
+    unsigned int notificationWorkers;
+    size_t notificationCapacity;
+    NotificationQueue::OverflowPolicy notificationPolicy;
+    std::map<std::string, int> notificationPriorities;
+    // Created when the plugin starts if notifications are queued
+    NotificationQueue *notificationQueue;
 
     /**
      * Creates the callback function for the "manifest" method
@@ -88,6 +302,41 @@ protected:
      */
     void printResponseSuccess(const Json::Value &result, const std::string &reqId);
 
+    /**
+     * Prints a JSONRPC v2 response on stdout, whose result is already serialized
+     *
+     * @param rawResult The JSON text of the result
+     * @param reqId The JSON id of the request
+     */
+    void printRawResponseSuccess(const std::string &rawResult, const std::string &reqId);
+
+    /**
+     * Executes the handler of a message, and prints its response if it's a request. A
+     * request whose handler throws is answered with an error, whoever executes it.
+     *
+     * @param entry The handlers registered for its method
+     * @param params The parsed parameters of the message
+     * @param isRequest Whether the message is a request or a notification
+     * @param reqId The JSON id of the request
+     */
+    void dispatch(const DispatchEntry &entry, Json::Value &params, const bool &isRequest, const std::string &reqId);
+
+    /**
+     * Executes the "db_write" fast path handler and acknowledges the hook call
+     *
+     * @param message The hook call
+     * @param received When it was read
+     */
+    void dispatchDbWrite(const PluginMessage &message, const std::chrono::steady_clock::time_point &received);
+
+    /**
+     * Parses the parameters of a hook call into the arena, executes its handler and answers it
+     *
+     * @param entry The handlers registered for its method
+     * @param message The hook call
+     */
+    void dispatchArena(const DispatchEntry &entry, const PluginMessage &message);
+
 };
 
 #endif // LIGHTNINGCPP_PLUGIN_H
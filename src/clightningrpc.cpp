@@ -1,29 +1,129 @@
 #include "clightningrpc.h"
 #include "rpcexception.h"
 
-CLightningRpc::CLightningRpc(const std::string &socket_path)
+CLightningRpc::CLightningRpc(const std::string &socket_path, const unsigned int &poolSize, const bool &multiplexed):
+    socketPath(socket_path),
+    pool(nullptr),
+    multiplexed(multiplexed),
+    eventLoop(nullptr)
 {
     socketClient = new jsonrpc::UnixDomainSocketClient(socket_path);
     client = new jsonrpc::Client(*socketClient, jsonrpc::JSONRPC_CLIENT_V2);
+    if (poolSize)
+        pool = new RpcConnectionPool(socket_path, poolSize);
 }
 
 CLightningRpc::~CLightningRpc()
 {
     delete socketClient;
     delete client;
+    if (pool)
+        delete pool;
+    if (eventLoop)
+        delete eventLoop;
 }
 
-Json::Value CLightningRpc::sendCommand(const std::string &command, const Json::Value &arguments)
+RpcPoolStats CLightningRpc::getPoolStats()
+{
+    if (pool)
+        return pool->getStats();
+    RpcPoolStats stats = {};
+    return stats;
+}
+
+/**
+ * Always send parameters as an array for consistency
+ */
+static Json::Value normalizeArguments(const Json::Value &arguments)
 {
-    Json::Value res;
-    // Always send parameters as an array for consistency
     Json::Value args(Json::arrayValue);
     if (!arguments.isArray() && !arguments.empty() && !arguments.isObject())
         args[0] = arguments;
     else
         args = arguments;
+    return args;
+}
+
+Json::Value CLightningRpc::sendCommand(const std::string &command, const Json::Value &arguments)
+{
+    Json::Value args = normalizeArguments(arguments);
+    if (cache.isCached(command))
+        return cache.get(command, args, [this, &command, &args] { return call(command, args); });
+    try {
+        Json::Value res = call(command, args);
+        cache.completed(command);
+        return res;
+    } catch (...) {
+        // It may have changed things before failing
+        cache.completed(command);
+        throw;
+    }
+}
+
+/**
+ * A callback passing the result of a command, or its error, to a promise
+ */
+static RpcCallback fulfill(const std::shared_ptr<std::promise<Json::Value>> &promise)
+{
+    return [promise](const RpcResult &result) {
+        if (result.failed)
+            promise->set_exception(std::make_exception_ptr(CLightningRpcException(result.errorCode, result.errorMessage)));
+        else
+            promise->set_value(result.result);
+    };
+}
+
+/**
+ * Makes a call from the calling thread, recording its latency and the bytes it exchanged
+ */
+template <typename Call>
+static Json::Value instrumented(Instrumentation &instrumentation, const std::string &command, const Call &call)
+{
+    uint64_t sentBefore, receivedBefore, sent, received;
+    RpcConnection::getThreadTraffic(sentBefore, receivedBefore);
+    auto start = std::chrono::steady_clock::now();
     try {
-        res = client->CallMethod(command, args);
+        Json::Value res = call();
+        RpcConnection::getThreadTraffic(sent, received);
+        instrumentation.record(command, Instrumentation::microsSince(start), false, received - receivedBefore,
+                               sent - sentBefore);
+        return res;
+    } catch (...) {
+        RpcConnection::getThreadTraffic(sent, received);
+        instrumentation.record(command, Instrumentation::microsSince(start), true, received - receivedBefore,
+                               sent - sentBefore);
+        throw;
+    }
+}
+
+Json::Value CLightningRpc::call(const std::string &command, const Json::Value &args)
+{
+    // Multiplexed commands are recorded by queueCommand()
+    if (!instrumentation.isEnabled() || multiplexed)
+        return callTransport(command, args);
+    return instrumented(instrumentation, command, [this, &command, &args] { return callTransport(command, args); });
+}
+
+Json::Value CLightningRpc::callTransport(const std::string &command, const Json::Value &args)
+{
+    Json::Value res;
+    // The response would have to be read by the very thread waiting for it
+    if (multiplexed && getEventLoop()->isLoopThread())
+        throw CLightningRpcException(1, "Can't wait for '" + command + "' from the event loop thread, use sendCommandAsync()");
+    try {
+        if (multiplexed) {
+            // Not through sendCommandAsync(), our caller takes care of the cache
+            auto promise = std::make_shared<std::promise<Json::Value>>();
+            queueCommand(command, args, fulfill(promise));
+            res = promise->get_future().get();
+        } else if (pool) {
+            res = pool->call(command, args);
+        } else {
+            std::lock_guard<std::mutex> lock(clientMutex);
+            res = client->CallMethod(command, args);
+        }
+    } catch (CLightningRpcException &e) {
+        throw;
     } catch (jsonrpc::JsonRpcException &e) {
         throw CLightningRpcException(e.GetCode(), e.GetMessage());
     } catch (std::exception &e) {
@@ -34,16 +134,256 @@ Json::Value CLightningRpc::sendCommand(const std::string &command, const Json::V
     return res;
 }
 
-Json::Value CLightningRpc::autoCleanInvoice(const unsigned int &cycleSeconds, const unsigned int &expiredBy)
+Json::Value CLightningRpc::sendCommand(const RpcRequest &request)
+{
+    return sendCommand(request.command, request.params);
+}
+
+ResponseCache &CLightningRpc::getCache()
+{
+    return cache;
+}
+
+Instrumentation &CLightningRpc::getInstrumentation()
+{
+    return instrumentation;
+}
+
+RpcEventLoop *CLightningRpc::getEventLoop()
+{
+    std::lock_guard<std::mutex> lock(eventLoopMutex);
+    if (!eventLoop)
+        eventLoop = new RpcEventLoop(socketPath);
+    return eventLoop;
+}
+
+void CLightningRpc::queueCommand(const std::string &command, const Json::Value &args, RpcCallback callback)
+{
+    if (instrumentation.isEnabled()) {
+        RpcCallback done = callback;
+        auto start = std::chrono::steady_clock::now();
+        callback = [this, command, done, start](const RpcResult &result) {
+            instrumentation.record(command, Instrumentation::microsSince(start), result.failed);
+            done(result);
+        };
+    }
+    getEventLoop()->call(command, args, callback);
+}
+
+void CLightningRpc::sendCommandAsync(const std::string &command, const Json::Value &arguments, RpcCallback callback)
+{
+    if (cache.invalidates(command)) {
+        RpcCallback done = callback;
+        callback = [this, command, done](const RpcResult &result) {
+            cache.completed(command);
+            done(result);
+        };
+    }
+    queueCommand(command, normalizeArguments(arguments), callback);
+}
+
+std::future<Json::Value> CLightningRpc::sendCommandAsync(const std::string &command, const Json::Value &arguments)
+{
+    auto promise = std::make_shared<std::promise<Json::Value>>();
+    sendCommandAsync(command, arguments, fulfill(promise));
+    return promise->get_future();
+}
+
+std::future<Json::Value> CLightningRpc::sendCommandAsync(const RpcRequest &request)
+{
+    return sendCommandAsync(request.command, request.params);
+}
+
+void CLightningRpc::addTimer(const std::chrono::milliseconds &delay, const std::function<void()> &callback)
+{
+    getEventLoop()->addTimer(delay, callback);
+}
+
+std::vector<RpcResult> CLightningRpc::sendBatch(const std::vector<RpcRequest> &commands)
+{
+    std::vector<RpcRequest> requests(commands);
+    for (auto &request : requests)
+        request.params = normalizeArguments(request.params);
+    if (multiplexed) {
+        if (getEventLoop()->isLoopThread())
+            throw CLightningRpcException(1, "Can't wait for a batch from the event loop thread, use sendCommandAsync()");
+        std::vector<std::shared_ptr<std::promise<RpcResult>>> promises;
+        for (const auto &request : requests) {
+            auto promise = std::make_shared<std::promise<RpcResult>>();
+            // Each recorded as a command of its own
+            queueCommand(request.command, request.params, [promise](const RpcResult &result) {
+                promise->set_value(result);
+            });
+            promises.push_back(promise);
+        }
+        std::vector<RpcResult> results;
+        for (auto &promise : promises)
+            results.push_back(promise->get_future().get());
+        for (const auto &request : requests)
+            cache.completed(request.command);
+        return results;
+    }
+    if (pool) {
+        std::vector<RpcResult> results;
+        if (!instrumentation.isEnabled()) {
+            results = pool->callBatch(requests);
+        } else {
+            // Pipelined, the commands have no latency of their own : the batch is recorded as a whole
+            instrumented(instrumentation, "batch", [this, &requests, &results] {
+                results = pool->callBatch(requests);
+                return Json::Value();
+            });
+        }
+        for (const auto &request : requests)
+            cache.completed(request.command);
+        return results;
+    }
+
+    // Without persistent connections, we can't do better than one round trip per command
+    std::vector<RpcResult> results;
+    for (const auto &request : requests) {
+        RpcResult result;
+        result.failed = false;
+        result.errorCode = 0;
+        try {
+            result.result = sendCommand(request.command, request.params);
+        } catch (CLightningRpcException &e) {
+            result.failed = true;
+            result.errorCode = e.getCode();
+            result.errorMessage = e.what();
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+
+Json::Value CLightningRpc::sendCommandStreaming(const std::string &command, const Json::Value &arguments,
+            const std::string &member, const std::function<void(Json::Value&)> &onElement)
+{
+    Json::Value args = normalizeArguments(arguments);
+    auto stream = [this, &command, &args, &member, &onElement] {
+        // Exceptions thrown by the callback are passed through as is
+        if (pool)
+            return pool->callStreaming(command, args, member, onElement);
+        RpcConnection connection(socketPath);
+        return connection.callStreaming(command, args, member, onElement);
+    };
+    if (!instrumentation.isEnabled())
+        return stream();
+    return instrumented(instrumentation, command, stream);
+}
+
+void CLightningRpc::sendCommandRaw(const std::string &command, const Json::Value &arguments,
+            const std::function<void(const char*, const char*)> &onResult)
+{
+    Json::Value args = normalizeArguments(arguments);
+    auto callRaw = [this, &command, &args, &onResult] {
+        if (pool) {
+            pool->callRaw(command, args, onResult);
+        } else {
+            RpcConnection connection(socketPath);
+            connection.callRaw(command, args, onResult);
+        }
+        return Json::Value();
+    };
+    if (!instrumentation.isEnabled())
+        callRaw();
+    else
+        instrumented(instrumentation, command, callRaw);
+}
+
+/**
+ * Sends a request and decodes its result into a typed result
+ */
+template <typename Result>
+static void decodeInto(CLightningRpc &rpc, const RpcRequest &request, Result &result, Interner &nodeIds)
+{
+    rpc.sendCommandRaw(request.command, request.params, [&](const char *begin, const char *end) {
+        if (!result.decode(begin, end, nodeIds))
+            throw CLightningRpcException(1, "Could not decode the result of " + request.command);
+    });
+}
+
+/**
+ * Sends a request and decodes its result into a typed result which doesn't hold node ids
+ */
+template <typename Result>
+static void decodeInto(CLightningRpc &rpc, const RpcRequest &request, Result &result)
+{
+    rpc.sendCommandRaw(request.command, request.params, [&](const char *begin, const char *end) {
+        if (!result.decode(begin, end))
+            throw CLightningRpcException(1, "Could not decode the result of " + request.command);
+    });
+}
+
+void CLightningRpc::getInfo(GetInfoResult &result)
+{
+    decodeInto(*this, getInfoRequest(), result, nodeIds);
+}
+
+void CLightningRpc::listPeers(ListPeersResult &result, const std::string &id, const std::string &level)
+{
+    decodeInto(*this, listPeersRequest(id, level), result, nodeIds);
+}
+
+void CLightningRpc::listFunds(ListFundsResult &result)
+{
+    decodeInto(*this, listFundsRequest(), result, nodeIds);
+}
+
+void CLightningRpc::listInvoices(ListInvoicesResult &result, const std::string &label)
+{
+    decodeInto(*this, listInvoicesRequest(label), result);
+}
+
+void CLightningRpc::listChannels(ListChannelsResult &result, const std::string &scid, const std::string &source)
+{
+    decodeInto(*this, listChannelsRequest(scid, source), result, nodeIds);
+}
+
+void CLightningRpc::listNodes(ListNodesResult &result)
+{
+    decodeInto(*this, listNodesRequest(), result, nodeIds);
+}
+
+Interner &CLightningRpc::getNodeIds()
+{
+    return nodeIds;
+}
+
+void CLightningRpc::streamChannels(const std::function<void(Json::Value&)> &onChannel, const std::string &scid,
+            const std::string &source)
+{
+    RpcRequest request = listChannelsRequest(scid, source);
+    sendCommandStreaming(request.command, request.params, "channels", onChannel);
+}
+
+void CLightningRpc::streamNodes(const std::function<void(Json::Value&)> &onNode)
+{
+    RpcRequest request = listNodesRequest();
+    sendCommandStreaming(request.command, request.params, "nodes", onNode);
+}
+
+RpcRequest CLightningRpc::autoCleanInvoiceRequest(const unsigned int &cycleSeconds, const unsigned int &expiredBy)
 {
     std::string command = "autocleaninvoice";
     Json::Value params(Json::objectValue);
     params["cycle_seconds"] = cycleSeconds;
     params["expired_by"] = expiredBy;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::check(const std::string &commandToCheck, const Json::Value &parameters)
+Json::Value CLightningRpc::autoCleanInvoice(const unsigned int &cycleSeconds, const unsigned int &expiredBy)
+{
+    return sendCommand(autoCleanInvoiceRequest(cycleSeconds, expiredBy));
+}
+
+std::future<Json::Value> CLightningRpc::autoCleanInvoiceAsync(const unsigned int &cycleSeconds, const unsigned int &expiredBy)
+{
+    return sendCommandAsync(autoCleanInvoiceRequest(cycleSeconds, expiredBy));
+}
+
+RpcRequest CLightningRpc::checkRequest(const std::string &commandToCheck, const Json::Value &parameters)
 {
     if (!parameters.isObject())
         throw CLightningRpcException(1, "The parameters of the command to check must be a JSON object");
@@ -53,20 +393,40 @@ Json::Value CLightningRpc::check(const std::string &commandToCheck, const Json::
     for (const auto &key: parameters.getMemberNames()) {
         params[key] = parameters[key];
     }
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::close(const std::string &id, const bool &force, const unsigned int &timeout)
+Json::Value CLightningRpc::check(const std::string &commandToCheck, const Json::Value &parameters)
+{
+    return sendCommand(checkRequest(commandToCheck, parameters));
+}
+
+std::future<Json::Value> CLightningRpc::checkAsync(const std::string &commandToCheck, const Json::Value &parameters)
+{
+    return sendCommandAsync(checkRequest(commandToCheck, parameters));
+}
+
+RpcRequest CLightningRpc::closeRequest(const std::string &id, const bool &force, const unsigned int &timeout)
 {
     std::string command = "close";
     Json::Value params(Json::objectValue);
     params["id"] = id;
     params["force"] = force;
     params["timeout"] = timeout;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::connect(const std::string &id, const std::string &host, const unsigned int &port)
+Json::Value CLightningRpc::close(const std::string &id, const bool &force, const unsigned int &timeout)
+{
+    return sendCommand(closeRequest(id, force, timeout));
+}
+
+std::future<Json::Value> CLightningRpc::closeAsync(const std::string &id, const bool &force, const unsigned int &timeout)
+{
+    return sendCommandAsync(closeRequest(id, force, timeout));
+}
+
+RpcRequest CLightningRpc::connectRequest(const std::string &id, const std::string &host, const unsigned int &port)
 {
     std::string command = "connect";
     Json::Value params(Json::objectValue);
@@ -75,54 +435,114 @@ Json::Value CLightningRpc::connect(const std::string &id, const std::string &hos
         params["host"] = host;
         params["port"] = port;
     }
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::decodepay(const std::string &bolt11, const std::string &description)
+Json::Value CLightningRpc::connect(const std::string &id, const std::string &host, const unsigned int &port)
+{
+    return sendCommand(connectRequest(id, host, port));
+}
+
+std::future<Json::Value> CLightningRpc::connectAsync(const std::string &id, const std::string &host, const unsigned int &port)
+{
+    return sendCommandAsync(connectRequest(id, host, port));
+}
+
+RpcRequest CLightningRpc::decodepayRequest(const std::string &bolt11, const std::string &description)
 {
     std::string command = "decodepay";
     Json::Value params(Json::objectValue);
     params["bolt11"] = bolt11;
     if (description != "")
         params["description"] = description;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::delExpiredInvoices(const unsigned int &maxExpiryTime)
+Json::Value CLightningRpc::decodepay(const std::string &bolt11, const std::string &description)
+{
+    return sendCommand(decodepayRequest(bolt11, description));
+}
+
+std::future<Json::Value> CLightningRpc::decodepayAsync(const std::string &bolt11, const std::string &description)
+{
+    return sendCommandAsync(decodepayRequest(bolt11, description));
+}
+
+RpcRequest CLightningRpc::delExpiredInvoicesRequest(const unsigned int &maxExpiryTime)
 {
     std::string command = "delexpiredinvoice";
     Json::Value params(Json::objectValue);
     params["maxexpirytime"] = maxExpiryTime;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::delInvoice(const std::string &label, const std::string &status)
+Json::Value CLightningRpc::delExpiredInvoices(const unsigned int &maxExpiryTime)
+{
+    return sendCommand(delExpiredInvoicesRequest(maxExpiryTime));
+}
+
+std::future<Json::Value> CLightningRpc::delExpiredInvoicesAsync(const unsigned int &maxExpiryTime)
+{
+    return sendCommandAsync(delExpiredInvoicesRequest(maxExpiryTime));
+}
+
+RpcRequest CLightningRpc::delInvoiceRequest(const std::string &label, const std::string &status)
 {
     std::string command = "delinvoice";
     Json::Value params(Json::objectValue);
     params["label"] = label;
     params["status"] = status;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::disconnect(const std::string &id, const bool &force)
+Json::Value CLightningRpc::delInvoice(const std::string &label, const std::string &status)
+{
+    return sendCommand(delInvoiceRequest(label, status));
+}
+
+std::future<Json::Value> CLightningRpc::delInvoiceAsync(const std::string &label, const std::string &status)
+{
+    return sendCommandAsync(delInvoiceRequest(label, status));
+}
+
+RpcRequest CLightningRpc::disconnectRequest(const std::string &id, const bool &force)
 {
     std::string command = "disconnect";
     Json::Value params(Json::objectValue);
     params["id"] = id;
     params["force"] = force;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::feerates(const std::string &style)
+Json::Value CLightningRpc::disconnect(const std::string &id, const bool &force)
+{
+    return sendCommand(disconnectRequest(id, force));
+}
+
+std::future<Json::Value> CLightningRpc::disconnectAsync(const std::string &id, const bool &force)
+{
+    return sendCommandAsync(disconnectRequest(id, force));
+}
+
+RpcRequest CLightningRpc::feeratesRequest(const std::string &style)
 {
     std::string command = "feerates";
     Json::Value params(Json::objectValue);
     params["style"] = style;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::fundChannel(const std::string &id, const unsigned int &sats, const unsigned int &feerate,
+Json::Value CLightningRpc::feerates(const std::string &style)
+{
+    return sendCommand(feeratesRequest(style));
+}
+
+std::future<Json::Value> CLightningRpc::feeratesAsync(const std::string &style)
+{
+    return sendCommandAsync(feeratesRequest(style));
+}
+
+RpcRequest CLightningRpc::fundChannelRequest(const std::string &id, const unsigned int &sats, const unsigned int &feerate,
         const bool &announce, const unsigned int &minconf)
 {
     std::string command = "fundchannel";
@@ -133,25 +553,57 @@ Json::Value CLightningRpc::fundChannel(const std::string &id, const unsigned int
         params["feerate"] = feerate;
     params["announce"] = announce;
     params["minconf"] = minconf;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::getInfo()
+Json::Value CLightningRpc::fundChannel(const std::string &id, const unsigned int &sats, const unsigned int &feerate,
+        const bool &announce, const unsigned int &minconf)
+{
+    return sendCommand(fundChannelRequest(id, sats, feerate, announce, minconf));
+}
+
+std::future<Json::Value> CLightningRpc::fundChannelAsync(const std::string &id, const unsigned int &sats, const unsigned int &feerate,
+        const bool &announce, const unsigned int &minconf)
+{
+    return sendCommandAsync(fundChannelRequest(id, sats, feerate, announce, minconf));
+}
+
+RpcRequest CLightningRpc::getInfoRequest()
 {
     std::string command = "getinfo";
     Json::Value params(Json::objectValue);
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::getLog(const std::string &level)
+Json::Value CLightningRpc::getInfo()
+{
+    return sendCommand(getInfoRequest());
+}
+
+std::future<Json::Value> CLightningRpc::getInfoAsync()
+{
+    return sendCommandAsync(getInfoRequest());
+}
+
+RpcRequest CLightningRpc::getLogRequest(const std::string &level)
 {
     std::string command = "getlog";
     Json::Value params(Json::objectValue);
     params["level"] = level;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::getRoute(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor,
+Json::Value CLightningRpc::getLog(const std::string &level)
+{
+    return sendCommand(getLogRequest(level));
+}
+
+std::future<Json::Value> CLightningRpc::getLogAsync(const std::string &level)
+{
+    return sendCommandAsync(getLogRequest(level));
+}
+
+RpcRequest CLightningRpc::getRouteRequest(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor,
         const unsigned int &cltv, const std::string &fromId, const float &fuzzPercent, const Json::Value &exclude,
         const unsigned int &maxhops)
 {
@@ -167,19 +619,51 @@ Json::Value CLightningRpc::getRoute(const std::string &id, const unsigned int &m
     if (!exclude.empty())
         params["exclude"] = exclude;
     params["maxhops"] = maxhops;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::help(const std::string &cmd)
+Json::Value CLightningRpc::getRoute(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor,
+        const unsigned int &cltv, const std::string &fromId, const float &fuzzPercent, const Json::Value &exclude,
+        const unsigned int &maxhops)
+{
+    return sendCommand(getRouteRequest(id, msats, riskfactor, cltv, fromId, fuzzPercent, exclude, maxhops));
+}
+
+std::future<Json::Value> CLightningRpc::getRouteAsync(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor,
+        const unsigned int &cltv, const std::string &fromId, const float &fuzzPercent, const Json::Value &exclude,
+        const unsigned int &maxhops)
+{
+    return sendCommandAsync(getRouteRequest(id, msats, riskfactor, cltv, fromId, fuzzPercent, exclude, maxhops));
+}
+
+RpcRequest CLightningRpc::helpRequest(const std::string &cmd)
 {
     std::string command = "help";
     Json::Value params(Json::objectValue);
-    if (command != "")
+    if (cmd != "")
         params["command"] = cmd;
-    return sendCommand(command, params)["help"];
+    return {command, params};
 }
 
-Json::Value CLightningRpc::invoice(const unsigned int &msat, const std::string &label, const std::string &description,
+Json::Value CLightningRpc::help(const std::string &cmd)
+{
+    return sendCommand(helpRequest(cmd))["help"];
+}
+
+std::future<Json::Value> CLightningRpc::helpAsync(const std::string &cmd)
+{
+    auto promise = std::make_shared<std::promise<Json::Value>>();
+    RpcRequest request = helpRequest(cmd);
+    sendCommandAsync(request.command, request.params, [promise](const RpcResult &result) {
+        if (result.failed)
+            promise->set_exception(std::make_exception_ptr(CLightningRpcException(result.errorCode, result.errorMessage)));
+        else
+            promise->set_value(result.result["help"]);
+    });
+    return promise->get_future();
+}
+
+RpcRequest CLightningRpc::invoiceRequest(const unsigned int &msat, const std::string &label, const std::string &description,
         const unsigned int &expiry, const Json::Value &fallbacks, const std::string &preimage)
 {
     std::string command = "invoice";
@@ -192,10 +676,22 @@ Json::Value CLightningRpc::invoice(const unsigned int &msat, const std::string &
         params["fallbacks"] = fallbacks;
     if (preimage != "")
         params["preimage"] = preimage;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listChannels(const std::string &scid, const std::string &source)
+Json::Value CLightningRpc::invoice(const unsigned int &msat, const std::string &label, const std::string &description,
+        const unsigned int &expiry, const Json::Value &fallbacks, const std::string &preimage)
+{
+    return sendCommand(invoiceRequest(msat, label, description, expiry, fallbacks, preimage));
+}
+
+std::future<Json::Value> CLightningRpc::invoiceAsync(const unsigned int &msat, const std::string &label, const std::string &description,
+        const unsigned int &expiry, const Json::Value &fallbacks, const std::string &preimage)
+{
+    return sendCommandAsync(invoiceRequest(msat, label, description, expiry, fallbacks, preimage));
+}
+
+RpcRequest CLightningRpc::listChannelsRequest(const std::string &scid, const std::string &source)
 {
     std::string command = "listchannels";
     Json::Value params(Json::objectValue);
@@ -203,58 +699,128 @@ Json::Value CLightningRpc::listChannels(const std::string &scid, const std::stri
         params["short_channel_id"] = scid;
     if (source != "")
         params["source"] = source;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listConfigs(const std::string &param)
+Json::Value CLightningRpc::listChannels(const std::string &scid, const std::string &source)
+{
+    return sendCommand(listChannelsRequest(scid, source));
+}
+
+std::future<Json::Value> CLightningRpc::listChannelsAsync(const std::string &scid, const std::string &source)
+{
+    return sendCommandAsync(listChannelsRequest(scid, source));
+}
+
+RpcRequest CLightningRpc::listConfigsRequest(const std::string &param)
 {
     std::string command = "listconfigs";
     Json::Value params(Json::objectValue);
     if (param != "")
         params["config"] = param;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listForwards()
+Json::Value CLightningRpc::listConfigs(const std::string &param)
+{
+    return sendCommand(listConfigsRequest(param));
+}
+
+std::future<Json::Value> CLightningRpc::listConfigsAsync(const std::string &param)
+{
+    return sendCommandAsync(listConfigsRequest(param));
+}
+
+RpcRequest CLightningRpc::listForwardsRequest()
 {
     std::string command = "listforwards";
     Json::Value params(Json::objectValue);
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listFunds()
+Json::Value CLightningRpc::listForwards()
+{
+    return sendCommand(listForwardsRequest());
+}
+
+std::future<Json::Value> CLightningRpc::listForwardsAsync()
+{
+    return sendCommandAsync(listForwardsRequest());
+}
+
+RpcRequest CLightningRpc::listFundsRequest()
 {
     std::string command = "listfunds";
     Json::Value params(Json::objectValue);
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listInvoices(const std::string &label)
+Json::Value CLightningRpc::listFunds()
+{
+    return sendCommand(listFundsRequest());
+}
+
+std::future<Json::Value> CLightningRpc::listFundsAsync()
+{
+    return sendCommandAsync(listFundsRequest());
+}
+
+RpcRequest CLightningRpc::listInvoicesRequest(const std::string &label)
 {
     std::string command = "listinvoices";
     Json::Value params(Json::objectValue);
     if (label != "")
         params["label"] = label;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listNodes()
+Json::Value CLightningRpc::listInvoices(const std::string &label)
+{
+    return sendCommand(listInvoicesRequest(label));
+}
+
+std::future<Json::Value> CLightningRpc::listInvoicesAsync(const std::string &label)
+{
+    return sendCommandAsync(listInvoicesRequest(label));
+}
+
+RpcRequest CLightningRpc::listNodesRequest()
 {
     std::string command = "listnodes";
     Json::Value params(Json::objectValue);
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listPays(const std::string &bolt11)
+Json::Value CLightningRpc::listNodes()
+{
+    return sendCommand(listNodesRequest());
+}
+
+std::future<Json::Value> CLightningRpc::listNodesAsync()
+{
+    return sendCommandAsync(listNodesRequest());
+}
+
+RpcRequest CLightningRpc::listPaysRequest(const std::string &bolt11)
 {
     std::string command = "listpays";
     Json::Value params(Json::objectValue);
     if (bolt11 != "")
         params["bolt11"] = bolt11;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listPayments(const std::string &bolt11, const std::string &payment_hash)
+Json::Value CLightningRpc::listPays(const std::string &bolt11)
+{
+    return sendCommand(listPaysRequest(bolt11));
+}
+
+std::future<Json::Value> CLightningRpc::listPaysAsync(const std::string &bolt11)
+{
+    return sendCommandAsync(listPaysRequest(bolt11));
+}
+
+RpcRequest CLightningRpc::listPaymentsRequest(const std::string &bolt11, const std::string &payment_hash)
 {
     std::string command = "listpayments";
     Json::Value params(Json::objectValue);
@@ -262,10 +828,20 @@ Json::Value CLightningRpc::listPayments(const std::string &bolt11, const std::st
         params["bolt11"] = bolt11;
     if (payment_hash != "")
         params["payment_hash"] = payment_hash;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listPeers(const std::string &id, const std::string &level)
+Json::Value CLightningRpc::listPayments(const std::string &bolt11, const std::string &payment_hash)
+{
+    return sendCommand(listPaymentsRequest(bolt11, payment_hash));
+}
+
+std::future<Json::Value> CLightningRpc::listPaymentsAsync(const std::string &bolt11, const std::string &payment_hash)
+{
+    return sendCommandAsync(listPaymentsRequest(bolt11, payment_hash));
+}
+
+RpcRequest CLightningRpc::listPeersRequest(const std::string &id, const std::string &level)
 {
     std::string command = "listpeers";
     Json::Value params(Json::objectValue);
@@ -273,29 +849,59 @@ Json::Value CLightningRpc::listPeers(const std::string &id, const std::string &l
         params["id"] = id;
     if (level != "")
         params["level"] = level;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::listSendPays(const std::string &bolt11, const std::string &payment_hash)
+Json::Value CLightningRpc::listPeers(const std::string &id, const std::string &level)
+{
+    return sendCommand(listPeersRequest(id, level));
+}
+
+std::future<Json::Value> CLightningRpc::listPeersAsync(const std::string &id, const std::string &level)
+{
+    return sendCommandAsync(listPeersRequest(id, level));
+}
+
+RpcRequest CLightningRpc::listSendPaysRequest(const std::string &bolt11, const std::string &payment_hash)
 {
     std::string command = "listsendpays";
-    Json::Value params(Json::arrayValue);
+    Json::Value params(Json::objectValue);
     if (bolt11 != "")
         params["bolt11"] = bolt11;
     if (payment_hash != "")
         params["payment_hash"] = payment_hash;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::newAddr(const std::string &type)
+Json::Value CLightningRpc::listSendPays(const std::string &bolt11, const std::string &payment_hash)
+{
+    return sendCommand(listSendPaysRequest(bolt11, payment_hash));
+}
+
+std::future<Json::Value> CLightningRpc::listSendPaysAsync(const std::string &bolt11, const std::string &payment_hash)
+{
+    return sendCommandAsync(listSendPaysRequest(bolt11, payment_hash));
+}
+
+RpcRequest CLightningRpc::newAddrRequest(const std::string &type)
 {
     std::string command = "newaddr";
     Json::Value params(Json::objectValue);
     params["addresstype"] = type;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::pay(const std::string &bolt11, const unsigned int &msats, const std::string &label,
+Json::Value CLightningRpc::newAddr(const std::string &type)
+{
+    return sendCommand(newAddrRequest(type));
+}
+
+std::future<Json::Value> CLightningRpc::newAddrAsync(const std::string &type)
+{
+    return sendCommandAsync(newAddrRequest(type));
+}
+
+RpcRequest CLightningRpc::payRequest(const std::string &bolt11, const unsigned int &msats, const std::string &label,
         const unsigned int &riskfactor, const float &maxFeePercent, const unsigned int &retryFor, 
         const unsigned int &maxDelay, const unsigned int exemptFee)
 {
@@ -316,29 +922,63 @@ Json::Value CLightningRpc::pay(const std::string &bolt11, const unsigned int &ms
         params["maxdelay"] = maxDelay;
     if (exemptFee)
         params["exemptfee"] = exemptFee;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::payStatus(const std::string &bolt11)
+Json::Value CLightningRpc::pay(const std::string &bolt11, const unsigned int &msats, const std::string &label,
+        const unsigned int &riskfactor, const float &maxFeePercent, const unsigned int &retryFor, 
+        const unsigned int &maxDelay, const unsigned int exemptFee)
+{
+    return sendCommand(payRequest(bolt11, msats, label, riskfactor, maxFeePercent, retryFor, maxDelay, exemptFee));
+}
+
+std::future<Json::Value> CLightningRpc::payAsync(const std::string &bolt11, const unsigned int &msats, const std::string &label,
+        const unsigned int &riskfactor, const float &maxFeePercent, const unsigned int &retryFor, 
+        const unsigned int &maxDelay, const unsigned int exemptFee)
+{
+    return sendCommandAsync(payRequest(bolt11, msats, label, riskfactor, maxFeePercent, retryFor, maxDelay, exemptFee));
+}
+
+RpcRequest CLightningRpc::payStatusRequest(const std::string &bolt11)
 {
     std::string command = "paystatus";
     Json::Value params(Json::objectValue);
     if (bolt11 != "")
         params["bolt11"] = bolt11;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::ping(const std::string &id, const unsigned int &len, const unsigned int &pongbytes)
+Json::Value CLightningRpc::payStatus(const std::string &bolt11)
+{
+    return sendCommand(payStatusRequest(bolt11));
+}
+
+std::future<Json::Value> CLightningRpc::payStatusAsync(const std::string &bolt11)
+{
+    return sendCommandAsync(payStatusRequest(bolt11));
+}
+
+RpcRequest CLightningRpc::pingRequest(const std::string &id, const unsigned int &len, const unsigned int &pongbytes)
 {
     std::string command = "ping";
     Json::Value params(Json::objectValue);
     params["id"] = id;
     params["len"] = len;
     params["pongbytes"] = pongbytes;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::sendPay(const std::string &route, const std::string &payment_hash, const std::string &label,
+Json::Value CLightningRpc::ping(const std::string &id, const unsigned int &len, const unsigned int &pongbytes)
+{
+    return sendCommand(pingRequest(id, len, pongbytes));
+}
+
+std::future<Json::Value> CLightningRpc::pingAsync(const std::string &id, const unsigned int &len, const unsigned int &pongbytes)
+{
+    return sendCommandAsync(pingRequest(id, len, pongbytes));
+}
+
+RpcRequest CLightningRpc::sendPayRequest(const std::string &route, const std::string &payment_hash, const std::string &label,
         const unsigned int &msats, const std::string &bolt11)
 {
     std::string command = "sendpay";
@@ -351,10 +991,22 @@ Json::Value CLightningRpc::sendPay(const std::string &route, const std::string &
         params["msatoshi"] = msats;
     if (bolt11 != "")
         params["bolt11"] = bolt11;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::setChannelFee(const std::string &id, const unsigned int &baseFee, const unsigned int &ppmFee)
+Json::Value CLightningRpc::sendPay(const std::string &route, const std::string &payment_hash, const std::string &label,
+        const unsigned int &msats, const std::string &bolt11)
+{
+    return sendCommand(sendPayRequest(route, payment_hash, label, msats, bolt11));
+}
+
+std::future<Json::Value> CLightningRpc::sendPayAsync(const std::string &route, const std::string &payment_hash, const std::string &label,
+        const unsigned int &msats, const std::string &bolt11)
+{
+    return sendCommandAsync(sendPayRequest(route, payment_hash, label, msats, bolt11));
+}
+
+RpcRequest CLightningRpc::setChannelFeeRequest(const std::string &id, const unsigned int &baseFee, const unsigned int &ppmFee)
 {
     std::string command = "setchannelfee";
     Json::Value params(Json::objectValue);
@@ -363,34 +1015,74 @@ Json::Value CLightningRpc::setChannelFee(const std::string &id, const unsigned i
         params["base"] = baseFee;
     if (ppmFee)
         params["ppm"] = ppmFee;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::stop()
+Json::Value CLightningRpc::setChannelFee(const std::string &id, const unsigned int &baseFee, const unsigned int &ppmFee)
+{
+    return sendCommand(setChannelFeeRequest(id, baseFee, ppmFee));
+}
+
+std::future<Json::Value> CLightningRpc::setChannelFeeAsync(const std::string &id, const unsigned int &baseFee, const unsigned int &ppmFee)
+{
+    return sendCommandAsync(setChannelFeeRequest(id, baseFee, ppmFee));
+}
+
+RpcRequest CLightningRpc::stopRequest()
 {
     std::string command = "stop";
     Json::Value params(Json::objectValue);
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::waitAnyInvoice(const unsigned int &lastpayIndex)
+Json::Value CLightningRpc::stop()
+{
+    return sendCommand(stopRequest());
+}
+
+std::future<Json::Value> CLightningRpc::stopAsync()
+{
+    return sendCommandAsync(stopRequest());
+}
+
+RpcRequest CLightningRpc::waitAnyInvoiceRequest(const unsigned int &lastpayIndex)
 {
     std::string command = "waitanyinvoice";
     Json::Value params(Json::objectValue);
     if (lastpayIndex)
         params["lastpay_index"] = lastpayIndex;
-    return sendCommand(command, params);
+    return {command, params};
+}
+
+Json::Value CLightningRpc::waitAnyInvoice(const unsigned int &lastpayIndex)
+{
+    return sendCommand(waitAnyInvoiceRequest(lastpayIndex));
+}
+
+std::future<Json::Value> CLightningRpc::waitAnyInvoiceAsync(const unsigned int &lastpayIndex)
+{
+    return sendCommandAsync(waitAnyInvoiceRequest(lastpayIndex));
 }
    
-Json::Value CLightningRpc::waitInvoice(const std::string &label)
+RpcRequest CLightningRpc::waitInvoiceRequest(const std::string &label)
 {
     std::string command = "waitinvoice";
     Json::Value params(Json::objectValue);
     params["label"] = label;
-    return sendCommand(command, params);
+    return {command, params};
 }
 
-Json::Value CLightningRpc::withdraw(const std::string &address, const unsigned int &sats, const unsigned int &feerate,
+Json::Value CLightningRpc::waitInvoice(const std::string &label)
+{
+    return sendCommand(waitInvoiceRequest(label));
+}
+
+std::future<Json::Value> CLightningRpc::waitInvoiceAsync(const std::string &label)
+{
+    return sendCommandAsync(waitInvoiceRequest(label));
+}
+
+RpcRequest CLightningRpc::withdrawRequest(const std::string &address, const unsigned int &sats, const unsigned int &feerate,
         const unsigned int &minconf)
 {
     std::string command = "withdraw";
@@ -401,5 +1093,17 @@ Json::Value CLightningRpc::withdraw(const std::string &address, const unsigned i
         params["feerate"] = feerate;
     if (minconf > 1)
         params["minconf"] = minconf;
-    return sendCommand(command, params);
+    return {command, params};
+}
+
+Json::Value CLightningRpc::withdraw(const std::string &address, const unsigned int &sats, const unsigned int &feerate,
+        const unsigned int &minconf)
+{
+    return sendCommand(withdrawRequest(address, sats, feerate, minconf));
+}
+
+std::future<Json::Value> CLightningRpc::withdrawAsync(const std::string &address, const unsigned int &sats, const unsigned int &feerate,
+        const unsigned int &minconf)
+{
+    return sendCommandAsync(withdrawRequest(address, sats, feerate, minconf));
 }
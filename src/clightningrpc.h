@@ -1,10 +1,18 @@
 #ifndef LIGHTNINGCPP_RPC_H
 #define LIGHTNINGCPP_RPC_H
 
+#include "instrumentation.h"
+#include "rpcconnection.h"
+#include "rpceventloop.h"
 #include "rpcexception.h"
+#include "rpcresults.h"
+#include "responsecache.h"
 
+#include <functional>
+#include <future>
 #include <jsonrpccpp/client.h>
 #include <jsonrpccpp/client/connectors/unixdomainsocketclient.h>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -13,15 +21,116 @@ class CLightningRpc
 private:
     jsonrpc::UnixDomainSocketClient *socketClient;
     jsonrpc::Client *client;
+    // libjson-rpc-cpp's client is not thread-safe
+    std::mutex clientMutex;
+    std::string socketPath;
+    // Our persistent connections, if enabled
+    RpcConnectionPool *pool;
+    // Whether blocking commands are multiplexed over the event loop connection
+    bool multiplexed;
+    // Drives the asynchronous commands, started on first use
+    RpcEventLoop *eventLoop;
+    std::mutex eventLoopMutex;
+    // The node ids of the typed results
+    Interner nodeIds;
+    ResponseCache cache;
+    Instrumentation instrumentation;
+
+    RpcEventLoop *getEventLoop();
+    /** Sends a command over the selected transport, bypassing the cache. */
+    Json::Value call(const std::string &command, const Json::Value &args);
+    Json::Value callTransport(const std::string &command, const Json::Value &args);
+    /** Queues a command on the event loop, recording it but leaving the cache to the caller. */
+    void queueCommand(const std::string &command, const Json::Value &args, RpcCallback callback);
 
 public:
-    CLightningRpc(const std::string &socket_path);
+    /**
+     * A CLightningRpc instance can be shared between threads. How well concurrent calls
+     * scale depends on the transport selected here : with the default one, commands are
+     * sent one at a time.
+     *
+     * @param socket_path The path to lightningd's "lightning-rpc" socket
+     * @param poolSize If not 0, keep this many connections open to lightningd and reuse them
+     *                 across calls instead of connecting for each command (defaults to 0).
+     *                 These connections frame and parse the messages themselves instead of
+     *                 going through libjson-rpc-cpp, 1 is the fastest choice for a single caller.
+     * @param multiplexed If set, send all commands over a single connection with any number
+     *                 of them in flight, as the asynchronous ones are (defaults to false). The
+     *                 blocking commands then throw if called from the event loop thread, e.g.
+     *                 from an asynchronous callback, instead of waiting for ever.
+     */
+    CLightningRpc(const std::string &socket_path, const unsigned int &poolSize=0, const bool &multiplexed=false);
     ~CLightningRpc();
 
+    /**
+     * Get the health counters of the connection pool (all zero if it's not enabled).
+     */
+    RpcPoolStats getPoolStats();
+
+    /**
+     * The cache of the results of the blocking commands, which caches nothing until a time to
+     * live is set for a command, e.g. `getCache().setTtl("getinfo", std::chrono::seconds(5))`.
+     */
+    ResponseCache &getCache();
+
+    /**
+     * The calls, errors, latency and bytes exchanged of each command sent to lightningd, once
+     * enabled with `getInstrumentation().setEnabled(true)`. Bytes are only counted over the
+     * native connections (with a pool, or for the streamed and typed commands). The batches
+     * pipelined over a pooled connection are recorded as a whole, under "batch".
+     */
+    Instrumentation &getInstrumentation();
+
     /**
      * Sends a JSON-RPC command to the C-Lightning socket. Used by all methods to communicate with lightningd.
+     *
+     * The results of the commands given a time to live in getCache() may come from there.
      */
     Json::Value sendCommand(const std::string &command, const Json::Value &arguments);
+    Json::Value sendCommand(const RpcRequest &request);
+
+    /**
+     * Sends a JSON-RPC command without waiting for the response.
+     *
+     * All asynchronous commands are multiplexed over a single connection by an
+     * internal event loop thread, whatever the pool size.
+     *
+     * @param callback Executed from the event loop thread upon completion, so it must not block.
+     * @return If no callback is passed, a future which will hold the result, or throw a
+     *         CLightningRpcException.
+     */
+    void sendCommandAsync(const std::string &command, const Json::Value &arguments, RpcCallback callback);
+    std::future<Json::Value> sendCommandAsync(const std::string &command, const Json::Value &arguments);
+    std::future<Json::Value> sendCommandAsync(const RpcRequest &request);
+
+    /**
+     * Executes `callback` after `delay` from the thread running the asynchronous commands'
+     * callbacks, so it must not block either.
+     */
+    void addTimer(const std::chrono::milliseconds &delay, const std::function<void()> &callback);
+
+    /**
+     * Sends several commands at once. With a connection pool, they are pipelined over a single
+     * connection and their responses matched by id, instead of waiting for each one in turn.
+     *
+     * @param commands The commands to send along with their parameters
+     * @return The result (or lightningd error) of each command, in the same order
+     */
+    std::vector<RpcResult> sendBatch(const std::vector<RpcRequest> &commands);
+
+    /**
+     * Sends a JSON-RPC command whose result holds a (potentially huge) array, and hands
+     * its elements to a callback as they are read from the socket. Only one element is
+     * held in memory at a time.
+     *
+     * It uses a pooled connection if any, or a connection of its own otherwise.
+     *
+     * @param member The member of the result holding the array (e.g. "channels")
+     * @param onElement Called with each element of the array, in order, from the calling thread
+     * @return The rest of the result, in which the array is empty
+     */
+    Json::Value sendCommandStreaming(const std::string &command, const Json::Value &arguments,
+            const std::string &member, const std::function<void(Json::Value&)> &onElement);
 
     /**
      * Sets up automatic cleaning of expired invoices.
@@ -279,6 +388,133 @@ public:
      */
     Json::Value withdraw(const std::string &address, const unsigned int &sats, const unsigned int &feerate=0,
             const unsigned int &minconf=1);
+
+    /**
+     * Sends a JSON-RPC command and hands the raw JSON text of its result to a callback,
+     * e.g. to decode it into a typed result. Like sendCommandStreaming(), it uses a pooled
+     * connection if any, or a connection of its own otherwise.
+     *
+     * @param onResult Called with the span of the result, only valid during the call
+     */
+    void sendCommandRaw(const std::string &command, const Json::Value &arguments,
+            const std::function<void(const char*, const char*)> &onResult);
+
+    /**
+     * Typed variants of getInfo(), listPeers(), listFunds(), listInvoices(), listChannels() and listNodes(),
+     * which decode the response directly into `result` (see rpcresults.h).
+     *
+     * @throw CLightningRpcException if lightningd returned an error, or a malformed result
+     */
+    void getInfo(GetInfoResult &result);
+    void listPeers(ListPeersResult &result, const std::string &id="", const std::string &level="");
+    void listFunds(ListFundsResult &result);
+    void listInvoices(ListInvoicesResult &result, const std::string &label="");
+    void listChannels(ListChannelsResult &result, const std::string &scid="", const std::string &source="");
+    void listNodes(ListNodesResult &result);
+
+    /** The node ids referred to by the typed results. */
+    Interner &getNodeIds();
+
+    /**
+     * Streaming variants of listChannels() and listNodes(), see sendCommandStreaming().
+     *
+     * @param onChannel Called with each channel as soon as it's read
+     */
+    void streamChannels(const std::function<void(Json::Value&)> &onChannel, const std::string &scid="",
+            const std::string &source="");
+    void streamNodes(const std::function<void(Json::Value&)> &onNode);
+
+    /**
+     * Asynchronous variants of the commands above, see sendCommandAsync().
+     */
+    std::future<Json::Value> autoCleanInvoiceAsync(const unsigned int &cycleSeconds=3600, const unsigned int &expiredBy=86400);
+    std::future<Json::Value> checkAsync(const std::string &command, const Json::Value &parameters={});
+    std::future<Json::Value> closeAsync(const std::string &id, const bool &force=false, const unsigned int &timeout=30);
+    std::future<Json::Value> connectAsync(const std::string &id, const std::string &host="", const unsigned int &port=9735);
+    std::future<Json::Value> decodepayAsync(const std::string &invoice, const std::string &description="");
+    std::future<Json::Value> delInvoiceAsync(const std::string &label, const std::string &status="unpaid");
+    std::future<Json::Value> delExpiredInvoicesAsync(const unsigned int &maxExpiryTime=0);
+    std::future<Json::Value> disconnectAsync(const std::string &id, const bool &force=false);
+    std::future<Json::Value> feeratesAsync(const std::string &style="perkb");
+    std::future<Json::Value> fundChannelAsync(const std::string &id, const unsigned int &sats, const unsigned int &feerate=0,
+            const bool &announce=true, const unsigned int &minconf=1);
+    std::future<Json::Value> getInfoAsync();
+    std::future<Json::Value> getLogAsync(const std::string &level="info");
+    std::future<Json::Value> getRouteAsync(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor, const unsigned int &cltv=9,
+            const std::string &fromId="", const float &fuzzPercent=5.0, const Json::Value &exclude={}, const unsigned int &maxhops=20);
+    std::future<Json::Value> invoiceAsync(const unsigned int &msats, const std::string &label, const std::string &description,
+            const unsigned int &expiry=604800, const Json::Value &fallbacks={}, const std::string &preimage="");
+    std::future<Json::Value> helpAsync(const std::string &command);
+    std::future<Json::Value> listChannelsAsync(const std::string &scid="", const std::string &source="");
+    std::future<Json::Value> listConfigsAsync(const std::string &param="");
+    std::future<Json::Value> listForwardsAsync();
+    std::future<Json::Value> listFundsAsync();
+    std::future<Json::Value> listInvoicesAsync(const std::string &label="");
+    std::future<Json::Value> listNodesAsync();
+    std::future<Json::Value> listPaysAsync(const std::string &bolt11="");
+    std::future<Json::Value> listPaymentsAsync(const std::string &bolt11="", const std::string &payment_hash="");
+    std::future<Json::Value> listPeersAsync(const std::string &id="", const std::string &level="");
+    std::future<Json::Value> listSendPaysAsync(const std::string &bolt11="", const std::string &payment_hash="");
+    std::future<Json::Value> newAddrAsync(const std::string &type="bech32");
+    std::future<Json::Value> payAsync(const std::string &bolt11, const unsigned int &msat=0, const std::string &label="", const unsigned int &riskfactor=10,
+            const float &maxFeePercent=0.5, const unsigned int &retryFor=60, const unsigned int &maxDelay=500,
+            const unsigned int exemptFee=5000);
+    std::future<Json::Value> payStatusAsync(const std::string &bolt11="");
+    std::future<Json::Value> pingAsync(const std::string &id, const unsigned int &len=128, const unsigned int &pongbytes=128);
+    std::future<Json::Value> sendPayAsync(const std::string &route, const std::string &payment_hash, const std::string &label="", 
+            const unsigned int &msats=0, const std::string &bolt11="");
+    std::future<Json::Value> setChannelFeeAsync(const std::string &id, const unsigned int &baseFee=0, const unsigned int &ppmFee=0);
+    std::future<Json::Value> stopAsync();
+    std::future<Json::Value> waitAnyInvoiceAsync(const unsigned int &lastpayIndex=0);
+    std::future<Json::Value> waitInvoiceAsync(const std::string &label);
+    std::future<Json::Value> withdrawAsync(const std::string &address, const unsigned int &sats, const unsigned int &feerate=0,
+            const unsigned int &minconf=1);
+
+    /**
+     * The requests sent by the commands above, e.g. to be sent in a single sendBatch().
+     */
+    static RpcRequest autoCleanInvoiceRequest(const unsigned int &cycleSeconds=3600, const unsigned int &expiredBy=86400);
+    static RpcRequest checkRequest(const std::string &command, const Json::Value &parameters={});
+    static RpcRequest closeRequest(const std::string &id, const bool &force=false, const unsigned int &timeout=30);
+    static RpcRequest connectRequest(const std::string &id, const std::string &host="", const unsigned int &port=9735);
+    static RpcRequest decodepayRequest(const std::string &invoice, const std::string &description="");
+    static RpcRequest delInvoiceRequest(const std::string &label, const std::string &status="unpaid");
+    static RpcRequest delExpiredInvoicesRequest(const unsigned int &maxExpiryTime=0);
+    static RpcRequest disconnectRequest(const std::string &id, const bool &force=false);
+    static RpcRequest feeratesRequest(const std::string &style="perkb");
+    static RpcRequest fundChannelRequest(const std::string &id, const unsigned int &sats, const unsigned int &feerate=0,
+            const bool &announce=true, const unsigned int &minconf=1);
+    static RpcRequest getInfoRequest();
+    static RpcRequest getLogRequest(const std::string &level="info");
+    static RpcRequest getRouteRequest(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor, const unsigned int &cltv=9,
+            const std::string &fromId="", const float &fuzzPercent=5.0, const Json::Value &exclude={}, const unsigned int &maxhops=20);
+    static RpcRequest invoiceRequest(const unsigned int &msats, const std::string &label, const std::string &description,
+            const unsigned int &expiry=604800, const Json::Value &fallbacks={}, const std::string &preimage="");
+    static RpcRequest helpRequest(const std::string &command);
+    static RpcRequest listChannelsRequest(const std::string &scid="", const std::string &source="");
+    static RpcRequest listConfigsRequest(const std::string &param="");
+    static RpcRequest listForwardsRequest();
+    static RpcRequest listFundsRequest();
+    static RpcRequest listInvoicesRequest(const std::string &label="");
+    static RpcRequest listNodesRequest();
+    static RpcRequest listPaysRequest(const std::string &bolt11="");
+    static RpcRequest listPaymentsRequest(const std::string &bolt11="", const std::string &payment_hash="");
+    static RpcRequest listPeersRequest(const std::string &id="", const std::string &level="");
+    static RpcRequest listSendPaysRequest(const std::string &bolt11="", const std::string &payment_hash="");
+    static RpcRequest newAddrRequest(const std::string &type="bech32");
+    static RpcRequest payRequest(const std::string &bolt11, const unsigned int &msat=0, const std::string &label="", const unsigned int &riskfactor=10,
+            const float &maxFeePercent=0.5, const unsigned int &retryFor=60, const unsigned int &maxDelay=500,
+            const unsigned int exemptFee=5000);
+    static RpcRequest payStatusRequest(const std::string &bolt11="");
+    static RpcRequest pingRequest(const std::string &id, const unsigned int &len=128, const unsigned int &pongbytes=128);
+    static RpcRequest sendPayRequest(const std::string &route, const std::string &payment_hash, const std::string &label="", 
+            const unsigned int &msats=0, const std::string &bolt11="");
+    static RpcRequest setChannelFeeRequest(const std::string &id, const unsigned int &baseFee=0, const unsigned int &ppmFee=0);
+    static RpcRequest stopRequest();
+    static RpcRequest waitAnyInvoiceRequest(const unsigned int &lastpayIndex=0);
+    static RpcRequest waitInvoiceRequest(const std::string &label);
+    static RpcRequest withdrawRequest(const std::string &address, const unsigned int &sats, const unsigned int &feerate=0,
+            const unsigned int &minconf=1);
 };
 
 #endif // LIGHTNINGCPP_WRAPPER_H
@@ -0,0 +1,52 @@
+#include "dbwrite.h"
+#include "jsonscanner.h"
+
+#include <cstring>
+
+/** Whether a (raw) member name is this literal, without copying it. */
+static bool is(const char *begin, const char *end, const char *literal)
+{
+    size_t length = strlen(literal);
+    return (size_t)(end - begin) == length && memcmp(begin, literal, length) == 0;
+}
+
+bool DbWrite::parse(const char *begin, const char *end)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+
+    writes.clear();
+    hasDataVersion = false;
+    unescaped.clear();
+    // A decoded string is never longer than its JSON text, so this can't reallocate
+    // and invalidate the views into it
+    unescaped.reserve(end - begin);
+    if (!scanner.beginObject())
+        return false;
+    while (scanner.nextMember(keyBegin, keyEnd)) {
+        if (is(keyBegin, keyEnd, "writes")) {
+            if (!scanner.beginArray())
+                return false;
+            while (scanner.nextElement()) {
+                const char *b, *e;
+                if (!scanner.readRawString(b, e))
+                    return false;
+                if (memchr(b, '\\', e - b)) {
+                    size_t start = unescaped.size();
+                    if (!JsonScanner::unescape(b, e, unescaped))
+                        return false;
+                    writes.push_back({unescaped.data() + start, unescaped.size() - start});
+                } else {
+                    writes.push_back({b, (size_t)(e - b)});
+                }
+            }
+        } else if (is(keyBegin, keyEnd, "data_version")) {
+            if (!scanner.readUnsigned(dataVersion))
+                return false;
+            hasDataVersion = true;
+        } else if (!scanner.skipValue()) {
+            return false;
+        }
+    }
+    return !scanner.failed();
+}
@@ -0,0 +1,34 @@
+#ifndef LIGHTNINGCPP_DBWRITE_H
+#define LIGHTNINGCPP_DBWRITE_H
+
+#include "stringview.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * The parameters of a "db_write" hook call: the SQL statements lightningd is
+ * about to commit.
+ *
+ * The statements point directly into the message read from lightningd, except
+ * the ones containing JSON escape sequences which are decoded into `unescaped`.
+ * They are only valid during the call to the handler.
+ */
+struct DbWrite {
+    std::vector<StringView> writes;
+    // The version of the database after these writes, only sent by recent lightningd
+    bool hasDataVersion;
+    uint64_t dataVersion;
+    // Backs the writes which had to be decoded
+    std::string unescaped;
+
+    /**
+     * Scans the raw JSON parameters of the hook, reusing our storage.
+     *
+     * @return false if they are malformed
+     */
+    bool parse(const char *begin, const char *end);
+};
+
+#endif // LIGHTNINGCPP_DBWRITE_H
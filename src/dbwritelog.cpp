@@ -0,0 +1,102 @@
+#include "dbwritelog.h"
+#include "pluginexception.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+DbWriteLog::DbWriteLog(const std::string &path):
+    syncing(false),
+    failed(false),
+    appended(0),
+    durable(0),
+    syncs(0)
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0)
+        throw CLightningPluginException(errno, "Could not open " + path + ": " + strerror(errno));
+}
+
+DbWriteLog::~DbWriteLog()
+{
+    close(fd);
+}
+
+bool DbWriteLog::sync()
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t written = 0;
+    while (written < writing.size()) {
+        ssize_t n = write(fd, writing.data() + written, writing.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            return false;
+        written += n;
+    }
+    if (fdatasync(fd) < 0)
+        return false;
+    syncLatency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+    return true;
+}
+
+bool DbWriteLog::append(const DbWrite &batch)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (failed)
+        return false;
+    pending += std::to_string(batch.writes.size());
+    pending += ' ';
+    pending += batch.hasDataVersion ? std::to_string(batch.dataVersion) : "-";
+    pending += '\n';
+    for (const StringView &write : batch.writes) {
+        pending += std::to_string(write.size);
+        pending += '\n';
+        pending.append(write.data, write.size);
+        pending += '\n';
+    }
+    uint64_t sequence = ++appended;
+
+    while (durable < sequence && !failed) {
+        if (syncing) {
+            synced.wait(lock);
+            continue;
+        }
+        // Commit everything appended so far, ours included
+        syncing = true;
+        writing.swap(pending);
+        uint64_t upTo = appended;
+        lock.unlock();
+        bool ok = sync();
+        writing.clear();
+        lock.lock();
+        syncing = false;
+        syncs++;
+        if (ok)
+            durable = upTo;
+        else
+            failed = true;
+        synced.notify_all();
+    }
+    return !failed;
+}
+
+uint64_t DbWriteLog::getBatches()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return appended;
+}
+
+uint64_t DbWriteLog::getSyncs()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return syncs;
+}
+
+const LatencyHistogram &DbWriteLog::getSyncLatency() const
+{
+    return syncLatency;
+}
@@ -0,0 +1,69 @@
+#ifndef LIGHTNINGCPP_DBWRITELOG_H
+#define LIGHTNINGCPP_DBWRITELOG_H
+
+#include "dbwrite.h"
+#include "latencyhistogram.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+/**
+ * An append-only log of database writes, e.g. to replicate lightningd's
+ * database from the "db_write" hook.
+ *
+ * append() returns once the writes are on disk. Writes appended while another
+ * thread is syncing are committed together by the next sync (group commit),
+ * so that the number of fsyncs doesn't grow with the number of writers.
+ *
+ * Each batch is recorded as its number of writes and data version on a line,
+ * followed by each write as its size on a line then its bytes and a newline.
+ */
+class DbWriteLog {
+
+public:
+    /**
+     * Opens (or creates) the log, appending to it.
+     *
+     * @throw CLightningPluginException if it can't be opened
+     */
+    DbWriteLog(const std::string &path);
+    ~DbWriteLog();
+
+    /**
+     * Appends a batch of writes and waits for them to be durable.
+     *
+     * @return false if they could not be written or synced, in which case nothing
+     *         appended afterwards will be either
+     */
+    bool append(const DbWrite &batch);
+
+    /** The number of batches appended, and of fsyncs it took. */
+    uint64_t getBatches();
+    uint64_t getSyncs();
+
+    /** The time taken by each write and fsync, in microseconds. */
+    const LatencyHistogram &getSyncLatency() const;
+
+private:
+    int fd;
+    std::mutex mutex;
+    std::condition_variable synced;
+    // The batches appended but not written yet
+    std::string pending;
+    // What the syncing thread is writing, kept to reuse its allocation
+    std::string writing;
+    bool syncing;
+    bool failed;
+    // The sequence number of the last batch appended, and of the last one durable
+    uint64_t appended;
+    uint64_t durable;
+    uint64_t syncs;
+    LatencyHistogram syncLatency;
+
+    /** Writes and syncs `writing`, without holding the lock. */
+    bool sync();
+};
+
+#endif // LIGHTNINGCPP_DBWRITELOG_H
@@ -0,0 +1,103 @@
+#include "dispatchtable.h"
+#include "pluginexception.h"
+
+#include <cstring>
+
+DispatchTable::DispatchTable():
+    mask(0)
+{}
+
+uint64_t DispatchTable::hash(const char *data, const size_t &length)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+DispatchEntry &DispatchTable::entry(const std::string &name)
+{
+    if (!slots.empty())
+        throw CLightningPluginException(1, "Cannot register '" + name + "' once the plugin is started.");
+    for (auto &it : entries)
+        if (it.first == name)
+            return it.second;
+    DispatchEntry empty = {nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, 0};
+    entries.push_back(std::make_pair(name, empty));
+    return entries.back().second;
+}
+
+void DispatchTable::addMethod(const std::string &name, RpcMethod *method)
+{
+    entry(name).method = method;
+}
+
+void DispatchTable::addHook(const std::string &name, std::function<Json::Value(Json::Value&)> *hook)
+{
+    entry(name).hook = hook;
+}
+
+void DispatchTable::addRawHook(const std::string &name, std::function<std::string(Json::Value&)> *hook)
+{
+    entry(name).rawHook = hook;
+}
+
+void DispatchTable::addAsyncHook(const std::string &name, std::function<void(Json::Value&, RpcResponder)> *hook)
+{
+    entry(name).asyncHook = hook;
+}
+
+void DispatchTable::addArenaHook(const std::string &name,
+            std::function<void(const JsonView&, Arena&, ArenaString&)> *hook)
+{
+    entry(name).arenaHook = hook;
+}
+
+void DispatchTable::addNotification(const std::string &name, std::function<void(Json::Value&)> *notification)
+{
+    entry(name).notification = notification;
+}
+
+void DispatchTable::addQueuedNotification(const std::string &name, const size_t &topic)
+{
+    entry(name).queuedTopic = topic + 1;
+}
+
+void DispatchTable::freeze()
+{
+    // Keep the load factor under 1/2 so that probe sequences stay short
+    size_t size = 8;
+    while (size < entries.size() * 2)
+        size *= 2;
+    slots.assign(size, 0);
+    mask = size - 1;
+    for (uint32_t i = 0; i < entries.size(); i++) {
+        DispatchEntry &entry = entries[i].second;
+        entry.name = &entries[i].first;
+        // Once, rather than for each call
+        bool hook = entry.hook || entry.rawHook || entry.asyncHook || entry.arenaHook;
+        entry.requestOperation = (hook ? "hook:" : "method:") + entries[i].first;
+        entry.notificationOperation = "notification:" + entries[i].first;
+        size_t slot = hash(entries[i].first.data(), entries[i].first.size()) & mask;
+        while (slots[slot])
+            slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
+    }
+}
+
+const DispatchEntry *DispatchTable::find(const char *name, const size_t &length) const
+{
+    if (slots.empty())
+        return nullptr;
+    size_t slot = hash(name, length) & mask;
+    while (slots[slot]) {
+        const std::pair<std::string, DispatchEntry> &it = entries[slots[slot] - 1];
+        if (it.first.size() == length && memcmp(it.first.data(), name, length) == 0)
+            return &it.second;
+        slot = (slot + 1) & mask;
+    }
+    return nullptr;
+}
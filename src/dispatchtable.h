@@ -0,0 +1,75 @@
+#ifndef LIGHTNINGCPP_DISPATCHTABLE_H
+#define LIGHTNINGCPP_DISPATCHTABLE_H
+
+#include "arena.h"
+#include "jsonview.h"
+#include "rpcmethod.h"
+
+#include <cstdint>
+#include <functional>
+#include <jsonrpccpp/client.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Everything registered by a plugin under a given name.
+ */
+struct DispatchEntry {
+    // The name it's registered under, set once the table is frozen
+    const std::string *name;
+    RpcMethod *method;
+    std::function<Json::Value(Json::Value&)> *hook;
+    std::function<std::string(Json::Value&)> *rawHook;
+    std::function<void(Json::Value&, RpcResponder)> *asyncHook;
+    std::function<void(const JsonView&, Arena&, ArenaString&)> *arenaHook;
+    std::function<void(Json::Value&)> *notification;
+    // The index of its notification queue plus one, 0 if its notifications are not queued
+    size_t queuedTopic;
+    // The names its handlers are instrumented under, "method:<name>" or "hook:<name>" for
+    // requests and "notification:<name>", set once the table is frozen
+    std::string requestOperation;
+    std::string notificationOperation;
+};
+
+/**
+ * An open-addressing hash table from a method, hook or notification name to
+ * its handlers.
+ *
+ * It is filled before the plugin starts then frozen, after which lookups
+ * directly hash the name bytes from the parsed message and never allocate.
+ */
+class DispatchTable {
+
+public:
+    DispatchTable();
+
+    void addMethod(const std::string &name, RpcMethod *method);
+    void addHook(const std::string &name, std::function<Json::Value(Json::Value&)> *hook);
+    void addRawHook(const std::string &name, std::function<std::string(Json::Value&)> *hook);
+    void addAsyncHook(const std::string &name, std::function<void(Json::Value&, RpcResponder)> *hook);
+    void addArenaHook(const std::string &name, std::function<void(const JsonView&, Arena&, ArenaString&)> *hook);
+    void addNotification(const std::string &name, std::function<void(Json::Value&)> *notification);
+    void addQueuedNotification(const std::string &name, const size_t &topic);
+
+    /**
+     * Builds the hash index, no entry can be added afterwards.
+     */
+    void freeze();
+
+    /**
+     * @return The entry registered under this name, or nullptr.
+     */
+    const DispatchEntry *find(const char *name, const size_t &length) const;
+
+private:
+    std::vector<std::pair<std::string, DispatchEntry>> entries;
+    // Indexes into `entries` plus one, 0 for an empty slot
+    std::vector<uint32_t> slots;
+    size_t mask;
+
+    DispatchEntry &entry(const std::string &name);
+    static uint64_t hash(const char *data, const size_t &length);
+};
+
+#endif // LIGHTNINGCPP_DISPATCHTABLE_H
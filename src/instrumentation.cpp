@@ -0,0 +1,238 @@
+#include "instrumentation.h"
+
+#include <cstdio>
+#include <ctime>
+
+struct Instrumentation::Operation {
+    std::string name;
+    LatencyHistogram latency;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> bytesIn;
+    std::atomic<uint64_t> bytesOut;
+    // The calls at the last periodic dump, only used by the dumping thread
+    uint64_t dumpedCalls;
+
+    Operation(const std::string &name):
+        name(name),
+        errors(0),
+        bytesIn(0),
+        bytesOut(0),
+        dumpedCalls(0)
+    {}
+};
+
+Instrumentation::Instrumentation():
+    enabled(false),
+    other(new Operation("other")),
+    dumping(false)
+{
+    for (size_t i = 0; i < SLOTS; i++)
+        slots[i].store(nullptr, std::memory_order_relaxed);
+}
+
+Instrumentation::~Instrumentation()
+{
+    stopDumping();
+    for (Operation *operation : operations)
+        delete operation;
+    delete other;
+}
+
+void Instrumentation::setEnabled(const bool &enabled)
+{
+    this->enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool Instrumentation::isEnabled() const
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t Instrumentation::microsSince(const std::chrono::steady_clock::time_point &start)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t Instrumentation::hash(const std::string &name)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (const char &c : name) {
+        h ^= (unsigned char)c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+Instrumentation::Operation *Instrumentation::find(const std::string &name)
+{
+    size_t start = hash(name) & (SLOTS - 1), slot = start;
+    Operation *operation;
+    // Operations are never removed, so a name is either in its probe sequence or not added yet
+    while ((operation = slots[slot].load(std::memory_order_acquire))) {
+        if (operation->name == name)
+            return operation;
+        slot = (slot + 1) & (SLOTS - 1);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    slot = start;
+    while ((operation = slots[slot].load(std::memory_order_relaxed))) {
+        if (operation->name == name)
+            return operation;
+        slot = (slot + 1) & (SLOTS - 1);
+    }
+    if (operations.size() >= MAX_OPERATIONS)
+        return other;
+    operation = new Operation(name);
+    operations.push_back(operation);
+    slots[slot].store(operation, std::memory_order_release);
+    return operation;
+}
+
+void Instrumentation::record(const std::string &name, const uint64_t &micros, const bool &failed,
+            const uint64_t &bytesIn, const uint64_t &bytesOut)
+{
+    if (!isEnabled())
+        return;
+    Operation *operation = find(name);
+    operation->latency.record(micros);
+    if (failed)
+        operation->errors.fetch_add(1, std::memory_order_relaxed);
+    if (bytesIn)
+        operation->bytesIn.fetch_add(bytesIn, std::memory_order_relaxed);
+    if (bytesOut)
+        operation->bytesOut.fetch_add(bytesOut, std::memory_order_relaxed);
+}
+
+std::vector<OperationStats> Instrumentation::getSnapshot()
+{
+    std::vector<Operation*> recorded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded = operations;
+    }
+    if (other->latency.getCount())
+        recorded.push_back(other);
+
+    std::vector<OperationStats> snapshot;
+    for (const Operation *operation : recorded) {
+        OperationStats stats;
+        stats.name = operation->name;
+        stats.calls = operation->latency.getCount();
+        stats.errors = operation->errors.load(std::memory_order_relaxed);
+        stats.meanMicros = operation->latency.getMean();
+        stats.p50Micros = operation->latency.getPercentile(50);
+        stats.p99Micros = operation->latency.getPercentile(99);
+        stats.p999Micros = operation->latency.getPercentile(99.9);
+        stats.maxMicros = operation->latency.getMax();
+        stats.bytesIn = operation->bytesIn.load(std::memory_order_relaxed);
+        stats.bytesOut = operation->bytesOut.load(std::memory_order_relaxed);
+        snapshot.push_back(stats);
+    }
+    return snapshot;
+}
+
+std::string Instrumentation::format()
+{
+    return format(false);
+}
+
+std::string Instrumentation::format(const bool &sinceLast)
+{
+    std::vector<Operation*> recorded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded = operations;
+    }
+    recorded.push_back(other);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%-32s %10s %8s %10s %10s %10s %10s %10s %12s %12s\n", "operation", "calls", "errors",
+             "mean(us)", "p50", "p99", "p99.9", "max", "bytes in", "bytes out");
+    std::string table(line);
+    size_t header = table.size();
+    for (Operation *operation : recorded) {
+        uint64_t calls = operation->latency.getCount();
+        bool called = sinceLast ? calls != operation->dumpedCalls : calls > 0;
+        if (sinceLast)
+            operation->dumpedCalls = calls;
+        if (!called)
+            continue;
+        snprintf(line, sizeof(line), "%-32s %10llu %8llu %10.1f %10llu %10llu %10llu %10llu %12llu %12llu\n",
+                 operation->name.c_str(), (unsigned long long)calls,
+                 (unsigned long long)operation->errors.load(std::memory_order_relaxed), operation->latency.getMean(),
+                 (unsigned long long)operation->latency.getPercentile(50),
+                 (unsigned long long)operation->latency.getPercentile(99),
+                 (unsigned long long)operation->latency.getPercentile(99.9),
+                 (unsigned long long)operation->latency.getMax(),
+                 (unsigned long long)operation->bytesIn.load(std::memory_order_relaxed),
+                 (unsigned long long)operation->bytesOut.load(std::memory_order_relaxed));
+        table += line;
+    }
+    return table.size() > header ? table : "";
+}
+
+void Instrumentation::reset()
+{
+    std::vector<Operation*> recorded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        recorded = operations;
+    }
+    recorded.push_back(other);
+    for (Operation *operation : recorded) {
+        operation->latency.reset();
+        operation->errors.store(0, std::memory_order_relaxed);
+        operation->bytesIn.store(0, std::memory_order_relaxed);
+        operation->bytesOut.store(0, std::memory_order_relaxed);
+    }
+}
+
+void Instrumentation::startDumping(const std::chrono::milliseconds &interval,
+            const std::function<void(const std::string&)> &sink)
+{
+    stopDumping();
+    std::lock_guard<std::mutex> lock(dumpMutex);
+    dumping = true;
+    dumper = std::thread(&Instrumentation::dumpPeriodically, this, interval, sink);
+}
+
+void Instrumentation::startDumping(const std::chrono::milliseconds &interval, const std::string &path)
+{
+    startDumping(interval, [path](const std::string &table) {
+        FILE *file = fopen(path.c_str(), "a");
+        if (!file)
+            return;
+        char date[32];
+        time_t now = time(nullptr);
+        struct tm local;
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime_r(&now, &local));
+        fprintf(file, "%s\n%s\n", date, table.c_str());
+        fclose(file);
+    });
+}
+
+void Instrumentation::stopDumping()
+{
+    {
+        std::lock_guard<std::mutex> lock(dumpMutex);
+        dumping = false;
+    }
+    dumpStopped.notify_all();
+    if (dumper.joinable())
+        dumper.join();
+}
+
+void Instrumentation::dumpPeriodically(const std::chrono::milliseconds interval,
+            const std::function<void(const std::string&)> sink)
+{
+    std::unique_lock<std::mutex> lock(dumpMutex);
+    while (!dumpStopped.wait_for(lock, interval, [this] { return !dumping; })) {
+        lock.unlock();
+        std::string table = format(true);
+        if (!table.empty())
+            sink(table);
+        lock.lock();
+    }
+}
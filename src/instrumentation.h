@@ -0,0 +1,108 @@
+#ifndef LIGHTNINGCPP_INSTRUMENTATION_H
+#define LIGHTNINGCPP_INSTRUMENTATION_H
+
+#include "latencyhistogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** A snapshot of the counters of an instrumented operation (a command, a handler, ..). */
+struct OperationStats {
+    std::string name;
+    uint64_t calls;
+    uint64_t errors;
+    double meanMicros;
+    uint64_t p50Micros;
+    uint64_t p99Micros;
+    uint64_t p999Micros;
+    uint64_t maxMicros;
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+};
+
+/**
+ * Counts the calls, errors, latency and bytes transferred of named operations.
+ *
+ * It is disabled by default, recording costing a relaxed atomic load then. Once
+ * enabled, recording is lock-free : operations are looked up by name in an
+ * open-addressing table (only the first record of a name takes a lock, to
+ * insert it) and their counters are atomics. There can be at most 1024 distinct
+ * operations, any other is counted under "other".
+ */
+class Instrumentation {
+
+public:
+    Instrumentation();
+    /** Stops dumping. */
+    ~Instrumentation();
+
+    void setEnabled(const bool &enabled);
+    bool isEnabled() const;
+
+    /**
+     * Records a completed operation, does nothing if disabled.
+     *
+     * @param micros The time it took
+     * @param failed Whether it failed
+     * @param bytesIn, bytesOut The bytes it received and sent, if it's known
+     */
+    void record(const std::string &name, const uint64_t &micros, const bool &failed=false,
+            const uint64_t &bytesIn=0, const uint64_t &bytesOut=0);
+
+    /** The counters of every operation recorded so far, by name. */
+    std::vector<OperationStats> getSnapshot();
+
+    /** The snapshot as a text table, one line per operation, empty if nothing was recorded. */
+    std::string format();
+
+    /** Zeroes the counters, the operations recorded so far are still reported. */
+    void reset();
+
+    /**
+     * Hands format() to `sink` every `interval` from a thread of its own, until stopDumping().
+     * Operations which were not called since the last dump are skipped.
+     */
+    void startDumping(const std::chrono::milliseconds &interval, const std::function<void(const std::string&)> &sink);
+
+    /** Appends format() to the file at `path` every `interval`, preceded by the date. */
+    void startDumping(const std::chrono::milliseconds &interval, const std::string &path);
+
+    void stopDumping();
+
+    /** The microseconds elapsed since `start`, a shorthand for the callers of record(). */
+    static uint64_t microsSince(const std::chrono::steady_clock::time_point &start);
+
+private:
+    struct Operation;
+
+    static const size_t SLOTS = 2048;
+    static const size_t MAX_OPERATIONS = 1024;
+
+    std::atomic<bool> enabled;
+    // Operations by hash of their name, filled once and never moved
+    std::atomic<Operation*> slots[SLOTS];
+    // Guards the insertion of operations
+    std::mutex mutex;
+    std::vector<Operation*> operations;
+    Operation *other;
+
+    std::thread dumper;
+    std::mutex dumpMutex;
+    std::condition_variable dumpStopped;
+    bool dumping;
+
+    Operation *find(const std::string &name);
+    static uint64_t hash(const std::string &name);
+    /** @param sinceLast If set, only the operations called since the last dump */
+    std::string format(const bool &sinceLast);
+    void dumpPeriodically(const std::chrono::milliseconds interval, const std::function<void(const std::string&)> sink);
+};
+
+#endif // LIGHTNINGCPP_INSTRUMENTATION_H
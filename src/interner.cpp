@@ -0,0 +1,88 @@
+#include "interner.h"
+
+#include <cstring>
+
+Interner::Interner():
+    slots(64, 0),
+    mask(63)
+{}
+
+uint64_t Interner::hash(const char *data, const size_t &length)
+{
+    // FNV-1a
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void Interner::grow()
+{
+    slots.assign(slots.size() * 2, 0);
+    mask = slots.size() - 1;
+    for (uint32_t i = 0; i < strings.size(); i++) {
+        size_t slot = hash(strings[i].data(), strings[i].size()) & mask;
+        while (slots[slot])
+            slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
+    }
+}
+
+uint32_t Interner::intern(const char *begin, const char *end)
+{
+    size_t length = end - begin;
+    uint64_t h = hash(begin, length);
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t slot = h & mask;
+    while (slots[slot]) {
+        const std::string &str = strings[slots[slot] - 1];
+        if (str.size() == length && memcmp(str.data(), begin, length) == 0)
+            return slots[slot] - 1;
+        slot = (slot + 1) & mask;
+    }
+    strings.push_back(std::string(begin, end));
+    slots[slot] = strings.size();
+    // Keep the load factor under 1/2 so that probe sequences stay short
+    if (strings.size() * 2 > slots.size())
+        grow();
+    return strings.size() - 1;
+}
+
+uint32_t Interner::intern(const std::string &str)
+{
+    return intern(str.data(), str.data() + str.size());
+}
+
+bool Interner::find(const char *begin, const char *end, uint32_t &index) const
+{
+    size_t length = end - begin;
+    uint64_t h = hash(begin, length);
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t slot = h & mask; slots[slot]; slot = (slot + 1) & mask) {
+        const std::string &str = strings[slots[slot] - 1];
+        if (str.size() == length && memcmp(str.data(), begin, length) == 0) {
+            index = slots[slot] - 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Interner::find(const std::string &str, uint32_t &index) const
+{
+    return find(str.data(), str.data() + str.size(), index);
+}
+
+const std::string &Interner::lookup(const uint32_t &index) const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return strings.at(index);
+}
+
+size_t Interner::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return strings.size();
+}
@@ -0,0 +1,56 @@
+#ifndef LIGHTNINGCPP_INTERNER_H
+#define LIGHTNINGCPP_INTERNER_H
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Maps strings which are repeated a lot (node ids, ..) to small integers,
+ * storing each of them once.
+ *
+ * Indexes are attributed in order from 0 and never change, and the strings
+ * they refer to are never moved. It can be shared between threads.
+ */
+class Interner {
+
+public:
+    Interner();
+
+    /** @return The index of this string, added if it's not known yet. */
+    uint32_t intern(const char *begin, const char *end);
+    uint32_t intern(const std::string &str);
+
+    /**
+     * Looks a string up without adding it, e.g. for ids coming from a caller.
+     *
+     * @param index Set to the index of this string if it's known
+     * @return Whether it's known
+     */
+    bool find(const char *begin, const char *end, uint32_t &index) const;
+    bool find(const std::string &str, uint32_t &index) const;
+
+    /**
+     * @param index An index returned by intern()
+     * @return The string it refers to, valid as long as the Interner
+     */
+    const std::string &lookup(const uint32_t &index) const;
+
+    /** The number of strings interned. */
+    size_t size() const;
+
+private:
+    mutable std::mutex mutex;
+    std::deque<std::string> strings;
+    // Indexes into `strings` plus one, 0 for an empty slot
+    std::vector<uint32_t> slots;
+    size_t mask;
+
+    static uint64_t hash(const char *data, const size_t &length);
+    /** Doubles the number of slots, the mutex being held. */
+    void grow();
+};
+
+#endif // LIGHTNINGCPP_INTERNER_H
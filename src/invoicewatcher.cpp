@@ -0,0 +1,264 @@
+#include "invoicewatcher.h"
+#include "rpcexception.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+// Retries after an error start after this long, doubling up to the maximum
+static const std::chrono::milliseconds MIN_BACKOFF(100);
+static const std::chrono::milliseconds MAX_BACKOFF(5000);
+
+static void signalEvent(const int &fd)
+{
+    uint64_t one = 1;
+    // Only fails if the counter would overflow, it's readable anyway
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+InvoiceSubscription::InvoiceSubscription(InvoiceWatcher &watcher, const uint64_t &cursor):
+    watcher(watcher),
+    cursor(cursor),
+    eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (eventFd < 0)
+        throw CLightningRpcException(errno, "Could not create an eventfd");
+}
+
+InvoiceSubscription::~InvoiceSubscription()
+{
+    close(eventFd);
+}
+
+size_t InvoiceSubscription::poll(const std::function<void(const Invoice&)> &onInvoice, const size_t &max)
+{
+    // Consume the wakeup before looking, so that none is lost for what comes next
+    uint64_t count;
+    ssize_t n = read(eventFd, &count, sizeof(count));
+    (void)n;
+
+    uint64_t next = cursor.load(std::memory_order_relaxed);
+    uint64_t published = watcher.published.load(std::memory_order_acquire);
+    size_t handed = 0;
+    while (next < published && handed < max) {
+        onInvoice(watcher.ring[next & watcher.mask]);
+        // The watcher may reuse the slot once we moved past it
+        cursor.store(++next, std::memory_order_release);
+        handed++;
+    }
+    if (next < published)
+        signalEvent(eventFd);
+    return handed;
+}
+
+bool InvoiceSubscription::wait(const std::chrono::milliseconds &timeout)
+{
+    if (cursor.load(std::memory_order_relaxed) < watcher.published.load(std::memory_order_acquire))
+        return true;
+    struct pollfd pfd;
+    pfd.fd = eventFd;
+    pfd.events = POLLIN;
+    ::poll(&pfd, 1, timeout.count());
+    return cursor.load(std::memory_order_relaxed) < watcher.published.load(std::memory_order_acquire);
+}
+
+int InvoiceSubscription::getFd() const
+{
+    return eventFd;
+}
+
+InvoiceWatcher::InvoiceWatcher(const std::string &socketPath, const std::string &cursorPath, const uint64_t &payIndex,
+            const size_t &capacity):
+    socketPath(socketPath),
+    cursorPath(cursorPath),
+    connection(nullptr),
+    published(0),
+    payIndex(0),
+    errors(0),
+    running(false)
+{
+    size_t size = 2;
+    while (size < capacity + 1)
+        size <<= 1;
+    ring.resize(size);
+    mask = size - 1;
+    startPayIndex = loadCursor(payIndex);
+    this->payIndex = startPayIndex;
+}
+
+InvoiceWatcher::~InvoiceWatcher()
+{
+    stop();
+    for (InvoiceSubscription *subscription : subscribers)
+        delete subscription;
+}
+
+void InvoiceWatcher::start()
+{
+    std::lock_guard<std::mutex> lock(stateMutex);
+    if (running)
+        return;
+    running = true;
+    // An interrupted connection can't be reused, each run gets its own
+    connection = new RpcConnection(socketPath);
+    thread = std::thread(&InvoiceWatcher::run, this);
+}
+
+void InvoiceWatcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        if (!running)
+            return;
+        running = false;
+        // Unblocks waitanyinvoice
+        connection->interrupt();
+    }
+    stopped.notify_all();
+    thread.join();
+    delete connection;
+    connection = nullptr;
+    saveCursor();
+}
+
+InvoiceSubscription *InvoiceWatcher::subscribe()
+{
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    InvoiceSubscription *subscription = new InvoiceSubscription(*this, published.load(std::memory_order_acquire));
+    subscribers.push_back(subscription);
+    return subscription;
+}
+
+void InvoiceWatcher::unsubscribe(InvoiceSubscription *subscription)
+{
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    for (size_t i = 0; i < subscribers.size(); i++) {
+        if (subscribers[i] == subscription) {
+            subscribers.erase(subscribers.begin() + i);
+            delete subscription;
+            return;
+        }
+    }
+}
+
+uint64_t InvoiceWatcher::getPayIndex()
+{
+    return payIndex.load();
+}
+
+unsigned long InvoiceWatcher::getPublished()
+{
+    return published.load();
+}
+
+unsigned long InvoiceWatcher::getErrors()
+{
+    return errors.load();
+}
+
+void InvoiceWatcher::run()
+{
+    Json::Value params(Json::objectValue);
+    Invoice invoice;
+    std::chrono::milliseconds backoff = MIN_BACKOFF;
+
+    while (true) {
+        saveCursor();
+        params["lastpay_index"] = (Json::UInt64)payIndex.load();
+        bool decoded = false;
+        try {
+            connection->callRaw("waitanyinvoice", params, [&invoice, &decoded](const char *begin, const char *end) {
+                decoded = invoice.decode(begin, end);
+            });
+        } catch (const CLightningRpcException &e) {
+            // lightningd went away, or we were stopped
+        }
+        if (!decoded || invoice.payIndex <= payIndex.load()) {
+            {
+                std::lock_guard<std::mutex> lock(stateMutex);
+                if (!running)
+                    return;
+            }
+            errors++;
+            if (!sleep(backoff))
+                return;
+            backoff = std::min(backoff * 2, MAX_BACKOFF);
+            continue;
+        }
+        backoff = MIN_BACKOFF;
+
+        // Never overwrite an invoice a subscriber did not read yet, nor the last one
+        // they all read, whose pay_index is the cursor we persist
+        uint64_t seq = published.load(std::memory_order_relaxed);
+        while (seq - slowestCursor() >= mask) {
+            if (!sleep(std::chrono::milliseconds(1)))
+                return;
+        }
+        std::swap(ring[seq & mask], invoice);
+        payIndex = ring[seq & mask].payIndex;
+        published.store(seq + 1, std::memory_order_release);
+
+        std::lock_guard<std::mutex> lock(subscribersMutex);
+        for (InvoiceSubscription *subscription : subscribers)
+            signalEvent(subscription->eventFd);
+    }
+}
+
+uint64_t InvoiceWatcher::slowestCursor()
+{
+    uint64_t slowest = published.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(subscribersMutex);
+    for (InvoiceSubscription *subscription : subscribers)
+        slowest = std::min(slowest, subscription->cursor.load(std::memory_order_acquire));
+    return slowest;
+}
+
+bool InvoiceWatcher::sleep(const std::chrono::milliseconds &duration)
+{
+    std::unique_lock<std::mutex> lock(stateMutex);
+    return !stopped.wait_for(lock, duration, [this] { return !running; });
+}
+
+uint64_t InvoiceWatcher::loadCursor(const uint64_t &fallback)
+{
+    if (cursorPath.empty())
+        return fallback;
+    FILE *file = fopen(cursorPath.c_str(), "r");
+    if (!file)
+        return fallback;
+    unsigned long long cursor;
+    bool read = fscanf(file, "%llu", &cursor) == 1;
+    fclose(file);
+    return read ? cursor : fallback;
+}
+
+void InvoiceWatcher::saveCursor()
+{
+    if (cursorPath.empty())
+        return;
+    uint64_t cursor = payIndex.load();
+    // Only called from the watching thread, or once it's stopped : the ring is ours. The
+    // slot before the slowest cursor is never reused, see run()
+    uint64_t seq = published.load(std::memory_order_relaxed), slowest = slowestCursor();
+    if (slowest < seq)
+        cursor = slowest > 0 ? ring[(slowest - 1) & mask].payIndex : startPayIndex;
+
+    // Written aside then renamed, so that a crash leaves either cursor but never half of one
+    std::string tmpPath = cursorPath + ".tmp";
+    std::string content = std::to_string(cursor) + "\n";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        errors++;
+        return;
+    }
+    bool written = write(fd, content.data(), content.size()) == (ssize_t)content.size() && fsync(fd) == 0;
+    close(fd);
+    if (!written || rename(tmpPath.c_str(), cursorPath.c_str()) != 0)
+        errors++;
+}
@@ -0,0 +1,132 @@
+#ifndef LIGHTNINGCPP_INVOICEWATCHER_H
+#define LIGHTNINGCPP_INVOICEWATCHER_H
+
+#include "rpcconnection.h"
+#include "rpcresults.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class InvoiceWatcher;
+
+/**
+ * A subscriber's view of the paid invoices, each one seeing all of them in
+ * pay_index order from the moment it subscribed.
+ *
+ * Reading never takes a lock nor makes a system call but to consume the
+ * wakeup of getFd(). A subscription must only be polled from one thread at a time.
+ */
+class InvoiceSubscription {
+
+public:
+    /**
+     * Hands the invoices paid since the last poll to `onInvoice`, without blocking.
+     *
+     * @param max The maximum number of invoices to hand
+     * @return The number of invoices handed
+     */
+    size_t poll(const std::function<void(const Invoice&)> &onInvoice, const size_t &max=SIZE_MAX);
+
+    /** Blocks until invoices are waiting to be polled or `timeout` elapsed, returns whether there are. */
+    bool wait(const std::chrono::milliseconds &timeout);
+
+    /** An eventfd readable when invoices are waiting, for the subscriber's own event loop. */
+    int getFd() const;
+
+private:
+    friend class InvoiceWatcher;
+
+    InvoiceWatcher &watcher;
+    // The sequence number of the next invoice to hand
+    std::atomic<uint64_t> cursor;
+    int eventFd;
+
+    InvoiceSubscription(InvoiceWatcher &watcher, const uint64_t &cursor);
+    ~InvoiceSubscription();
+};
+
+/**
+ * Follows the invoices being paid with waitanyinvoice, from a thread and a
+ * connection of its own, and broadcasts them to any number of subscribers.
+ *
+ * Invoices are published in a ring buffer which subscribers read at their
+ * own pace, an invoice slot being reused once every subscriber read it. If
+ * the slowest one lags `capacity` invoices behind, the watcher waits for it
+ * instead of dropping anything.
+ *
+ * The pay_index of the last invoice read by every subscriber is saved to
+ * `cursorPath` after each one, so that after a restart the watcher resumes
+ * from there : invoices are delivered at least once.
+ */
+class InvoiceWatcher {
+
+public:
+    /**
+     * @param socketPath The path to lightningd's "lightning-rpc" socket
+     * @param cursorPath Where to persist the cursor, not persisted if empty
+     * @param payIndex The pay_index to start after if there is no persisted cursor
+     *            (defaults to 0, all the invoices paid so far)
+     * @param capacity The number of invoices subscribers may lag behind before the watcher waits for them
+     */
+    InvoiceWatcher(const std::string &socketPath, const std::string &cursorPath="", const uint64_t &payIndex=0,
+            const size_t &capacity=1024);
+
+    /** Stops watching, and frees the subscriptions left. */
+    ~InvoiceWatcher();
+
+    void start();
+    void stop();
+
+    /** Subscriptions only see the invoices published after they were made. */
+    InvoiceSubscription *subscribe();
+    void unsubscribe(InvoiceSubscription *subscription);
+
+    /** The pay_index of the last invoice published. */
+    uint64_t getPayIndex();
+
+    unsigned long getPublished();
+
+    /** The times waitanyinvoice failed, lightningd being down or restarting. */
+    unsigned long getErrors();
+
+private:
+    friend class InvoiceSubscription;
+
+    std::string socketPath;
+    std::string cursorPath;
+    RpcConnection *connection;
+
+    std::vector<Invoice> ring;
+    size_t mask;
+    // The cursor we started from, before the first invoice published
+    uint64_t startPayIndex;
+    // The number of invoices published, whose slots are readable
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> payIndex;
+    std::atomic<unsigned long> errors;
+
+    std::mutex subscribersMutex;
+    std::vector<InvoiceSubscription*> subscribers;
+
+    std::thread thread;
+    std::mutex stateMutex;
+    std::condition_variable stopped;
+    bool running;
+
+    void run();
+    /** The sequence number below which every subscriber read the invoices. */
+    uint64_t slowestCursor();
+    /** Sleeps, unless we are stopped meanwhile. Returns whether we are still running. */
+    bool sleep(const std::chrono::milliseconds &duration);
+    uint64_t loadCursor(const uint64_t &fallback);
+    void saveCursor();
+};
+
+#endif // LIGHTNINGCPP_INVOICEWATCHER_H
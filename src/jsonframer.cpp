@@ -0,0 +1,104 @@
+#include "jsonframer.h"
+
+#include <algorithm>
+#include <cstring>
+
+JsonFramer::JsonFramer():
+    size(0),
+    start(0),
+    scanned(0),
+    depth(0),
+    inString(false),
+    escaped(false),
+    started(false)
+{}
+
+void JsonFramer::compact()
+{
+    if (!start)
+        return;
+    memmove(&buffer[0], &buffer[start], size - start);
+    size -= start;
+    scanned -= start;
+    start = 0;
+}
+
+char *JsonFramer::prepare(const size_t &length)
+{
+    // Only move the leftovers when it saves growing the buffer
+    if (buffer.size() - size < length)
+        compact();
+    if (buffer.size() - size < length)
+        buffer.resize(std::max(buffer.size() * 2, size + length));
+    return &buffer[size];
+}
+
+void JsonFramer::commit(const size_t &length)
+{
+    size += length;
+}
+
+void JsonFramer::append(const char *data, const size_t &length)
+{
+    memcpy(prepare(length), data, length);
+    commit(length);
+}
+
+bool JsonFramer::next(const char *&begin, const char *&end)
+{
+    const char *data = buffer.data();
+    while (scanned < size) {
+        char c = data[scanned];
+        if (!started) {
+            // Skip the separators between objects
+            if (c != '{' && c != '[') {
+                start = ++scanned;
+                continue;
+            }
+            started = true;
+        }
+        if (inString) {
+            if (escaped) {
+                escaped = false;
+                scanned++;
+                continue;
+            }
+            // Most of a response is strings, skip their plain characters in a tight loop
+            while (scanned < size && data[scanned] != '"' && data[scanned] != '\\')
+                scanned++;
+            if (scanned == size)
+                break;
+            if (data[scanned] == '\\')
+                escaped = true;
+            else
+                inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{' || c == '[') {
+            depth++;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+            begin = data + start;
+            end = data + scanned + 1;
+            start = ++scanned;
+            started = false;
+            return true;
+        }
+        scanned++;
+    }
+    // Nothing left to consume, we can start over from the beginning of the buffer
+    if (!started)
+        start = scanned = size = 0;
+    return false;
+}
+
+bool JsonFramer::hasPartial() const
+{
+    return started;
+}
+
+void JsonFramer::clear()
+{
+    size = start = scanned = 0;
+    depth = 0;
+    inString = escaped = started = false;
+}
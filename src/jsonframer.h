@@ -0,0 +1,64 @@
+#ifndef LIGHTNINGCPP_JSONFRAMER_H
+#define LIGHTNINGCPP_JSONFRAMER_H
+
+#include <string>
+
+/**
+ * Splits a stream of concatenated JSON objects, as exchanged with lightningd,
+ * into whole messages.
+ *
+ * Bytes are read directly into the framer's buffer, which is reused across
+ * messages. The scan resumes where it previously stopped, so that a message
+ * arriving in many chunks is only scanned once.
+ */
+class JsonFramer {
+
+public:
+    JsonFramer();
+
+    /**
+     * Makes room for at least `size` more bytes and returns where to write them.
+     * Invalidates the spans returned by next().
+     */
+    char *prepare(const size_t &size);
+
+    /** Records that `size` bytes were written at the pointer returned by prepare(). */
+    void commit(const size_t &size);
+
+    /** Appends bytes to the stream, invalidates the spans returned by next(). */
+    void append(const char *data, const size_t &size);
+
+    /**
+     * Extracts the next complete JSON object.
+     *
+     * @param begin Set to the beginning of the object
+     * @param end Set right after the end of the object
+     * @return false if no complete object is buffered yet
+     */
+    bool next(const char *&begin, const char *&end);
+
+    /** Whether there are bytes (other than whitespace) belonging to an incomplete object. */
+    bool hasPartial() const;
+
+    /** Drops everything buffered and resets the scan. */
+    void clear();
+
+private:
+    std::string buffer;
+    // The bytes actually filled in `buffer`
+    size_t size;
+    // Where the next object starts, everything before was consumed
+    size_t start;
+    // Where the scan stopped, and its state at that point
+    size_t scanned;
+    int depth;
+    bool inString;
+    bool escaped;
+    // Whether the current object has begun, to skip separators between objects
+    bool started;
+
+    /** Moves the unconsumed bytes to the beginning of the buffer. */
+    void compact();
+};
+
+#endif // LIGHTNINGCPP_JSONFRAMER_H
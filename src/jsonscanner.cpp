@@ -0,0 +1,338 @@
+#include "jsonscanner.h"
+
+#include <cstdlib>
+#include <cstring>
+
+JsonScanner::JsonScanner(const char *begin, const char *end):
+    cursor(begin),
+    end(end),
+    error(false)
+{}
+
+void JsonScanner::skipWhitespace()
+{
+    while (cursor < end && (*cursor == ' ' || *cursor == '\n' || *cursor == '\r' || *cursor == '\t'))
+        cursor++;
+}
+
+bool JsonScanner::fail()
+{
+    error = true;
+    return false;
+}
+
+bool JsonScanner::expect(const char &c)
+{
+    skipWhitespace();
+    if (cursor == end || *cursor != c)
+        return fail();
+    cursor++;
+    return true;
+}
+
+char JsonScanner::peek()
+{
+    skipWhitespace();
+    return cursor < end ? *cursor : 0;
+}
+
+const char *JsonScanner::position() const
+{
+    return cursor;
+}
+
+bool JsonScanner::failed() const
+{
+    return error;
+}
+
+bool JsonScanner::beginObject()
+{
+    return expect('{');
+}
+
+bool JsonScanner::nextMember(const char *&keyBegin, const char *&keyEnd)
+{
+    char c = peek();
+    if (c == '}') {
+        cursor++;
+        return false;
+    }
+    if (c == ',')
+        cursor++;
+    return readRawString(keyBegin, keyEnd) && expect(':');
+}
+
+bool JsonScanner::beginArray()
+{
+    return expect('[');
+}
+
+bool JsonScanner::nextElement()
+{
+    char c = peek();
+    if (c == ']') {
+        cursor++;
+        return false;
+    }
+    if (c == ',')
+        cursor++;
+    else if (!c || c == '}')
+        return fail();
+    return true;
+}
+
+bool JsonScanner::readRawString(const char *&begin, const char *&stringEnd)
+{
+    if (!expect('"'))
+        return false;
+    begin = cursor;
+    while (cursor < end && *cursor != '"') {
+        if (*cursor == '\\')
+            cursor++;
+        cursor++;
+    }
+    if (cursor >= end)
+        return fail();
+    stringEnd = cursor++;
+    return true;
+}
+
+/** Writes a code point at `out`, encoded as UTF-8, and returns the end of what was written. */
+static char *writeUtf8(const uint32_t &codePoint, char *out)
+{
+    if (codePoint < 0x80) {
+        *out++ = (char)codePoint;
+    } else if (codePoint < 0x800) {
+        *out++ = (char)(0xC0 | (codePoint >> 6));
+        *out++ = (char)(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        *out++ = (char)(0xE0 | (codePoint >> 12));
+        *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (codePoint & 0x3F));
+    } else {
+        *out++ = (char)(0xF0 | (codePoint >> 18));
+        *out++ = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        *out++ = (char)(0x80 | (codePoint & 0x3F));
+    }
+    return out;
+}
+
+static bool readHex4(const char *p, const char *end, uint32_t &out)
+{
+    if (end - p < 4)
+        return false;
+    out = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        out <<= 4;
+        if (c >= '0' && c <= '9')
+            out |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            out |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            out |= c - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+bool JsonScanner::unescape(const char *begin, const char *end, char *out, size_t &length)
+{
+    const char *p = begin;
+    char *written = out;
+    while (p < end) {
+        // Copy the unescaped runs at once
+        const char *run = p;
+        while (p < end && *p != '\\')
+            p++;
+        memcpy(written, run, p - run);
+        written += p - run;
+        if (p == end)
+            break;
+        if (++p == end)
+            return false;
+        switch (*p++) {
+            case '"': *written++ = '"'; break;
+            case '\\': *written++ = '\\'; break;
+            case '/': *written++ = '/'; break;
+            case 'b': *written++ = '\b'; break;
+            case 'f': *written++ = '\f'; break;
+            case 'n': *written++ = '\n'; break;
+            case 'r': *written++ = '\r'; break;
+            case 't': *written++ = '\t'; break;
+            case 'u': {
+                uint32_t codePoint, low;
+                if (!readHex4(p, end, codePoint))
+                    return false;
+                p += 4;
+                // A surrogate pair
+                if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+                    if (end - p < 6 || p[0] != '\\' || p[1] != 'u' || !readHex4(p + 2, end, low))
+                        return false;
+                    p += 6;
+                    codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+                }
+                // At most 4 bytes for the 6 or 12 of the escape sequence
+                written = writeUtf8(codePoint, written);
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    length = written - out;
+    return true;
+}
+
+bool JsonScanner::unescape(const char *begin, const char *end, std::string &out)
+{
+    // The decoded string is never longer than the escaped one
+    size_t size = out.size(), length;
+    out.resize(size + (end - begin));
+    bool decoded = unescape(begin, end, &out[0] + size, length);
+    out.resize(decoded ? size + length : size);
+    return decoded;
+}
+
+bool JsonScanner::readString(std::string &out)
+{
+    const char *begin, *stringEnd;
+    if (!readRawString(begin, stringEnd))
+        return false;
+    return unescape(begin, stringEnd, out) || fail();
+}
+
+bool JsonScanner::readInteger(int64_t &out)
+{
+    skipWhitespace();
+    bool negative = cursor < end && *cursor == '-';
+    uint64_t value;
+    if (negative)
+        cursor++;
+    if (!readUnsigned(value) || value > (uint64_t)INT64_MAX + negative)
+        return fail();
+    // -INT64_MIN doesn't fit in an int64_t
+    if (negative)
+        out = value == (uint64_t)INT64_MAX + 1 ? INT64_MIN : -(int64_t)value;
+    else
+        out = value;
+    return true;
+}
+
+bool JsonScanner::readUnsigned(uint64_t &out)
+{
+    skipWhitespace();
+    if (cursor == end || *cursor < '0' || *cursor > '9')
+        return fail();
+    out = 0;
+    while (cursor < end && *cursor >= '0' && *cursor <= '9') {
+        unsigned int digit = *cursor++ - '0';
+        // Rather than wrapping around
+        if (out > (UINT64_MAX - digit) / 10)
+            return fail();
+        out = out * 10 + digit;
+    }
+    // Tolerate a zero fraction for integral values such as "1.0", but don't truncate others
+    if (cursor < end && *cursor == '.') {
+        const char *fraction = ++cursor;
+        while (cursor < end && *cursor == '0')
+            cursor++;
+        if (cursor == fraction || (cursor < end && *cursor >= '1' && *cursor <= '9'))
+            return fail();
+    }
+    if (cursor < end && (*cursor == 'e' || *cursor == 'E'))
+        return fail();
+    return true;
+}
+
+bool JsonScanner::readDouble(double &out)
+{
+    const char *begin, *valueEnd;
+    if (!skipValue(begin, valueEnd) || valueEnd - begin > 63)
+        return fail();
+    char number[64];
+    memcpy(number, begin, valueEnd - begin);
+    number[valueEnd - begin] = '\0';
+    char *parsedEnd;
+    out = strtod(number, &parsedEnd);
+    return parsedEnd == number + (valueEnd - begin) || fail();
+}
+
+bool JsonScanner::readBool(bool &out)
+{
+    skipWhitespace();
+    if (end - cursor >= 4 && memcmp(cursor, "true", 4) == 0) {
+        cursor += 4;
+        out = true;
+        return true;
+    }
+    if (end - cursor >= 5 && memcmp(cursor, "false", 5) == 0) {
+        cursor += 5;
+        out = false;
+        return true;
+    }
+    return fail();
+}
+
+bool JsonScanner::readNull()
+{
+    skipWhitespace();
+    if (end - cursor >= 4 && memcmp(cursor, "null", 4) == 0) {
+        cursor += 4;
+        return true;
+    }
+    return false;
+}
+
+bool JsonScanner::skipValue()
+{
+    const char *begin, *valueEnd;
+    return skipValue(begin, valueEnd);
+}
+
+bool JsonScanner::skipValue(const char *&begin, const char *&valueEnd)
+{
+    skipWhitespace();
+    begin = cursor;
+    if (cursor == end)
+        return fail();
+    if (*cursor == '"') {
+        const char *stringBegin, *stringEnd;
+        if (!readRawString(stringBegin, stringEnd))
+            return false;
+    } else if (*cursor == '{' || *cursor == '[') {
+        int depth = 0;
+        bool inString = false;
+        for (; cursor < end; cursor++) {
+            char c = *cursor;
+            if (inString) {
+                if (c == '\\')
+                    cursor++;
+                else if (c == '"')
+                    inString = false;
+            } else if (c == '"') {
+                inString = true;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && --depth == 0) {
+                cursor++;
+                break;
+            }
+        }
+        if (depth)
+            return fail();
+    } else {
+        // A number, boolean or null
+        while (cursor < end && *cursor != ',' && *cursor != '}' && *cursor != ']'
+                && *cursor != ' ' && *cursor != '\n' && *cursor != '\r' && *cursor != '\t')
+            cursor++;
+        // A missing value, e.g. in `[1,]`, which would leave us in place for ever
+        if (cursor == begin)
+            return fail();
+    }
+    valueEnd = cursor;
+    return true;
+}
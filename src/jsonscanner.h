@@ -0,0 +1,97 @@
+#ifndef LIGHTNINGCPP_JSONSCANNER_H
+#define LIGHTNINGCPP_JSONSCANNER_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * A pull tokenizer over a JSON text which doesn't build any tree.
+ *
+ * It lets us walk through the parts of a message we care about and skip the
+ * rest, getting pointers into the original text instead of copies. Objects are
+ * iterated with beginObject() then nextMember() until it returns false, arrays
+ * with beginArray() then nextElement().
+ *
+ * Once a method returned false because of malformed input, failed() is set and
+ * the scanner should be discarded.
+ */
+class JsonScanner {
+
+public:
+    JsonScanner(const char *begin, const char *end);
+
+    /** Skips whitespace and returns the next character, or 0 at the end of the text. */
+    char peek();
+
+    bool beginObject();
+
+    /**
+     * Moves to the next member of the current object.
+     *
+     * @param keyBegin Set to the beginning of the (raw, still escaped) member name
+     * @param keyEnd Set to the end of the member name
+     * @return false once the end of the object is consumed
+     */
+    bool nextMember(const char *&keyBegin, const char *&keyEnd);
+
+    bool beginArray();
+
+    /** Moves to the next element of the current array, returns false once its end is consumed. */
+    bool nextElement();
+
+    /**
+     * Reads a string without decoding it.
+     *
+     * @param begin Set to the first character after the opening quote
+     * @param end Set to the closing quote
+     */
+    bool readRawString(const char *&begin, const char *&end);
+
+    /** Reads a string, appending it to `out` with its escape sequences decoded. */
+    bool readString(std::string &out);
+
+    /**
+     * Reads an integer, which may be written with a zero fraction ("1.0"). Fails rather than
+     * truncating a fraction or an exponent, or wrapping around if it's out of range.
+     */
+    bool readInteger(int64_t &out);
+    bool readUnsigned(uint64_t &out);
+    bool readDouble(double &out);
+    bool readBool(bool &out);
+
+    /** Consumes a null value, returns false (without failing) if the next value is not null. */
+    bool readNull();
+
+    /** Skips the next value, whatever its type. */
+    bool skipValue();
+
+    /** Skips the next value, setting its span (without the surrounding whitespace). */
+    bool skipValue(const char *&begin, const char *&end);
+
+    /** The current position in the text. */
+    const char *position() const;
+
+    bool failed() const;
+
+    /** Decodes the contents of a JSON string (without its quotes), appending them to `out`. */
+    static bool unescape(const char *begin, const char *end, std::string &out);
+
+    /**
+     * Decodes the contents of a JSON string (without its quotes) into `out`, which must
+     * hold at least `end - begin` bytes : the decoded string is never longer.
+     *
+     * @param length Set to the length of the decoded string
+     */
+    static bool unescape(const char *begin, const char *end, char *out, size_t &length);
+
+private:
+    const char *cursor;
+    const char *end;
+    bool error;
+
+    void skipWhitespace();
+    bool fail();
+    bool expect(const char &c);
+};
+
+#endif // LIGHTNINGCPP_JSONSCANNER_H
@@ -0,0 +1,150 @@
+#include "jsonview.h"
+#include "jsonscanner.h"
+
+#include <cstring>
+
+const JsonView JsonView::null = {JsonView::NULL_VALUE, {"null", 4}, {"", 0}, nullptr, nullptr, 0};
+
+/**
+ * Parses the next value of the scanner, and its children
+ */
+static JsonView *parseValue(JsonScanner &scanner, Arena &arena)
+{
+    JsonView *value = arena.create<JsonView>(JsonView::null);
+    const char *begin = nullptr, *end = nullptr;
+    char c = scanner.peek();
+
+    if (c == '{' || c == '[') {
+        begin = scanner.position();
+        const JsonView **last = &value->first;
+        if (c == '{') {
+            value->type = JsonView::OBJECT;
+            if (!scanner.beginObject())
+                return nullptr;
+            const char *key, *keyEnd;
+            while (scanner.nextMember(key, keyEnd)) {
+                JsonView *member = parseValue(scanner, arena);
+                if (!member)
+                    return nullptr;
+                member->key.data = key;
+                member->key.size = keyEnd - key;
+                *last = member;
+                last = &member->next;
+                value->size++;
+            }
+        } else {
+            value->type = JsonView::ARRAY;
+            if (!scanner.beginArray())
+                return nullptr;
+            while (scanner.nextElement()) {
+                JsonView *element = parseValue(scanner, arena);
+                if (!element)
+                    return nullptr;
+                *last = element;
+                last = &element->next;
+                value->size++;
+            }
+        }
+        if (scanner.failed())
+            return nullptr;
+        value->raw.data = begin;
+        value->raw.size = scanner.position() - begin;
+        return value;
+    }
+
+    if (c == '"') {
+        if (!scanner.readRawString(begin, end))
+            return nullptr;
+        value->type = JsonView::STRING;
+    } else {
+        if (!scanner.skipValue(begin, end))
+            return nullptr;
+        if (c == 't' || c == 'f')
+            value->type = JsonView::BOOLEAN;
+        else if (c != 'n')
+            value->type = JsonView::NUMBER;
+    }
+    value->raw.data = begin;
+    value->raw.size = end - begin;
+    return value;
+}
+
+const JsonView *JsonView::parse(const char *begin, const char *end, Arena &arena)
+{
+    JsonScanner scanner(begin, end);
+    return parseValue(scanner, arena);
+}
+
+const JsonView &JsonView::operator[](const char *name) const
+{
+    size_t length = strlen(name);
+    if (type != OBJECT)
+        return null;
+    for (const JsonView *member = first; member; member = member->next)
+        if (member->key.size == length && memcmp(member->key.data, name, length) == 0)
+            return *member;
+    return null;
+}
+
+bool JsonView::isMember(const char *name) const
+{
+    return &(*this)[name] != &null;
+}
+
+const JsonView &JsonView::operator[](const int &index) const
+{
+    if (type != ARRAY || index < 0)
+        return null;
+    const JsonView *element = first;
+    for (int i = 0; element && i < index; i++)
+        element = element->next;
+    return element ? *element : null;
+}
+
+int64_t JsonView::asInt() const
+{
+    int64_t value = 0;
+    if (type == NUMBER && !JsonScanner(raw.begin(), raw.end()).readInteger(value))
+        return 0;
+    return value;
+}
+
+uint64_t JsonView::asUInt() const
+{
+    uint64_t value = 0;
+    if (type == NUMBER && !JsonScanner(raw.begin(), raw.end()).readUnsigned(value))
+        return 0;
+    return value;
+}
+
+double JsonView::asDouble() const
+{
+    double value = 0;
+    if (type == NUMBER && !JsonScanner(raw.begin(), raw.end()).readDouble(value))
+        return 0;
+    return value;
+}
+
+bool JsonView::asBool() const
+{
+    return type == BOOLEAN && raw.data[0] == 't';
+}
+
+StringView JsonView::asString(Arena &arena) const
+{
+    if (type != STRING || !memchr(raw.data, '\\', raw.size))
+        return raw;
+    // Decoded straight into the arena, it's never longer than the escaped string
+    char *decoded = static_cast<char*>(arena.allocate(raw.size, 1));
+    size_t length;
+    if (!JsonScanner::unescape(raw.begin(), raw.end(), decoded, length))
+        return raw;
+    StringView view = {decoded, length};
+    return view;
+}
+
+bool JsonView::equals(const char *str) const
+{
+    size_t length = strlen(str);
+    return type == STRING && raw.size == length && memcmp(raw.data, str, length) == 0;
+}
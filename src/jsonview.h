@@ -0,0 +1,75 @@
+#ifndef LIGHTNINGCPP_JSONVIEW_H
+#define LIGHTNINGCPP_JSONVIEW_H
+
+#include "arena.h"
+#include "stringview.h"
+
+#include <cstdint>
+
+/**
+ * A JSON value parsed into an Arena instead of a Json::Value tree.
+ *
+ * Nodes point into the parsed text, which must outlive them, and strings are
+ * only decoded when asked to. Members and elements are linked in order, so
+ * lookups are linear : it's meant for the small objects lightningd sends.
+ */
+struct JsonView {
+    enum Type {
+        NULL_VALUE,
+        BOOLEAN,
+        NUMBER,
+        STRING,
+        ARRAY,
+        OBJECT
+    };
+
+    Type type;
+    // The raw text of the value, without the quotes of a string (still escaped)
+    StringView raw;
+    // Its name if it's the member of an object (still escaped)
+    StringView key;
+    // The first member or element, and the next one of our parent
+    const JsonView *first;
+    const JsonView *next;
+    // The number of members or elements
+    size_t size;
+
+    bool isNull() const { return type == NULL_VALUE; }
+    bool isObject() const { return type == OBJECT; }
+    bool isArray() const { return type == ARRAY; }
+    bool isString() const { return type == STRING; }
+
+    /** The member with this name, or a null value. */
+    const JsonView &operator[](const char *name) const;
+    bool isMember(const char *name) const;
+
+    /** The element at this index, or a null value. */
+    const JsonView &operator[](const int &index) const;
+
+    /** The value as a number, 0 if it's not a number. */
+    int64_t asInt() const;
+    uint64_t asUInt() const;
+    double asDouble() const;
+    bool asBool() const;
+
+    /**
+     * The decoded string, copied into the arena if it contains escape sequences.
+     * Anything but a string is returned raw.
+     */
+    StringView asString(Arena &arena) const;
+
+    /** Whether it's a string equal to `str`, compared without decoding it. */
+    bool equals(const char *str) const;
+
+    /**
+     * Parses a JSON text.
+     *
+     * @return The root value, or nullptr if the text is malformed
+     */
+    static const JsonView *parse(const char *begin, const char *end, Arena &arena);
+
+    /** What's returned for missing members and elements. */
+    static const JsonView null;
+};
+
+#endif // LIGHTNINGCPP_JSONVIEW_H
@@ -0,0 +1,127 @@
+#include "jsonwriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static void appendUnsigned(uint64_t value, std::string &out)
+{
+    char digits[20];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n)
+        out += digits[--n];
+}
+
+static void appendDouble(const double &value, std::string &out)
+{
+    if (!std::isfinite(value)) {
+        out += "null";
+        return;
+    }
+    char number[32];
+    int n = snprintf(number, sizeof(number), "%.17g", value);
+    out.append(number, n);
+    // Keep it a real, as Json::FastWriter does
+    if (!strpbrk(number, ".eE"))
+        out += ".0";
+}
+
+void JsonWriter::appendString(const char *begin, const char *end, std::string &out)
+{
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    const char *p = begin;
+    while (p < end) {
+        // Copy the runs which don't need escaping at once
+        const char *run = p;
+        while (p < end && (unsigned char)*p >= 0x20 && *p != '"' && *p != '\\')
+            p++;
+        out.append(run, p - run);
+        if (p == end)
+            break;
+        switch (*p) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[((unsigned char)*p) >> 4];
+                out += hex[((unsigned char)*p) & 0xF];
+        }
+        p++;
+    }
+    out += '"';
+}
+
+void JsonWriter::appendString(const std::string &str, std::string &out)
+{
+    appendString(str.data(), str.data() + str.size(), out);
+}
+
+void JsonWriter::append(const Json::Value &value, std::string &out)
+{
+    switch (value.type()) {
+        case Json::nullValue:
+            out += "null";
+            break;
+        case Json::intValue: {
+            Json::Int64 i = value.asInt64();
+            if (i < 0) {
+                out += '-';
+                appendUnsigned(-(uint64_t)i, out);
+            } else {
+                appendUnsigned(i, out);
+            }
+            break;
+        }
+        case Json::uintValue:
+            appendUnsigned(value.asUInt64(), out);
+            break;
+        case Json::realValue:
+            appendDouble(value.asDouble(), out);
+            break;
+        case Json::stringValue: {
+            const char *begin, *end;
+            value.getString(&begin, &end);
+            appendString(begin, end, out);
+            break;
+        }
+        case Json::booleanValue:
+            out += value.asBool() ? "true" : "false";
+            break;
+        case Json::arrayValue: {
+            out += '[';
+            for (Json::ArrayIndex i = 0; i < value.size(); i++) {
+                if (i)
+                    out += ',';
+                append(value[i], out);
+            }
+            out += ']';
+            break;
+        }
+        case Json::objectValue: {
+            out += '{';
+            bool first = true;
+            for (Json::Value::const_iterator it = value.begin(); it != value.end(); ++it) {
+                if (!first)
+                    out += ',';
+                first = false;
+                const char *end;
+                const char *name = it.memberName(&end);
+                appendString(name, end, out);
+                out += ':';
+                append(*it, out);
+            }
+            out += '}';
+            break;
+        }
+    }
+}
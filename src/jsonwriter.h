@@ -0,0 +1,24 @@
+#ifndef LIGHTNINGCPP_JSONWRITER_H
+#define LIGHTNINGCPP_JSONWRITER_H
+
+#include <jsonrpccpp/client.h>
+#include <string>
+
+/**
+ * Compact JSON serialization appending to a caller-provided buffer.
+ *
+ * Json::FastWriter returns a new string for each value, whereas this lets us
+ * serialize a whole message in place into a buffer reused across messages.
+ */
+class JsonWriter {
+
+public:
+    /** Appends the compact JSON serialization of `value` to `out`. */
+    static void append(const Json::Value &value, std::string &out);
+
+    /** Appends a string as a quoted and escaped JSON string to `out`. */
+    static void appendString(const char *begin, const char *end, std::string &out);
+    static void appendString(const std::string &str, std::string &out);
+};
+
+#endif // LIGHTNINGCPP_JSONWRITER_H
@@ -0,0 +1,78 @@
+#include "latencyhistogram.h"
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+unsigned int LatencyHistogram::bucketOf(const uint64_t &value)
+{
+    if (value < SUB_BUCKETS)
+        return value;
+    unsigned int highestBit = 63 - __builtin_clzll(value);
+    // The 4 bits following the highest one
+    unsigned int sub = (value >> (highestBit - 4)) & (SUB_BUCKETS - 1);
+    return (highestBit - 3) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucketHighest(const unsigned int &bucket)
+{
+    unsigned int exponent = bucket / SUB_BUCKETS, sub = bucket % SUB_BUCKETS;
+    if (!exponent)
+        return sub;
+    uint64_t width = (uint64_t)1 << (exponent - 1);
+    return (SUB_BUCKETS + sub) * width + width - 1;
+}
+
+void LatencyHistogram::record(const uint64_t &micros)
+{
+    buckets[bucketOf(micros)].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(micros, std::memory_order_relaxed);
+    uint64_t current = max.load(std::memory_order_relaxed);
+    while (micros > current && !max.compare_exchange_weak(current, micros, std::memory_order_relaxed))
+        ;
+}
+
+uint64_t LatencyHistogram::getCount() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::getMax() const
+{
+    return max.load(std::memory_order_relaxed);
+}
+
+double LatencyHistogram::getMean() const
+{
+    uint64_t n = getCount();
+    return n ? (double)sum.load(std::memory_order_relaxed) / n : 0;
+}
+
+uint64_t LatencyHistogram::getPercentile(const double &percentile) const
+{
+    uint64_t n = getCount();
+    if (!n)
+        return 0;
+    // The rank of the value we are looking for, from 1 to n
+    uint64_t rank = percentile / 100 * n + 0.5;
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+            return bucketHighest(i) < getMax() ? bucketHighest(i) : getMax();
+    }
+    return getMax();
+}
+
+void LatencyHistogram::reset()
+{
+    for (unsigned int i = 0; i < BUCKETS; i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+    count.store(0, std::memory_order_relaxed);
+    sum.store(0, std::memory_order_relaxed);
+    max.store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,49 @@
+#ifndef LIGHTNINGCPP_LATENCYHISTOGRAM_H
+#define LIGHTNINGCPP_LATENCYHISTOGRAM_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * A histogram of durations in microseconds, with a bounded relative error.
+ *
+ * Values under 16 have their own bucket, larger ones are bucketed by their
+ * highest bit then by the next 4 bits, so that any recorded value is reported
+ * within 1/16 of itself. Recording is lock-free and can be done from any
+ * thread.
+ */
+class LatencyHistogram {
+
+public:
+    LatencyHistogram();
+
+    void record(const uint64_t &micros);
+
+    uint64_t getCount() const;
+    uint64_t getMax() const;
+    double getMean() const;
+
+    /**
+     * @param percentile The percentile to compute, from 0 to 100 (e.g. 99.9)
+     * @return The highest value of the bucket holding this percentile, 0 if nothing was recorded
+     */
+    uint64_t getPercentile(const double &percentile) const;
+
+    void reset();
+
+private:
+    static const unsigned int SUB_BUCKETS = 16;
+    // One bucket per value under 16, then 16 per exponent up to 2^63
+    static const unsigned int BUCKETS = 61 * SUB_BUCKETS;
+
+    std::atomic<uint64_t> buckets[BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+    static unsigned int bucketOf(const uint64_t &value);
+    /** The highest value falling into this bucket. */
+    static uint64_t bucketHighest(const unsigned int &bucket);
+};
+
+#endif // LIGHTNINGCPP_LATENCYHISTOGRAM_H
@@ -0,0 +1,104 @@
+#include "messagereader.h"
+#include "jsonscanner.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+// How much we try to read from the file descriptor at once
+static const size_t READ_SIZE = 65536;
+
+std::string PluginMessage::getId() const
+{
+    std::string result;
+    if (!JsonScanner::unescape(id, id + idLength, result))
+        return std::string(id, idLength);
+    return result;
+}
+
+MessageReader::MessageReader(const int &fd):
+    fd(fd)
+{
+    Json::CharReaderBuilder builder;
+    reader.reset(builder.newCharReader());
+}
+
+bool MessageReader::parseEnvelope(const char *begin, const char *end, PluginMessage &message)
+{
+    JsonScanner scanner(begin, end);
+    const char *key, *keyEnd;
+    bool hasJsonrpc = false, hasMethod = false, hasParams = false;
+
+    message.hasId = false;
+    if (!scanner.beginObject())
+        return false;
+    while (scanner.nextMember(key, keyEnd)) {
+        size_t length = keyEnd - key;
+        const char *valueBegin, *valueEnd;
+        if (length == 6 && memcmp(key, "method", 6) == 0) {
+            if (!scanner.readRawString(valueBegin, valueEnd))
+                return false;
+            message.method = valueBegin;
+            message.methodLength = valueEnd - valueBegin;
+            hasMethod = true;
+        } else if (length == 6 && memcmp(key, "params", 6) == 0) {
+            if (!scanner.skipValue(valueBegin, valueEnd))
+                return false;
+            message.params = valueBegin;
+            message.paramsLength = valueEnd - valueBegin;
+            // Like a missing member, a null one is noise
+            hasParams = !(valueEnd - valueBegin == 4 && memcmp(valueBegin, "null", 4) == 0);
+        } else if (length == 2 && memcmp(key, "id", 2) == 0) {
+            if (scanner.peek() == '"') {
+                if (!scanner.readRawString(valueBegin, valueEnd))
+                    return false;
+            } else if (!scanner.skipValue(valueBegin, valueEnd)) {
+                return false;
+            }
+            message.id = valueBegin;
+            message.idLength = valueEnd - valueBegin;
+            message.hasId = !(valueEnd - valueBegin == 4 && memcmp(valueBegin, "null", 4) == 0);
+        } else {
+            if (!scanner.skipValue(valueBegin, valueEnd))
+                return false;
+            if (length == 7 && memcmp(key, "jsonrpc", 7) == 0)
+                hasJsonrpc = true;
+        }
+    }
+    return !scanner.failed() && hasJsonrpc && hasMethod && hasParams;
+}
+
+bool MessageReader::next(PluginMessage &message)
+{
+    while (!nextBuffered(message))
+        if (!fill())
+            return false;
+    return true;
+}
+
+bool MessageReader::nextBuffered(PluginMessage &message)
+{
+    const char *begin, *end;
+    while (framer.next(begin, end))
+        if (parseEnvelope(begin, end, message))
+            return true;
+    return false;
+}
+
+bool MessageReader::fill()
+{
+    while (true) {
+        ssize_t n = read(fd, framer.prepare(READ_SIZE), READ_SIZE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        framer.commit(n);
+        return true;
+    }
+}
+
+bool MessageReader::parseParams(const PluginMessage &message, Json::Value &params)
+{
+    return reader->parse(message.params, message.params + message.paramsLength, &params, nullptr);
+}
@@ -0,0 +1,87 @@
+#ifndef LIGHTNINGCPP_MESSAGEREADER_H
+#define LIGHTNINGCPP_MESSAGEREADER_H
+
+#include "jsonframer.h"
+
+#include <jsonrpccpp/client.h>
+#include <memory>
+#include <string>
+
+/**
+ * The envelope of a JSONRPC message sent by lightningd to a plugin.
+ *
+ * All the spans point into the MessageReader buffer and are only valid until
+ * the next call to MessageReader::next().
+ */
+struct PluginMessage {
+    // The method name
+    const char *method;
+    size_t methodLength;
+    // The id, without its quotes if it's a string. Notifications don't have any.
+    bool hasId;
+    const char *id;
+    size_t idLength;
+    // The raw JSON text of the parameters, not parsed yet
+    const char *params;
+    size_t paramsLength;
+
+    /** The id as a string, as sent back in the response. */
+    std::string getId() const;
+};
+
+/**
+ * Reads lightningd's messages from a file descriptor (the plugin's stdin).
+ *
+ * Messages are read into a reusable buffer and only their envelope is scanned,
+ * without building a JSON tree. The parameters are parsed separately, and only
+ * once we know there is a handler for them.
+ */
+class MessageReader {
+
+public:
+    MessageReader(const int &fd);
+
+    /**
+     * Blocks until the next valid message is read. Anything which is not a JSONRPC
+     * message with a method and parameters is discarded.
+     *
+     * @return false once the file descriptor is closed
+     */
+    bool next(PluginMessage &message);
+
+    /**
+     * Gets the next valid message already read, without reading from the file descriptor.
+     *
+     * @return false if there is none
+     */
+    bool nextBuffered(PluginMessage &message);
+
+    /**
+     * Reads once from the file descriptor, e.g. when an event loop tells it's readable.
+     *
+     * @return false once the file descriptor is closed
+     */
+    bool fill();
+
+    /**
+     * Parses the parameters of a message.
+     *
+     * @param params Set to the parsed parameters
+     * @return false if they are not valid JSON
+     */
+    bool parseParams(const PluginMessage &message, Json::Value &params);
+
+    /**
+     * Scans the envelope of a JSONRPC message.
+     *
+     * @return false if it isn't a valid message
+     */
+    static bool parseEnvelope(const char *begin, const char *end, PluginMessage &message);
+
+private:
+    int fd;
+    JsonFramer framer;
+    std::unique_ptr<Json::CharReader> reader;
+};
+
+#endif // LIGHTNINGCPP_MESSAGEREADER_H
@@ -0,0 +1,235 @@
+#include "networkgraph.h"
+
+#include <algorithm>
+
+uint32_t GraphSnapshot::getNodeCount() const
+{
+    return offsets.empty() ? 0 : offsets.size() - 1;
+}
+
+size_t GraphSnapshot::getChannelCount() const
+{
+    return channels.size();
+}
+
+ChannelRange GraphSnapshot::outgoing(const uint32_t &node) const
+{
+    if (node >= getNodeCount())
+        return {nullptr, nullptr};
+    const Channel *first = channels.data();
+    return {first + offsets[node], first + offsets[node + 1]};
+}
+
+ChannelIndexRange GraphSnapshot::incoming(const uint32_t &node) const
+{
+    if (node + 1 >= incomingOffsets.size())
+        return {nullptr, nullptr};
+    const uint32_t *first = incomingChannels.data();
+    return {first + incomingOffsets[node], first + incomingOffsets[node + 1]};
+}
+
+const Channel *GraphSnapshot::findChannel(const uint64_t &shortChannelId, const uint8_t &direction) const
+{
+    auto it = std::lower_bound(index.begin(), index.end(), std::make_pair(shortChannelId, (uint32_t)0),
+            [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+        return a.first < b.first;
+    });
+    for (; it != index.end() && it->first == shortChannelId; it++)
+        if ((channels[it->second].channelFlags & 1) == direction)
+            return &channels[it->second];
+    return nullptr;
+}
+
+const Node *GraphSnapshot::findNode(const uint32_t &node) const
+{
+    if (node >= nodes.size() || nodes[node].id == UINT32_MAX)
+        return nullptr;
+    return &nodes[node];
+}
+
+const std::vector<Channel> &GraphSnapshot::getChannels() const
+{
+    return channels;
+}
+
+NetworkGraph::NetworkGraph(CLightningRpc &rpc, const bool &withNodes):
+    rpc(rpc),
+    withNodes(withNodes),
+    snapshot(std::make_shared<GraphSnapshot>()),
+    stats(),
+    refreshing(false)
+{}
+
+NetworkGraph::~NetworkGraph()
+{
+    stopRefreshing();
+}
+
+/** Whether two states of a channel are the same. */
+static bool sameUpdate(const Channel &a, const Channel &b)
+{
+    return a.lastUpdate == b.lastUpdate && a.baseFeeMsat == b.baseFeeMsat && a.feePerMillionth == b.feePerMillionth
+        && a.delay == b.delay && a.htlcMinimumMsat == b.htlcMinimumMsat && a.amountMsat == b.amountMsat
+        && a.messageFlags == b.messageFlags && a.channelFlags == b.channelFlags && a.active == b.active
+        && a.isPublic == b.isPublic;
+}
+
+void NetworkGraph::build(GraphSnapshot &graph, const std::vector<Channel> &channels, const uint32_t &nodeCount)
+{
+    // Counting sort by source, which keeps the channels of a node in the order lightningd gave them
+    graph.offsets.assign(nodeCount + 1, 0);
+    for (const Channel &channel : channels)
+        graph.offsets[channel.source + 1]++;
+    for (uint32_t node = 0; node < nodeCount; node++)
+        graph.offsets[node + 1] += graph.offsets[node];
+    std::vector<uint32_t> next(graph.offsets.begin(), graph.offsets.end() - 1);
+    graph.channels.resize(channels.size());
+    for (const Channel &channel : channels)
+        graph.channels[next[channel.source]++] = channel;
+
+    graph.incomingOffsets.assign(nodeCount + 1, 0);
+    for (const Channel &channel : channels)
+        graph.incomingOffsets[channel.destination + 1]++;
+    for (uint32_t node = 0; node < nodeCount; node++)
+        graph.incomingOffsets[node + 1] += graph.incomingOffsets[node];
+    next.assign(graph.incomingOffsets.begin(), graph.incomingOffsets.end() - 1);
+    graph.incomingChannels.resize(channels.size());
+    for (uint32_t i = 0; i < graph.channels.size(); i++)
+        graph.incomingChannels[next[graph.channels[i].destination]++] = i;
+
+    graph.index.resize(channels.size());
+    for (uint32_t i = 0; i < graph.channels.size(); i++)
+        graph.index[i] = std::make_pair(graph.channels[i].shortChannelId, i);
+    std::sort(graph.index.begin(), graph.index.end(),
+            [&graph](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+        if (a.first != b.first)
+            return a.first < b.first;
+        return (graph.channels[a.second].channelFlags & 1) < (graph.channels[b.second].channelFlags & 1);
+    });
+}
+
+void NetworkGraph::refresh()
+{
+    std::lock_guard<std::mutex> refreshLock(refreshMutex);
+    auto start = std::chrono::steady_clock::now();
+    try {
+        rpc.listChannels(fetchedChannels);
+        if (withNodes)
+            rpc.listNodes(fetchedNodes);
+    } catch (CLightningRpcException &e) {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        stats.errors++;
+        throw;
+    }
+    // Any node id the graph refers to has been interned by now
+    uint32_t nodeCount = rpc.getNodeIds().size();
+
+    std::shared_ptr<const GraphSnapshot> current = getSnapshot();
+    std::shared_ptr<GraphSnapshot> next = std::make_shared<GraphSnapshot>();
+    unsigned long added = 0, matched = 0, updated = 0;
+    positions.resize(fetchedChannels.channels.size());
+    for (size_t i = 0; i < fetchedChannels.channels.size(); i++) {
+        const Channel &channel = fetchedChannels.channels[i];
+        const Channel *known = current->findChannel(channel.shortChannelId, channel.channelFlags & 1);
+        if (!known || known->source != channel.source || known->destination != channel.destination) {
+            added++;
+            continue;
+        }
+        matched++;
+        positions[i] = known - current->channels.data();
+        if (!sameUpdate(*known, channel))
+            updated++;
+    }
+    unsigned long removed = current->channels.size() > matched ? current->channels.size() - matched : 0;
+    bool rebuild = added > 0 || removed > 0;
+
+    if (rebuild) {
+        build(*next, fetchedChannels.channels, nodeCount);
+    } else {
+        // Same channels, same layout : only patch the updated ones
+        next->channels = current->channels;
+        if (updated > 0)
+            for (size_t i = 0; i < fetchedChannels.channels.size(); i++)
+                next->channels[positions[i]] = fetchedChannels.channels[i];
+        next->offsets = current->offsets;
+        next->offsets.resize(nodeCount + 1, next->offsets.empty() ? 0 : next->offsets.back());
+        next->incomingOffsets = current->incomingOffsets;
+        next->incomingOffsets.resize(nodeCount + 1, next->incomingOffsets.empty() ? 0 : next->incomingOffsets.back());
+        next->incomingChannels = current->incomingChannels;
+        next->index = current->index;
+    }
+
+    if (withNodes) {
+        Node unannounced = Node();
+        unannounced.id = UINT32_MAX;
+        next->nodes.assign(nodeCount, unannounced);
+        for (const Node &node : fetchedNodes.nodes)
+            next->nodes[node.id] = node;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        snapshot = next;
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    stats.refreshes++;
+    if (rebuild)
+        stats.rebuilds++;
+    stats.channelsAdded = added;
+    stats.channelsRemoved = removed;
+    stats.channelsUpdated = updated;
+    stats.lastRefreshMicros = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+void NetworkGraph::startRefreshing(const std::chrono::milliseconds &interval)
+{
+    stopRefreshing();
+    std::lock_guard<std::mutex> lock(refresherMutex);
+    refreshing = true;
+    refresher = std::thread(&NetworkGraph::refreshPeriodically, this, interval);
+}
+
+void NetworkGraph::stopRefreshing()
+{
+    {
+        std::lock_guard<std::mutex> lock(refresherMutex);
+        refreshing = false;
+    }
+    refresherWakeup.notify_all();
+    if (refresher.joinable())
+        refresher.join();
+}
+
+void NetworkGraph::refreshPeriodically(const std::chrono::milliseconds interval)
+{
+    std::unique_lock<std::mutex> lock(refresherMutex);
+    while (refreshing) {
+        lock.unlock();
+        try {
+            refresh();
+        } catch (CLightningRpcException &e) {
+            // Counted, we'll retry at the next tick
+        }
+        lock.lock();
+        refresherWakeup.wait_for(lock, interval, [this] { return !refreshing; });
+    }
+}
+
+std::shared_ptr<const GraphSnapshot> NetworkGraph::getSnapshot()
+{
+    std::lock_guard<std::mutex> lock(snapshotMutex);
+    return snapshot;
+}
+
+NetworkGraphStats NetworkGraph::getStats()
+{
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return stats;
+}
+
+Interner &NetworkGraph::getNodeIds()
+{
+    return rpc.getNodeIds();
+}
@@ -0,0 +1,170 @@
+#ifndef LIGHTNINGCPP_NETWORKGRAPH_H
+#define LIGHTNINGCPP_NETWORKGRAPH_H
+
+#include "clightningrpc.h"
+#include "rpcresults.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/** The channels going out of a node, contiguous in memory. */
+struct ChannelRange {
+    const Channel *first;
+    const Channel *last;
+
+    const Channel *begin() const { return first; }
+    const Channel *end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
+/** Indexes into GraphSnapshot::getChannels(), of the channels going to a node. */
+struct ChannelIndexRange {
+    const uint32_t *first;
+    const uint32_t *last;
+
+    const uint32_t *begin() const { return first; }
+    const uint32_t *end() const { return last; }
+    size_t size() const { return last - first; }
+};
+
+/**
+ * An immutable state of the network as known by lightningd at some refresh.
+ *
+ * Channels (one per direction) are stored grouped by source node in a single
+ * array, in compressed sparse row layout : the outgoing channels of the node
+ * `n` are those between `offsets[n]` and `offsets[n + 1]`. Nodes are the
+ * indexes of their id in the CLightningRpc's node ids interner. Incoming
+ * channels are indexed the same way, by destination.
+ */
+class GraphSnapshot {
+
+public:
+    /** One more than the greatest node index of the graph. */
+    uint32_t getNodeCount() const;
+    size_t getChannelCount() const;
+
+    ChannelRange outgoing(const uint32_t &node) const;
+    ChannelIndexRange incoming(const uint32_t &node) const;
+
+    /**
+     * @param direction 0 for the channel from the lesser node id to the greater one, 1 otherwise
+     * @return The channel, or nullptr if it's not in the graph
+     */
+    const Channel *findChannel(const uint64_t &shortChannelId, const uint8_t &direction) const;
+
+    /** @return The node, or nullptr if it did not announce itself. */
+    const Node *findNode(const uint32_t &node) const;
+
+    /** All the channels, grouped by source. */
+    const std::vector<Channel> &getChannels() const;
+
+private:
+    friend class NetworkGraph;
+
+    std::vector<Channel> channels;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> incomingOffsets;
+    std::vector<uint32_t> incomingChannels;
+    // (short_channel_id, index into `channels`), sorted by short channel id then direction
+    std::vector<std::pair<uint64_t, uint32_t>> index;
+    // Indexed by node, id set to UINT32_MAX for the nodes which did not announce themselves
+    std::vector<Node> nodes;
+};
+
+struct NetworkGraphStats {
+    // Successful refreshes
+    unsigned long refreshes;
+    // Refreshes which changed the set of channels, and re-laid the graph out
+    unsigned long rebuilds;
+    // Refreshes which failed, the graph being kept as it was
+    unsigned long errors;
+    // What the last successful refresh changed
+    unsigned long channelsAdded;
+    unsigned long channelsRemoved;
+    unsigned long channelsUpdated;
+    // How long the last successful refresh took, in microseconds
+    unsigned long lastRefreshMicros;
+};
+
+/**
+ * A cached view of the network graph (from listchannels and listnodes), for
+ * route finding or any repeated walk of the graph.
+ *
+ * Readers take a snapshot, which stays valid and unchanged as long as they hold
+ * it while refreshes publish new ones. lightningd does not tell what changed in
+ * its gossip store so each refresh fetches the whole set, but decodes it into
+ * typed results without building any Json::Value, and only lays the graph out
+ * again if channels appeared or disappeared : updated fees or flags are patched
+ * into a copy of the current arrays.
+ */
+class NetworkGraph {
+
+public:
+    /**
+     * @param rpc Used to fetch the graph, it must outlive the NetworkGraph. A
+     *            connection pool (see CLightningRpc) makes refreshes cheaper.
+     * @param withNodes Whether to fetch the nodes too, otherwise findNode() always
+     *            returns nullptr (defaults to true)
+     */
+    NetworkGraph(CLightningRpc &rpc, const bool &withNodes=true);
+
+    /** Stops refreshing. */
+    ~NetworkGraph();
+
+    /**
+     * Fetches the graph from lightningd and publishes it, concurrent calls are
+     * serialized.
+     *
+     * @throw CLightningRpcException if lightningd could not be queried
+     */
+    void refresh();
+
+    /**
+     * Refreshes from a background thread every `interval`, starting now. Failed
+     * refreshes are only counted in the stats.
+     */
+    void startRefreshing(const std::chrono::milliseconds &interval);
+    void stopRefreshing();
+
+    /** The latest state of the graph, empty until the first refresh. */
+    std::shared_ptr<const GraphSnapshot> getSnapshot();
+
+    NetworkGraphStats getStats();
+
+    /** The node ids the snapshots refer to. */
+    Interner &getNodeIds();
+
+private:
+    CLightningRpc &rpc;
+    bool withNodes;
+
+    std::mutex snapshotMutex;
+    std::shared_ptr<const GraphSnapshot> snapshot;
+
+    // Held during a whole refresh, protects the buffers below
+    std::mutex refreshMutex;
+    ListChannelsResult fetchedChannels;
+    ListNodesResult fetchedNodes;
+    // Where each fetched channel is in the current graph
+    std::vector<uint32_t> positions;
+
+    std::mutex statsMutex;
+    NetworkGraphStats stats;
+
+    std::thread refresher;
+    std::mutex refresherMutex;
+    std::condition_variable refresherWakeup;
+    bool refreshing;
+
+    /** Lays `channels` out into `graph`, sorting them by source. */
+    static void build(GraphSnapshot &graph, const std::vector<Channel> &channels, const uint32_t &nodeCount);
+    void refreshPeriodically(const std::chrono::milliseconds interval);
+};
+
+#endif // LIGHTNINGCPP_NETWORKGRAPH_H
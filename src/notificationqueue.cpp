@@ -0,0 +1,225 @@
+#include "notificationqueue.h"
+
+#include <algorithm>
+
+NotificationQueue::Topic::Topic(const std::string &name, const std::function<void(std::vector<Json::Value>&)> &handler,
+            const size_t &capacity, const size_t &maxBatch, const int &priority):
+    name(name),
+    handler(handler),
+    maxBatch(maxBatch ? maxBatch : 1),
+    priority(priority),
+    head(0),
+    tail(0),
+    received(0),
+    delivered(0),
+    dropped(0),
+    overflows(0),
+    batches(0),
+    operation("notification:" + name)
+{
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+    std::vector<Slot> ring(size);
+    slots.swap(ring);
+    mask = size - 1;
+    // A slot's sequence is the position it can be pushed at, plus one once it can be popped
+    for (size_t i = 0; i < size; i++)
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool NotificationQueue::Topic::tryPush(Json::Value &params)
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[pos & mask];
+        intptr_t diff = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)pos;
+        if (diff == 0 && head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+        // Not popped yet since the last lap
+        if (diff < 0)
+            return false;
+        if (diff > 0)
+            pos = head.load(std::memory_order_relaxed);
+    }
+    slot->params.swap(params);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+bool NotificationQueue::Topic::tryPop(Json::Value &params)
+{
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &slots[pos & mask];
+        intptr_t diff = (intptr_t)slot->sequence.load(std::memory_order_acquire) - (intptr_t)(pos + 1);
+        if (diff == 0 && tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+        // Not pushed yet
+        if (diff < 0)
+            return false;
+        if (diff > 0)
+            pos = tail.load(std::memory_order_relaxed);
+    }
+    // Workers pop into an empty value, so that the slot doesn't keep the parameters alive
+    params.swap(slot->params);
+    slot->sequence.store(pos + mask + 1, std::memory_order_release);
+    return true;
+}
+
+bool NotificationQueue::Topic::empty() const
+{
+    size_t pos = tail.load(std::memory_order_relaxed);
+    return slots[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+}
+
+NotificationQueue::NotificationQueue(const unsigned int &workers, const OverflowPolicy &policy,
+            Instrumentation *instrumentation):
+    policy(policy),
+    instrumentation(instrumentation),
+    workerCount(workers ? workers : 1),
+    idleWorkers(0),
+    producerBlocked(false),
+    stopping(false)
+{}
+
+NotificationQueue::~NotificationQueue()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping.store(true);
+    }
+    queued.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+    for (Topic *topic : topics)
+        delete topic;
+}
+
+size_t NotificationQueue::addTopic(const std::string &name, const std::function<void(std::vector<Json::Value>&)> &handler,
+            const size_t &capacity, const size_t &maxBatch, const int &priority)
+{
+    Topic *topic = new Topic(name, handler, capacity, maxBatch, priority);
+    topics.push_back(topic);
+    byPriority = topics;
+    std::stable_sort(byPriority.begin(), byPriority.end(),
+                     [](const Topic *a, const Topic *b) { return a->priority > b->priority; });
+    return topics.size() - 1;
+}
+
+bool NotificationQueue::push(const size_t &index, Json::Value &params)
+{
+    // Topics can't be added anymore
+    if (workers.empty())
+        for (unsigned int i = 0; i < workerCount; i++)
+            workers.push_back(std::thread(&NotificationQueue::work, this));
+
+    Topic *topic = topics[index];
+    topic->received.fetch_add(1, std::memory_order_relaxed);
+    if (!topic->tryPush(params)) {
+        topic->overflows.fetch_add(1, std::memory_order_relaxed);
+        if (policy == DROP) {
+            topic->dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        producerBlocked.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!topic->tryPush(params))
+            popped.wait(lock);
+        producerBlocked.store(false);
+    }
+    // Pairs with the fence in work(), so that either we see an idle worker or it sees the notification
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idleWorkers.load(std::memory_order_relaxed)) {
+        // Not to notify between its check and its wait
+        { std::lock_guard<std::mutex> lock(mutex); }
+        queued.notify_one();
+    }
+    return true;
+}
+
+bool NotificationQueue::empty() const
+{
+    for (const Topic *topic : byPriority)
+        if (!topic->empty())
+            return false;
+    return true;
+}
+
+void NotificationQueue::work()
+{
+    std::vector<Json::Value> batch;
+    Json::Value params;
+
+    while (true) {
+        Topic *served = nullptr;
+        for (Topic *topic : byPriority) {
+            batch.clear();
+            while (batch.size() < topic->maxBatch && topic->tryPop(params)) {
+                batch.push_back(Json::Value());
+                batch.back().swap(params);
+            }
+            if (!batch.empty()) {
+                served = topic;
+                break;
+            }
+        }
+
+        if (served) {
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (producerBlocked.load(std::memory_order_relaxed)) {
+                { std::lock_guard<std::mutex> lock(mutex); }
+                popped.notify_one();
+            }
+            bool timed = instrumentation && instrumentation->isEnabled();
+            std::chrono::steady_clock::time_point start;
+            if (timed)
+                start = std::chrono::steady_clock::now();
+            size_t handed = batch.size();
+            bool failed = false;
+            try {
+                served->handler(batch);
+            } catch (...) {
+                // Notifications can't be answered, and a worker must not die
+                failed = true;
+            }
+            if (timed)
+                instrumentation->record(served->operation, Instrumentation::microsSince(start), failed);
+            served->delivered.fetch_add(handed, std::memory_order_relaxed);
+            served->batches.fetch_add(1, std::memory_order_relaxed);
+            // Serve the highest priority again
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        idleWorkers.fetch_add(1);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!stopping.load() && empty())
+            queued.wait(lock);
+        idleWorkers.fetch_sub(1);
+        // What's left is handled before stopping
+        if (stopping.load() && empty())
+            return;
+    }
+}
+
+std::vector<NotificationTopicStats> NotificationQueue::getStats()
+{
+    std::vector<NotificationTopicStats> stats;
+    for (const Topic *topic : topics) {
+        NotificationTopicStats topicStats;
+        topicStats.name = topic->name;
+        topicStats.received = topic->received.load(std::memory_order_relaxed);
+        topicStats.delivered = topic->delivered.load(std::memory_order_relaxed);
+        topicStats.dropped = topic->dropped.load(std::memory_order_relaxed);
+        topicStats.overflows = topic->overflows.load(std::memory_order_relaxed);
+        topicStats.batches = topic->batches.load(std::memory_order_relaxed);
+        size_t head = topic->head.load(std::memory_order_relaxed), tail = topic->tail.load(std::memory_order_relaxed);
+        topicStats.queued = head > tail ? head - tail : 0;
+        stats.push_back(topicStats);
+    }
+    return stats;
+}
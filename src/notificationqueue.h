@@ -0,0 +1,135 @@
+#ifndef LIGHTNINGCPP_NOTIFICATIONQUEUE_H
+#define LIGHTNINGCPP_NOTIFICATIONQUEUE_H
+
+#include "instrumentation.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <jsonrpccpp/client.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct NotificationTopicStats {
+    std::string name;
+    // Notifications pushed, including those dropped
+    uint64_t received;
+    uint64_t delivered;
+    // Notifications dropped because the queue was full
+    uint64_t dropped;
+    // Times the queue was found full, whether the notification was dropped or waited for room
+    uint64_t overflows;
+    // Calls to the handler
+    uint64_t batches;
+    // Notifications waiting for a worker
+    size_t queued;
+};
+
+/**
+ * Hands the notifications received by a plugin to dedicated worker threads, so
+ * that a burst of them doesn't delay the hook calls and requests lightningd is
+ * waiting on.
+ *
+ * Each topic (notification name) has its own bounded lock-free ring buffer.
+ * Workers always serve the topic with the highest priority first, and hand up
+ * to `maxBatch` queued notifications of a topic to its handler at once. With
+ * more than one worker, batches of a topic may be handled concurrently and out
+ * of order.
+ */
+class NotificationQueue {
+
+public:
+    enum OverflowPolicy {
+        // Drop the notification, and count it
+        DROP,
+        // Wait for room, so that lightningd waits for us
+        BLOCK
+    };
+
+    /**
+     * @param workers The number of threads executing the handlers
+     * @param policy What to do with a notification whose topic's queue is full
+     * @param instrumentation If not null, where to record the time taken by each batch
+     */
+    NotificationQueue(const unsigned int &workers, const OverflowPolicy &policy=DROP,
+                      Instrumentation *instrumentation=nullptr);
+
+    /**
+     * Executes the handlers of the notifications already queued, then stops the workers.
+     */
+    ~NotificationQueue();
+
+    /**
+     * Adds a topic, before the first push().
+     *
+     * @param capacity The number of notifications which may be queued, rounded up to a power of 2
+     * @param maxBatch The maximum number of notifications handed to the handler at once
+     * @param priority Topics with a higher priority are served first
+     * @return The index of the topic
+     */
+    size_t addTopic(const std::string &name, const std::function<void(std::vector<Json::Value>&)> &handler,
+                    const size_t &capacity=1024, const size_t &maxBatch=64, const int &priority=0);
+
+    /**
+     * Queues a notification, from a single thread.
+     *
+     * @param params Its parameters, swapped out
+     * @return false if it was dropped
+     */
+    bool push(const size_t &topic, Json::Value &params);
+
+    std::vector<NotificationTopicStats> getStats();
+
+private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Json::Value params;
+    };
+
+    struct Topic {
+        std::string name;
+        std::function<void(std::vector<Json::Value>&)> handler;
+        size_t maxBatch;
+        int priority;
+        std::vector<Slot> slots;
+        size_t mask;
+        // The position of the next push, and of the next pop
+        std::atomic<size_t> head;
+        std::atomic<size_t> tail;
+        std::atomic<uint64_t> received;
+        std::atomic<uint64_t> delivered;
+        std::atomic<uint64_t> dropped;
+        std::atomic<uint64_t> overflows;
+        std::atomic<uint64_t> batches;
+        std::string operation;
+
+        Topic(const std::string &name, const std::function<void(std::vector<Json::Value>&)> &handler,
+              const size_t &capacity, const size_t &maxBatch, const int &priority);
+        bool tryPush(Json::Value &params);
+        bool tryPop(Json::Value &params);
+        bool empty() const;
+    };
+
+    OverflowPolicy policy;
+    Instrumentation *instrumentation;
+    unsigned int workerCount;
+    std::vector<std::thread> workers;
+    std::vector<Topic*> topics;
+    // By decreasing priority
+    std::vector<Topic*> byPriority;
+    // Only used to sleep when there is nothing to do, or no room
+    std::mutex mutex;
+    std::condition_variable queued;
+    std::condition_variable popped;
+    std::atomic<unsigned int> idleWorkers;
+    std::atomic<bool> producerBlocked;
+    std::atomic<bool> stopping;
+
+    bool empty() const;
+    void work();
+};
+
+#endif // LIGHTNINGCPP_NOTIFICATIONQUEUE_H
@@ -0,0 +1,273 @@
+#include "paymentexecutor.h"
+
+#include <chrono>
+#include <vector>
+
+// The sendpay and waitsendpay errors we handle, as numbered by lightningd
+static const int PAY_IN_PROGRESS = 200;
+static const int PAY_TRY_OTHER_ROUTE = 204;
+static const int PAY_ROUTE_NOT_FOUND = 205;
+static const int PAY_ROUTE_TOO_EXPENSIVE = 206;
+static const int PAY_STOPPED_RETRYING = 210;
+
+// Parts are not split below this amount
+static const uint64_t MIN_PART_MSAT = 1000000;
+
+static unsigned long nowMicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PaymentRequest::PaymentRequest():
+    amountMsat(0),
+    maxFeeMsat(0),
+    riskfactor(10),
+    cltv(9)
+{}
+
+/** The state of a payment, shared by its parts. */
+struct Payment {
+    PaymentRequest request;
+    PaymentCallback onDone;
+    PaymentPartCallback onPart;
+
+    std::mutex mutex;
+    // The channels which failed our parts
+    std::vector<std::string> exclude;
+    // The parts being routed, sent or waited on
+    unsigned int inFlight;
+    unsigned int splits;
+    uint64_t succeededMsat;
+    bool failed;
+    unsigned long startMicros;
+    PaymentResult result;
+};
+
+PaymentExecutor::PaymentExecutor(CLightningRpc &rpc, RouteFinder &finder, const unsigned int &threads,
+            const uint64_t &maxPartMsat, const unsigned int &maxAttempts):
+    rpc(rpc),
+    finder(finder),
+    pool(new ThreadPool(threads ? threads : 1)),
+    maxPartMsat(maxPartMsat ? maxPartMsat : 1),
+    maxAttempts(maxAttempts),
+    pending(0)
+{}
+
+PaymentExecutor::~PaymentExecutor()
+{
+    wait();
+    delete pool;
+}
+
+void PaymentExecutor::pay(const PaymentRequest &request, const PaymentCallback &onDone, const PaymentPartCallback &onPart)
+{
+    std::shared_ptr<Payment> payment = std::make_shared<Payment>();
+    payment->request = request;
+    payment->onDone = onDone;
+    payment->onPart = onPart;
+    payment->splits = 0;
+    payment->succeededMsat = 0;
+    payment->failed = false;
+    payment->startMicros = nowMicros();
+    payment->result.paymentHash = request.paymentHash;
+    payment->result.succeeded = false;
+    payment->result.amountMsat = request.amountMsat;
+    payment->result.feesMsat = 0;
+    payment->result.parts = 0;
+    payment->result.attempts = 0;
+    payment->result.latencyMicros = 0;
+    payment->result.errorCode = 0;
+
+    uint64_t parts = (request.amountMsat + maxPartMsat - 1) / maxPartMsat;
+    if (parts == 0)
+        parts = 1;
+    payment->inFlight = parts;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending++;
+    }
+    for (uint64_t i = 0; i < parts; i++) {
+        uint64_t amount = request.amountMsat / parts + (i < request.amountMsat % parts ? 1 : 0);
+        pool->submit([this, payment, amount] {
+            sendPart(payment, amount);
+        });
+    }
+}
+
+void PaymentExecutor::sendPart(std::shared_ptr<Payment> payment, const uint64_t &amount)
+{
+    const PaymentRequest &request = payment->request;
+    std::vector<std::string> exclude;
+    bool failed;
+    {
+        std::lock_guard<std::mutex> lock(payment->mutex);
+        if (payment->result.attempts >= maxAttempts)
+            fail(*payment, PAY_STOPPED_RETRYING, "Ran out of attempts");
+        failed = payment->failed;
+        exclude = payment->exclude;
+    }
+    if (failed)
+        return release(payment);
+
+    std::vector<RouteHop> route;
+    bool found = finder.findRoute(RouteQuery(request.destination, amount, request.riskfactor, request.cltv, "", 5.0, exclude),
+                                  route);
+    uint64_t fee = found ? route[0].amountMsat - amount : 0;
+    // Each part gets its share of the fee budget
+    bool tooExpensive = found && request.maxFeeMsat
+                        && (double)fee * request.amountMsat > (double)request.maxFeeMsat * amount;
+    if (!found || tooExpensive) {
+        std::unique_lock<std::mutex> lock(payment->mutex);
+        // Smaller parts fit through more channels
+        if (amount >= 2 * MIN_PART_MSAT && payment->splits < maxAttempts && !payment->failed) {
+            payment->splits++;
+            payment->inFlight++;
+            lock.unlock();
+            uint64_t half = amount / 2;
+            pool->submit([this, payment, half] {
+                sendPart(payment, half);
+            });
+            return sendPart(payment, amount - half);
+        }
+        if (found)
+            fail(*payment, PAY_ROUTE_TOO_EXPENSIVE, "No route within the fee budget");
+        else
+            fail(*payment, PAY_ROUTE_NOT_FOUND, "Could not find a route");
+        lock.unlock();
+        return release(payment);
+    }
+
+    std::shared_ptr<PaymentPart> part = std::make_shared<PaymentPart>();
+    part->paymentHash = request.paymentHash;
+    part->amountMsat = amount;
+    part->feeMsat = fee;
+    part->hops = route.size();
+    part->succeeded = false;
+    part->errorCode = 0;
+    part->latencyMicros = 0;
+    {
+        std::lock_guard<std::mutex> lock(payment->mutex);
+        part->partId = ++payment->result.attempts;
+    }
+
+    Json::Value params(Json::objectValue);
+    params["route"] = finder.toJson(route)["route"];
+    params["payment_hash"] = request.paymentHash;
+    params["msatoshi"] = (Json::UInt64)request.amountMsat;
+    params["partid"] = part->partId;
+    if (!request.paymentSecret.empty())
+        params["payment_secret"] = request.paymentSecret;
+    if (!request.bolt11.empty())
+        params["bolt11"] = request.bolt11;
+    if (!request.label.empty())
+        params["label"] = request.label;
+    unsigned long start = nowMicros();
+    rpc.sendCommandAsync("sendpay", params, [this, payment, part, start](const RpcResult &result) {
+        if (result.failed)
+            partFailed(payment, part, result, start);
+        else
+            waitPart(payment, part, start);
+    });
+}
+
+void PaymentExecutor::waitPart(std::shared_ptr<Payment> payment, std::shared_ptr<PaymentPart> part,
+            const unsigned long &startMicros)
+{
+    Json::Value params(Json::objectValue);
+    params["payment_hash"] = payment->request.paymentHash;
+    params["partid"] = part->partId;
+    rpc.sendCommandAsync("waitsendpay", params, [this, payment, part, startMicros](const RpcResult &result) {
+        if (result.failed && result.errorCode == PAY_IN_PROGRESS)
+            return waitPart(payment, part, startMicros);
+        if (result.failed)
+            return partFailed(payment, part, result, startMicros);
+
+        part->succeeded = true;
+        part->latencyMicros = nowMicros() - startMicros;
+        {
+            std::lock_guard<std::mutex> lock(payment->mutex);
+            payment->succeededMsat += part->amountMsat;
+            payment->result.parts++;
+            payment->result.feesMsat += part->feeMsat;
+            if (payment->result.preimage.empty())
+                payment->result.preimage = result.result["payment_preimage"].asString();
+        }
+        if (payment->onPart)
+            payment->onPart(*part);
+        release(payment);
+    });
+}
+
+void PaymentExecutor::partFailed(std::shared_ptr<Payment> payment, std::shared_ptr<PaymentPart> part,
+            const RpcResult &result, const unsigned long &startMicros)
+{
+    part->errorCode = result.errorCode;
+    part->errorMessage = result.errorMessage;
+    part->latencyMicros = nowMicros() - startMicros;
+    if (payment->onPart)
+        payment->onPart(*part);
+
+    bool retry = false;
+    {
+        std::lock_guard<std::mutex> lock(payment->mutex);
+        const Json::Value &erringChannel = result.errorData["erring_channel"];
+        if (result.errorCode == PAY_TRY_OTHER_ROUTE && erringChannel.isString() && !payment->failed) {
+            payment->exclude.push_back(erringChannel.asString() + "/"
+                                       + std::to_string(result.errorData["erring_direction"].asUInt()));
+            retry = true;
+        } else {
+            fail(*payment, result.errorCode, result.errorMessage);
+        }
+    }
+    if (!retry)
+        return release(payment);
+    // Route finding is too slow for the event loop thread, which calls us
+    uint64_t amount = part->amountMsat;
+    pool->submit([this, payment, amount] {
+        sendPart(payment, amount);
+    });
+}
+
+void PaymentExecutor::fail(Payment &payment, const int &code, const std::string &message)
+{
+    if (payment.failed)
+        return;
+    payment.failed = true;
+    payment.result.errorCode = code;
+    payment.result.errorMessage = message;
+}
+
+void PaymentExecutor::release(std::shared_ptr<Payment> payment)
+{
+    {
+        std::lock_guard<std::mutex> lock(payment->mutex);
+        if (--payment->inFlight > 0)
+            return;
+        // Whatever went wrong, the destination got the whole amount
+        payment->result.succeeded = payment->succeededMsat >= payment->request.amountMsat;
+        if (payment->result.succeeded) {
+            payment->result.errorCode = 0;
+            payment->result.errorMessage.clear();
+        }
+        payment->result.latencyMicros = nowMicros() - payment->startMicros;
+    }
+    if (payment->onDone)
+        payment->onDone(payment->result);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (--pending == 0)
+        completed.notify_all();
+}
+
+size_t PaymentExecutor::getPending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+void PaymentExecutor::wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    completed.wait(lock, [this] { return pending == 0; });
+}
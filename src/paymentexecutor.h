@@ -0,0 +1,128 @@
+#ifndef LIGHTNINGCPP_PAYMENTEXECUTOR_H
+#define LIGHTNINGCPP_PAYMENTEXECUTOR_H
+
+#include "clightningrpc.h"
+#include "routefinder.h"
+#include "threadpool.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/** What to pay, and how much we are ready to spend on it. */
+struct PaymentRequest {
+    std::string destination;
+    uint64_t amountMsat;
+    std::string paymentHash;
+    // Needed to pay in several parts, from the invoice
+    std::string paymentSecret;
+    std::string bolt11;
+    std::string label;
+    // 0 for no limit
+    uint64_t maxFeeMsat;
+    unsigned int riskfactor;
+    // The delay the destination asks for its final hop
+    unsigned int cltv;
+
+    PaymentRequest();
+};
+
+/** An attempt to pay part of a payment over a route. */
+struct PaymentPart {
+    std::string paymentHash;
+    unsigned int partId;
+    uint64_t amountMsat;
+    uint64_t feeMsat;
+    unsigned int hops;
+    bool succeeded;
+    int errorCode;
+    std::string errorMessage;
+    // From sendpay to the outcome of waitsendpay
+    unsigned long latencyMicros;
+};
+
+struct PaymentResult {
+    std::string paymentHash;
+    bool succeeded;
+    std::string preimage;
+    uint64_t amountMsat;
+    uint64_t feesMsat;
+    // The parts which made it to the destination
+    unsigned int parts;
+    // Every sendpay issued, failed ones included
+    unsigned int attempts;
+    unsigned long latencyMicros;
+    // The error which made us give up, if the payment failed
+    int errorCode;
+    std::string errorMessage;
+};
+
+typedef std::function<void(const PaymentResult&)> PaymentCallback;
+typedef std::function<void(const PaymentPart&)> PaymentPartCallback;
+
+struct Payment;
+
+/**
+ * Pays through sendpay and waitsendpay with routes from a RouteFinder,
+ * splitting each payment into parts sent concurrently and rerouting those
+ * which fail around the channel lightningd reports as failing.
+ *
+ * The commands go over the CLightningRpc's event loop, so that any number of
+ * parts can be waited on without a thread each. Routes are found by a fixed
+ * number of threads. Callbacks are called from any of these threads.
+ */
+class PaymentExecutor {
+
+public:
+    /**
+     * @param rpc, finder Must outlive the executor
+     * @param threads The threads finding routes and (re)sending parts
+     * @param maxPartMsat Payments are split in parts of at most this amount, which
+     *             are split again when no route can carry them (defaults to 0.1 BTC)
+     * @param maxAttempts The number of sendpay a payment may issue before giving up
+     */
+    PaymentExecutor(CLightningRpc &rpc, RouteFinder &finder, const unsigned int &threads=2,
+            const uint64_t &maxPartMsat=10000000000ULL, const unsigned int &maxAttempts=20);
+
+    /** Waits for the payments in flight to complete. */
+    ~PaymentExecutor();
+
+    /**
+     * Starts a payment and returns at once.
+     *
+     * @param onDone Called once the payment succeeded or failed, and no part is in flight anymore
+     * @param onPart If set, called with the outcome of each part sent
+     */
+    void pay(const PaymentRequest &request, const PaymentCallback &onDone, const PaymentPartCallback &onPart=nullptr);
+
+    /** The number of payments not completed yet. */
+    size_t getPending();
+
+    /** Blocks until every payment started completed. */
+    void wait();
+
+private:
+    CLightningRpc &rpc;
+    RouteFinder &finder;
+    ThreadPool *pool;
+    uint64_t maxPartMsat;
+    unsigned int maxAttempts;
+
+    std::mutex mutex;
+    std::condition_variable completed;
+    size_t pending;
+
+    void sendPart(std::shared_ptr<Payment> payment, const uint64_t &amount);
+    void waitPart(std::shared_ptr<Payment> payment, std::shared_ptr<PaymentPart> part, const unsigned long &startMicros);
+    void partFailed(std::shared_ptr<Payment> payment, std::shared_ptr<PaymentPart> part, const RpcResult &result,
+            const unsigned long &startMicros);
+    /** Marks the payment failed, with the error reported if no other was before. */
+    void fail(Payment &payment, const int &code, const std::string &message);
+    /** Releases a part, and reports the payment if it's over and no part is in flight anymore. */
+    void release(std::shared_ptr<Payment> payment);
+};
+
+#endif // LIGHTNINGCPP_PAYMENTEXECUTOR_H
@@ -0,0 +1,163 @@
+#include "pendingrequests.h"
+
+/**
+ * An estimate of the memory used by a node of a node-based container holding this value
+ */
+template<typename T>
+static size_t nodeSize(const size_t &pointers)
+{
+    return sizeof(T) + pointers * sizeof(void*);
+}
+
+PendingRequests::PendingRequests():
+    maxPending(0),
+    answered(0),
+    timedOut(0),
+    stopping(false)
+{}
+
+PendingRequests::~PendingRequests()
+{
+    std::unordered_map<std::string, Entry> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        dropped.swap(entries);
+        deadlines.clear();
+    }
+    changed.notify_all();
+    if (timer.joinable())
+        timer.join();
+    // Answers the requests only held here with an error, which calls remove()
+    dropped.clear();
+}
+
+void PendingRequests::add(RpcResponder &responder)
+{
+    std::string reqId = responder.getId();
+    responder.onAnswered([this, reqId]() { remove(reqId); });
+    std::lock_guard<std::mutex> lock(mutex);
+    Entry entry = {responder.state, nullptr, deadlines.end(), nullptr};
+    entries.insert(std::make_pair(reqId, entry));
+    if (entries.size() > maxPending)
+        maxPending = entries.size();
+}
+
+void PendingRequests::remove(const std::string &reqId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(reqId);
+    if (it == entries.end())
+        return;
+    if (it->second.onTimeout)
+        deadlines.erase(it->second.deadline);
+    // The thread answering holds the responder, so this is not the last reference to it
+    entries.erase(it);
+    answered++;
+}
+
+bool PendingRequests::setTimeout(const std::string &reqId, const std::chrono::milliseconds &timeout,
+                    const std::shared_ptr<const std::string> &onTimeout)
+{
+    bool earliest;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(reqId);
+        if (it == entries.end() || stopping)
+            return false;
+        it->second.held = it->second.responder.lock();
+        if (!it->second.held)
+            return false;
+        if (it->second.onTimeout)
+            deadlines.erase(it->second.deadline);
+        it->second.deadline = deadlines.insert(std::make_pair(std::chrono::steady_clock::now() + timeout, reqId));
+        it->second.onTimeout = onTimeout;
+        earliest = it->second.deadline == deadlines.begin();
+        if (!timer.joinable())
+            timer = std::thread(&PendingRequests::expire, this);
+    }
+    if (earliest)
+        changed.notify_all();
+    return true;
+}
+
+std::shared_ptr<RpcResponder::State> PendingRequests::find(const std::string &reqId)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(reqId);
+    if (it == entries.end())
+        return nullptr;
+    return it->second.responder.lock();
+}
+
+bool PendingRequests::resolve(const std::string &reqId, const Json::Value &result)
+{
+    // Answering removes the entry, so it's done without the lock
+    std::shared_ptr<RpcResponder::State> state = find(reqId);
+    return state && RpcResponder(state).resolve(result);
+}
+
+bool PendingRequests::reject(const std::string &reqId, const int &code, const std::string &message)
+{
+    std::shared_ptr<RpcResponder::State> state = find(reqId);
+    return state && RpcResponder(state).reject(code, message);
+}
+
+std::vector<std::string> PendingRequests::getIds()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> ids;
+    ids.reserve(entries.size());
+    for (const auto &it : entries)
+        ids.push_back(it.first);
+    return ids;
+}
+
+PendingRequestsStats PendingRequests::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    PendingRequestsStats stats;
+    stats.pending = entries.size();
+    stats.maxPending = maxPending;
+    stats.answered = answered;
+    stats.timedOut = timedOut;
+    // A hash node and its bucket, and a tree node for those with a deadline. The ids lightningd
+    // sends are short enough not to be allocated.
+    stats.bytes = entries.bucket_count() * sizeof(void*)
+                    + entries.size() * nodeSize<std::pair<const std::string, Entry>>(2)
+                    + deadlines.size() * nodeSize<Deadlines::value_type>(4);
+    return stats;
+}
+
+void PendingRequests::expire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        if (deadlines.empty()) {
+            changed.wait(lock);
+            continue;
+        }
+        // A copy, the entry may be answered while we wait
+        auto now = std::chrono::steady_clock::now(), next = deadlines.begin()->first;
+        if (next > now) {
+            changed.wait_until(lock, next);
+            continue;
+        }
+        std::vector<std::pair<RpcResponder, std::shared_ptr<const std::string>>> expired;
+        while (!deadlines.empty() && deadlines.begin()->first <= now) {
+            Entry &entry = entries.at(deadlines.begin()->second);
+            expired.push_back(std::make_pair(RpcResponder(entry.held), entry.onTimeout));
+            entry.onTimeout = nullptr;
+            entry.held = nullptr;
+            deadlines.erase(deadlines.begin());
+        }
+        lock.unlock();
+        uint64_t answeredHere = 0;
+        // The handler may answer concurrently, in which case our answer is dropped
+        for (auto &it : expired)
+            answeredHere += it.first.resolveRaw(*it.second);
+        expired.clear();
+        lock.lock();
+        timedOut += answeredHere;
+    }
+}
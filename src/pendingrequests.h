@@ -0,0 +1,108 @@
+#ifndef LIGHTNINGCPP_PENDINGREQUESTS_H
+#define LIGHTNINGCPP_PENDINGREQUESTS_H
+
+#include "rpcresponder.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <jsonrpccpp/client.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+struct PendingRequestsStats {
+    // Requests whose handler did not answer yet
+    size_t pending;
+    // The most requests pending at once
+    size_t maxPending;
+    // The memory held to track the pending requests, in bytes
+    size_t bytes;
+    // Requests answered, including on timeout
+    uint64_t answered;
+    // Requests answered on timeout
+    uint64_t timedOut;
+};
+
+/**
+ * The requests to a plugin which its asynchronous handlers did not answer yet,
+ * by id.
+ *
+ * They can be answered by id from any thread, e.g. once an external decision
+ * about an HTLC is made, and get a default answer once their timeout expires.
+ * Timeouts are run by a dedicated thread started with the first one.
+ *
+ * A request is only kept alive here once it has a timeout, otherwise it's
+ * answered with an error when its handler drops every copy of its responder.
+ */
+class PendingRequests {
+
+public:
+    PendingRequests();
+    ~PendingRequests();
+
+    /**
+     * Tracks a request until it's answered, through this responder or any copy of it.
+     */
+    void add(RpcResponder &responder);
+
+    /**
+     * Answers a pending request with `onTimeout` (serialized JSON) if it's still pending after `timeout`.
+     * Until then its handler doesn't need to keep its responder, it can be answered by id.
+     *
+     * @return false if the request is not pending
+     */
+    bool setTimeout(const std::string &reqId, const std::chrono::milliseconds &timeout,
+                    const std::shared_ptr<const std::string> &onTimeout);
+
+    /**
+     * Answers a pending request.
+     *
+     * @return false if the request is not pending
+     */
+    bool resolve(const std::string &reqId, const Json::Value &result);
+    bool reject(const std::string &reqId, const int &code, const std::string &message);
+
+    /** The ids of the pending requests. */
+    std::vector<std::string> getIds();
+
+    PendingRequestsStats getStats();
+
+private:
+    typedef std::multimap<std::chrono::steady_clock::time_point, std::string> Deadlines;
+
+    struct Entry {
+        std::weak_ptr<RpcResponder::State> responder;
+        // Set along with a timeout, to keep the request until then
+        std::shared_ptr<RpcResponder::State> held;
+        // Only meaningful if onTimeout is set
+        Deadlines::iterator deadline;
+        std::shared_ptr<const std::string> onTimeout;
+    };
+
+    std::mutex mutex;
+    // Signaled when the earliest deadline changes, or when stopping
+    std::condition_variable changed;
+    std::unordered_map<std::string, Entry> entries;
+    Deadlines deadlines;
+    size_t maxPending;
+    uint64_t answered;
+    uint64_t timedOut;
+    bool stopping;
+    std::thread timer;
+
+    /** Stops tracking an answered request. */
+    void remove(const std::string &reqId);
+
+    /** The body of the timer thread. */
+    void expire();
+
+    /** The responder of a pending request, to answer it without holding the lock. */
+    std::shared_ptr<RpcResponder::State> find(const std::string &reqId);
+};
+
+#endif // LIGHTNINGCPP_PENDINGREQUESTS_H
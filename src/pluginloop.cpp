@@ -0,0 +1,186 @@
+#include "pluginloop.h"
+#include "pluginexception.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+PluginLoop::PluginLoop():
+    nextTimer(1),
+    stopping(false)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || eventFd < 0)
+        throw CLightningPluginException(1, std::string("Could not create the plugin event loop : ") + strerror(errno));
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = eventFd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event) < 0)
+        throw CLightningPluginException(1, std::string("Could not create the plugin event loop : ") + strerror(errno));
+}
+
+PluginLoop::~PluginLoop()
+{
+    for (auto &it : timers)
+        ::close(it.second->fd);
+    ::close(eventFd);
+    ::close(epollFd);
+}
+
+bool PluginLoop::addFd(const int &fd, const std::function<void(uint32_t)> &callback, const uint32_t &events)
+{
+    std::shared_ptr<Watch> watch = std::make_shared<Watch>();
+    watch->callback = callback;
+    watch->fd = fd;
+    watch->timer = false;
+    watch->repeat = true;
+    watch->id = 0;
+    struct epoll_event event;
+    event.events = events;
+    event.data.fd = fd;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        if (errno == EPERM)
+            return false;
+        throw CLightningPluginException(1, "Could not watch file descriptor " + std::to_string(fd) + " : "
+                                            + strerror(errno));
+    }
+    watches[fd] = watch;
+    return true;
+}
+
+void PluginLoop::removeFd(const int &fd)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = watches.find(fd);
+    // Timers are removed by their identifier
+    if (it == watches.end() || it->second->timer)
+        return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    watches.erase(it);
+}
+
+int PluginLoop::addTimer(const std::chrono::milliseconds &interval, const std::function<void()> &callback,
+            const bool &repeat)
+{
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0)
+        throw CLightningPluginException(1, std::string("Could not create a timer : ") + strerror(errno));
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    // A zero value would disarm it
+    long long nanos = interval.count() > 0 ? interval.count() * 1000000LL : 1;
+    spec.it_value.tv_sec = nanos / 1000000000LL;
+    spec.it_value.tv_nsec = nanos % 1000000000LL;
+    if (repeat)
+        spec.it_interval = spec.it_value;
+    if (timerfd_settime(fd, 0, &spec, nullptr) < 0) {
+        int err = errno;
+        ::close(fd);
+        throw CLightningPluginException(1, std::string("Could not arm a timer : ") + strerror(err));
+    }
+
+    std::shared_ptr<Watch> watch = std::make_shared<Watch>();
+    watch->callback = [fd, callback](uint32_t) {
+        uint64_t expirations;
+        // Expirations we missed are coalesced into a single call
+        if (read(fd, &expirations, sizeof(expirations)) == sizeof(expirations))
+            callback();
+    };
+    watch->fd = fd;
+    watch->timer = true;
+    watch->repeat = repeat;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        int err = errno;
+        ::close(fd);
+        throw CLightningPluginException(1, std::string("Could not watch a timer : ") + strerror(err));
+    }
+    watch->id = nextTimer++;
+    watches[fd] = watch;
+    timers[watch->id] = watch;
+    return watch->id;
+}
+
+void PluginLoop::removeTimer(const int &timer)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = timers.find(timer);
+    if (it == timers.end() || !it->second->timer)
+        return;
+    int fd = it->second->fd;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    watches.erase(fd);
+    timers.erase(it);
+    ::close(fd);
+}
+
+void PluginLoop::stop()
+{
+    stopping.store(true);
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) < 0) {
+        // The counter is already non-zero, the loop will wake up anyway
+    }
+}
+
+std::shared_ptr<PluginLoop::Watch> PluginLoop::find(const int &fd)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = watches.find(fd);
+    return it == watches.end() ? nullptr : it->second;
+}
+
+void PluginLoop::serve(const int &timeout)
+{
+    struct epoll_event events[32];
+
+    int n = epoll_wait(epollFd, events, 32, timeout);
+    if (n < 0 && errno == EINTR)
+        return;
+    if (n < 0)
+        throw CLightningPluginException(1, std::string("Error waiting for events : ") + strerror(errno));
+    for (int i = 0; i < n && !stopping.load(); i++) {
+        if (events[i].data.fd == eventFd)
+            continue;
+        // It may have been removed by a previous callback
+        std::shared_ptr<Watch> watch = find(events[i].data.fd);
+        if (!watch)
+            continue;
+        try {
+            watch->callback(events[i].events);
+        } catch (std::exception &e) {
+            // The other callbacks and the loop itself must go on
+            std::cerr << "A plugin loop callback failed : " << e.what() << std::endl;
+        } catch (...) {
+            std::cerr << "A plugin loop callback failed" << std::endl;
+        }
+        // A no-op if the callback already removed it
+        if (watch->timer && !watch->repeat)
+            removeTimer(watch->id);
+    }
+}
+
+void PluginLoop::poll()
+{
+    serve(0);
+}
+
+void PluginLoop::run()
+{
+    while (!stopping.load())
+        serve(-1);
+    stopping.store(false);
+    uint64_t counter;
+    if (read(eventFd, &counter, sizeof(counter)) < 0) {
+        // Not stopped through the eventfd
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef LIGHTNINGCPP_PLUGINLOOP_H
+#define LIGHTNINGCPP_PLUGINLOOP_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sys/epoll.h>
+#include <unordered_map>
+
+/**
+ * The event loop of a plugin : an epoll loop over lightningd's messages, the
+ * file descriptors registered by the plugin and its timers (one timerfd each).
+ *
+ * Everything is executed by the thread calling run(), so that a plugin can serve
+ * its own sockets and run periodic tasks without threads. Registering and
+ * removing file descriptors and timers is thread-safe, and can be done from the
+ * callbacks themselves.
+ */
+class PluginLoop {
+
+public:
+    PluginLoop();
+    ~PluginLoop();
+
+    /**
+     * Executes `callback` with the ready events (EPOLLIN, EPOLLOUT, EPOLLHUP, ..) whenever `fd`
+     * is ready. The file descriptor is not closed by the loop.
+     *
+     * @param events The events to wait for
+     * @return false if epoll can't watch this kind of file, e.g. a regular file or /dev/null
+     */
+    bool addFd(const int &fd, const std::function<void(uint32_t)> &callback, const uint32_t &events=EPOLLIN);
+
+    /** Stops watching a file descriptor, before it's closed. */
+    void removeFd(const int &fd);
+
+    /**
+     * Executes `callback` every `interval`, or once after it.
+     *
+     * @return An identifier to remove the timer with, never reused
+     */
+    int addTimer(const std::chrono::milliseconds &interval, const std::function<void()> &callback,
+                 const bool &repeat=true);
+
+    /** Does nothing if the timer already fired (one-shot) or was removed. */
+    void removeTimer(const int &timer);
+
+    /**
+     * Executes the callbacks as their file descriptor or timer is ready, until stop(). A
+     * callback throwing is reported on stderr (lightningd's log), and the loop goes on.
+     */
+    void run();
+
+    /**
+     * Executes the callbacks of the file descriptors and timers which are ready, without
+     * waiting, e.g. in between the messages of an input epoll can't watch.
+     */
+    void poll();
+
+    /** Makes run() return, from any thread. */
+    void stop();
+
+private:
+    struct Watch {
+        std::function<void(uint32_t)> callback;
+        int fd;
+        // Timers own their timerfd
+        bool timer;
+        bool repeat;
+        // The identifier of a timer
+        int id;
+    };
+
+    int epollFd;
+    // Used to wake up the loop when stopping
+    int eventFd;
+    std::mutex mutex;
+    // By file descriptor, timers included
+    std::unordered_map<int, std::shared_ptr<Watch>> watches;
+    // By identifier, as their file descriptor is reused once they are removed
+    std::unordered_map<int, std::shared_ptr<Watch>> timers;
+    int nextTimer;
+    std::atomic<bool> stopping;
+
+    std::shared_ptr<Watch> find(const int &fd);
+    /** Waits up to `timeout` milliseconds (-1 for ever) for events, and executes their callbacks. */
+    void serve(const int &timeout);
+};
+
+#endif // LIGHTNINGCPP_PLUGINLOOP_H
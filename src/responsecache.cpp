@@ -0,0 +1,214 @@
+#include "responsecache.h"
+#include "jsonwriter.h"
+
+/** A fetch in flight, which identical calls wait for. */
+struct ResponseCache::Flight {
+    std::promise<Json::Value> promise;
+    std::shared_future<Json::Value> future;
+
+    Flight(): future(promise.get_future()) {}
+};
+
+ResponseCache::ResponseCache():
+    enabled(false),
+    hits(0),
+    misses(0),
+    coalesced(0),
+    invalidated(0),
+    evicted(0)
+{
+    // What each command changes in the results of the others
+    invalidations["invoice"] = {"listinvoices"};
+    invalidations["delinvoice"] = {"listinvoices"};
+    invalidations["delexpiredinvoice"] = {"listinvoices"};
+    invalidations["autocleaninvoice"] = {"listinvoices"};
+    invalidations["waitinvoice"] = {"listinvoices"};
+    invalidations["waitanyinvoice"] = {"listinvoices"};
+    invalidations["pay"] = {"listpays", "listsendpays", "listpayments", "paystatus", "listpeers", "listfunds"};
+    invalidations["sendpay"] = {"listpays", "listsendpays", "listpayments", "paystatus", "listpeers", "listfunds"};
+    invalidations["connect"] = {"getinfo", "listpeers"};
+    invalidations["disconnect"] = {"getinfo", "listpeers"};
+    invalidations["fundchannel"] = {"getinfo", "listpeers", "listfunds", "listchannels"};
+    invalidations["close"] = {"getinfo", "listpeers", "listfunds", "listchannels"};
+    invalidations["withdraw"] = {"listfunds"};
+    invalidations["setchannelfee"] = {"listpeers", "listchannels"};
+}
+
+void ResponseCache::setTtl(const std::string &command, const std::chrono::milliseconds &ttl, const size_t &maxEntries)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ttl.count() <= 0) {
+        commands.erase(command);
+    } else {
+        commands[command].ttl = ttl;
+        commands[command].maxEntries = maxEntries ? maxEntries : 1;
+    }
+    enabled = !commands.empty();
+}
+
+void ResponseCache::addInvalidation(const std::string &command, const std::vector<std::string> &affected)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> &invalidated = invalidations[command];
+    invalidated.insert(invalidated.end(), affected.begin(), affected.end());
+}
+
+bool ResponseCache::isCached(const std::string &command)
+{
+    if (!enabled)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return commands.count(command) > 0;
+}
+
+Json::Value ResponseCache::get(const std::string &command, const Json::Value &params,
+            const std::function<Json::Value()> &fetch)
+{
+    std::string key;
+    std::shared_ptr<Flight> flight;
+    unsigned long generation;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto cached = commands.find(command);
+        if (cached == commands.end()) {
+            lock.unlock();
+            return fetch();
+        }
+        JsonWriter::append(params, key);
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        auto found = cached->second.entries.find(key);
+        if (found == cached->second.entries.end()) {
+            makeRoom(cached->second, now);
+            found = cached->second.entries.insert(std::make_pair(key, Entry())).first;
+        }
+        Entry &entry = found->second;
+        if (entry.flight) {
+            std::shared_future<Json::Value> future = entry.flight->future;
+            coalesced++;
+            lock.unlock();
+            // Rethrows the error of the call we waited for
+            return future.get();
+        }
+        if (entry.expires > now) {
+            hits++;
+            return entry.result;
+        }
+        flight = std::make_shared<Flight>();
+        entry.flight = flight;
+        generation = cached->second.generation;
+        misses++;
+    }
+
+    Json::Value result;
+    try {
+        result = fetch();
+    } catch (...) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto cached = commands.find(command);
+            if (cached != commands.end()) {
+                auto entry = cached->second.entries.find(key);
+                if (entry != cached->second.entries.end() && entry->second.flight == flight)
+                    cached->second.entries.erase(entry);
+            }
+        }
+        flight->promise.set_exception(std::current_exception());
+        throw;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto cached = commands.find(command);
+        // Unless it was invalidated meanwhile, in which case it may be stale already
+        if (cached != commands.end() && cached->second.generation == generation) {
+            Entry &entry = cached->second.entries[key];
+            entry.result = result;
+            entry.expires = std::chrono::steady_clock::now() + cached->second.ttl;
+            entry.flight = nullptr;
+        }
+    }
+    flight->promise.set_value(result);
+    return result;
+}
+
+bool ResponseCache::invalidates(const std::string &command)
+{
+    if (!enabled)
+        return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    return invalidations.count(command) > 0;
+}
+
+void ResponseCache::completed(const std::string &command)
+{
+    if (!enabled)
+        return;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto affected = invalidations.find(command);
+    if (affected == invalidations.end())
+        return;
+    for (const std::string &name : affected->second) {
+        auto cached = commands.find(name);
+        if (cached != commands.end())
+            invalidateLocked(cached->second);
+    }
+}
+
+void ResponseCache::invalidate(const std::string &command)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (command.empty()) {
+        for (auto &cached : commands)
+            invalidateLocked(cached.second);
+        return;
+    }
+    auto cached = commands.find(command);
+    if (cached != commands.end())
+        invalidateLocked(cached->second);
+}
+
+void ResponseCache::invalidateLocked(Command &command)
+{
+    // Calls in flight keep their own reference to the flight they wait for
+    invalidated += command.entries.size();
+    command.entries.clear();
+    command.generation++;
+}
+
+void ResponseCache::makeRoom(Command &command, const std::chrono::steady_clock::time_point &now)
+{
+    auto oldest = command.entries.end();
+    for (auto it = command.entries.begin(); it != command.entries.end();) {
+        // Entries being fetched are kept, the result of the fetch is stored in them
+        if (it->second.flight) {
+            ++it;
+        } else if (it->second.expires <= now) {
+            it = command.entries.erase(it);
+            evicted++;
+        } else {
+            // All the entries of a command live as long, the oldest expires first
+            if (oldest == command.entries.end() || it->second.expires < oldest->second.expires)
+                oldest = it;
+            ++it;
+        }
+    }
+    if (command.entries.size() >= command.maxEntries && oldest != command.entries.end()) {
+        command.entries.erase(oldest);
+        evicted++;
+    }
+}
+
+ResponseCacheStats ResponseCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    ResponseCacheStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.coalesced = coalesced;
+    stats.invalidations = invalidated;
+    stats.evictions = evicted;
+    stats.entries = 0;
+    for (const auto &cached : commands)
+        stats.entries += cached.second.entries.size();
+    return stats;
+}
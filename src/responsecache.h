@@ -0,0 +1,119 @@
+#ifndef LIGHTNINGCPP_RESPONSECACHE_H
+#define LIGHTNINGCPP_RESPONSECACHE_H
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <jsonrpccpp/client.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/** A snapshot of the counters of a ResponseCache. */
+struct ResponseCacheStats {
+    // Calls answered from the cache
+    unsigned long hits;
+    // Calls sent to lightningd
+    unsigned long misses;
+    // Calls which waited for an identical one in flight instead of sending their own
+    unsigned long coalesced;
+    // Entries dropped because a command changed what they hold
+    unsigned long invalidations;
+    // Entries dropped because they expired, or to make room for others
+    unsigned long evictions;
+    // Entries currently held, expired ones included
+    size_t entries;
+};
+
+/**
+ * Caches the results of the commands given a time to live, keyed by command
+ * and parameters. Concurrent identical calls missing the cache are sent only
+ * once, the others waiting for its result. Errors are not cached.
+ *
+ * Each command holds a bounded number of entries, one per distinct parameters :
+ * adding one drops those which expired, then the oldest if it's still full.
+ *
+ * Commands changing the state of lightningd drop the entries of the commands
+ * they affect once they completed, e.g. "invoice" those of "listinvoices".
+ *
+ * Nothing is cached until a time to live is set, and commands without one
+ * cost an atomic load.
+ */
+class ResponseCache {
+
+public:
+    ResponseCache();
+
+    /**
+     * Caches the results of `command` for `ttl`, or stops caching them if it's 0.
+     *
+     * @param command The lightningd command, e.g. "getinfo"
+     * @param maxEntries The most results of `command` held at once, with different parameters
+     */
+    void setTtl(const std::string &command, const std::chrono::milliseconds &ttl, const size_t &maxEntries=1024);
+
+    /** Makes `command` drop the entries of `affected` when it completes, on top of the defaults. */
+    void addInvalidation(const std::string &command, const std::vector<std::string> &affected);
+
+    /** Whether the results of `command` are cached. */
+    bool isCached(const std::string &command);
+
+    /**
+     * Returns the cached result of the command if it's fresh, or sends it with `fetch`.
+     *
+     * @param params The normalized parameters, part of the key (object members being sorted,
+     *            their order doesn't matter)
+     * @throw Whatever `fetch` threw, to every caller waiting for it
+     */
+    Json::Value get(const std::string &command, const Json::Value &params, const std::function<Json::Value()> &fetch);
+
+    /** Whether `command` drops the entries of others when it completes. */
+    bool invalidates(const std::string &command);
+
+    /** Drops the entries affected by `command`, which was just sent. */
+    void completed(const std::string &command);
+
+    /** Drops the entries of `command`, or all of them if it's empty. */
+    void invalidate(const std::string &command="");
+
+    ResponseCacheStats getStats();
+
+private:
+    struct Flight;
+
+    struct Entry {
+        Json::Value result;
+        std::chrono::steady_clock::time_point expires;
+        // The call fetching this entry, if any
+        std::shared_ptr<Flight> flight;
+    };
+
+    struct Command {
+        std::chrono::milliseconds ttl;
+        size_t maxEntries;
+        // Bumped by each invalidation, so that a fetch started before is not stored
+        unsigned long generation;
+        std::unordered_map<std::string, Entry> entries;
+    };
+
+    // Set once any command is cached, so that the others skip the lock
+    std::atomic<bool> enabled;
+    std::mutex mutex;
+    std::map<std::string, Command> commands;
+    std::map<std::string, std::vector<std::string>> invalidations;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long coalesced;
+    unsigned long invalidated;
+    unsigned long evicted;
+
+    void invalidateLocked(Command &command);
+    /** Drops the expired entries of a command, and its oldest one if it's still full. */
+    void makeRoom(Command &command, const std::chrono::steady_clock::time_point &now);
+};
+
+#endif // LIGHTNINGCPP_RESPONSECACHE_H
@@ -0,0 +1,145 @@
+#include "responsestreamer.h"
+
+// The depth of the elements of the streamed array : envelope, result, then the array
+static const int ARRAY_DEPTH = 3;
+
+ResponseStreamer::ResponseStreamer(const std::string &member,
+                    std::function<void(const char*, const char*)> onElement):
+    member(member),
+    onElement(onElement),
+    depth(0),
+    inString(false),
+    escaped(false),
+    hasStarted(false),
+    isDone(false),
+    streaming(false),
+    inElement(false),
+    elementIsContainer(false)
+{}
+
+static bool isWhitespace(const char &c)
+{
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+size_t ResponseStreamer::feed(const char *data, const size_t &size)
+{
+    // Where the bytes not appended to the envelope (or the element) yet begin
+    size_t runStart = 0;
+    size_t i;
+
+    for (i = 0; i < size && !isDone; i++) {
+        char c = data[i];
+        if (inElement) {
+            bool ends = false;
+            size_t end = i + 1;
+            if (inString) {
+                if (escaped)
+                    escaped = false;
+                else if (c == '\\')
+                    escaped = true;
+                else if (c == '"')
+                    inString = false, ends = !elementIsContainer && depth == ARRAY_DEPTH;
+            } else if (c == '"') {
+                inString = true;
+            } else if (c == '{' || c == '[') {
+                depth++;
+            } else if ((c == '}' || c == ']') && elementIsContainer) {
+                ends = --depth == ARRAY_DEPTH;
+            } else if (!elementIsContainer && (c == ',' || c == ']' || isWhitespace(c))) {
+                // The end of a number or a literal, this character is not part of it
+                ends = true;
+                end = i--;
+            }
+            if (!ends)
+                continue;
+            if (element.empty()) {
+                onElement(data + runStart, data + end);
+            } else {
+                element.append(data + runStart, end - runStart);
+                onElement(element.data(), element.data() + element.size());
+                element.clear();
+            }
+            inElement = false;
+            runStart = end;
+            continue;
+        }
+
+        if (inString) {
+            if (escaped)
+                escaped = false;
+            else if (c == '\\')
+                escaped = true;
+            else if (c == '"')
+                inString = false;
+            else if (depth <= 2)
+                lastString += c;
+            continue;
+        }
+        if (isWhitespace(c))
+            continue;
+        hasStarted = true;
+        if (streaming && depth == ARRAY_DEPTH && c != ']') {
+            // Elements are dropped from the envelope, and so are their separators
+            envelope.append(data + runStart, i - runStart);
+            runStart = i;
+            if (c == ',') {
+                runStart = i + 1;
+                continue;
+            }
+            inElement = true;
+            elementIsContainer = c == '{' || c == '[';
+            inString = c == '"';
+            if (elementIsContainer)
+                depth++;
+            continue;
+        }
+        switch (c) {
+            case '"':
+                inString = true;
+                lastString.clear();
+                break;
+            case ':':
+                if (depth == 1)
+                    envelopeKey = lastString;
+                else if (depth == 2)
+                    resultKey = lastString;
+                break;
+            case '[':
+                streaming = depth == 2 && envelopeKey == "result" && resultKey == member;
+                depth++;
+                break;
+            case '{':
+                depth++;
+                break;
+            case ']':
+            case '}':
+                if (streaming && depth == ARRAY_DEPTH)
+                    streaming = false;
+                if (--depth == 0)
+                    isDone = true;
+                break;
+        }
+    }
+
+    if (inElement)
+        element.append(data + runStart, i - runStart);
+    else
+        envelope.append(data + runStart, i - runStart);
+    return i;
+}
+
+bool ResponseStreamer::started() const
+{
+    return hasStarted;
+}
+
+bool ResponseStreamer::done() const
+{
+    return isDone;
+}
+
+const std::string &ResponseStreamer::getEnvelope() const
+{
+    return envelope;
+}
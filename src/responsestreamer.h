@@ -0,0 +1,65 @@
+#ifndef LIGHTNINGCPP_RESPONSESTREAMER_H
+#define LIGHTNINGCPP_RESPONSESTREAMER_H
+
+#include <functional>
+#include <string>
+
+/**
+ * Splits a JSON-RPC response, as it is received, into the elements of one of
+ * the arrays of its result (e.g. the "channels" of a listchannels result) and
+ * the rest of it.
+ *
+ * Each element is handed to a callback as soon as its last byte is fed, then
+ * dropped, so that memory is bounded by the size of one element rather than
+ * the one of the response. Everything else is kept as the envelope, in which
+ * the streamed array is left empty.
+ */
+class ResponseStreamer {
+
+public:
+    /**
+     * @param member The member of the result holding the array to stream
+     * @param onElement Called with the raw JSON text of each element of the array
+     */
+    ResponseStreamer(const std::string &member, std::function<void(const char*, const char*)> onElement);
+
+    /**
+     * Scans the next bytes of the response.
+     *
+     * @return The number of bytes which belonged to the response, less than `size`
+     *         only once it's complete
+     */
+    size_t feed(const char *data, const size_t &size);
+
+    /** Whether any byte of the response was fed yet. */
+    bool started() const;
+
+    /** Whether the whole response was fed. */
+    bool done() const;
+
+    /** The response without the elements of the streamed array. */
+    const std::string &getEnvelope() const;
+
+private:
+    std::string member;
+    std::function<void(const char*, const char*)> onElement;
+    std::string envelope;
+    // The beginning of the current element, when it spans several calls to feed()
+    std::string element;
+    int depth;
+    bool inString;
+    bool escaped;
+    bool hasStarted;
+    bool isDone;
+    // The last string read in the envelope and the result, to tell which member we are in
+    std::string lastString;
+    std::string envelopeKey;
+    std::string resultKey;
+    // Whether we are in the streamed array, and in one of its elements
+    bool streaming;
+    bool inElement;
+    // Whether the current element is an object or an array rather than a scalar
+    bool elementIsContainer;
+};
+
+#endif // LIGHTNINGCPP_RESPONSESTREAMER_H
@@ -0,0 +1,107 @@
+#include "responsewriter.h"
+#include "jsonwriter.h"
+
+#include <cerrno>
+#include <unistd.h>
+
+// The serialization buffer of each thread, reused across responses
+static thread_local std::string buffer;
+
+ResponseWriter::ResponseWriter(const int &fd):
+    fd(fd),
+    flushing(false),
+    writes(0),
+    messages(0)
+{}
+
+void ResponseWriter::appendEnvelope(const std::string &reqId, std::string &out)
+{
+    out += "{\"jsonrpc\":\"2.0\",\"id\":";
+    JsonWriter::appendString(reqId, out);
+    out += ",\"result\":";
+}
+
+size_t ResponseWriter::writeResult(const std::string &reqId, const Json::Value &result)
+{
+    buffer.clear();
+    appendEnvelope(reqId, buffer);
+    JsonWriter::append(result, buffer);
+    buffer += "}\n\n";
+    send(buffer);
+    return buffer.size();
+}
+
+size_t ResponseWriter::writeRawResult(const std::string &reqId, const std::string &rawResult)
+{
+    return writeRawResult(reqId, rawResult.data(), rawResult.size());
+}
+
+size_t ResponseWriter::writeRawResult(const std::string &reqId, const char *rawResult, const size_t &size)
+{
+    buffer.clear();
+    appendEnvelope(reqId, buffer);
+    buffer.append(rawResult, size);
+    buffer += "}\n\n";
+    send(buffer);
+    return buffer.size();
+}
+
+size_t ResponseWriter::writeError(const std::string &reqId, const int &code, const std::string &message)
+{
+    buffer.clear();
+    buffer += "{\"jsonrpc\":\"2.0\",\"id\":";
+    JsonWriter::appendString(reqId, buffer);
+    buffer += ",\"error\":{\"code\":";
+    buffer += std::to_string(code);
+    buffer += ",\"message\":";
+    JsonWriter::appendString(message, buffer);
+    buffer += "}}\n\n";
+    send(buffer);
+    return buffer.size();
+}
+
+void ResponseWriter::writeMessage(const std::string &message)
+{
+    send(message);
+}
+
+void ResponseWriter::send(const std::string &message)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    queued += message;
+    messages++;
+    // The thread currently writing will pick our message up
+    if (flushing)
+        return;
+    flushing = true;
+    while (!queued.empty()) {
+        writing.swap(queued);
+        lock.unlock();
+        size_t written = 0;
+        while (written < writing.size()) {
+            ssize_t n = write(fd, writing.data() + written, writing.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            // lightningd is gone, there is nobody to answer to anymore
+            if (n < 0)
+                break;
+            written += n;
+        }
+        writing.clear();
+        lock.lock();
+        writes++;
+    }
+    flushing = false;
+}
+
+unsigned long ResponseWriter::getWrites()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return writes;
+}
+
+unsigned long ResponseWriter::getMessages()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return messages;
+}
@@ -0,0 +1,73 @@
+#ifndef LIGHTNINGCPP_RESPONSEWRITER_H
+#define LIGHTNINGCPP_RESPONSEWRITER_H
+
+#include <jsonrpccpp/client.h>
+#include <mutex>
+#include <string>
+
+/**
+ * Writes JSONRPC responses to a file descriptor (the plugin's stdout).
+ *
+ * The envelope and the result are serialized directly into a per-thread buffer
+ * reused across responses, and each response costs a single write(2). When
+ * several threads respond at the same time, the one writing flushes the
+ * responses queued by the others along with its own in a single write.
+ */
+class ResponseWriter {
+
+public:
+    ResponseWriter(const int &fd);
+
+    /**
+     * Writes a successful response.
+     *
+     * @param reqId The JSON id of the request
+     * @param result The result to serialize
+     * @return The size of the response, in bytes
+     */
+    size_t writeResult(const std::string &reqId, const Json::Value &result);
+
+    /**
+     * Writes a successful response whose result is already serialized.
+     *
+     * @param reqId The JSON id of the request
+     * @param rawResult The JSON text of the result, written as is
+     * @return The size of the response, in bytes
+     */
+    size_t writeRawResult(const std::string &reqId, const std::string &rawResult);
+    size_t writeRawResult(const std::string &reqId, const char *rawResult, const size_t &size);
+
+    /**
+     * Writes an error response.
+     *
+     * @param reqId The JSON id of the request
+     * @return The size of the response, in bytes
+     */
+    size_t writeError(const std::string &reqId, const int &code, const std::string &message);
+
+    /** Writes a raw message as is, e.g. a notification to lightningd. */
+    void writeMessage(const std::string &message);
+
+    /** The number of write(2) calls made, and of messages written. */
+    unsigned long getWrites();
+    unsigned long getMessages();
+
+private:
+    int fd;
+    std::mutex mutex;
+    // Messages queued while another thread was writing
+    std::string queued;
+    // What the writing thread is currently writing, kept to reuse its allocation
+    std::string writing;
+    bool flushing;
+    unsigned long writes;
+    unsigned long messages;
+
+    /** Appends the beginning of a response envelope, up to the result. */
+    static void appendEnvelope(const std::string &reqId, std::string &out);
+
+    /** Queues a serialized message and writes everything queued unless another thread is doing so. */
+    void send(const std::string &message);
+};
+
+#endif // LIGHTNINGCPP_RESPONSEWRITER_H
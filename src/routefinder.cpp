@@ -0,0 +1,427 @@
+#include "routefinder.h"
+#include "rpcexception.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <utility>
+
+// As lightningd, to turn the riskfactor into a cost per block
+static const double BLOCKS_PER_YEAR = 52596;
+
+RouteQuery::RouteQuery(const std::string &id, const uint64_t &amountMsat, const unsigned int &riskfactor,
+            const unsigned int &cltv, const std::string &fromId, const float &fuzzPercent,
+            const std::vector<std::string> &exclude, const unsigned int &maxhops):
+    id(id),
+    amountMsat(amountMsat),
+    riskfactor(riskfactor),
+    cltv(cltv),
+    fromId(fromId),
+    fuzzPercent(fuzzPercent),
+    exclude(exclude),
+    maxhops(maxhops)
+{}
+
+/** The fee a channel charges to forward `amount`, without overflowing. */
+static uint64_t channelFee(const Channel &channel, const uint64_t &amount)
+{
+    return channel.baseFeeMsat + amount / 1000000 * channel.feePerMillionth
+        + amount % 1000000 * channel.feePerMillionth / 1000000;
+}
+
+/** A pseudo-random number in [-1, 1], always the same for a channel and a seed. */
+static double fuzzFactor(const uint64_t &shortChannelId, const uint64_t &seed)
+{
+    // splitmix64
+    uint64_t z = shortChannelId ^ seed;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    return (double)(z >> 11) / (double)(1ULL << 52) - 1.0;
+}
+
+/** The parameters shared by all the searches of a query. */
+struct SearchParams {
+    uint64_t amountMsat;
+    uint32_t cltv;
+    double riskPerBlock;
+    double fuzz;
+    uint64_t seed;
+};
+
+/** What using this channel to forward `amount` costs, fuzzed fee and risk. */
+static double hopCost(const SearchParams &params, const Channel &channel, const uint64_t &amount, const uint64_t &fee)
+{
+    double fuzzedFee = fee * (1.0 + params.fuzz * fuzzFactor(channel.shortChannelId, params.seed));
+    return fuzzedFee + params.riskPerBlock * (amount + fee) * channel.delay;
+}
+
+/**
+ * A Dijkstra search from the destination back to a source, with its state sized
+ * for a graph and reused across queries. Entries are only valid if their stamp
+ * is the current search's, which saves clearing them.
+ */
+class PathSearch {
+
+public:
+    PathSearch():
+        generation(0)
+    {}
+
+    void prepare(const GraphSnapshot &graph)
+    {
+        if (cost.size() != graph.getNodeCount()) {
+            cost.resize(graph.getNodeCount());
+            amount.resize(graph.getNodeCount());
+            hops.resize(graph.getNodeCount());
+            next.resize(graph.getNodeCount());
+            stamp.assign(graph.getNodeCount(), 0);
+            excludedNodes.assign(graph.getNodeCount(), 0);
+        }
+        if (excludedChannels.size() != graph.getChannelCount())
+            excludedChannels.assign(graph.getChannelCount(), 0);
+        for (uint32_t node : excludedNodeList)
+            excludedNodes[node] = 0;
+        for (uint32_t channel : excludedChannelList)
+            excludedChannels[channel] = 0;
+        excludedNodeList.clear();
+        excludedChannelList.clear();
+    }
+
+    /** Exclusions are counted, so that they can be undone back to a mark. */
+    void excludeNode(const uint32_t &node)
+    {
+        excludedNodes[node]++;
+        excludedNodeList.push_back(node);
+    }
+
+    void excludeChannel(const uint32_t &channel)
+    {
+        excludedChannels[channel]++;
+        excludedChannelList.push_back(channel);
+    }
+
+    std::pair<size_t, size_t> exclusionMark() const
+    {
+        return std::make_pair(excludedNodeList.size(), excludedChannelList.size());
+    }
+
+    void undoExclusions(const std::pair<size_t, size_t> &mark)
+    {
+        while (excludedNodeList.size() > mark.first) {
+            excludedNodes[excludedNodeList.back()]--;
+            excludedNodeList.pop_back();
+        }
+        while (excludedChannelList.size() > mark.second) {
+            excludedChannels[excludedChannelList.back()]--;
+            excludedChannelList.pop_back();
+        }
+    }
+
+    /**
+     * @param sourceCharges Whether the source takes a fee on its channel, if it's not our node
+     * @param path Set to the indexes of the channels from `source` to `destination`
+     */
+    bool run(const GraphSnapshot &graph, const SearchParams &params, const uint32_t &source,
+            const uint32_t &destination, const bool &sourceCharges, const unsigned int &maxhops,
+            std::vector<uint32_t> &path)
+    {
+        const std::vector<Channel> &channels = graph.getChannels();
+        generation++;
+        if (generation == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+        while (!queue.empty())
+            queue.pop();
+
+        visit(destination, 0, params.amountMsat, 0, UINT32_MAX);
+        queue.push(std::make_pair(0.0, destination));
+        while (!queue.empty()) {
+            double nodeCost = queue.top().first;
+            uint32_t node = queue.top().second;
+            queue.pop();
+            // A stale entry, the node was reached cheaper since
+            if (nodeCost > cost[node])
+                continue;
+            if (node == source)
+                break;
+            if (hops[node] >= maxhops)
+                continue;
+            for (uint32_t index : graph.incoming(node)) {
+                const Channel &channel = channels[index];
+                uint32_t from = channel.source;
+                if (excludedChannels[index] || excludedNodes[from] || !channel.active)
+                    continue;
+                if (amount[node] > channel.amountMsat || amount[node] < channel.htlcMinimumMsat)
+                    continue;
+                // Our own channels cost us nothing
+                uint64_t fee = from == source && !sourceCharges ? 0 : channelFee(channel, amount[node]);
+                double fromCost = nodeCost + hopCost(params, channel, amount[node], fee);
+                if (stamp[from] != generation || fromCost < cost[from]) {
+                    visit(from, fromCost, amount[node] + fee, hops[node] + 1, index);
+                    queue.push(std::make_pair(fromCost, from));
+                }
+            }
+        }
+        if (source >= stamp.size() || stamp[source] != generation)
+            return false;
+
+        path.clear();
+        for (uint32_t node = source; node != destination; node = channels[next[node]].destination)
+            path.push_back(next[node]);
+        return true;
+    }
+
+private:
+    std::vector<double> cost;
+    std::vector<uint64_t> amount;
+    std::vector<uint32_t> hops;
+    // The channel to take towards the destination
+    std::vector<uint32_t> next;
+    std::vector<uint32_t> stamp;
+    uint32_t generation;
+    std::vector<uint16_t> excludedNodes;
+    std::vector<uint16_t> excludedChannels;
+    std::vector<uint32_t> excludedNodeList;
+    std::vector<uint32_t> excludedChannelList;
+    std::priority_queue<std::pair<double, uint32_t>, std::vector<std::pair<double, uint32_t>>,
+            std::greater<std::pair<double, uint32_t>>> queue;
+
+    void visit(const uint32_t &node, const double &nodeCost, const uint64_t &nodeAmount,
+            const uint32_t &nodeHops, const uint32_t &channel)
+    {
+        stamp[node] = generation;
+        cost[node] = nodeCost;
+        amount[node] = nodeAmount;
+        hops[node] = nodeHops;
+        next[node] = channel;
+    }
+};
+
+// Each thread searches with its own state
+static thread_local PathSearch search;
+
+/** The cost of a whole path, as the search computes it. */
+static double pathCost(const GraphSnapshot &graph, const SearchParams &params, const std::vector<uint32_t> &path)
+{
+    double total = 0;
+    uint64_t amount = params.amountMsat;
+    for (size_t i = path.size(); i-- > 0;) {
+        const Channel &channel = graph.getChannels()[path[i]];
+        uint64_t fee = i > 0 ? channelFee(channel, amount) : 0;
+        total += hopCost(params, channel, amount, fee);
+        amount += fee;
+    }
+    return total;
+}
+
+/** Computes the amount and delay of each hop, from the destination backward. */
+static void makeRoute(const GraphSnapshot &graph, const SearchParams &params, const std::vector<uint32_t> &path,
+            std::vector<RouteHop> &route)
+{
+    uint64_t amount = params.amountMsat;
+    uint32_t delay = params.cltv;
+    route.resize(path.size());
+    for (size_t i = path.size(); i-- > 0;) {
+        const Channel &channel = graph.getChannels()[path[i]];
+        RouteHop &hop = route[i];
+        hop.shortChannelId = channel.shortChannelId;
+        hop.direction = channel.channelFlags & 1;
+        hop.id = channel.destination;
+        hop.amountMsat = amount;
+        hop.delay = delay;
+        amount += channelFee(channel, amount);
+        delay += channel.delay;
+    }
+}
+
+/**
+ * Sets the search up for a query.
+ *
+ * @return false if its source or destination is not in the graph
+ */
+static bool beginQuery(const GraphSnapshot &graph, const Interner &nodeIds, const std::string &self,
+            const RouteQuery &query, SearchParams &params, uint32_t &source, uint32_t &destination)
+{
+    search.prepare(graph);
+    // Ids we never saw can't be in the graph, and must not be added to the interner by a query
+    if (!nodeIds.find(query.fromId.empty() ? self : query.fromId, source) || !nodeIds.find(query.id, destination))
+        return false;
+    if (source >= graph.getNodeCount() || destination >= graph.getNodeCount() || source == destination)
+        return false;
+
+    for (const std::string &excluded : query.exclude) {
+        size_t slash = excluded.find('/');
+        uint64_t shortChannelId;
+        if (slash == std::string::npos) {
+            uint32_t node;
+            if (nodeIds.find(excluded, node) && node < graph.getNodeCount())
+                search.excludeNode(node);
+        } else if (ShortChannelId::parse(excluded.data(), excluded.data() + slash, shortChannelId)) {
+            const Channel *channel = graph.findChannel(shortChannelId, excluded.compare(slash + 1, 1, "1") == 0);
+            if (channel)
+                search.excludeChannel(channel - graph.getChannels().data());
+        }
+    }
+
+    params.amountMsat = query.amountMsat;
+    params.cltv = query.cltv;
+    params.riskPerBlock = query.riskfactor / (BLOCKS_PER_YEAR * 100);
+    params.fuzz = query.fuzzPercent / 100.0;
+    // FNV-1a of the destination and the amount
+    params.seed = 14695981039346656037ULL;
+    for (const char &c : query.id)
+        params.seed = (params.seed ^ (unsigned char)c) * 1099511628211ULL;
+    params.seed = (params.seed ^ query.amountMsat) * 1099511628211ULL;
+    return true;
+}
+
+RouteFinder::RouteFinder(NetworkGraph &graph, const std::string &self, const unsigned int &threads):
+    graph(graph),
+    self(self),
+    pool(threads ? new ThreadPool(threads) : nullptr)
+{}
+
+RouteFinder::~RouteFinder()
+{
+    delete pool;
+}
+
+bool RouteFinder::findRoute(const RouteQuery &query, std::vector<RouteHop> &route)
+{
+    std::shared_ptr<const GraphSnapshot> snapshot = graph.getSnapshot();
+    SearchParams params;
+    uint32_t source, destination;
+    std::vector<uint32_t> path;
+
+    route.clear();
+    if (!beginQuery(*snapshot, graph.getNodeIds(), self, query, params, source, destination))
+        return false;
+    if (!search.run(*snapshot, params, source, destination, false, query.maxhops, path))
+        return false;
+    makeRoute(*snapshot, params, path, route);
+    return true;
+}
+
+void RouteFinder::findRoutes(const RouteQuery &query, const unsigned int &k, std::vector<std::vector<RouteHop>> &routes)
+{
+    std::shared_ptr<const GraphSnapshot> snapshot = graph.getSnapshot();
+    const std::vector<Channel> &channels = snapshot->getChannels();
+    SearchParams params;
+    uint32_t source, destination;
+    std::vector<uint32_t> path, spurPath;
+    // The routes found so far, and the candidates for the next one
+    std::vector<std::vector<uint32_t>> found;
+    std::vector<std::pair<double, std::vector<uint32_t>>> candidates;
+
+    routes.clear();
+    if (k == 0 || !beginQuery(*snapshot, graph.getNodeIds(), self, query, params, source, destination))
+        return;
+    if (!search.run(*snapshot, params, source, destination, false, query.maxhops, path))
+        return;
+    found.push_back(path);
+
+    while (found.size() < k) {
+        const std::vector<uint32_t> previous = found.back();
+        // Deviate from the previous route at each of its nodes in turn
+        for (size_t i = 0; i < previous.size(); i++) {
+            std::pair<size_t, size_t> mark = search.exclusionMark();
+            for (const std::vector<uint32_t> &route : found)
+                if (route.size() > i && std::equal(previous.begin(), previous.begin() + i, route.begin()))
+                    search.excludeChannel(route[i]);
+            // The route must not loop back over its root
+            uint32_t spur = source;
+            for (size_t j = 0; j < i; spur = channels[previous[j]].destination, j++)
+                search.excludeNode(spur);
+
+            if (query.maxhops > i
+                    && search.run(*snapshot, params, spur, destination, i > 0, query.maxhops - i, spurPath)) {
+                path.assign(previous.begin(), previous.begin() + i);
+                path.insert(path.end(), spurPath.begin(), spurPath.end());
+                bool known = std::find(found.begin(), found.end(), path) != found.end();
+                for (size_t j = 0; !known && j < candidates.size(); j++)
+                    known = candidates[j].second == path;
+                if (!known)
+                    candidates.push_back(std::make_pair(pathCost(*snapshot, params, path), path));
+            }
+            search.undoExclusions(mark);
+        }
+        if (candidates.empty())
+            break;
+        auto cheapest = std::min_element(candidates.begin(), candidates.end(),
+                [](const std::pair<double, std::vector<uint32_t>> &a, const std::pair<double, std::vector<uint32_t>> &b) {
+            return a.first < b.first;
+        });
+        found.push_back(cheapest->second);
+        candidates.erase(cheapest);
+    }
+
+    routes.resize(found.size());
+    for (size_t i = 0; i < found.size(); i++)
+        makeRoute(*snapshot, params, found[i], routes[i]);
+}
+
+void RouteFinder::findRoutes(const std::vector<RouteQuery> &queries, std::vector<std::vector<RouteHop>> &routes)
+{
+    routes.resize(queries.size());
+    if (!pool) {
+        for (size_t i = 0; i < queries.size(); i++)
+            findRoute(queries[i], routes[i]);
+        return;
+    }
+
+    // A few chunks per thread, so that a slow one does not hold the batch up
+    const size_t chunk = std::max((size_t)1, queries.size() / 64);
+    std::mutex mutex;
+    std::condition_variable finished;
+    size_t pending = 0;
+    for (size_t begin = 0; begin < queries.size(); begin += chunk) {
+        size_t end = std::min(queries.size(), begin + chunk);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending++;
+        }
+        pool->submit([&, begin, end] {
+            for (size_t i = begin; i < end; i++)
+                findRoute(queries[i], routes[i]);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--pending == 0)
+                finished.notify_one();
+        });
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&pending] { return pending == 0; });
+}
+
+Json::Value RouteFinder::getRoute(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor,
+            const unsigned int &cltv, const std::string &fromId, const float &fuzzPercent,
+            const Json::Value &exclude, const unsigned int &maxhops)
+{
+    std::vector<std::string> excluded;
+    for (const Json::Value &it : exclude)
+        excluded.push_back(it.asString());
+    std::vector<RouteHop> route;
+    if (!findRoute(RouteQuery(id, msats, riskfactor, cltv, fromId, fuzzPercent, excluded, maxhops), route))
+        throw CLightningRpcException(205, "Could not find a route");
+    return toJson(route);
+}
+
+Json::Value RouteFinder::toJson(const std::vector<RouteHop> &route)
+{
+    Json::Value result(Json::objectValue);
+    result["route"] = Json::Value(Json::arrayValue);
+    for (const RouteHop &hop : route) {
+        Json::Value json(Json::objectValue);
+        json["id"] = graph.getNodeIds().lookup(hop.id);
+        json["channel"] = ShortChannelId::format(hop.shortChannelId);
+        json["direction"] = hop.direction;
+        json["msatoshi"] = (Json::UInt64)hop.amountMsat;
+        json["amount_msat"] = std::to_string(hop.amountMsat) + "msat";
+        json["delay"] = hop.delay;
+        result["route"].append(json);
+    }
+    return result;
+}
@@ -0,0 +1,102 @@
+#ifndef LIGHTNINGCPP_ROUTEFINDER_H
+#define LIGHTNINGCPP_ROUTEFINDER_H
+
+#include "networkgraph.h"
+#include "threadpool.h"
+
+#include <cstdint>
+#include <jsonrpccpp/client.h>
+#include <string>
+#include <vector>
+
+/** A channel of a route, as in the result of getroute. */
+struct RouteHop {
+    uint64_t shortChannelId;
+    // The amount sent through this channel, fees of the next hops included
+    uint64_t amountMsat;
+    // The node this channel leads to
+    uint32_t id;
+    uint32_t delay;
+    uint8_t direction;
+};
+
+/** The parameters of getroute, see CLightningRpc::getRoute(). */
+struct RouteQuery {
+    std::string id;
+    uint64_t amountMsat;
+    unsigned int riskfactor;
+    unsigned int cltv;
+    std::string fromId;
+    float fuzzPercent;
+    // "<short_channel_id>/<direction>" channels or node ids
+    std::vector<std::string> exclude;
+    unsigned int maxhops;
+
+    RouteQuery(const std::string &id, const uint64_t &amountMsat, const unsigned int &riskfactor,
+            const unsigned int &cltv=9, const std::string &fromId="", const float &fuzzPercent=5.0,
+            const std::vector<std::string> &exclude={}, const unsigned int &maxhops=20);
+};
+
+/**
+ * Finds payment routes over a NetworkGraph without asking lightningd, the way
+ * its getroute does : the search goes from the destination back to the source
+ * so that the fees of each hop are computed on the exact amount it forwards,
+ * and minimizes the sum of the fees plus the cost of the funds being locked
+ * (`riskfactor` percent per year of the amount times the delay). Fees are
+ * distorted by up to `fuzzPercent` so that routes are not always the same,
+ * deterministically for a given destination and amount.
+ *
+ * Every query works on the graph snapshot current when it starts, and any
+ * number of threads can query concurrently.
+ */
+class RouteFinder {
+
+public:
+    /**
+     * @param graph Must outlive the RouteFinder, and be refreshed at least once
+     * @param self Our node id, the source of the routes unless `fromId` is set
+     * @param threads The number of threads of findRoutes() for batches (defaults to 0, the calling one)
+     */
+    RouteFinder(NetworkGraph &graph, const std::string &self, const unsigned int &threads=0);
+    ~RouteFinder();
+
+    /**
+     * @param route Filled with the channels from the source to the destination
+     * @return false if there is no route
+     */
+    bool findRoute(const RouteQuery &query, std::vector<RouteHop> &route);
+
+    /**
+     * Finds the `k` cheapest loopless routes (Yen's algorithm), as distinct
+     * alternatives to retry a payment over.
+     *
+     * @param routes Filled with at most `k` routes, cheapest first
+     */
+    void findRoutes(const RouteQuery &query, const unsigned int &k, std::vector<std::vector<RouteHop>> &routes);
+
+    /**
+     * Answers a batch of queries, spread over the threads given at construction.
+     *
+     * @param routes Filled with a route per query, empty if there is none
+     */
+    void findRoutes(const std::vector<RouteQuery> &queries, std::vector<std::vector<RouteHop>> &routes);
+
+    /**
+     * A drop-in replacement for CLightningRpc::getRoute(), with the same parameters and result.
+     *
+     * @throw CLightningRpcException (205) if there is no route
+     */
+    Json::Value getRoute(const std::string &id, const unsigned int &msats, const unsigned int &riskfactor,
+            const unsigned int &cltv=9, const std::string &fromId="", const float &fuzzPercent=5.0,
+            const Json::Value &exclude={}, const unsigned int &maxhops=20);
+
+    /** Formats a route as lightningd does in the result of getroute. */
+    Json::Value toJson(const std::vector<RouteHop> &route);
+
+private:
+    NetworkGraph &graph;
+    std::string self;
+    ThreadPool *pool;
+};
+
+#endif // LIGHTNINGCPP_ROUTEFINDER_H
@@ -0,0 +1,539 @@
+#include "rpcconnection.h"
+#include "jsonscanner.h"
+#include "jsonwriter.h"
+#include "rpcexception.h"
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// What the calling thread sent to and received from lightningd, see getThreadTraffic()
+static thread_local uint64_t threadBytesSent = 0;
+static thread_local uint64_t threadBytesReceived = 0;
+
+RpcConnection::RpcConnection(const std::string &socketPath):
+    socketPath(socketPath),
+    fd(-1),
+    nextId(0),
+    connected(false),
+    reconnects(0),
+    wasConnected(false),
+    interrupted(false)
+{}
+
+RpcConnection::~RpcConnection()
+{
+    disconnect();
+}
+
+void RpcConnection::connect()
+{
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw CLightningRpcException(1, "Socket path too long : " + socketPath);
+    disconnect();
+    {
+        std::lock_guard<std::mutex> lock(interruptMutex);
+        if (interrupted)
+            throw CLightningRpcException(1, "The connection to lightningd was interrupted");
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            throw CLightningRpcException(1, std::string("Could not create socket : ") + strerror(errno));
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        disconnect();
+        throw CLightningRpcException(1, "Could not connect to " + socketPath + " : " + strerror(err));
+    }
+    if (wasConnected)
+        reconnects++;
+    wasConnected = true;
+    connected = true;
+}
+
+void RpcConnection::disconnect()
+{
+    {
+        std::lock_guard<std::mutex> lock(interruptMutex);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+    connected = false;
+    framer.clear();
+}
+
+void RpcConnection::interrupt()
+{
+    std::lock_guard<std::mutex> lock(interruptMutex);
+    interrupted = true;
+    // Wakes the reader up with an EOF, the fd itself is closed by its owner
+    if (fd >= 0)
+        shutdown(fd, SHUT_RDWR);
+}
+
+bool RpcConnection::isConnected() const
+{
+    return connected;
+}
+
+unsigned long RpcConnection::getReconnects() const
+{
+    return reconnects;
+}
+
+bool RpcConnection::writeAll(const std::string &data)
+{
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t n = send(fd, data.data() + written, data.size() - written, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+            continue;
+        // Only a request of which nothing was sent can safely be sent again
+        if (n < 0 && (errno == EPIPE || errno == ECONNRESET) && !written)
+            return false;
+        if (n < 0)
+            throw CLightningRpcException(1, std::string("Error writing to lightningd socket : ") + strerror(errno));
+        written += n;
+    }
+    threadBytesSent += written;
+    return true;
+}
+
+void RpcConnection::getThreadTraffic(uint64_t &sent, uint64_t &received)
+{
+    sent = threadBytesSent;
+    received = threadBytesReceived;
+}
+
+bool RpcConnection::sendRequest(const std::string &request)
+{
+    bool reused = isConnected();
+    if (!reused)
+        connect();
+    if (writeAll(request))
+        return true;
+    if (!reused)
+        throw CLightningRpcException(1, "lightningd closed the connection before reading the request");
+    return false;
+}
+
+void RpcConnection::readResponse(const char *&begin, const char *&end)
+{
+    while (!framer.next(begin, end)) {
+        ssize_t n = read(fd, framer.prepare(65536), 65536);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == ECONNRESET && !framer.hasPartial())
+            throw CLightningRpcException(1, "lightningd closed the connection before answering");
+        if (n < 0)
+            throw CLightningRpcException(1, std::string("Error reading from lightningd socket : ") + strerror(errno));
+        if (n == 0) {
+            if (!framer.hasPartial())
+                throw CLightningRpcException(1, "lightningd closed the connection before answering");
+            throw CLightningRpcException(1, "lightningd closed the connection in the middle of a response");
+        }
+        threadBytesReceived += n;
+        framer.commit(n);
+    }
+}
+
+bool RpcConnection::roundTrip(const std::string &request, const char *&begin, const char *&end)
+{
+    if (!sendRequest(request))
+        return false;
+    readResponse(begin, end);
+    return true;
+}
+
+void RpcConnection::appendRequest(const unsigned long &id, const std::string &command,
+                    const Json::Value &params, std::string &out)
+{
+    out += "{\"jsonrpc\":\"2.0\",\"id\":";
+    out += std::to_string(id);
+    out += ",\"method\":";
+    JsonWriter::appendString(command, out);
+    out += ",\"params\":";
+    JsonWriter::append(params, out);
+    out += "}\n";
+}
+
+unsigned long RpcConnection::scanResponse(const char *begin, const char *end, const char *&resultBegin,
+                    const char *&resultEnd, const char *&errorBegin, const char *&errorEnd)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+    uint64_t id = 0;
+    bool hasId = false;
+
+    resultBegin = resultEnd = errorBegin = errorEnd = nullptr;
+    if (scanner.beginObject()) {
+        while (scanner.nextMember(keyBegin, keyEnd)) {
+            std::string key(keyBegin, keyEnd);
+            if (key == "id")
+                hasId = scanner.readUnsigned(id);
+            else if (key == "result")
+                scanner.skipValue(resultBegin, resultEnd);
+            else if (key == "error")
+                scanner.skipValue(errorBegin, errorEnd);
+            else
+                scanner.skipValue();
+        }
+    }
+    if (scanner.failed() || !hasId)
+        throw CLightningRpcException(1, "Invalid JSON-RPC response from lightningd : " + std::string(begin, end));
+    return id;
+}
+
+unsigned long RpcConnection::parseResponse(const char *begin, const char *end, RpcResult &result)
+{
+    // Parsing a string into a Json::Value only needs a reader, not a new one each time
+    static thread_local std::unique_ptr<Json::CharReader> reader;
+    const char *resultBegin, *resultEnd, *errorBegin, *errorEnd;
+    std::string errors;
+    unsigned long id = scanResponse(begin, end, resultBegin, resultEnd, errorBegin, errorEnd);
+
+    if (!reader) {
+        Json::CharReaderBuilder builder;
+        builder["collectComments"] = false;
+        reader.reset(builder.newCharReader());
+    }
+    result.failed = errorBegin != nullptr;
+    result.errorCode = 0;
+    result.errorMessage.clear();
+    result.errorData = Json::Value();
+    result.result = Json::Value();
+    if (result.failed) {
+        Json::Value error;
+        if (!reader->parse(errorBegin, errorEnd, &error, &errors))
+            throw CLightningRpcException(1, "Could not parse lightningd response : " + errors);
+        result.errorCode = error["code"].asInt();
+        result.errorMessage = error["message"].asString();
+        result.errorData.swap(error["data"]);
+    } else if (resultBegin && !reader->parse(resultBegin, resultEnd, &result.result, &errors)) {
+        throw CLightningRpcException(1, "Could not parse lightningd response : " + errors);
+    }
+    return id;
+}
+
+Json::Value RpcConnection::call(const std::string &command, const Json::Value &params)
+{
+    unsigned long id = nextId++;
+    const char *begin, *end;
+    RpcResult result;
+    Json::Value value;
+
+    writeBuffer.clear();
+    appendRequest(id, command, params, writeBuffer);
+    try {
+        if (!roundTrip(writeBuffer, begin, end)) {
+            // lightningd closed our idle connection before we sent anything, retry once on a fresh one
+            disconnect();
+            roundTrip(writeBuffer, begin, end);
+        }
+        if (parseResponse(begin, end, result) != id)
+            throw CLightningRpcException(1, "Unexpected response id from lightningd for : " + command);
+    } catch (...) {
+        disconnect();
+        throw;
+    }
+    if (result.failed)
+        throw CLightningRpcException(result.errorCode, result.errorMessage);
+    value.swap(result.result);
+    return value;
+}
+
+void RpcConnection::callRaw(const std::string &command, const Json::Value &params,
+                    const std::function<void(const char*, const char*)> &onResult)
+{
+    unsigned long id = nextId++;
+    const char *begin, *end, *resultBegin, *resultEnd, *errorBegin, *errorEnd;
+
+    writeBuffer.clear();
+    appendRequest(id, command, params, writeBuffer);
+    try {
+        if (!roundTrip(writeBuffer, begin, end)) {
+            // lightningd closed our idle connection before we sent anything, retry once on a fresh one
+            disconnect();
+            roundTrip(writeBuffer, begin, end);
+        }
+        if (scanResponse(begin, end, resultBegin, resultEnd, errorBegin, errorEnd) != id)
+            throw CLightningRpcException(1, "Unexpected response id from lightningd for : " + command);
+    } catch (...) {
+        disconnect();
+        throw;
+    }
+    if (errorBegin) {
+        // Errors are small, parse them the usual way
+        RpcResult error;
+        parseResponse(begin, end, error);
+        throw CLightningRpcException(error.errorCode, error.errorMessage);
+    }
+    if (!resultBegin) {
+        static const char null[] = "null";
+        resultBegin = null;
+        resultEnd = null + 4;
+    }
+    onResult(resultBegin, resultEnd);
+}
+
+bool RpcConnection::streamRoundTrip(const std::string &request, ResponseStreamer &streamer)
+{
+    char chunk[65536];
+    if (!sendRequest(request))
+        return false;
+    while (!streamer.done()) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == ECONNRESET && !streamer.started())
+            throw CLightningRpcException(1, "lightningd closed the connection before answering");
+        if (n < 0)
+            throw CLightningRpcException(1, std::string("Error reading from lightningd socket : ") + strerror(errno));
+        if (n == 0) {
+            if (!streamer.started())
+                throw CLightningRpcException(1, "lightningd closed the connection before answering");
+            throw CLightningRpcException(1, "lightningd closed the connection in the middle of a response");
+        }
+        threadBytesReceived += n;
+        size_t consumed = streamer.feed(chunk, n);
+        // Keep whatever follows the response (its separator) for the next read
+        if (consumed < (size_t)n)
+            framer.append(chunk + consumed, n - consumed);
+    }
+    return true;
+}
+
+Json::Value RpcConnection::callStreaming(const std::string &command, const Json::Value &params,
+                    const std::string &member, const std::function<void(Json::Value&)> &onElement)
+{
+    unsigned long id = nextId++;
+    Json::CharReaderBuilder builder;
+    builder["collectComments"] = false;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    std::string errors;
+    Json::Value element, value;
+    RpcResult result;
+    ResponseStreamer streamer(member, [&](const char *begin, const char *end) {
+        if (!reader->parse(begin, end, &element, &errors))
+            throw CLightningRpcException(1, "Could not parse lightningd response : " + errors);
+        onElement(element);
+    });
+
+    writeBuffer.clear();
+    appendRequest(id, command, params, writeBuffer);
+    try {
+        if (!streamRoundTrip(writeBuffer, streamer)) {
+            // lightningd closed our idle connection before we sent anything, retry once on a fresh one
+            disconnect();
+            streamRoundTrip(writeBuffer, streamer);
+        }
+        const std::string &envelope = streamer.getEnvelope();
+        if (parseResponse(envelope.data(), envelope.data() + envelope.size(), result) != id)
+            throw CLightningRpcException(1, "Unexpected response id from lightningd for : " + command);
+    } catch (...) {
+        // We don't know how much of the response is left to read
+        disconnect();
+        throw;
+    }
+    if (result.failed)
+        throw CLightningRpcException(result.errorCode, result.errorMessage);
+    value.swap(result.result);
+    return value;
+}
+
+bool RpcConnection::pipeline(const std::vector<RpcRequest> &requests, const unsigned int &window,
+                    const unsigned long &firstId, std::vector<RpcResult> &results)
+{
+    size_t sent = 0, received = 0;
+    const char *begin, *end;
+    RpcResult response;
+    std::vector<bool> answered(requests.size(), false);
+    bool firstWrite = true;
+
+    while (received < requests.size()) {
+        // Fill the window with as many requests as we can in a single write
+        writeBuffer.clear();
+        while (sent < requests.size() && sent - received < window) {
+            appendRequest(firstId + sent, requests[sent].command, requests[sent].params, writeBuffer);
+            sent++;
+        }
+        if (firstWrite) {
+            firstWrite = false;
+            if (!sendRequest(writeBuffer))
+                return false;
+        } else if (!writeBuffer.empty() && !writeAll(writeBuffer)) {
+            // The requests sent so far may have been executed, they must not be sent again
+            throw CLightningRpcException(1, "lightningd closed the connection in the middle of a batch");
+        }
+        readResponse(begin, end);
+        unsigned long id = parseResponse(begin, end, response);
+        if (id < firstId || id >= firstId + sent || answered[id - firstId])
+            throw CLightningRpcException(1, "Unexpected response id from lightningd in batch");
+        answered[id - firstId] = true;
+        RpcResult &result = results[id - firstId];
+        result.failed = response.failed;
+        result.errorCode = response.errorCode;
+        result.errorMessage.swap(response.errorMessage);
+        result.errorData.swap(response.errorData);
+        result.result.swap(response.result);
+        received++;
+    }
+    return true;
+}
+
+std::vector<RpcResult> RpcConnection::callBatch(const std::vector<RpcRequest> &requests, const unsigned int &window)
+{
+    RpcResult empty;
+    empty.failed = false;
+    empty.errorCode = 0;
+    std::vector<RpcResult> results(requests.size(), empty);
+    unsigned long firstId = nextId;
+    nextId += requests.size();
+
+    try {
+        if (!pipeline(requests, window ? window : 1, firstId, results)) {
+            // lightningd closed our idle connection before we sent anything, retry once on a fresh one
+            disconnect();
+            pipeline(requests, window ? window : 1, firstId, results);
+        }
+    } catch (...) {
+        disconnect();
+        throw;
+    }
+    return results;
+}
+
+RpcConnectionPool::RpcConnectionPool(const std::string &socketPath, const unsigned int &size):
+    calls(0),
+    waits(0),
+    failures(0)
+{
+    for (unsigned int i = 0; i < (size ? size : 1); i++) {
+        connections.push_back(new RpcConnection(socketPath));
+        idle.push_back(connections.back());
+    }
+}
+
+RpcConnectionPool::~RpcConnectionPool()
+{
+    for (auto connection : connections)
+        delete connection;
+}
+
+RpcConnection *RpcConnectionPool::acquire()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    calls++;
+    if (idle.empty()) {
+        waits++;
+        released.wait(lock, [this]{ return !idle.empty(); });
+    }
+    RpcConnection *connection = idle.back();
+    idle.pop_back();
+    return connection;
+}
+
+void RpcConnectionPool::release(RpcConnection *connection)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(connection);
+    }
+    released.notify_one();
+}
+
+Json::Value RpcConnectionPool::call(const std::string &command, const Json::Value &params)
+{
+    RpcConnection *connection = acquire();
+    try {
+        Json::Value result = connection->call(command, params);
+        release(connection);
+        return result;
+    } catch (...) {
+        // A lightningd error keeps the connection up, only count socket failures
+        if (!connection->isConnected()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures++;
+        }
+        release(connection);
+        throw;
+    }
+}
+
+std::vector<RpcResult> RpcConnectionPool::callBatch(const std::vector<RpcRequest> &requests,
+                    const unsigned int &window)
+{
+    RpcConnection *connection = acquire();
+    try {
+        std::vector<RpcResult> results = connection->callBatch(requests, window);
+        release(connection);
+        return results;
+    } catch (...) {
+        if (!connection->isConnected()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures++;
+        }
+        release(connection);
+        throw;
+    }
+}
+
+void RpcConnectionPool::callRaw(const std::string &command, const Json::Value &params,
+                    const std::function<void(const char*, const char*)> &onResult)
+{
+    RpcConnection *connection = acquire();
+    try {
+        connection->callRaw(command, params, onResult);
+        release(connection);
+    } catch (...) {
+        if (!connection->isConnected()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures++;
+        }
+        release(connection);
+        throw;
+    }
+}
+
+Json::Value RpcConnectionPool::callStreaming(const std::string &command, const Json::Value &params,
+                    const std::string &member, const std::function<void(Json::Value&)> &onElement)
+{
+    RpcConnection *connection = acquire();
+    try {
+        Json::Value result = connection->callStreaming(command, params, member, onElement);
+        release(connection);
+        return result;
+    } catch (...) {
+        if (!connection->isConnected()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            failures++;
+        }
+        release(connection);
+        throw;
+    }
+}
+
+RpcPoolStats RpcConnectionPool::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    RpcPoolStats stats;
+    stats.size = connections.size();
+    stats.idle = idle.size();
+    stats.connected = 0;
+    stats.reconnects = 0;
+    for (auto connection : connections) {
+        stats.connected += connection->isConnected();
+        stats.reconnects += connection->getReconnects();
+    }
+    stats.calls = calls;
+    stats.waits = waits;
+    stats.failures = failures;
+    return stats;
+}
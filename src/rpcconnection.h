@@ -0,0 +1,247 @@
+#ifndef LIGHTNINGCPP_RPCCONNECTION_H
+#define LIGHTNINGCPP_RPCCONNECTION_H
+
+#include "jsonframer.h"
+#include "responsestreamer.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <jsonrpccpp/client.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/** A command to be sent as part of a batch. */
+struct RpcRequest {
+    std::string command;
+    Json::Value params;
+};
+
+/** The outcome of one command of a batch. */
+struct RpcResult {
+    // The "result" member of the response, null if the command failed
+    Json::Value result;
+    // Whether lightningd returned an error for this command
+    bool failed;
+    int errorCode;
+    std::string errorMessage;
+    // The "data" member of the error, if lightningd gave details
+    Json::Value errorData;
+};
+
+/**
+ * A long-lived connection to lightningd's JSON-RPC Unix socket.
+ *
+ * Unlike jsonrpc::UnixDomainSocketClient, the socket is kept open across
+ * calls. It is (re)connected lazily on first use and after lightningd closed it.
+ *
+ * Requests are serialized straight into a reused buffer, and responses are
+ * read into a JsonFramer then only their result is parsed, so that a call
+ * doesn't go through any intermediate JSON-RPC layer.
+ */
+class RpcConnection {
+
+public:
+    RpcConnection(const std::string &socketPath);
+    ~RpcConnection();
+
+    /**
+     * Sends a JSON-RPC request and blocks until its response is read.
+     *
+     * If a connection kept from a previous call turns out to be closed before any
+     * byte of the request could be sent, it is reconnected and the request is sent
+     * again once. Once the request was sent it is never sent again, since lightningd
+     * may have executed it : losing the connection then is an error.
+     *
+     * @param command The lightningd command
+     * @param params The command parameters
+     * @return The "result" member of the response
+     */
+    Json::Value call(const std::string &command, const Json::Value &params);
+
+    /**
+     * Sends several JSON-RPC requests back to back over this connection, and
+     * demultiplexes their responses by id.
+     *
+     * A lightningd error for one of the commands does not abort the batch but is
+     * reported in the corresponding RpcResult, socket errors are thrown.
+     *
+     * @param requests The commands to send
+     * @param window The maximum number of requests in flight at once (defaults to 64)
+     * @return The results, in the same order as `requests`
+     */
+    std::vector<RpcResult> callBatch(const std::vector<RpcRequest> &requests, const unsigned int &window=64);
+
+    /**
+     * Sends a JSON-RPC request and hands the elements of an array of its result to a
+     * callback as they are read, instead of parsing the whole response at once.
+     *
+     * @param member The member of the result holding the array (e.g. "channels")
+     * @param onElement Called with each element of the array, in order
+     * @return The rest of the result, in which the array is empty
+     */
+    Json::Value callStreaming(const std::string &command, const Json::Value &params, const std::string &member,
+                    const std::function<void(Json::Value&)> &onElement);
+
+    /**
+     * Sends a JSON-RPC request and hands the raw JSON text of its result to a callback,
+     * to be decoded without building a Json::Value.
+     *
+     * @param onResult Called with the span of the result, which is only valid during the call
+     */
+    void callRaw(const std::string &command, const Json::Value &params,
+                    const std::function<void(const char*, const char*)> &onResult);
+
+    void connect();
+    void disconnect();
+    bool isConnected() const;
+
+    /**
+     * Makes the call blocked on this connection in another thread, if any, fail
+     * at once, as well as any later one : the connection can't be used anymore.
+     */
+    void interrupt();
+
+    /** The number of times this connection was re-established after being lost. */
+    unsigned long getReconnects() const;
+
+    /**
+     * The bytes the calling thread sent to and received from lightningd so far, over
+     * any RpcConnection : the difference across a call is what this call transferred.
+     */
+    static void getThreadTraffic(uint64_t &sent, uint64_t &received);
+
+    /** Serializes a JSON-RPC request at the end of `out`. */
+    static void appendRequest(const unsigned long &id, const std::string &command, const Json::Value &params,
+                    std::string &out);
+
+    /**
+     * Parses a raw response, only building the Json::Value of its result (or error).
+     *
+     * @param result Set to the outcome of the command
+     * @return The id of the response
+     * @throw CLightningRpcException if it's not a valid JSON-RPC response
+     */
+    static unsigned long parseResponse(const char *begin, const char *end, RpcResult &result);
+
+    /**
+     * Scans the envelope of a raw response without parsing anything.
+     *
+     * @param result Set to the span of the result, or nullptr if there is none
+     * @param error Set to the span of the error, or nullptr if there is none
+     * @return The id of the response
+     * @throw CLightningRpcException if it's not a valid JSON-RPC response
+     */
+    static unsigned long scanResponse(const char *begin, const char *end, const char *&resultBegin,
+                    const char *&resultEnd, const char *&errorBegin, const char *&errorEnd);
+
+private:
+    std::string socketPath;
+    int fd;
+    // Bytes read from the socket but not consumed yet
+    JsonFramer framer;
+    // The requests being sent, kept to reuse its allocation
+    std::string writeBuffer;
+    unsigned long nextId;
+    // Both are read by RpcConnectionPool::getStats() while the connection is in use
+    std::atomic<bool> connected;
+    std::atomic<unsigned long> reconnects;
+    // Whether we ever connected, to tell reconnections from the first connection
+    bool wasConnected;
+    // Guards `fd` against interrupt(), which is called from other threads
+    std::mutex interruptMutex;
+    bool interrupted;
+
+    /** Writes the whole buffer to the socket, returns false on EPIPE/ECONNRESET before anything was written. */
+    bool writeAll(const std::string &data);
+
+    /**
+     * Connects if needed and writes a request, returns false if the connection was
+     * kept from a previous call and lightningd closed it before anything was sent.
+     */
+    bool sendRequest(const std::string &request);
+
+    /**
+     * Reads from the socket until a whole JSON object is buffered.
+     *
+     * @param begin Set to the beginning of the raw response, valid until the next read
+     * @param end Set right after its end
+     */
+    void readResponse(const char *&begin, const char *&end);
+
+    /** Sends one request and feeds its response to the streamer, returns false if it can be sent again. */
+    bool streamRoundTrip(const std::string &request, ResponseStreamer &streamer);
+
+    /** Sends one request and reads its response, returns false if it can be sent again. */
+    bool roundTrip(const std::string &request, const char *&begin, const char *&end);
+
+    /**
+     * Pipelines the requests and stores their parsed responses, returns false
+     * if they can all be sent again.
+     */
+    bool pipeline(const std::vector<RpcRequest> &requests, const unsigned int &window,
+                    const unsigned long &firstId, std::vector<RpcResult> &results);
+};
+
+/** A snapshot of the health counters of a RpcConnectionPool. */
+struct RpcPoolStats {
+    // The maximum number of connections
+    unsigned int size;
+    // Connections currently open
+    unsigned int connected;
+    // Connections currently waiting for a caller
+    unsigned int idle;
+    // Total number of calls made through the pool
+    unsigned long calls;
+    // Calls which had to wait for a connection to be released
+    unsigned long waits;
+    // Connections re-established after lightningd closed them
+    unsigned long reconnects;
+    // Calls which failed because of a socket error
+    unsigned long failures;
+};
+
+/**
+ * A fixed-size pool of persistent connections to lightningd.
+ *
+ * Each call borrows an idle connection, blocking until one is released if they
+ * are all busy.
+ */
+class RpcConnectionPool {
+
+public:
+    RpcConnectionPool(const std::string &socketPath, const unsigned int &size);
+    ~RpcConnectionPool();
+
+    /** Sends a command over a pooled connection, see RpcConnection::call(). */
+    Json::Value call(const std::string &command, const Json::Value &params);
+
+    /** Pipelines commands over a single pooled connection, see RpcConnection::callBatch(). */
+    std::vector<RpcResult> callBatch(const std::vector<RpcRequest> &requests, const unsigned int &window=64);
+
+    /** Gets a raw result over a pooled connection, see RpcConnection::callRaw(). */
+    void callRaw(const std::string &command, const Json::Value &params,
+                    const std::function<void(const char*, const char*)> &onResult);
+
+    /** Streams a response over a pooled connection, see RpcConnection::callStreaming(). */
+    Json::Value callStreaming(const std::string &command, const Json::Value &params, const std::string &member,
+                    const std::function<void(Json::Value&)> &onElement);
+
+    RpcPoolStats getStats();
+
+private:
+    std::vector<RpcConnection*> connections;
+    std::vector<RpcConnection*> idle;
+    std::mutex mutex;
+    std::condition_variable released;
+    unsigned long calls;
+    unsigned long waits;
+    unsigned long failures;
+
+    RpcConnection *acquire();
+    void release(RpcConnection *connection);
+};
+
+#endif // LIGHTNINGCPP_RPCCONNECTION_H
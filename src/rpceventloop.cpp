@@ -0,0 +1,290 @@
+#include "rpceventloop.h"
+#include "rpcexception.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// The epoll data of the eventfd, the socket uses its connection generation (> 0)
+static const uint64_t WAKE_EVENT = 0;
+
+RpcEventLoop::RpcEventLoop(const std::string &socketPath):
+    socketPath(socketPath),
+    socketFd(-1),
+    nextId(0),
+    waitingWritable(false),
+    stopping(false),
+    generation(0)
+{
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || eventFd < 0)
+        throw CLightningRpcException(1, std::string("Could not create the RPC event loop : ") + strerror(errno));
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_EVENT;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event);
+    thread = std::thread(&RpcEventLoop::run, this);
+}
+
+RpcEventLoop::~RpcEventLoop()
+{
+    std::vector<std::pair<RpcCallback, RpcResult>> failed;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        wake();
+    }
+    thread.join();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        disconnect(failed, "The RPC event loop was stopped");
+    }
+    runCallbacks(failed);
+    ::close(eventFd);
+    ::close(epollFd);
+}
+
+void RpcEventLoop::connect()
+{
+    struct sockaddr_un addr;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+        throw CLightningRpcException(1, "Socket path too long : " + socketPath);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        throw CLightningRpcException(1, std::string("Could not create socket : ") + strerror(errno));
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        int err = errno;
+        ::close(fd);
+        throw CLightningRpcException(1, "Could not connect to " + socketPath + " : " + strerror(err));
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    socketFd = fd;
+    generation++;
+    waitingWritable = false;
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.u64 = generation;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, socketFd, &event);
+}
+
+void RpcEventLoop::disconnect(std::vector<std::pair<RpcCallback, RpcResult>> &failed, const std::string &reason)
+{
+    if (socketFd >= 0)
+        ::close(socketFd);
+    socketFd = -1;
+    writeBuffer.clear();
+    framer.clear();
+    for (auto &it : pending) {
+        RpcResult result;
+        result.failed = true;
+        result.errorCode = 1;
+        result.errorMessage = reason;
+        failed.push_back(std::make_pair(it.second, result));
+    }
+    pending.clear();
+}
+
+void RpcEventLoop::wake()
+{
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) < 0) {
+        // The counter is already non-zero, the loop will wake up anyway
+    }
+}
+
+void RpcEventLoop::call(const std::string &command, const Json::Value &params, RpcCallback callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping)
+        throw CLightningRpcException(1, "The RPC event loop was stopped");
+    unsigned long id = nextId++;
+    pending[id] = callback;
+    // The loop is already going to connect and write what's buffered
+    if (writeBuffer.empty() && !waitingWritable)
+        wake();
+    RpcConnection::appendRequest(id, command, params, writeBuffer);
+}
+
+void RpcEventLoop::addTimer(const std::chrono::milliseconds &delay, const std::function<void()> &callback)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping)
+        throw CLightningRpcException(1, "The RPC event loop was stopped");
+    auto timer = timers.insert(std::make_pair(std::chrono::steady_clock::now() + delay, callback));
+    // The loop waits for the earliest timer, which just changed
+    if (timer == timers.begin())
+        wake();
+}
+
+int RpcEventLoop::runTimers()
+{
+    std::vector<std::function<void()>> expired;
+    int timeout = -1;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = std::chrono::steady_clock::now();
+        while (!timers.empty() && timers.begin()->first <= now) {
+            expired.push_back(std::move(timers.begin()->second));
+            timers.erase(timers.begin());
+        }
+        if (!timers.empty()) {
+            // Rounded up, not to wake up right before the deadline
+            auto wait = std::chrono::duration_cast<std::chrono::microseconds>(timers.begin()->first - now);
+            timeout = (wait.count() + 999) / 1000;
+        }
+    }
+    for (auto &callback : expired) {
+        // A throwing timer must not take the loop, and the process, down with it
+        try {
+            callback();
+        } catch (...) {}
+    }
+    return expired.empty() ? timeout : 0;
+}
+
+size_t RpcEventLoop::getPending()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending.size();
+}
+
+bool RpcEventLoop::flushWrites()
+{
+    size_t written = 0;
+    while (written < writeBuffer.size()) {
+        ssize_t n = send(socketFd, writeBuffer.data() + written, writeBuffer.size() - written,
+                            MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0)
+            return false;
+        written += n;
+    }
+    writeBuffer.erase(0, written);
+    // Only poll for writability while the socket buffer is full
+    bool wantWritable = !writeBuffer.empty();
+    if (wantWritable != waitingWritable) {
+        struct epoll_event event;
+        event.events = wantWritable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+        event.data.u64 = generation;
+        epoll_ctl(epollFd, EPOLL_CTL_MOD, socketFd, &event);
+        waitingWritable = wantWritable;
+    }
+    return true;
+}
+
+void RpcEventLoop::readResponses()
+{
+    std::vector<std::pair<RpcCallback, RpcResult>> completed;
+    const char *begin, *end;
+    bool closed = false;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        while (true) {
+            ssize_t n = read(socketFd, framer.prepare(65536), 65536);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            if (n <= 0) {
+                closed = true;
+                break;
+            }
+            framer.commit(n);
+        }
+        while (framer.next(begin, end)) {
+            RpcResult result;
+            unsigned long id;
+            try {
+                id = RpcConnection::parseResponse(begin, end, result);
+            } catch (CLightningRpcException &e) {
+                disconnect(completed, e.what());
+                break;
+            }
+            auto it = pending.find(id);
+            if (it == pending.end())
+                continue;
+            completed.push_back(std::make_pair(it->second, std::move(result)));
+            pending.erase(it);
+        }
+        if (closed && socketFd >= 0)
+            disconnect(completed, "lightningd closed the connection before answering");
+    }
+    runCallbacks(completed);
+}
+
+void RpcEventLoop::runCallbacks(std::vector<std::pair<RpcCallback, RpcResult>> &completed)
+{
+    // Callbacks may queue new requests, so they are always run without holding the lock
+    for (auto &it : completed) {
+        try {
+            it.first(it.second);
+        } catch (...) {
+            // The other callbacks and the loop itself must go on
+        }
+    }
+}
+
+bool RpcEventLoop::isLoopThread() const
+{
+    return std::this_thread::get_id() == thread.get_id();
+}
+
+void RpcEventLoop::run()
+{
+    struct epoll_event events[16];
+
+    while (true) {
+        int n = epoll_wait(epollFd, events, 16, runTimers());
+        if (n < 0 && errno == EINTR)
+            continue;
+        for (int i = 0; i < n; i++) {
+            std::vector<std::pair<RpcCallback, RpcResult>> failed;
+            bool readable = false;
+            if (events[i].data.u64 == WAKE_EVENT) {
+                uint64_t counter;
+                if (read(eventFd, &counter, sizeof(counter)) < 0) {
+                    // Spurious wake up
+                }
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping)
+                    return;
+                // Connecting from here, the callbacks learn about a failure like about any other
+                if (socketFd < 0 && !pending.empty()) {
+                    try {
+                        connect();
+                    } catch (CLightningRpcException &e) {
+                        disconnect(failed, e.what());
+                    }
+                }
+                if (socketFd >= 0 && !flushWrites())
+                    disconnect(failed, std::string("Error writing to lightningd socket : ") + strerror(errno));
+            } else {
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    // An event for a connection we already closed
+                    if (events[i].data.u64 != generation || socketFd < 0)
+                        continue;
+                    if ((events[i].events & EPOLLOUT) && !flushWrites())
+                        disconnect(failed, std::string("Error writing to lightningd socket : ") + strerror(errno));
+                    readable = socketFd >= 0 && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR));
+                }
+                if (readable)
+                    readResponses();
+            }
+            runCallbacks(failed);
+        }
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef LIGHTNINGCPP_RPCEVENTLOOP_H
+#define LIGHTNINGCPP_RPCEVENTLOOP_H
+
+#include "rpcconnection.h"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <jsonrpccpp/client.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+/** The completion callback of an asynchronous command. */
+typedef std::function<void(const RpcResult&)> RpcCallback;
+
+/**
+ * Multiplexes any number of in-flight requests over a single non-blocking
+ * connection to lightningd.
+ *
+ * A dedicated thread runs an epoll loop over the socket, writes the queued
+ * requests and matches the responses to their callback by id. It also runs
+ * timers, so that code waiting on lightningd or on time alone can be resumed
+ * by the same thread.
+ */
+class RpcEventLoop {
+
+public:
+    RpcEventLoop(const std::string &socketPath);
+    ~RpcEventLoop();
+
+    /**
+     * Queues a request to lightningd.
+     *
+     * The callback is executed from the event loop thread once the response is
+     * received, so it must not block. If lightningd can't be reached or the connection
+     * is lost, it's executed with a failed RpcResult : this never throws but once the
+     * loop was stopped.
+     *
+     * @param command The lightningd command
+     * @param params The command parameters
+     * @param callback The function to be executed upon completion
+     */
+    void call(const std::string &command, const Json::Value &params, RpcCallback callback);
+
+    /**
+     * Executes `callback` from the event loop thread once `delay` elapsed, so it must not
+     * block either. Timers still pending when the loop is destroyed are dropped.
+     */
+    void addTimer(const std::chrono::milliseconds &delay, const std::function<void()> &callback);
+
+    /** The number of requests waiting for a response. */
+    size_t getPending();
+
+    /** Whether we are called from the event loop thread, which must never wait for a response. */
+    bool isLoopThread() const;
+
+private:
+    std::string socketPath;
+    int epollFd;
+    // Used to wake up the loop when requests are queued or when stopping
+    int eventFd;
+    int socketFd;
+    std::thread thread;
+    // Protects everything below, along with the socket state
+    std::mutex mutex;
+    // Serialized requests not written to the socket yet
+    std::string writeBuffer;
+    std::unordered_map<unsigned long, RpcCallback> pending;
+    // By deadline
+    std::multimap<std::chrono::steady_clock::time_point, std::function<void()>> timers;
+    unsigned long nextId;
+    bool waitingWritable;
+    bool stopping;
+    // Incremented on each connection, to discard the events of a closed socket
+    uint64_t generation;
+    // Only accessed by the loop thread
+    JsonFramer framer;
+
+    /** Connects to lightningd from the loop thread, with the mutex held. */
+    void connect();
+
+    /** Closes the socket and fails every pending request, with the mutex held. */
+    void disconnect(std::vector<std::pair<RpcCallback, RpcResult>> &failed, const std::string &reason);
+
+    void run();
+    void wake();
+
+    /** Writes as much of the write buffer as possible without blocking, with the mutex held. */
+    bool flushWrites();
+
+    /** Reads and dispatches the available responses. */
+    void readResponses();
+
+    void runCallbacks(std::vector<std::pair<RpcCallback, RpcResult>> &completed);
+
+    /** Runs the expired timers, and returns how long epoll may wait for the next one (-1 for ever). */
+    int runTimers();
+};
+
+#endif // LIGHTNINGCPP_RPCEVENTLOOP_H
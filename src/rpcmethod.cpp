@@ -26,29 +26,44 @@ Json::Value RpcMethod::main(Json::Value& parameters)
 void RpcMethod::setMain(std::function<Json::Value(Json::Value&)> func)
 {
     mainFunc = func;
+    rawMainFunc = nullptr;
+    asyncMainFunc = nullptr;
 }
 
 void RpcMethod::setMain(Json::Value& (*func)(Json::Value&))
 {
     mainFunc = [&](Json::Value& param){return func(param);};
+    rawMainFunc = nullptr;
+    asyncMainFunc = nullptr;
 }
 
-std::string RpcMethod::getName()
+void RpcMethod::setRawMain(std::function<std::string(Json::Value&)> func)
+{
+    rawMainFunc = func;
+    asyncMainFunc = nullptr;
+}
+
+void RpcMethod::setAsyncMain(std::function<void(Json::Value&, RpcResponder)> func)
+{
+    asyncMainFunc = func;
+}
+
+const std::string &RpcMethod::getName() const
 {
     return name;
 }
 
-std::string RpcMethod::getUsage()
+const std::string &RpcMethod::getUsage() const
 {
     return usage;
 }
 
-std::string RpcMethod::getDescription()
+const std::string &RpcMethod::getDescription() const
 {
     return description;
 }
 
-std::string RpcMethod::getLongDescription()
+const std::string &RpcMethod::getLongDescription() const
 {
     return longDescription;
 }
@@ -1,6 +1,8 @@
 #ifndef LIGHTNINGCPP_RPCMETHOD_H
 #define LIGHTNINGCPP_RPCMETHOD_H
 
+#include "rpcresponder.h"
+
 #include <functional>
 #include <jsonrpccpp/client.h>
 #include <string>
@@ -34,10 +36,37 @@ public:
     void setMain(std::function<Json::Value(Json::Value&)> func);
     void setMain(Json::Value& (*func)(Json::Value&));
 
-    std::string getName();
-    std::string getUsage();
-    std::string getDescription();
-    std::string getLongDescription();
+    /**
+     * If set, the function executed instead of mainFunc. It returns the result already
+     * serialized as JSON, which is written as is in the response.
+     */
+    std::function<std::string(Json::Value&)> rawMainFunc;
+
+    /**
+     * Sets a function returning pre-serialized JSON to be executed when the method is called,
+     * e.g. to avoid re-encoding a large cached result.
+     *
+     * @param func A function taking a Json::Value as parameter and returning its JSON result as a string
+     */
+    void setRawMain(std::function<std::string(Json::Value&)> func);
+
+    /**
+     * If set, the function executed instead of the two above. It answers through the
+     * responder, possibly after returning, see Plugin::hookSubscribeAsync().
+     */
+    std::function<void(Json::Value&, RpcResponder)> asyncMainFunc;
+
+    /**
+     * Sets a function which may suspend on an `rpc` command or a timer before answering.
+     *
+     * @param func A function taking a Json::Value as parameter and the completion of the request
+     */
+    void setAsyncMain(std::function<void(Json::Value&, RpcResponder)> func);
+
+    const std::string &getName() const;
+    const std::string &getUsage() const;
+    const std::string &getDescription() const;
+    const std::string &getLongDescription() const;
 
 protected:
     // The method name
@@ -0,0 +1,94 @@
+#include "rpcresponder.h"
+
+#include <atomic>
+#include <chrono>
+
+struct RpcResponder::State {
+    ResponseWriter &output;
+    std::string reqId;
+    Instrumentation *instrumentation;
+    std::string operation;
+    std::chrono::steady_clock::time_point start;
+    std::atomic<bool> answered;
+    std::function<void()> onAnswered;
+
+    State(ResponseWriter &output, const std::string &reqId, Instrumentation *instrumentation,
+          const std::string &operation):
+        output(output),
+        reqId(reqId),
+        instrumentation(instrumentation),
+        operation(operation),
+        start(std::chrono::steady_clock::now()),
+        answered(false)
+    {}
+
+    ~State()
+    {
+        // The handler dropped the request, don't leave lightningd waiting on it
+        if (!answered.load(std::memory_order_acquire))
+            done(output.writeError(reqId, -32603, "The handler of '" + operation + "' completed without answering"),
+                 true);
+    }
+
+    /** Whether we are the ones answering. */
+    bool claim()
+    {
+        return !answered.exchange(true, std::memory_order_acq_rel);
+    }
+
+    void done(const size_t &written, const bool &failed)
+    {
+        if (instrumentation)
+            instrumentation->record(operation, Instrumentation::microsSince(start), failed, 0, written);
+        if (onAnswered)
+            onAnswered();
+    }
+};
+
+RpcResponder::RpcResponder(ResponseWriter &output, const std::string &reqId, Instrumentation *instrumentation,
+                           const std::string &operation):
+    state(std::make_shared<State>(output, reqId, instrumentation, operation))
+{}
+
+RpcResponder::RpcResponder(const std::shared_ptr<State> &state):
+    state(state)
+{}
+
+bool RpcResponder::resolve(const Json::Value &result)
+{
+    if (!state->claim())
+        return false;
+    state->done(state->output.writeResult(state->reqId, result), false);
+    return true;
+}
+
+bool RpcResponder::resolveRaw(const std::string &rawResult)
+{
+    if (!state->claim())
+        return false;
+    state->done(state->output.writeRawResult(state->reqId, rawResult), false);
+    return true;
+}
+
+bool RpcResponder::reject(const int &code, const std::string &message)
+{
+    if (!state->claim())
+        return false;
+    state->done(state->output.writeError(state->reqId, code, message), true);
+    return true;
+}
+
+const std::string &RpcResponder::getId() const
+{
+    return state->reqId;
+}
+
+bool RpcResponder::isDone() const
+{
+    return state->answered.load(std::memory_order_acquire);
+}
+
+void RpcResponder::onAnswered(const std::function<void()> &callback)
+{
+    state->onAnswered = callback;
+}
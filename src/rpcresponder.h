@@ -0,0 +1,72 @@
+#ifndef LIGHTNINGCPP_RPCRESPONDER_H
+#define LIGHTNINGCPP_RPCRESPONDER_H
+
+#include "instrumentation.h"
+#include "responsewriter.h"
+
+#include <functional>
+#include <jsonrpccpp/client.h>
+#include <memory>
+#include <string>
+
+/**
+ * The completion of a request to the plugin, handed to asynchronous handlers.
+ *
+ * A handler can keep a copy of it in the callback of an `rpc` command or of a
+ * timer and return immediately, so that the plugin keeps serving other requests.
+ * The original request is answered once, by the first call to resolve() or
+ * reject() on any copy. If every copy is destroyed before that, an error is sent
+ * so that lightningd never waits for ever.
+ *
+ * It is thread-safe.
+ */
+class RpcResponder {
+
+public:
+    /**
+     * @param output Where to write the response
+     * @param reqId The JSON id of the request
+     * @param instrumentation If not null, where to record the time taken to answer
+     * @param operation The name it's recorded under
+     */
+    RpcResponder(ResponseWriter &output, const std::string &reqId, Instrumentation *instrumentation=nullptr,
+                 const std::string &operation="");
+
+    /**
+     * Answers the request with this result.
+     *
+     * @return false if it was already answered, in which case nothing is written
+     */
+    bool resolve(const Json::Value &result);
+
+    /**
+     * Answers the request with a result already serialized as JSON.
+     */
+    bool resolveRaw(const std::string &rawResult);
+
+    /**
+     * Answers the request with an error.
+     */
+    bool reject(const int &code, const std::string &message);
+
+    const std::string &getId() const;
+
+    /** Whether the request was already answered. */
+    bool isDone() const;
+
+    /**
+     * Sets a function executed right after the request is answered, by the thread answering it.
+     * It must be set before the responder is handed out.
+     */
+    void onAnswered(const std::function<void()> &callback);
+
+private:
+    friend class PendingRequests;
+
+    struct State;
+    std::shared_ptr<State> state;
+
+    RpcResponder(const std::shared_ptr<State> &state);
+};
+
+#endif // LIGHTNINGCPP_RPCRESPONDER_H
@@ -0,0 +1,462 @@
+#include "rpcresults.h"
+#include "jsonscanner.h"
+
+#include <cstring>
+
+/** Whether a (raw) member name is this literal. */
+static bool is(const char *begin, const char *end, const char *literal)
+{
+    size_t length = strlen(literal);
+    return (size_t)(end - begin) == length && memcmp(begin, literal, length) == 0;
+}
+
+static bool readString(JsonScanner &scanner, std::string &out)
+{
+    out.clear();
+    return scanner.readString(out);
+}
+
+static bool readUnsigned32(JsonScanner &scanner, uint32_t &out)
+{
+    uint64_t value;
+    if (!scanner.readUnsigned(value) || value > UINT32_MAX)
+        return false;
+    out = value;
+    return true;
+}
+
+static bool readBool(JsonScanner &scanner, bool &out)
+{
+    return scanner.readBool(out);
+}
+
+/** Reads an amount, either a number of `unit` millisatoshis or a "<number>msat" string. */
+static bool readMsat(JsonScanner &scanner, uint64_t &out, const uint64_t &unit=1)
+{
+    const char *begin, *end;
+    if (scanner.peek() != '"') {
+        if (!scanner.readUnsigned(out) || out > UINT64_MAX / unit)
+            return false;
+        out *= unit;
+        return true;
+    }
+    if (!scanner.readRawString(begin, end) || end - begin < 5 || !is(end - 4, end, "msat"))
+        return false;
+    out = 0;
+    for (const char *p = begin; p < end - 4; p++) {
+        if (*p < '0' || *p > '9' || out > (UINT64_MAX - (*p - '0')) / 10)
+            return false;
+        out = out * 10 + (*p - '0');
+    }
+    return true;
+}
+
+static bool readNodeId(JsonScanner &scanner, Interner &nodeIds, uint32_t &out)
+{
+    const char *begin, *end;
+    if (!scanner.readRawString(begin, end))
+        return false;
+    out = nodeIds.intern(begin, end);
+    return true;
+}
+
+static bool readShortChannelId(JsonScanner &scanner, uint64_t &out)
+{
+    const char *begin, *end;
+    return scanner.readRawString(begin, end) && ShortChannelId::parse(begin, end, out);
+}
+
+/** Enters the result object then the array held by its `member`. */
+static bool beginResultArray(JsonScanner &scanner, const char *member)
+{
+    const char *keyBegin, *keyEnd;
+    if (!scanner.beginObject())
+        return false;
+    while (scanner.nextMember(keyBegin, keyEnd)) {
+        if (is(keyBegin, keyEnd, member))
+            return scanner.beginArray();
+        if (!scanner.skipValue())
+            return false;
+    }
+    return false;
+}
+
+/** Consumes the rest of the result object, after its array. */
+static bool endResult(JsonScanner &scanner)
+{
+    const char *keyBegin, *keyEnd;
+    while (scanner.nextMember(keyBegin, keyEnd))
+        if (!scanner.skipValue())
+            return false;
+    return !scanner.failed();
+}
+
+bool ShortChannelId::parse(const char *begin, const char *end, uint64_t &scid)
+{
+    uint64_t parts[3] = {0, 0, 0};
+    unsigned int part = 0;
+    bool digits = false;
+    for (const char *p = begin; p < end; p++) {
+        if (*p == 'x' && digits && part < 2) {
+            part++;
+            digits = false;
+        } else if (*p >= '0' && *p <= '9' && parts[part] < (1 << 24)) {
+            parts[part] = parts[part] * 10 + (*p - '0');
+            digits = true;
+        } else {
+            return false;
+        }
+    }
+    if (part != 2 || !digits || parts[0] >= (1 << 24) || parts[1] >= (1 << 24) || parts[2] >= (1 << 16))
+        return false;
+    scid = parts[0] << 40 | parts[1] << 16 | parts[2];
+    return true;
+}
+
+std::string ShortChannelId::format(const uint64_t &scid)
+{
+    return std::to_string(scid >> 40) + "x" + std::to_string((scid >> 16) & 0xFFFFFF) + "x"
+            + std::to_string(scid & 0xFFFF);
+}
+
+bool GetInfoResult::decode(const char *begin, const char *end, Interner &nodeIds)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+    bool ok = true;
+
+    *this = GetInfoResult();
+    if (!scanner.beginObject())
+        return false;
+    while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+        if (is(keyBegin, keyEnd, "id"))
+            ok = readNodeId(scanner, nodeIds, id);
+        else if (is(keyBegin, keyEnd, "alias"))
+            ok = readString(scanner, alias);
+        else if (is(keyBegin, keyEnd, "color"))
+            ok = readString(scanner, color);
+        else if (is(keyBegin, keyEnd, "version"))
+            ok = readString(scanner, version);
+        else if (is(keyBegin, keyEnd, "network"))
+            ok = readString(scanner, network);
+        else if (is(keyBegin, keyEnd, "num_peers"))
+            ok = readUnsigned32(scanner, numPeers);
+        else if (is(keyBegin, keyEnd, "num_pending_channels"))
+            ok = readUnsigned32(scanner, numPendingChannels);
+        else if (is(keyBegin, keyEnd, "num_active_channels"))
+            ok = readUnsigned32(scanner, numActiveChannels);
+        else if (is(keyBegin, keyEnd, "num_inactive_channels"))
+            ok = readUnsigned32(scanner, numInactiveChannels);
+        else if (is(keyBegin, keyEnd, "blockheight"))
+            ok = readUnsigned32(scanner, blockheight);
+        else if (is(keyBegin, keyEnd, "msatoshi_fees_collected") || is(keyBegin, keyEnd, "fees_collected_msat"))
+            ok = readMsat(scanner, feesCollectedMsat);
+        else
+            ok = scanner.skipValue();
+    }
+    return ok && !scanner.failed();
+}
+
+static bool decodePeerChannel(JsonScanner &scanner, PeerChannel &channel)
+{
+    const char *keyBegin, *keyEnd;
+    bool ok = true;
+
+    channel = PeerChannel();
+    if (!scanner.beginObject())
+        return false;
+    while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+        if (is(keyBegin, keyEnd, "state"))
+            ok = readString(scanner, channel.state);
+        else if (is(keyBegin, keyEnd, "short_channel_id"))
+            ok = readShortChannelId(scanner, channel.shortChannelId);
+        else if (is(keyBegin, keyEnd, "direction")) {
+            uint32_t direction = 0;
+            ok = readUnsigned32(scanner, direction);
+            channel.direction = direction;
+        } else if (is(keyBegin, keyEnd, "channel_id"))
+            ok = readString(scanner, channel.channelId);
+        else if (is(keyBegin, keyEnd, "funding_txid"))
+            ok = readString(scanner, channel.fundingTxid);
+        else if (is(keyBegin, keyEnd, "private"))
+            ok = readBool(scanner, channel.isPrivate);
+        else if (is(keyBegin, keyEnd, "msatoshi_to_us") || is(keyBegin, keyEnd, "to_us_msat"))
+            ok = readMsat(scanner, channel.toUsMsat);
+        else if (is(keyBegin, keyEnd, "msatoshi_total") || is(keyBegin, keyEnd, "total_msat"))
+            ok = readMsat(scanner, channel.totalMsat);
+        else if (is(keyBegin, keyEnd, "spendable_msatoshi") || is(keyBegin, keyEnd, "spendable_msat"))
+            ok = readMsat(scanner, channel.spendableMsat);
+        else if (is(keyBegin, keyEnd, "in_msatoshi_fulfilled") || is(keyBegin, keyEnd, "in_fulfilled_msat"))
+            ok = readMsat(scanner, channel.inFulfilledMsat);
+        else if (is(keyBegin, keyEnd, "out_msatoshi_fulfilled") || is(keyBegin, keyEnd, "out_fulfilled_msat"))
+            ok = readMsat(scanner, channel.outFulfilledMsat);
+        else if (is(keyBegin, keyEnd, "in_payments_offered"))
+            ok = readUnsigned32(scanner, channel.inPaymentsOffered);
+        else if (is(keyBegin, keyEnd, "in_payments_fulfilled"))
+            ok = readUnsigned32(scanner, channel.inPaymentsFulfilled);
+        else if (is(keyBegin, keyEnd, "out_payments_offered"))
+            ok = readUnsigned32(scanner, channel.outPaymentsOffered);
+        else if (is(keyBegin, keyEnd, "out_payments_fulfilled"))
+            ok = readUnsigned32(scanner, channel.outPaymentsFulfilled);
+        else if (is(keyBegin, keyEnd, "their_to_self_delay"))
+            ok = readUnsigned32(scanner, channel.theirToSelfDelay);
+        else if (is(keyBegin, keyEnd, "our_to_self_delay"))
+            ok = readUnsigned32(scanner, channel.ourToSelfDelay);
+        else
+            ok = scanner.skipValue();
+    }
+    return ok && !scanner.failed();
+}
+
+bool ListPeersResult::decode(const char *begin, const char *end, Interner &nodeIds)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+
+    peers.clear();
+    if (!beginResultArray(scanner, "peers"))
+        return false;
+    while (scanner.nextElement()) {
+        peers.push_back(Peer());
+        Peer &peer = peers.back();
+        bool ok = scanner.beginObject();
+        peer.connected = false;
+        while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+            if (is(keyBegin, keyEnd, "id")) {
+                ok = readNodeId(scanner, nodeIds, peer.id);
+            } else if (is(keyBegin, keyEnd, "connected")) {
+                ok = readBool(scanner, peer.connected);
+            } else if (is(keyBegin, keyEnd, "netaddr")) {
+                ok = scanner.beginArray();
+                while (ok && scanner.nextElement()) {
+                    peer.netaddr.push_back(std::string());
+                    ok = scanner.readString(peer.netaddr.back());
+                }
+            } else if (is(keyBegin, keyEnd, "channels")) {
+                ok = scanner.beginArray();
+                while (ok && scanner.nextElement()) {
+                    peer.channels.push_back(PeerChannel());
+                    ok = decodePeerChannel(scanner, peer.channels.back());
+                }
+            } else {
+                ok = scanner.skipValue();
+            }
+        }
+        if (!ok || scanner.failed())
+            return false;
+    }
+    return endResult(scanner);
+}
+
+bool ListFundsResult::decode(const char *begin, const char *end, Interner &nodeIds)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+    bool ok = true;
+
+    outputs.clear();
+    channels.clear();
+    if (!scanner.beginObject())
+        return false;
+    while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+        if (is(keyBegin, keyEnd, "outputs")) {
+            ok = scanner.beginArray();
+            while (ok && scanner.nextElement()) {
+                outputs.push_back(FundsOutput());
+                FundsOutput &output = outputs.back();
+                ok = scanner.beginObject();
+                while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+                    if (is(keyBegin, keyEnd, "txid"))
+                        ok = readString(scanner, output.txid);
+                    else if (is(keyBegin, keyEnd, "output"))
+                        ok = readUnsigned32(scanner, output.output);
+                    else if (is(keyBegin, keyEnd, "value"))
+                        ok = readMsat(scanner, output.amountMsat, 1000);
+                    else if (is(keyBegin, keyEnd, "amount_msat"))
+                        ok = readMsat(scanner, output.amountMsat);
+                    else if (is(keyBegin, keyEnd, "address"))
+                        ok = readString(scanner, output.address);
+                    else if (is(keyBegin, keyEnd, "status"))
+                        ok = readString(scanner, output.status);
+                    else
+                        ok = scanner.skipValue();
+                }
+            }
+        } else if (is(keyBegin, keyEnd, "channels")) {
+            ok = scanner.beginArray();
+            while (ok && scanner.nextElement()) {
+                channels.push_back(FundsChannel());
+                FundsChannel &channel = channels.back();
+                ok = scanner.beginObject();
+                while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+                    if (is(keyBegin, keyEnd, "peer_id"))
+                        ok = readNodeId(scanner, nodeIds, channel.peerId);
+                    else if (is(keyBegin, keyEnd, "connected"))
+                        ok = readBool(scanner, channel.connected);
+                    else if (is(keyBegin, keyEnd, "state"))
+                        ok = readString(scanner, channel.state);
+                    else if (is(keyBegin, keyEnd, "short_channel_id"))
+                        ok = readShortChannelId(scanner, channel.shortChannelId);
+                    else if (is(keyBegin, keyEnd, "channel_sat"))
+                        ok = readMsat(scanner, channel.ourAmountMsat, 1000);
+                    else if (is(keyBegin, keyEnd, "our_amount_msat"))
+                        ok = readMsat(scanner, channel.ourAmountMsat);
+                    else if (is(keyBegin, keyEnd, "channel_total_sat"))
+                        ok = readMsat(scanner, channel.amountMsat, 1000);
+                    else if (is(keyBegin, keyEnd, "amount_msat"))
+                        ok = readMsat(scanner, channel.amountMsat);
+                    else if (is(keyBegin, keyEnd, "funding_txid"))
+                        ok = readString(scanner, channel.fundingTxid);
+                    else if (is(keyBegin, keyEnd, "funding_output"))
+                        ok = readUnsigned32(scanner, channel.fundingOutput);
+                    else
+                        ok = scanner.skipValue();
+                }
+            }
+        } else {
+            ok = scanner.skipValue();
+        }
+    }
+    return ok && !scanner.failed();
+}
+
+static bool decodeInvoice(JsonScanner &scanner, Invoice &invoice)
+{
+    const char *keyBegin, *keyEnd;
+    bool ok = scanner.beginObject();
+    while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+        if (is(keyBegin, keyEnd, "label")) {
+            ok = readString(scanner, invoice.label);
+        } else if (is(keyBegin, keyEnd, "bolt11")) {
+            ok = readString(scanner, invoice.bolt11);
+        } else if (is(keyBegin, keyEnd, "payment_hash")) {
+            ok = readString(scanner, invoice.paymentHash);
+        } else if (is(keyBegin, keyEnd, "payment_preimage")) {
+            ok = readString(scanner, invoice.paymentPreimage);
+        } else if (is(keyBegin, keyEnd, "description")) {
+            ok = readString(scanner, invoice.description);
+        } else if (is(keyBegin, keyEnd, "msatoshi") || is(keyBegin, keyEnd, "amount_msat")) {
+            ok = readMsat(scanner, invoice.amountMsat);
+        } else if (is(keyBegin, keyEnd, "msatoshi_received") || is(keyBegin, keyEnd, "amount_received_msat")) {
+            ok = readMsat(scanner, invoice.receivedMsat);
+        } else if (is(keyBegin, keyEnd, "expires_at")) {
+            ok = scanner.readUnsigned(invoice.expiresAt);
+        } else if (is(keyBegin, keyEnd, "pay_index")) {
+            ok = scanner.readUnsigned(invoice.payIndex);
+        } else if (is(keyBegin, keyEnd, "paid_at")) {
+            ok = scanner.readUnsigned(invoice.paidAt);
+        } else if (is(keyBegin, keyEnd, "status")) {
+            const char *statusBegin, *statusEnd;
+            ok = scanner.readRawString(statusBegin, statusEnd);
+            invoice.status = is(statusBegin, statusEnd, "paid") ? INVOICE_PAID
+                             : is(statusBegin, statusEnd, "expired") ? INVOICE_EXPIRED : INVOICE_UNPAID;
+        } else {
+            ok = scanner.skipValue();
+        }
+    }
+    return ok && !scanner.failed();
+}
+
+bool Invoice::decode(const char *begin, const char *end)
+{
+    JsonScanner scanner(begin, end);
+    *this = Invoice();
+    return decodeInvoice(scanner, *this);
+}
+
+bool ListInvoicesResult::decode(const char *begin, const char *end)
+{
+    JsonScanner scanner(begin, end);
+
+    invoices.clear();
+    if (!beginResultArray(scanner, "invoices"))
+        return false;
+    while (scanner.nextElement()) {
+        invoices.push_back(Invoice());
+        if (!decodeInvoice(scanner, invoices.back()))
+            return false;
+    }
+    return endResult(scanner);
+}
+
+bool ListChannelsResult::decode(const char *begin, const char *end, Interner &nodeIds)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+
+    channels.clear();
+    if (!beginResultArray(scanner, "channels"))
+        return false;
+    while (scanner.nextElement()) {
+        channels.push_back(Channel());
+        Channel &channel = channels.back();
+        bool ok = scanner.beginObject();
+        while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+            if (is(keyBegin, keyEnd, "source")) {
+                ok = readNodeId(scanner, nodeIds, channel.source);
+            } else if (is(keyBegin, keyEnd, "destination")) {
+                ok = readNodeId(scanner, nodeIds, channel.destination);
+            } else if (is(keyBegin, keyEnd, "short_channel_id")) {
+                ok = readShortChannelId(scanner, channel.shortChannelId);
+            } else if (is(keyBegin, keyEnd, "public")) {
+                ok = readBool(scanner, channel.isPublic);
+            } else if (is(keyBegin, keyEnd, "active")) {
+                ok = readBool(scanner, channel.active);
+            } else if (is(keyBegin, keyEnd, "satoshis")) {
+                ok = readMsat(scanner, channel.amountMsat, 1000);
+            } else if (is(keyBegin, keyEnd, "amount_msat")) {
+                ok = readMsat(scanner, channel.amountMsat);
+            } else if (is(keyBegin, keyEnd, "htlc_minimum_msat")) {
+                ok = readMsat(scanner, channel.htlcMinimumMsat);
+            } else if (is(keyBegin, keyEnd, "message_flags") || is(keyBegin, keyEnd, "channel_flags")) {
+                uint32_t flags = 0;
+                ok = readUnsigned32(scanner, flags);
+                (keyBegin[0] == 'm' ? channel.messageFlags : channel.channelFlags) = flags;
+            } else if (is(keyBegin, keyEnd, "last_update")) {
+                ok = readUnsigned32(scanner, channel.lastUpdate);
+            } else if (is(keyBegin, keyEnd, "base_fee_millisatoshi")) {
+                ok = readUnsigned32(scanner, channel.baseFeeMsat);
+            } else if (is(keyBegin, keyEnd, "fee_per_millionth")) {
+                ok = readUnsigned32(scanner, channel.feePerMillionth);
+            } else if (is(keyBegin, keyEnd, "delay")) {
+                ok = readUnsigned32(scanner, channel.delay);
+            } else {
+                ok = scanner.skipValue();
+            }
+        }
+        if (!ok || scanner.failed())
+            return false;
+    }
+    return endResult(scanner);
+}
+
+bool ListNodesResult::decode(const char *begin, const char *end, Interner &nodeIds)
+{
+    JsonScanner scanner(begin, end);
+    const char *keyBegin, *keyEnd;
+
+    nodes.clear();
+    if (!beginResultArray(scanner, "nodes"))
+        return false;
+    while (scanner.nextElement()) {
+        nodes.push_back(Node());
+        Node &node = nodes.back();
+        bool ok = scanner.beginObject();
+        while (ok && scanner.nextMember(keyBegin, keyEnd)) {
+            if (is(keyBegin, keyEnd, "nodeid")) {
+                ok = readNodeId(scanner, nodeIds, node.id);
+            } else if (is(keyBegin, keyEnd, "last_timestamp")) {
+                ok = readUnsigned32(scanner, node.lastTimestamp);
+            } else if (is(keyBegin, keyEnd, "alias")) {
+                ok = readString(scanner, node.alias);
+            } else if (is(keyBegin, keyEnd, "color")) {
+                ok = readString(scanner, node.color);
+            } else {
+                ok = scanner.skipValue();
+            }
+        }
+        if (!ok || scanner.failed())
+            return false;
+    }
+    return endResult(scanner);
+}
@@ -0,0 +1,172 @@
+#ifndef LIGHTNINGCPP_RPCRESULTS_H
+#define LIGHTNINGCPP_RPCRESULTS_H
+
+#include "interner.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Typed results of the most used commands, decoded directly from the JSON text
+ * of the response into plain fields instead of a Json::Value tree.
+ *
+ * Amounts are all in millisatoshis, whichever form lightningd used. Short
+ * channel ids are packed into integers, and node ids are interned : they are
+ * indexes into CLightningRpc::getNodeIds(), so that comparing them is cheap and
+ * each of them is stored once however many channels it has.
+ *
+ * A result can be reused across calls, its vectors keep their capacity.
+ */
+
+/** A short channel id packed as its block height (24 bits), transaction index (24 bits) and output (16 bits). */
+struct ShortChannelId {
+    /** Parses a "BLOCKxTXxOUTPUT" short channel id. */
+    static bool parse(const char *begin, const char *end, uint64_t &scid);
+    static std::string format(const uint64_t &scid);
+};
+
+struct GetInfoResult {
+    uint32_t id;
+    std::string alias;
+    std::string color;
+    std::string version;
+    std::string network;
+    uint32_t numPeers;
+    uint32_t numPendingChannels;
+    uint32_t numActiveChannels;
+    uint32_t numInactiveChannels;
+    uint32_t blockheight;
+    uint64_t feesCollectedMsat;
+
+    /** @return false if the result is malformed */
+    bool decode(const char *begin, const char *end, Interner &nodeIds);
+};
+
+struct PeerChannel {
+    uint64_t shortChannelId;
+    uint64_t toUsMsat;
+    uint64_t totalMsat;
+    uint64_t spendableMsat;
+    uint64_t inFulfilledMsat;
+    uint64_t outFulfilledMsat;
+    uint32_t inPaymentsOffered;
+    uint32_t inPaymentsFulfilled;
+    uint32_t outPaymentsOffered;
+    uint32_t outPaymentsFulfilled;
+    uint32_t theirToSelfDelay;
+    uint32_t ourToSelfDelay;
+    uint8_t direction;
+    bool isPrivate;
+    std::string state;
+    std::string channelId;
+    std::string fundingTxid;
+};
+
+struct Peer {
+    uint32_t id;
+    bool connected;
+    std::vector<std::string> netaddr;
+    std::vector<PeerChannel> channels;
+};
+
+struct ListPeersResult {
+    std::vector<Peer> peers;
+
+    bool decode(const char *begin, const char *end, Interner &nodeIds);
+};
+
+struct FundsOutput {
+    uint64_t amountMsat;
+    uint32_t output;
+    std::string txid;
+    std::string address;
+    std::string status;
+};
+
+struct FundsChannel {
+    uint64_t shortChannelId;
+    uint64_t ourAmountMsat;
+    uint64_t amountMsat;
+    uint32_t peerId;
+    uint32_t fundingOutput;
+    bool connected;
+    std::string state;
+    std::string fundingTxid;
+};
+
+struct ListFundsResult {
+    std::vector<FundsOutput> outputs;
+    std::vector<FundsChannel> channels;
+
+    bool decode(const char *begin, const char *end, Interner &nodeIds);
+};
+
+enum InvoiceStatus {
+    INVOICE_UNPAID,
+    INVOICE_PAID,
+    INVOICE_EXPIRED
+};
+
+struct Invoice {
+    uint64_t amountMsat;
+    uint64_t receivedMsat;
+    uint64_t expiresAt;
+    // 0 if not paid
+    uint64_t payIndex;
+    uint64_t paidAt;
+    InvoiceStatus status;
+    std::string label;
+    std::string bolt11;
+    std::string paymentHash;
+    std::string paymentPreimage;
+    std::string description;
+
+    /** Decodes a single invoice, as returned by waitanyinvoice or waitinvoice. */
+    bool decode(const char *begin, const char *end);
+};
+
+struct ListInvoicesResult {
+    std::vector<Invoice> invoices;
+
+    bool decode(const char *begin, const char *end);
+};
+
+/** One direction of a channel of the network. */
+struct Channel {
+    uint64_t shortChannelId;
+    uint64_t amountMsat;
+    uint64_t htlcMinimumMsat;
+    uint32_t source;
+    uint32_t destination;
+    uint32_t lastUpdate;
+    uint32_t baseFeeMsat;
+    uint32_t feePerMillionth;
+    uint32_t delay;
+    uint8_t messageFlags;
+    uint8_t channelFlags;
+    bool isPublic;
+    bool active;
+};
+
+struct ListChannelsResult {
+    std::vector<Channel> channels;
+
+    bool decode(const char *begin, const char *end, Interner &nodeIds);
+};
+
+/** A node of the network, the fields but its id are empty if it did not announce itself. */
+struct Node {
+    uint32_t id;
+    uint32_t lastTimestamp;
+    std::string alias;
+    std::string color;
+};
+
+struct ListNodesResult {
+    std::vector<Node> nodes;
+
+    bool decode(const char *begin, const char *end, Interner &nodeIds);
+};
+
+#endif // LIGHTNINGCPP_RPCRESULTS_H
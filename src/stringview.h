@@ -0,0 +1,19 @@
+#ifndef LIGHTNINGCPP_STRINGVIEW_H
+#define LIGHTNINGCPP_STRINGVIEW_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * A span of characters owned by someone else, only valid as long as its owner.
+ */
+struct StringView {
+    const char *data;
+    size_t size;
+
+    const char *begin() const { return data; }
+    const char *end() const { return data + size; }
+    std::string toString() const { return std::string(data, size); }
+};
+
+#endif // LIGHTNINGCPP_STRINGVIEW_H
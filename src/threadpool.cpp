@@ -0,0 +1,51 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(const unsigned int &size):
+    stopping(false)
+{
+    for (unsigned int i = 0; i < (size ? size : 1); i++)
+        workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    queued.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push(std::move(task));
+    }
+    queued.notify_one();
+}
+
+size_t ThreadPool::getQueued()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return tasks.size();
+}
+
+void ThreadPool::work()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this]{ return stopping || !tasks.empty(); });
+            // Drain the queue before stopping
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
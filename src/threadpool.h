@@ -0,0 +1,43 @@
+#ifndef LIGHTNINGCPP_THREADPOOL_H
+#define LIGHTNINGCPP_THREADPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+/**
+ * A fixed number of worker threads executing tasks in submission order.
+ */
+class ThreadPool {
+
+public:
+    ThreadPool(const unsigned int &size);
+
+    /**
+     * Waits for all the submitted tasks to complete, then stops the workers.
+     */
+    ~ThreadPool();
+
+    /**
+     * Queues a task to be executed by the first available worker. The task must not
+     * throw, there is nobody to catch it on the worker.
+     */
+    void submit(std::function<void()> task);
+
+    /** The number of tasks waiting for a worker. */
+    size_t getQueued();
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable queued;
+    bool stopping;
+
+    void work();
+};
+
+#endif // LIGHTNINGCPP_THREADPOOL_H
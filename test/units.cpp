@@ -0,0 +1,1329 @@
+/**
+ * Tests which don't need a running lightningd, run by `make units`.
+ */
+#include <clightningplugin.h>
+#include <dbwrite.h>
+#include <dbwritelog.h>
+#include <dispatchtable.h>
+#include <fakelightningd.h>
+#include <invoicewatcher.h>
+#include <jsonframer.h>
+#include <jsonscanner.h>
+#include <jsonview.h>
+#include <messagereader.h>
+#include <notificationqueue.h>
+#include <paymentexecutor.h>
+#include <pendingrequests.h>
+#include <pluginexception.h>
+#include <pluginloop.h>
+#include <responsecache.h>
+#include <responsewriter.h>
+#include <routefinder.h>
+#include <rpcconnection.h>
+#include <rpceventloop.h>
+#include <rpcresults.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/** Walks through a whole JSON text with the scanner, decoding every value. */
+static bool walk(JsonScanner &scanner)
+{
+    const char *key, *keyEnd;
+    std::string str;
+    bool boolean;
+    double number;
+    switch (scanner.peek()) {
+        case '{':
+            if (!scanner.beginObject())
+                return false;
+            while (scanner.nextMember(key, keyEnd))
+                if (!walk(scanner))
+                    return false;
+            return !scanner.failed();
+        case '[':
+            if (!scanner.beginArray())
+                return false;
+            while (scanner.nextElement())
+                if (!walk(scanner))
+                    return false;
+            return !scanner.failed();
+        case '"':
+            return scanner.readString(str);
+        case 't':
+        case 'f':
+            return scanner.readBool(boolean);
+        case 'n':
+            return scanner.readNull();
+        default:
+            return scanner.readDouble(number);
+    }
+}
+
+/** Feeds `stream` to a framer `chunk` bytes at a time, and returns the objects it extracted. */
+static std::vector<std::string> frame(const std::string &stream, const size_t &chunk)
+{
+    JsonFramer framer;
+    std::vector<std::string> objects;
+    const char *begin, *end;
+    for (size_t i = 0; i < stream.size(); i += chunk) {
+        size_t size = std::min(chunk, stream.size() - i);
+        memcpy(framer.prepare(size), stream.data() + i, size);
+        framer.commit(size);
+        while (framer.next(begin, end))
+            objects.push_back(std::string(begin, end));
+    }
+    assert(!framer.hasPartial());
+    return objects;
+}
+
+static void testJsonFramer()
+{
+    std::cout << "JsonFramer" << std::endl;
+    // Braces and quotes inside strings, escaped or not, don't delimit objects
+    std::vector<std::string> expected = {"{\"jsonrpc\":\"2.0\",\"id\":1,\"result\":{\"a\":[1,{}]}}",
+                                         "{\"s\":\"}\\\"{\"}",
+                                         "{\"s\":\"\\\\\",\"t\":\"]\"}",
+                                         "{}"};
+    std::string stream;
+    for (const std::string &object : expected)
+        stream += object + "\n\n";
+    // Whatever the reads the stream is split into
+    for (size_t chunk = 1; chunk <= stream.size(); chunk++)
+        assert(frame(stream, chunk) == expected);
+
+    JsonFramer framer;
+    const char *begin, *end;
+    framer.append(" \n{\"a\":", 7);
+    assert(!framer.next(begin, end) && framer.hasPartial());
+    framer.append("\"}\"}{\"b", 8);
+    assert(framer.next(begin, end) && std::string(begin, end) == "{\"a\":\"}\"}");
+    assert(!framer.next(begin, end) && framer.hasPartial());
+    framer.clear();
+    assert(!framer.hasPartial());
+    framer.append("{}", 2);
+    assert(framer.next(begin, end) && std::string(begin, end) == "{}");
+    std::cout << "Ok." << std::endl;
+}
+
+static void testJsonScanner()
+{
+    std::cout << "JsonScanner" << std::endl;
+    std::string text = "{\"s\":\"a\\\"b\\\\c\\/d\\n\\u00e9\\ud83d\\ude00\",\"n\":-42,\"u\":18446744073709551615,"
+                       "\"d\":1.5e3,\"t\":true,\"z\":null,\"skip\":{\"x\":[1,\"]\",{}]}}";
+    JsonScanner scanner(text.data(), text.data() + text.size());
+    const char *key, *keyEnd;
+    std::string s;
+    int64_t n;
+    uint64_t u;
+    double d;
+    bool t;
+    assert(scanner.beginObject());
+    assert(scanner.nextMember(key, keyEnd) && std::string(key, keyEnd) == "s");
+    assert(scanner.readString(s) && s == "a\"b\\c/d\n\xc3\xa9\xf0\x9f\x98\x80");
+    assert(scanner.nextMember(key, keyEnd) && scanner.readInteger(n) && n == -42);
+    assert(scanner.nextMember(key, keyEnd) && scanner.readUnsigned(u) && u == UINT64_MAX);
+    assert(scanner.nextMember(key, keyEnd) && scanner.readDouble(d) && d == 1500);
+    assert(scanner.nextMember(key, keyEnd) && scanner.readBool(t) && t);
+    assert(scanner.nextMember(key, keyEnd) && scanner.readNull());
+    assert(scanner.nextMember(key, keyEnd) && std::string(key, keyEnd) == "skip" && scanner.skipValue());
+    assert(!scanner.nextMember(key, keyEnd) && !scanner.failed());
+
+    // Decoding into a buffer as long as the escaped string
+    const char escaped[] = "x\\ty\\u0041";
+    char decoded[sizeof(escaped)];
+    size_t length;
+    assert(JsonScanner::unescape(escaped, escaped + strlen(escaped), decoded, length));
+    assert(std::string(decoded, length) == "x\tyA");
+
+    // Malformed texts fail instead of reading past their end, or looping
+    const char *malformed[] = {"{\"a\":}", "{\"a\" 1}", "[1,,2]", "[1,]", "{\"a\":[1}", "{\"a\":1,}", "\"unterminated",
+                               "{\"a\":tru}", "{", "{\"a\":\"\\x\"}", "{\"a\":\"\\u12\"}", "{\"a\":\"\\ud83d\"}"};
+    for (const char *bad : malformed) {
+        JsonScanner badScanner(bad, bad + strlen(bad));
+        assert(!walk(badScanner));
+    }
+    const char overflow[] = "18446744073709551616";
+    assert(!JsonScanner(overflow, overflow + strlen(overflow)).readUnsigned(u));
+
+    // Integers are read exactly, or not at all
+    const char *integers[] = {"9223372036854775807", "-9223372036854775808", "-0", "12.000", "7.0}"};
+    const int64_t values[] = {INT64_MAX, INT64_MIN, 0, 12, 7};
+    for (size_t i = 0; i < sizeof(integers) / sizeof(integers[0]); i++)
+        assert(JsonScanner(integers[i], integers[i] + strlen(integers[i])).readInteger(n) && n == values[i]);
+    const char *inexact[] = {"1e3", "1.5", "1.05", "2.", "1.0e2", "1E0"};
+    for (const char *bad : inexact) {
+        assert(!JsonScanner(bad, bad + strlen(bad)).readInteger(n));
+        assert(!JsonScanner(bad, bad + strlen(bad)).readUnsigned(u));
+    }
+    const char *outOfRange[] = {"9223372036854775808", "-9223372036854775809"};
+    for (const char *bad : outOfRange)
+        assert(!JsonScanner(bad, bad + strlen(bad)).readInteger(n));
+    assert(JsonScanner(outOfRange[0], outOfRange[0] + strlen(outOfRange[0])).readUnsigned(u) && u == 9223372036854775808ULL);
+    std::cout << "Ok." << std::endl;
+}
+
+static void testJsonView()
+{
+    std::cout << "JsonView" << std::endl;
+    Arena arena;
+    std::string text = "{\"htlc\":{\"amount_msat\":\"1000msat\",\"cltv_expiry\":117},\"label\":\"a\\\"b\",\"list\":[1,true,null]}";
+    const JsonView *root = JsonView::parse(text.data(), text.data() + text.size(), arena);
+    assert(root && root->isObject() && root->size == 3);
+    assert((*root)["htlc"]["cltv_expiry"].asUInt() == 117);
+    assert((*root)["htlc"]["amount_msat"].equals("1000msat"));
+    assert((*root)["htlc"]["missing"].isNull() && !(*root)["htlc"].isMember("missing"));
+    StringView label = (*root)["label"].asString(arena);
+    assert(std::string(label.data, label.size) == "a\"b");
+    assert((*root)["list"].size == 3 && (*root)["list"][1].asBool() && (*root)["list"][2].isNull());
+    assert((*root)["list"][3].isNull());
+
+    const char *malformed[] = {"{\"a\":[1}", "[1,]", "{\"a\":}", "{\"a\":\"x"};
+    for (const char *bad : malformed)
+        assert(!JsonView::parse(bad, bad + strlen(bad), arena));
+    std::cout << "Ok." << std::endl;
+}
+
+static void testMessageReader()
+{
+    std::cout << "MessageReader" << std::endl;
+    int fds[2];
+    assert(pipe(fds) == 0);
+    MessageReader reader(fds[0]);
+    PluginMessage message;
+    Json::Value params;
+
+    // Malformed envelopes are skipped : not an object, no jsonrpc, no method, no params, and a method which is not a string
+    std::string noise = "[1,2]\n\n{\"id\":1,\"method\":\"a\",\"params\":{}}\n\n{\"jsonrpc\":\"2.0\",\"id\":1,\"params\":{}}\n\n"
+                        "{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"a\"}\n\n{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":3,\"params\":{}}\n\n";
+    std::string hook = "{\"jsonrpc\":\"2.0\",\"id\":\"cln:\\\"7\\\"\",\"method\":\"htlc_accepted\","
+                       "\"params\":{\"onion\":{\"payload\":\"}{\"}}}\n\n";
+    std::string notification = "{\"jsonrpc\":\"2.0\",\"method\":\"warning\",\"params\":{\"level\":\"warn\"}}\n\n";
+    // Written one byte at a time, so that every message is split across many reads
+    std::string stream = noise + hook + notification;
+    for (const char &c : stream) {
+        assert(write(fds[1], &c, 1) == 1);
+        assert(reader.fill());
+    }
+    assert(reader.nextBuffered(message));
+    assert(std::string(message.method, message.methodLength) == "htlc_accepted");
+    assert(message.hasId && message.getId() == "cln:\"7\"");
+    assert(reader.parseParams(message, params) && params["onion"]["payload"] == "}{");
+    assert(reader.nextBuffered(message));
+    assert(std::string(message.method, message.methodLength) == "warning" && !message.hasId);
+    assert(!reader.nextBuffered(message));
+
+    // Parameters which are not valid JSON are only found out once parsed
+    std::string badParams = "{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"a\",\"params\":{\"x\":tru}}\n\n";
+    assert(write(fds[1], badParams.data(), badParams.size()) == (ssize_t)badParams.size());
+    close(fds[1]);
+    assert(reader.next(message) && message.getId() == "2");
+    assert(!reader.parseParams(message, params));
+    assert(!reader.next(message));
+    close(fds[0]);
+    std::cout << "Ok." << std::endl;
+}
+
+static void testRpcResults()
+{
+    std::cout << "Typed results" << std::endl;
+    Interner nodeIds;
+    // The same channel with the amounts as integers, as older lightningd do, then as "msat" strings
+    std::string channels = "{\"channels\":["
+            "{\"source\":\"02aa\",\"destination\":\"03bb\",\"short_channel_id\":\"103x1x0\",\"public\":true,"
+            "\"satoshis\":1000,\"htlc_minimum_msat\":1,\"base_fee_millisatoshi\":1000,\"fee_per_millionth\":10,"
+            "\"delay\":6,\"active\":true,\"unknown\":{\"x\":[]}},"
+            "{\"source\":\"03bb\",\"destination\":\"02aa\",\"short_channel_id\":\"103x1x0\",\"public\":true,"
+            "\"amount_msat\":\"1000000msat\",\"htlc_minimum_msat\":\"1msat\",\"base_fee_millisatoshi\":1000,"
+            "\"fee_per_millionth\":10,\"delay\":6,\"active\":false}]}";
+    ListChannelsResult listChannels;
+    assert(listChannels.decode(channels.data(), channels.data() + channels.size(), nodeIds));
+    assert(listChannels.channels.size() == 2 && nodeIds.size() == 2);
+    for (const Channel &channel : listChannels.channels) {
+        assert(channel.amountMsat == 1000000 && channel.htlcMinimumMsat == 1);
+        assert(channel.baseFeeMsat == 1000 && channel.feePerMillionth == 10 && channel.delay == 6 && channel.isPublic);
+        assert(ShortChannelId::format(channel.shortChannelId) == "103x1x0");
+    }
+    assert(nodeIds.lookup(listChannels.channels[0].source) == "02aa");
+    assert(listChannels.channels[0].source == listChannels.channels[1].destination);
+    assert(listChannels.channels[0].active && !listChannels.channels[1].active);
+
+    std::string invoices = "{\"invoices\":[{\"label\":\"a\\\"b\",\"msatoshi\":5,\"status\":\"unpaid\",\"expires_at\":7},"
+            "{\"label\":\"c\",\"amount_msat\":\"5msat\",\"amount_received_msat\":\"6msat\",\"status\":\"paid\","
+            "\"pay_index\":1}]}";
+    ListInvoicesResult listInvoices;
+    assert(listInvoices.decode(invoices.data(), invoices.data() + invoices.size()));
+    assert(listInvoices.invoices.size() == 2);
+    assert(listInvoices.invoices[0].label == "a\"b" && listInvoices.invoices[0].amountMsat == 5);
+    assert(listInvoices.invoices[0].status == INVOICE_UNPAID && listInvoices.invoices[0].expiresAt == 7);
+    assert(listInvoices.invoices[1].amountMsat == 5 && listInvoices.invoices[1].receivedMsat == 6);
+    assert(listInvoices.invoices[1].status == INVOICE_PAID && listInvoices.invoices[1].payIndex == 1);
+
+    // Malformed amounts, overflowing ones included, and short channel ids
+    const char *malformed[] = {"\"12sat\"", "\"msat\"", "\"1a2msat\"", "-1", "\"18446744073709551616msat\"",
+                               "18446744073709551615", "18446744073709551616"};
+    for (const char *amount : malformed) {
+        std::string bad = std::string("{\"channels\":[{\"satoshis\":") + amount + "}]}";
+        assert(!listChannels.decode(bad.data(), bad.data() + bad.size(), nodeIds));
+    }
+    const char *scids[] = {"103x1", "103x1x0x0", "x1x0", "16777216x1x0", "1x1x65536", "184467440737095516160x1x0"};
+    uint64_t scid;
+    for (const char *bad : scids)
+        assert(!ShortChannelId::parse(bad, bad + strlen(bad), scid));
+    std::cout << "Ok." << std::endl;
+}
+
+/** Holds the handler of a topic until opened, so that its queue fills up. */
+struct Gate {
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool open = false;
+    std::atomic<unsigned int> entered{0};
+    std::vector<int> handled;
+
+    void handle(std::vector<Json::Value> &batch)
+    {
+        entered++;
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this] { return open; });
+        for (const Json::Value &params : batch)
+            handled.push_back(params["n"].asInt());
+    }
+
+    void release()
+    {
+        { std::lock_guard<std::mutex> lock(mutex); open = true; }
+        condition.notify_all();
+    }
+
+    void waitEntered()
+    {
+        while (!entered.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+};
+
+static bool pushNumber(NotificationQueue &queue, const size_t &topic, const int &n)
+{
+    Json::Value params;
+    params["n"] = n;
+    return queue.push(topic, params);
+}
+
+static void testNotificationQueue()
+{
+    std::cout << "NotificationQueue" << std::endl;
+    Gate dropGate;
+    {
+        // One notification held by the worker, and room for two more
+        NotificationQueue queue(1, NotificationQueue::DROP);
+        size_t topic = queue.addTopic("warning", [&dropGate](std::vector<Json::Value> &batch) { dropGate.handle(batch); }, 2, 1);
+        assert(pushNumber(queue, topic, 0));
+        dropGate.waitEntered();
+        assert(pushNumber(queue, topic, 1) && pushNumber(queue, topic, 2));
+        assert(!pushNumber(queue, topic, 3));
+        NotificationTopicStats stats = queue.getStats()[topic];
+        assert(stats.name == "warning" && stats.received == 4 && stats.dropped == 1 && stats.overflows == 1);
+        assert(stats.queued == 2);
+        dropGate.release();
+    }
+    assert(dropGate.handled == std::vector<int>({0, 1, 2}));
+
+    Gate blockGate;
+    {
+        NotificationQueue queue(1, NotificationQueue::BLOCK);
+        size_t topic = queue.addTopic("warning", [&blockGate](std::vector<Json::Value> &batch) { blockGate.handle(batch); }, 2, 1);
+        assert(pushNumber(queue, topic, 0));
+        blockGate.waitEntered();
+        assert(pushNumber(queue, topic, 1) && pushNumber(queue, topic, 2));
+        // The producer waits for room instead of dropping
+        std::atomic<bool> pushed(false);
+        std::thread producer([&] { pushed.store(pushNumber(queue, topic, 3)); });
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        assert(!pushed.load());
+        blockGate.release();
+        producer.join();
+        assert(pushed.load());
+        NotificationTopicStats stats = queue.getStats()[topic];
+        assert(stats.received == 4 && stats.dropped == 0 && stats.overflows == 1);
+    }
+    assert(blockGate.handled == std::vector<int>({0, 1, 2, 3}));
+    std::cout << "Ok." << std::endl;
+}
+
+static void testPluginLoop()
+{
+    std::cout << "PluginLoop" << std::endl;
+    PluginLoop loop;
+    int fired = 0;
+    int timer = loop.addTimer(std::chrono::milliseconds(1), [&]() { fired++; loop.stop(); }, false);
+    loop.run();
+    assert(fired == 1);
+
+    // The timerfd of the one-shot timer was closed, and its number is reused
+    int fds[2];
+    assert(pipe(fds) == 0);
+    int reads = 0;
+    char c;
+    loop.addFd(fds[0], [&](uint32_t) { assert(read(fds[0], &c, 1) == 1); reads++; loop.stop(); });
+    // Neither a stale timer id nor a file descriptor number remove the watch
+    loop.removeTimer(timer);
+    loop.removeTimer(fds[0]);
+    assert(write(fds[1], "x", 1) == 1);
+    loop.run();
+    assert(reads == 1);
+
+    // A repeating timer removing itself
+    int ticks = 0, repeating;
+    repeating = loop.addTimer(std::chrono::milliseconds(1), [&]() {
+        if (++ticks == 3) {
+            loop.removeTimer(repeating);
+            loop.stop();
+        }
+    });
+    loop.run();
+    assert(ticks == 3);
+
+    // A callback throwing doesn't stop the loop, nor prevents the next ones
+    loop.addTimer(std::chrono::milliseconds(1), []() { throw std::runtime_error("expected"); }, false);
+    loop.addTimer(std::chrono::milliseconds(5), [&]() { loop.stop(); }, false);
+    loop.run();
+    int devNull = open("/dev/null", O_RDONLY);
+    assert(!loop.addFd(devNull, [](uint32_t) {}));
+    loop.removeFd(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+
+    // A plugin whose stdin is /dev/null reaches its end instead of failing to watch it
+    int input = dup(STDIN_FILENO);
+    assert(dup2(devNull, STDIN_FILENO) == STDIN_FILENO);
+    Plugin plugin;
+    plugin.start();
+    assert(dup2(input, STDIN_FILENO) == STDIN_FILENO);
+    close(input);
+    close(devNull);
+    std::cout << "Ok." << std::endl;
+}
+
+static void testResponseCache()
+{
+    std::cout << "ResponseCache" << std::endl;
+    ResponseCache cache;
+    int fetches = 0;
+    auto fetch = [&]() { return Json::Value(++fetches); };
+    auto params = [](const int &i) {
+        Json::Value label;
+        label["label"] = std::to_string(i);
+        return label;
+    };
+
+    // A result per distinct parameters, up to the limit of the command
+    cache.setTtl("listinvoices", std::chrono::hours(1), 3);
+    for (int i = 0; i < 5; i++)
+        assert(cache.get("listinvoices", params(i), fetch).asInt() == i + 1);
+    ResponseCacheStats stats = cache.getStats();
+    assert(stats.entries == 3 && stats.evictions == 2 && stats.misses == 5);
+    // The oldest were dropped first
+    assert(cache.get("listinvoices", params(4), fetch).asInt() == 5 && fetches == 5);
+    assert(cache.get("listinvoices", params(0), fetch).asInt() == 6);
+    assert(cache.getStats().hits == 1);
+
+    // Expired entries are dropped once another is added, even if the command is not full
+    cache.setTtl("listforwards", std::chrono::milliseconds(1), 100);
+    for (int i = 0; i < 3; i++)
+        cache.get("listforwards", params(i), fetch);
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    cache.get("listforwards", params(3), fetch);
+    stats = cache.getStats();
+    assert(stats.entries == 4 && stats.evictions == 6);
+
+    cache.completed("invoice");
+    assert(cache.getStats().entries == 1 && cache.getStats().invalidations == 3);
+    std::cout << "Ok." << std::endl;
+}
+
+/** Reads back the responses written to a temporary file, by id, and closes it. */
+static std::map<std::string, Json::Value> readResponses(FILE *output)
+{
+    std::string written;
+    char chunk[4096];
+    size_t size;
+    rewind(output);
+    while ((size = fread(chunk, 1, sizeof(chunk), output)) > 0)
+        written.append(chunk, size);
+    fclose(output);
+    std::map<std::string, Json::Value> responses;
+    JsonFramer framer;
+    const char *begin, *end;
+    Json::Reader reader;
+    framer.append(written.data(), written.size());
+    while (framer.next(begin, end)) {
+        Json::Value response;
+        assert(reader.parse(begin, end, response));
+        responses[response["id"].asString()] = response;
+    }
+    assert(!framer.hasPartial());
+    return responses;
+}
+
+/** Runs a plugin with `input` as its stdin (a pipe), and returns its responses by id. */
+static std::map<std::string, Json::Value> runPlugin(Plugin &plugin, const std::string &input)
+{
+    int fds[2];
+    assert(pipe(fds) == 0);
+    assert(write(fds[1], input.data(), input.size()) == (ssize_t)input.size());
+    close(fds[1]);
+    FILE *output = tmpfile();
+    assert(output);
+    std::cout.flush();
+    int stdinCopy = dup(STDIN_FILENO), stdoutCopy = dup(STDOUT_FILENO);
+    assert(dup2(fds[0], STDIN_FILENO) == STDIN_FILENO && dup2(fileno(output), STDOUT_FILENO) == STDOUT_FILENO);
+    plugin.start();
+    assert(dup2(stdinCopy, STDIN_FILENO) == STDIN_FILENO && dup2(stdoutCopy, STDOUT_FILENO) == STDOUT_FILENO);
+    close(stdinCopy);
+    close(stdoutCopy);
+    close(fds[0]);
+    return readResponses(output);
+}
+
+static std::string request(const std::string &id, const std::string &method)
+{
+    return "{\"jsonrpc\":\"2.0\",\"id\":\"" + id + "\",\"method\":\"" + method + "\",\"params\":{}}\n\n";
+}
+
+static void testPluginErrors()
+{
+    std::cout << "Plugin errors" << std::endl;
+    // The same handlers, executed in place and by workers
+    for (unsigned int workers = 0; workers < 3; workers += 2) {
+        Plugin plugin(workers);
+        RpcMethod fail("fail", "", "", ""), crash("crash", "", "", ""), weird("weird", "", "", ""), ok("ok", "", "", "");
+        fail.setMain([](Json::Value&) -> Json::Value { throw CLightningPluginException(42, "nope"); });
+        crash.setMain([](Json::Value&) -> Json::Value { throw std::runtime_error("crashed"); });
+        weird.setMain([](Json::Value&) -> Json::Value { throw 1; });
+        ok.setMain([](Json::Value&) { return Json::Value("fine"); });
+        plugin.addMethod(fail);
+        plugin.addMethod(crash);
+        plugin.addMethod(weird);
+        plugin.addMethod(ok);
+        plugin.hookSubscribeAsync("htlc_accepted", [](Json::Value&, RpcResponder) {
+            throw CLightningPluginException(43, "later");
+        });
+        plugin.hookSubscribeAsync("rpc_command", [](Json::Value&, RpcResponder) { throw 1; });
+        plugin.hookSubscribeArena("peer_connected", [](const JsonView&, Arena&, ArenaString&) {
+            throw CLightningPluginException(44, "arena");
+        });
+        plugin.dbWriteSubscribe([](const DbWrite&) -> bool { throw CLightningPluginException(45, "disk"); });
+        bool notified = false;
+        plugin.subscribe("warning", [&notified](Json::Value&) { notified = true; throw std::runtime_error("ignored"); });
+
+        std::map<std::string, Json::Value> responses = runPlugin(plugin, request("a", "fail") + request("b", "crash")
+                    + request("c", "weird") + request("e", "htlc_accepted") + request("f", "rpc_command")
+                    + request("g", "peer_connected") + request("h", "db_write")
+                    + "{\"jsonrpc\":\"2.0\",\"method\":\"warning\",\"params\":{}}\n\n" + request("d", "ok"));
+        assert(responses.size() == 8);
+        assert(responses["a"]["error"]["code"] == 42 && responses["a"]["error"]["message"] == "nope");
+        assert(responses["b"]["error"]["code"] == -32603 && responses["b"]["error"]["message"] == "crashed");
+        assert(responses["c"]["error"]["code"] == -32603 && responses["c"]["error"]["message"] == "The handler of 'weird' failed");
+        assert(responses["e"]["error"]["code"] == 43 && responses["e"]["error"]["message"] == "later");
+        assert(responses["f"]["error"]["code"] == -32603);
+        assert(responses["g"]["error"]["code"] == 44 && responses["g"]["error"]["message"] == "arena");
+        assert(responses["h"]["error"]["code"] == 45 && responses["h"]["error"]["message"] == "disk");
+        // The plugin went on
+        assert(responses["d"]["result"] == "fine" && notified);
+    }
+    std::cout << "Ok." << std::endl;
+}
+
+/** Reads a whole file. */
+static void testPendingRequests()
+{
+    std::cout << "PendingRequests" << std::endl;
+    FILE *output = tmpfile();
+    assert(output);
+    ResponseWriter writer(fileno(output));
+    auto onTimeout = std::make_shared<const std::string>("{\"result\":\"continue\"}");
+    Json::Value fail;
+    fail["result"] = "fail";
+    {
+        PendingRequests pending;
+        // Only held here until the timeout answers it
+        {
+            RpcResponder responder(writer, "1", nullptr, "htlc_accepted");
+            pending.add(responder);
+            assert(pending.setTimeout("1", std::chrono::milliseconds(10), onTimeout));
+        }
+        // Its handler kept a copy
+        RpcResponder kept(writer, "2", nullptr, "htlc_accepted");
+        pending.add(kept);
+        assert(pending.setTimeout("2", std::chrono::milliseconds(10), onTimeout));
+        // Answered before its timeout
+        {
+            RpcResponder responder(writer, "3", nullptr, "htlc_accepted");
+            pending.add(responder);
+            assert(pending.setTimeout("3", std::chrono::milliseconds(20), onTimeout));
+        }
+        assert(pending.resolve("3", fail));
+        // Dropped by its handler without a timeout
+        {
+            RpcResponder responder(writer, "4", nullptr, "custom");
+            pending.add(responder);
+        }
+        // Still pending when the plugin stops
+        {
+            RpcResponder responder(writer, "5", nullptr, "custom");
+            pending.add(responder);
+            assert(pending.setTimeout("5", std::chrono::seconds(60), onTimeout));
+        }
+        while (pending.getStats().timedOut < 2)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        // Late answers are ignored
+        assert(!pending.resolve("1", fail) && !pending.reject("1", 1, "late"));
+        assert(!kept.resolve(fail) && kept.isDone());
+        assert(!pending.resolve("3", fail) && !pending.resolve("4", fail));
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        PendingRequestsStats stats = pending.getStats();
+        assert(stats.pending == 1 && stats.maxPending == 3 && stats.answered == 4 && stats.timedOut == 2);
+        assert(pending.getIds() == std::vector<std::string>({"5"}));
+    }
+
+    std::map<std::string, Json::Value> responses = readResponses(output);
+    assert(responses.size() == 5);
+    assert(responses["1"]["result"]["result"] == "continue" && responses["2"]["result"]["result"] == "continue");
+    assert(responses["3"]["result"]["result"] == "fail");
+    for (const std::string &id : std::vector<std::string>({"4", "5"})) {
+        assert(responses[id]["error"]["code"].asInt() == -32603);
+        assert(responses[id]["error"]["message"] == "The handler of 'custom' completed without answering");
+    }
+    std::cout << "Ok." << std::endl;
+}
+
+static std::string readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream content;
+    content << file.rdbuf();
+    return content.str();
+}
+
+static void testDbWrite()
+{
+    std::cout << "DbWrite" << std::endl;
+    DbWrite batch;
+    std::string params = "{\"data_version\":7,\"writes\":[\"INSERT INTO vars VALUES ('a', 1);\","
+                         "\"UPDATE t SET s = 'x\\ny\\\"';\"],\"unknown\":{\"writes\":[]}}";
+    assert(batch.parse(params.data(), params.data() + params.size()));
+    assert(batch.hasDataVersion && batch.dataVersion == 7 && batch.writes.size() == 2);
+    assert(std::string(batch.writes[0].data, batch.writes[0].size) == "INSERT INTO vars VALUES ('a', 1);");
+    assert(std::string(batch.writes[1].data, batch.writes[1].size) == "UPDATE t SET s = 'x\ny\"';");
+    const char *malformed[] = {"{\"writes\":[1]}", "{\"writes\":\"x\"}", "{\"data_version\":-1}", "{\"writes\":[\"\\x\"]}"};
+    DbWrite badBatch;
+    for (const char *bad : malformed)
+        assert(!badBatch.parse(bad, bad + strlen(bad)));
+
+    // Every batch is in the log once append() returns, whoever synced it
+    char path[] = "/tmp/lightningcpp-units-XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    {
+        DbWriteLog log(path);
+        std::vector<std::thread> writers;
+        std::atomic<bool> durable(true);
+        for (int t = 0; t < 4; t++) {
+            writers.push_back(std::thread([&, t]() {
+                for (int i = 0; i < 25; i++) {
+                    std::string statement = "write " + std::to_string(t) + "-" + std::to_string(i) + ";";
+                    DbWrite write;
+                    write.hasDataVersion = false;
+                    write.writes.push_back({statement.data(), statement.size()});
+                    if (!log.append(write) || readFile(path).find("\n" + statement + "\n") == std::string::npos)
+                        durable.store(false);
+                }
+            }));
+        }
+        for (std::thread &writer : writers)
+            writer.join();
+        assert(durable.load());
+        assert(log.getBatches() == 100 && log.getSyncs() >= 1 && log.getSyncs() <= 100);
+        assert(log.append(batch));
+    }
+    std::string content = readFile(path);
+    std::string last = "2 7\n33\nINSERT INTO vars VALUES ('a', 1);\n24\nUPDATE t SET s = 'x\ny\"';\n";
+    assert(content.size() > last.size() && content.compare(content.size() - last.size(), last.size(), last) == 0);
+    assert(content.find("1 -\n10\nwrite 0-0;\n") != std::string::npos);
+    unlink(path);
+
+    // Nothing is acknowledged once a write failed
+    DbWriteLog full("/dev/full");
+    assert(!full.append(batch) && !full.append(batch));
+    std::cout << "Ok." << std::endl;
+}
+
+static void testDispatchTable()
+{
+    std::cout << "DispatchTable" << std::endl;
+    DispatchTable table;
+    RpcMethod method("hello", "", "", "");
+    std::function<Json::Value(Json::Value&)> hook = [](Json::Value &params) { return params; };
+    std::function<void(Json::Value&)> notification = [](Json::Value&) {};
+    table.addMethod("hello", &method);
+    table.addHook("htlc_accepted", &hook);
+    table.addNotification("warning", &notification);
+    // A name can have both a hook and a notification
+    table.addNotification("htlc_accepted", &notification);
+    // Enough names for the table to grow
+    std::vector<std::string> names;
+    for (int i = 0; i < 100; i++)
+        names.push_back("method" + std::to_string(i));
+    for (const std::string &name : names)
+        table.addMethod(name, &method);
+    table.freeze();
+
+    const DispatchEntry *entry = table.find("htlc_accepted", 13);
+    assert(entry && entry->hook == &hook && entry->notification == &notification && !entry->method);
+    assert(*entry->name == "htlc_accepted");
+    entry = table.find("hello", 5);
+    assert(entry && entry->method == &method && !entry->hook);
+    for (const std::string &name : names)
+        assert(table.find(name.data(), name.size()) && *table.find(name.data(), name.size())->name == name);
+    assert(!table.find("hell", 4) && !table.find("hello!", 6) && !table.find("", 0));
+    // The instrumentation names are built once
+    entry = table.find("htlc_accepted", 13);
+    assert(entry->requestOperation == "hook:htlc_accepted" && entry->notificationOperation == "notification:htlc_accepted");
+    assert(table.find("hello", 5)->requestOperation == "method:hello");
+    std::cout << "Ok." << std::endl;
+}
+
+static std::string nodeId(const unsigned int &index)
+{
+    char hex[67];
+    snprintf(hex, sizeof(hex), "02%064x", index);
+    return hex;
+}
+
+/** Adds both directions of a channel to a listchannels result, with the same fees. */
+static void addChannel(Json::Value &result, const unsigned int &a, const unsigned int &b, const std::string &scid,
+            const unsigned int &baseFee, const unsigned int &feeRate, const unsigned int &delay)
+{
+    for (int direction = 0; direction < 2; direction++) {
+        Json::Value channel;
+        channel["source"] = nodeId(direction ? b : a);
+        channel["destination"] = nodeId(direction ? a : b);
+        channel["short_channel_id"] = scid;
+        channel["public"] = true;
+        channel["amount_msat"] = "100000000msat";
+        channel["message_flags"] = 1;
+        channel["channel_flags"] = direction;
+        channel["active"] = true;
+        channel["last_update"] = 1;
+        channel["base_fee_millisatoshi"] = baseFee;
+        channel["fee_per_millionth"] = feeRate;
+        channel["delay"] = delay;
+        channel["htlc_minimum_msat"] = "0msat";
+        result["channels"].append(channel);
+    }
+}
+
+static void testRouteFinder()
+{
+    std::cout << "RouteFinder" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    FakeLightningd lightningd(socketPath);
+    CLightningRpc rpc(socketPath, 1);
+    // We are 0, and can reach 3 through 1 for 2000msat or through 2 for 6000msat
+    Json::Value channels;
+    addChannel(channels, 0, 1, "101x1x0", 1000, 1000, 6);
+    addChannel(channels, 1, 3, "102x1x0", 1000, 1000, 12);
+    addChannel(channels, 0, 2, "103x1x0", 1000, 1000, 6);
+    addChannel(channels, 2, 3, "104x1x0", 5000, 1000, 6);
+    lightningd.setResult("listchannels", channels);
+    NetworkGraph graph(rpc, false);
+    graph.refresh();
+    RouteFinder finder(graph, nodeId(0));
+    std::vector<RouteHop> route;
+
+    RouteQuery query(nodeId(3), 1000000, 10, 9, "", 0);
+    assert(finder.findRoute(query, route) && route.size() == 2);
+    assert(ShortChannelId::format(route[0].shortChannelId) == "101x1x0" && route[0].direction == 0);
+    assert(graph.getNodeIds().lookup(route[0].id) == nodeId(1));
+    // The fee of the last hop is paid to the first one, our own channel costs nothing
+    assert(route[0].amountMsat == 1002000 && route[0].delay == 21);
+    assert(ShortChannelId::format(route[1].shortChannelId) == "102x1x0");
+    assert(graph.getNodeIds().lookup(route[1].id) == nodeId(3));
+    assert(route[1].amountMsat == 1000000 && route[1].delay == 9);
+
+    // Without the cheapest channel, or its node
+    query.exclude = {"102x1x0/0"};
+    assert(finder.findRoute(query, route) && route.size() == 2);
+    assert(ShortChannelId::format(route[0].shortChannelId) == "103x1x0" && route[0].amountMsat == 1006000);
+    query.exclude = {nodeId(1)};
+    assert(finder.findRoute(query, route) && route[0].amountMsat == 1006000 && route[0].delay == 15);
+    // Too big for the channels
+    assert(!finder.findRoute(RouteQuery(nodeId(3), 200000000, 10, 9, "", 0), route) && route.empty());
+
+    // Unknown ids have no route, and are not interned
+    size_t known = graph.getNodeIds().size();
+    assert(!finder.findRoute(RouteQuery(nodeId(4), 1000, 10), route));
+    assert(!finder.findRoute(RouteQuery(nodeId(3), 1000, 10, 9, nodeId(5)), route));
+    query.exclude = {nodeId(6)};
+    assert(finder.findRoute(query, route));
+    assert(graph.getNodeIds().size() == known);
+    std::cout << "Ok." << std::endl;
+}
+
+/**
+ * A lightningd which hands each connection it accepts to the next of `sessions`, in
+ * order, to script what a real one only does under load or when restarting.
+ */
+struct ScriptedLightningd {
+    int listenFd;
+    std::thread thread;
+
+    ScriptedLightningd(const std::string &socketPath, const std::vector<std::function<void(int)>> &sessions)
+    {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(socketPath.c_str());
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        assert(bind(listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0 && listen(listenFd, 8) == 0);
+        thread = std::thread([this, sessions] {
+            for (const std::function<void(int)> &session : sessions)
+                session(accept(listenFd, nullptr, nullptr));
+        });
+    }
+
+    /** Waits for every session to end, and tells whether yet another connection is pending. */
+    bool join()
+    {
+        thread.join();
+        fcntl(listenFd, F_SETFL, O_NONBLOCK);
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd >= 0)
+            close(fd);
+        return fd >= 0;
+    }
+
+    ~ScriptedLightningd()
+    {
+        if (thread.joinable())
+            thread.join();
+        close(listenFd);
+    }
+};
+
+/** Reads a request from a scripted session, and returns its id. */
+static unsigned long readRequest(const int &fd)
+{
+    std::string line;
+    Json::Value request;
+    char c;
+    while (read(fd, &c, 1) == 1 && c != '\n')
+        line += c;
+    assert(Json::Reader().parse(line, request));
+    return request["id"].asUInt64();
+}
+
+static void writeResponse(const int &fd, const std::string &response)
+{
+    assert(write(fd, response.data(), response.size()) == (ssize_t)response.size());
+}
+
+static std::string response(const unsigned long &id, const std::string &result)
+{
+    return "{\"jsonrpc\":\"2.0\",\"id\":" + std::to_string(id) + ",\"result\":" + result + "}\n\n";
+}
+
+static void testPaymentExecutor()
+{
+    std::cout << "PaymentExecutor" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    FakeLightningd lightningd(socketPath);
+    CLightningRpc rpc(socketPath, 1);
+    // The same network as for the routes : through 1 is cheaper than through 2
+    Json::Value channels;
+    addChannel(channels, 0, 1, "101x1x0", 1000, 1000, 6);
+    addChannel(channels, 1, 3, "102x1x0", 1000, 1000, 12);
+    addChannel(channels, 0, 2, "103x1x0", 1000, 1000, 6);
+    addChannel(channels, 2, 3, "104x1x0", 5000, 1000, 6);
+    lightningd.setResult("listchannels", channels);
+    NetworkGraph graph(rpc, false);
+    graph.refresh();
+    RouteFinder finder(graph, nodeId(0));
+
+    // The payments to "1" fail in 102x1x0, those to "2" at the destination. Parts are
+    // first reported in progress, and only then resolved.
+    std::mutex mutex;
+    std::map<std::string, std::vector<std::string>> routes;
+    std::map<std::string, bool> waited;
+    lightningd.setHandler("sendpay", [&](const Json::Value &params) {
+        std::string key = params["payment_hash"].asString() + "/" + params["partid"].asString();
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const Json::Value &hop : params["route"])
+            routes[key].push_back(hop["channel"].asString());
+        Json::Value response;
+        response["result"]["status"] = "pending";
+        return response;
+    });
+    lightningd.setHandler("waitsendpay", [&](const Json::Value &params) {
+        std::string hash = params["payment_hash"].asString(), key = hash + "/" + params["partid"].asString();
+        std::lock_guard<std::mutex> lock(mutex);
+        Json::Value response;
+        if (!waited[key]) {
+            waited[key] = true;
+            response["error"]["code"] = 200;
+            response["error"]["message"] = "In progress";
+        } else if (hash[0] == '1' && routes[key][1] == "102x1x0") {
+            response["error"]["code"] = 204;
+            response["error"]["message"] = "Failing channel";
+            response["error"]["data"]["erring_channel"] = "102x1x0";
+            response["error"]["data"]["erring_direction"] = 0;
+        } else if (hash[0] == '2') {
+            response["error"]["code"] = 203;
+            response["error"]["message"] = "Unknown payment";
+        } else {
+            response["result"]["payment_preimage"] = std::string(64, 'f');
+        }
+        return response;
+    });
+
+    std::map<std::string, PaymentResult> results;
+    std::map<std::string, std::vector<PaymentPart>> parts;
+    {
+        PaymentExecutor executor(rpc, finder, 2, 1000000);
+        auto pay = [&](const char &hash, const unsigned int &destination, const uint64_t &amount) {
+            PaymentRequest request;
+            request.destination = nodeId(destination);
+            request.amountMsat = amount;
+            request.paymentHash = std::string(64, hash);
+            executor.pay(request, [&, hash](const PaymentResult &result) {
+                std::lock_guard<std::mutex> lock(mutex);
+                results[std::string(1, hash)] = result;
+            }, [&, hash](const PaymentPart &part) {
+                std::lock_guard<std::mutex> lock(mutex);
+                parts[std::string(1, hash)].push_back(part);
+            });
+        };
+        pay('1', 3, 1000000);
+        pay('2', 3, 1000000);
+        // Split in three parts
+        pay('3', 3, 3000000);
+        pay('4', 4, 1000000);
+        executor.wait();
+        assert(executor.getPending() == 0);
+    }
+
+    // Rerouted around the failing channel
+    assert(results["1"].succeeded && results["1"].preimage == std::string(64, 'f'));
+    assert(results["1"].attempts == 2 && results["1"].parts == 1 && results["1"].feesMsat == 6000);
+    assert(parts["1"].size() == 2 && parts["1"][0].errorCode == 204 && parts["1"][1].succeeded);
+    assert(routes[std::string(64, '1') + "/2"][0] == "103x1x0");
+    // Not retried after a final error
+    assert(!results["2"].succeeded && results["2"].errorCode == 203 && results["2"].attempts == 1);
+    assert(results["3"].succeeded && results["3"].attempts == 3 && results["3"].parts == 3);
+    assert(results["3"].amountMsat == 3000000 && results["3"].feesMsat == 6000);
+    assert(!results["4"].succeeded && results["4"].errorCode == 205 && results["4"].attempts == 0);
+    assert(parts["4"].empty());
+    std::cout << "Ok." << std::endl;
+}
+
+/** Polls a subscription until `count` invoices were read, and returns their pay_index. */
+static std::vector<uint64_t> pollInvoices(InvoiceSubscription *subscription, const size_t &count)
+{
+    std::vector<uint64_t> payIndexes;
+    while (payIndexes.size() < count) {
+        subscription->wait(std::chrono::milliseconds(100));
+        subscription->poll([&payIndexes](const Invoice &invoice) {
+            payIndexes.push_back(invoice.payIndex);
+        }, count - payIndexes.size());
+    }
+    return payIndexes;
+}
+
+static std::vector<uint64_t> sequence(const uint64_t &first, const uint64_t &last)
+{
+    std::vector<uint64_t> payIndexes;
+    for (uint64_t i = first; i <= last; i++)
+        payIndexes.push_back(i);
+    return payIndexes;
+}
+
+static void testInvoiceWatcher()
+{
+    std::cout << "InvoiceWatcher" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units", cursorPath = "/tmp/lightningcpp-units.cursor";
+    unlink(cursorPath.c_str());
+    FakeLightningd lightningd(socketPath);
+    // 40 invoices were paid, waiting for more fails as if lightningd was restarting
+    std::mutex mutex;
+    std::vector<uint64_t> asked;
+    lightningd.setHandler("waitanyinvoice", [&mutex, &asked](const Json::Value &params) {
+        uint64_t last = params["lastpay_index"].asUInt64();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            asked.push_back(last);
+        }
+        Json::Value response;
+        if (last >= 40) {
+            response["error"]["code"] = -1;
+            response["error"]["message"] = "Not yet";
+            return response;
+        }
+        response["result"]["label"] = "invoice" + std::to_string(last + 1);
+        response["result"]["status"] = "paid";
+        response["result"]["pay_index"] = (Json::UInt64)last + 1;
+        response["result"]["amount_msat"] = "1000msat";
+        return response;
+    });
+    {
+        // Room for 7 invoices not read by every subscriber
+        InvoiceWatcher watcher(socketPath, cursorPath, 0, 4);
+        InvoiceSubscription *slow = watcher.subscribe();
+        watcher.start();
+        // The watcher waits for the slowest subscriber instead of overwriting what it did not read
+        while (watcher.getPublished() < 7)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        assert(watcher.getPublished() == 7 && watcher.getPayIndex() == 7);
+        assert(pollInvoices(slow, 3) == sequence(1, 3));
+        while (watcher.getPublished() < 10)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert(pollInvoices(slow, 17) == sequence(4, 20));
+        while (watcher.getPublished() < 27)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        watcher.stop();
+        // The cursor is the last invoice every subscriber read, not the last one published
+        assert(watcher.getPayIndex() == 27 && readFile(cursorPath) == "20\n");
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        asked.clear();
+    }
+    {
+        // Restarted from the persisted cursor, rather than from the pay_index given
+        InvoiceWatcher watcher(socketPath, cursorPath, 5);
+        assert(watcher.getPayIndex() == 20);
+        InvoiceSubscription *subscription = watcher.subscribe();
+        watcher.start();
+        assert(pollInvoices(subscription, 20) == sequence(21, 40));
+        watcher.stop();
+        assert(readFile(cursorPath) == "40\n");
+        std::lock_guard<std::mutex> lock(mutex);
+        assert(asked.front() == 20);
+    }
+    unlink(cursorPath.c_str());
+    {
+        // Without a persisted cursor, from the pay_index given
+        InvoiceWatcher watcher(socketPath, cursorPath, 35);
+        InvoiceSubscription *subscription = watcher.subscribe();
+        watcher.start();
+        assert(pollInvoices(subscription, 5) == sequence(36, 40));
+        while (!watcher.getErrors())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        watcher.stop();
+        assert(readFile(cursorPath) == "40\n");
+    }
+    unlink(cursorPath.c_str());
+    std::cout << "Ok." << std::endl;
+}
+
+static void testRpcConnection()
+{
+    std::cout << "RpcConnection" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    {
+        // Every call goes over the same connection
+        ScriptedLightningd lightningd(socketPath, {[](int fd) {
+            for (int i = 0; i < 3; i++)
+                writeResponse(fd, response(readRequest(fd), "{\"n\":" + std::to_string(i) + "}"));
+            close(fd);
+        }});
+        RpcConnectionPool pool(socketPath, 1);
+        for (int i = 0; i < 3; i++)
+            assert(pool.call("getinfo", Json::Value())["n"].asInt() == i);
+        assert(!lightningd.join());
+        RpcPoolStats stats = pool.getStats();
+        assert(stats.calls == 3 && stats.reconnects == 0 && stats.failures == 0);
+    }
+    {
+        // lightningd closed the idle connection : the request is sent again, once, on a new one
+        std::atomic<bool> closed(false);
+        ScriptedLightningd lightningd(socketPath, {
+            [&closed](int fd) {
+                writeResponse(fd, response(readRequest(fd), "{}"));
+                close(fd);
+                closed = true;
+            },
+            [](int fd) {
+                writeResponse(fd, response(readRequest(fd), "{\"retried\":true}"));
+                close(fd);
+            }
+        });
+        RpcConnectionPool pool(socketPath, 1);
+        pool.call("getinfo", Json::Value());
+        while (!closed.load())
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        assert(pool.call("getinfo", Json::Value())["retried"].asBool());
+        assert(!lightningd.join());
+        RpcPoolStats stats = pool.getStats();
+        assert(stats.calls == 2 && stats.reconnects == 1 && stats.failures == 0);
+    }
+    {
+        // Once lightningd started answering the request may have been executed, it's never sent again
+        ScriptedLightningd lightningd(socketPath, {[](int fd) {
+            std::string partial = response(readRequest(fd), "{\"n\":1}");
+            writeResponse(fd, partial.substr(0, partial.size() / 2));
+            close(fd);
+        }});
+        RpcConnectionPool pool(socketPath, 1);
+        try {
+            pool.call("pay", Json::Value());
+            assert(false);
+        } catch (CLightningRpcException &e) {
+            assert(std::string(e.what()).find("in the middle of a response") != std::string::npos);
+        }
+        assert(!lightningd.join());
+        RpcPoolStats stats = pool.getStats();
+        assert(stats.calls == 1 && stats.reconnects == 0 && stats.failures == 1 && stats.connected == 0);
+    }
+    std::cout << "Ok." << std::endl;
+}
+
+static void testRpcBatch()
+{
+    std::cout << "RPC batches" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    // More than a window of requests, one of which fails
+    std::vector<RpcRequest> batch(150);
+    for (size_t i = 0; i < batch.size(); i++) {
+        batch[i].command = i == 75 ? "fail" : "echo";
+        batch[i].params["i"] = (Json::UInt64)i;
+    }
+    {
+        FakeLightningd lightningd(socketPath);
+        lightningd.setHandler("fail", [](const Json::Value &params) {
+            Json::Value response;
+            response["error"]["code"] = 42;
+            response["error"]["message"] = "Failed " + params["i"].asString();
+            return response;
+        });
+        // Pipelined over a pooled connection, or multiplexed
+        for (int multiplexed = 0; multiplexed < 2; multiplexed++) {
+            CLightningRpc rpc(socketPath, multiplexed ? 0 : 2, multiplexed);
+            std::vector<RpcResult> results = rpc.sendBatch(batch);
+            assert(results.size() == batch.size());
+            for (size_t i = 0; i < results.size(); i++) {
+                if (i == 75)
+                    assert(results[i].failed && results[i].errorCode == 42 && results[i].errorMessage == "Failed 75");
+                else
+                    assert(!results[i].failed && results[i].result["params"]["i"].asUInt64() == i);
+            }
+        }
+    }
+    {
+        // Responses come back in reverse order of each window, and never more than a window is in flight
+        std::atomic<bool> overflowed(false);
+        ScriptedLightningd lightningd(socketPath, {[&batch, &overflowed](int fd) {
+            size_t handled = 0;
+            while (handled < batch.size()) {
+                std::vector<unsigned long> ids;
+                while (ids.size() < std::min<size_t>(64, batch.size() - handled))
+                    ids.push_back(readRequest(fd));
+                char c;
+                if (recv(fd, &c, 1, MSG_DONTWAIT | MSG_PEEK) > 0)
+                    overflowed = true;
+                for (auto id = ids.rbegin(); id != ids.rend(); id++)
+                    writeResponse(fd, response(*id, "{\"id\":" + std::to_string(*id) + "}"));
+                handled += ids.size();
+            }
+            close(fd);
+        }});
+        RpcConnectionPool pool(socketPath, 1);
+        std::vector<RpcResult> results = pool.callBatch(batch);
+        assert(!lightningd.join() && !overflowed.load());
+        for (size_t i = 0; i < results.size(); i++)
+            assert(!results[i].failed && results[i].result["id"].asUInt64() == results[0].result["id"].asUInt64() + i);
+    }
+    std::cout << "Ok." << std::endl;
+}
+
+static void testRpcEventLoop()
+{
+    std::cout << "RpcEventLoop" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    unlink(socketPath.c_str());
+    {
+        // lightningd is not there : the failure is delivered like any other, not thrown
+        RpcEventLoop loop(socketPath);
+        std::promise<RpcResult> failed;
+        loop.call("getinfo", Json::Value(), [&failed](const RpcResult &result) { failed.set_value(result); });
+        RpcResult result = failed.get_future().get();
+        assert(result.failed && result.errorCode == 1 && result.errorMessage.find("Could not connect") == 0);
+        assert(loop.getPending() == 0);
+
+        CLightningRpc rpc(socketPath, 0, true);
+        std::future<Json::Value> future = rpc.sendCommandAsync("getinfo", Json::Value());
+        try {
+            future.get();
+            assert(false);
+        } catch (CLightningRpcException &e) {}
+        try {
+            rpc.sendCommand("getinfo", Json::Value());
+            assert(false);
+        } catch (CLightningRpcException &e) {}
+    }
+
+    FakeLightningd lightningd(socketPath);
+    // Once lightningd is up, the same loop connects for the next requests
+    RpcEventLoop loop(socketPath);
+    std::promise<RpcResult> first;
+    loop.call("getinfo", Json::Value(), [&first](const RpcResult &result) { first.set_value(result); });
+    assert(!first.get_future().get().failed);
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::map<int, bool> answered;
+    for (int i = 0; i < 100; i++) {
+        Json::Value params;
+        params["i"] = i;
+        loop.call("echo", params, [&, i](const RpcResult &result) {
+            std::lock_guard<std::mutex> lock(mutex);
+            answered[i] = !result.failed && result.result["params"]["i"].asInt() == i && loop.isLoopThread();
+            condition.notify_all();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&answered] { return answered.size() == 100; });
+        for (auto &it : answered)
+            assert(it.second);
+    }
+    assert(!loop.isLoopThread());
+
+    // Futures, and blocking calls which would wait for the very thread meant to answer them
+    CLightningRpc rpc(socketPath, 0, true);
+    Json::Value params;
+    params["n"] = 1;
+    assert(rpc.sendCommandAsync("echo", params).get()["params"]["n"].asInt() == 1);
+    std::promise<std::string> blocked;
+    rpc.sendCommandAsync("echo", params, [&rpc, &blocked](const RpcResult &) {
+        try {
+            rpc.sendCommand("getinfo", Json::Value());
+            blocked.set_value("");
+        } catch (CLightningRpcException &e) {
+            blocked.set_value(e.what());
+        }
+    });
+    assert(blocked.get_future().get().find("from the event loop thread") != std::string::npos);
+    std::promise<bool> batchBlocked;
+    rpc.addTimer(std::chrono::milliseconds(1), [&rpc, &batchBlocked] {
+        try {
+            rpc.sendBatch(std::vector<RpcRequest>(1));
+            batchBlocked.set_value(false);
+        } catch (CLightningRpcException &e) {
+            batchBlocked.set_value(true);
+        }
+    });
+    assert(batchBlocked.get_future().get());
+    std::cout << "Ok." << std::endl;
+}
+
+static void testRpcThreads()
+{
+    std::cout << "CLightningRpc from several threads" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    FakeLightningd lightningd(socketPath, 100);
+    // Fewer pooled connections than threads, or all of them over one
+    for (int multiplexed = 0; multiplexed < 2; multiplexed++) {
+        CLightningRpc rpc(socketPath, multiplexed ? 0 : 3, multiplexed);
+        std::atomic<unsigned int> mismatches(0);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 8; t++) {
+            threads.emplace_back([&rpc, &mismatches, t] {
+                for (int n = 0; n < 200; n++) {
+                    Json::Value params;
+                    params["thread"] = t;
+                    params["n"] = n;
+                    Json::Value result = rpc.sendCommand("echo", params);
+                    if (result["params"] != params)
+                        mismatches++;
+                }
+            });
+        }
+        for (std::thread &thread : threads)
+            thread.join();
+        assert(mismatches.load() == 0);
+        if (!multiplexed)
+            assert(rpc.getPoolStats().calls == 1600 && rpc.getPoolStats().failures == 0);
+    }
+    std::cout << "Ok." << std::endl;
+}
+
+static void testRpcInstrumentation()
+{
+    std::cout << "RPC instrumentation" << std::endl;
+    std::string socketPath = "/tmp/lightningcpp-units";
+    FakeLightningd lightningd(socketPath);
+    // Pipelined over a pooled connection, or multiplexed
+    for (int multiplexed = 0; multiplexed < 2; multiplexed++) {
+        CLightningRpc rpc(socketPath, multiplexed ? 0 : 1, multiplexed);
+        rpc.getInstrumentation().setEnabled(true);
+        std::vector<RpcRequest> batch(3);
+        for (RpcRequest &request : batch)
+            request.command = "echo";
+        assert(rpc.sendBatch(batch).size() == 3);
+        std::vector<OperationStats> stats = rpc.getInstrumentation().getSnapshot();
+        assert(stats.size() == 1);
+        if (multiplexed)
+            assert(stats[0].name == "echo" && stats[0].calls == 3);
+        else
+            assert(stats[0].name == "batch" && stats[0].calls == 1 && stats[0].bytesOut > 0 && stats[0].bytesIn > 0);
+    }
+    std::cout << "Ok." << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    testJsonFramer();
+    testJsonScanner();
+    testJsonView();
+    testMessageReader();
+    testRpcResults();
+    testNotificationQueue();
+    testPluginLoop();
+    testResponseCache();
+    testPluginErrors();
+    testPendingRequests();
+    testDbWrite();
+    testDispatchTable();
+    testRouteFinder();
+    testPaymentExecutor();
+    testInvoiceWatcher();
+    testRpcConnection();
+    testRpcBatch();
+    testRpcEventLoop();
+    testRpcThreads();
+    testRpcInstrumentation();
+    std::cout << std::endl << "All units passed." << std::endl;
+    return 0;
+}